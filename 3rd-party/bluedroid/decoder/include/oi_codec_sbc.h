@@ -403,6 +403,38 @@ OI_STATUS OI_CODEC_SBC_SkipFrame(OI_CODEC_SBC_DECODER_CONTEXT *context,
                                  const OI_BYTE **frameData,
                                  OI_UINT32 *frameBytes);
 
+/* BK4BTSTACK_CHANGE START */
+#define OI_CODEC_SBC_SIMD_NONE  0
+#define OI_CODEC_SBC_SIMD_SSE2  1
+#define OI_CODEC_SBC_SIMD_AVX2  2
+#define OI_CODEC_SBC_SIMD_NEON  3
+#define OI_CODEC_SBC_SIMD_AUTO  0xff
+
+/**
+ * Select the SIMD implementation of the 8 subband synthesis filter. The
+ * selection applies to all decoder contexts. Instruction sets without a
+ * SIMD synthesis filter (SSE2) are accepted and use the portable C code.
+ * The best available one is selected at load time; call this before any
+ * decoder runs, as the selection is not synchronized with decoding.
+ *
+ * @param simd  One of OI_CODEC_SBC_SIMD_NONE, OI_CODEC_SBC_SIMD_SSE2,
+ *              OI_CODEC_SBC_SIMD_AVX2, OI_CODEC_SBC_SIMD_NEON or
+ *              OI_CODEC_SBC_SIMD_AUTO for the best available one
+ *
+ * @return OI_STATUS_SUCCESS, or OI_STATUS_NOT_IMPLEMENTED if the
+ *         instruction set is not available on this build or CPU
+ */
+OI_STATUS OI_CODEC_SBC_SelectSimd(OI_UINT8 simd);
+
+/**
+ * Get the selected SIMD implementation.
+ *
+ * @return One of OI_CODEC_SBC_SIMD_NONE, OI_CODEC_SBC_SIMD_SSE2,
+ *         OI_CODEC_SBC_SIMD_AVX2, OI_CODEC_SBC_SIMD_NEON
+ */
+OI_UINT8 OI_CODEC_SBC_GetSimd(void);
+/* BK4BTSTACK_CHANGE END */
+
 /* Common functions */
 
 /**
@@ -192,6 +192,22 @@ PRIVATE void shift_buffer(SBC_BUFFER_T *dest, SBC_BUFFER_T *src, OI_UINT wordCou
 PRIVATE void cosineModulateSynth4(SBC_BUFFER_T * RESTRICT out, OI_INT32 const * RESTRICT in);
 PRIVATE void SynthWindow40_int32_int32_symmetry_with_sum(OI_INT16 *pcm, SBC_BUFFER_T buffer[80], OI_UINT strideShift);
 
+/* BK4BTSTACK_CHANGE START */
+/* SIMD synthesis filter, selected by OI_CODEC_SBC_SelectSimd */
+#ifndef OI_SBC_SIMD_OPT
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__) || defined(__ARM_NEON))
+#define OI_SBC_SIMD_OPT 1
+#else
+#define OI_SBC_SIMD_OPT 0
+#endif
+#endif
+
+typedef void (*OI_SBC_SYNTH_WINDOW80)(OI_INT16 *pcm, SBC_BUFFER_T const * RESTRICT buffer, OI_UINT strideShift);
+
+/* returns NULL if the instruction set is not available */
+PRIVATE OI_SBC_SYNTH_WINDOW80 OI_SBC_SimdGetSynthWindow80(OI_UINT8 simd);
+/* BK4BTSTACK_CHANGE END */
+
 INLINE void dct3_4(OI_INT32 * RESTRICT out, OI_INT32 const * RESTRICT in);
 PRIVATE void analyze4_generated(SBC_BUFFER_T analysisBuffer[RESTRICT 40],
                                 OI_INT16 *pcm,
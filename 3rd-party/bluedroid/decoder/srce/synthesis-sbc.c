@@ -248,6 +248,62 @@ typedef void (*SYNTH_FRAME)(OI_CODEC_SBC_DECODER_CONTEXT *context, OI_INT16 *pcm
 #define DCT2_8(dst, src) dct2_8(dst, src)
 #endif
 
+/* BK4BTSTACK_CHANGE START */
+#if OI_SBC_SIMD_OPT && !defined(SYNTH80)
+static OI_SBC_SYNTH_WINDOW80 synthWindow80 = SynthWindow80_generated;
+static OI_UINT8 simdSelected = OI_CODEC_SBC_SIMD_NONE;
+#define OI_SBC_SIMD_SYNTH80
+#define SYNTH80 synthWindow80
+#endif
+
+OI_STATUS OI_CODEC_SBC_SelectSimd(OI_UINT8 simd)
+{
+#ifdef OI_SBC_SIMD_SYNTH80
+    static const OI_UINT8 preferred[] = { OI_CODEC_SBC_SIMD_AVX2, OI_CODEC_SBC_SIMD_NEON };
+    OI_SBC_SYNTH_WINDOW80 synth = NULL;
+    OI_UINT i;
+
+    if (simd == OI_CODEC_SBC_SIMD_AUTO) {
+        simd = OI_CODEC_SBC_SIMD_NONE;
+        for (i = 0; i < sizeof(preferred); i++) {
+            synth = OI_SBC_SimdGetSynthWindow80(preferred[i]);
+            if (synth) {
+                simd = preferred[i];
+                break;
+            }
+        }
+    } else if (simd != OI_CODEC_SBC_SIMD_NONE) {
+        synth = OI_SBC_SimdGetSynthWindow80(simd);
+        if (!synth) {
+            return OI_STATUS_NOT_IMPLEMENTED;
+        }
+    }
+    synthWindow80 = synth ? synth : SynthWindow80_generated;
+    simdSelected = simd;
+    return OI_STATUS_SUCCESS;
+#else
+    return (simd == OI_CODEC_SBC_SIMD_NONE || simd == OI_CODEC_SBC_SIMD_AUTO) ? OI_STATUS_SUCCESS : OI_STATUS_NOT_IMPLEMENTED;
+#endif
+}
+
+OI_UINT8 OI_CODEC_SBC_GetSimd(void)
+{
+#ifdef OI_SBC_SIMD_SYNTH80
+    return simdSelected;
+#else
+    return OI_CODEC_SBC_SIMD_NONE;
+#endif
+}
+
+#ifdef OI_SBC_SIMD_SYNTH80
+/* select the best implementation once at load time, so decoders never race on lazy init */
+__attribute__((constructor)) static void SynthSelectSimdAuto(void)
+{
+    OI_CODEC_SBC_SelectSimd(OI_CODEC_SBC_SIMD_AUTO);
+}
+#endif
+/* BK4BTSTACK_CHANGE END */
+
 #ifndef SYNTH80
 #define SYNTH80 SynthWindow80_generated
 #endif
@@ -0,0 +1,200 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2017 BlueKitchen GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/**
+ @file
+
+ AVX2 and NEON versions of SynthWindow80_generated.
+
+ Each of the 8 output samples is the sum of 10 terms (coefficient * buffer
+ value, shifted left or right by a per term amount). Term t of all outputs
+ reads from buffer[synth80Load[t] .. synth80Load[t] + 7], so the 8 inputs of
+ a term are gathered with a single load and byte shuffle and the 8 outputs
+ are computed in parallel. The tables are taken from synthesis-8-generated.c,
+ missing terms have a zero coefficient. The result is bit-exact with the
+ generated C code.
+
+ SSE2 has neither 32 bit multiplications nor per lane shifts, the portable C
+ code is used there.
+ */
+
+#include "oi_codec_sbc_private.h"
+
+/* BK4BTSTACK_CHANGE START */
+
+PRIVATE void SynthWindow80_generated(OI_INT16 *pcm, SBC_BUFFER_T const * RESTRICT buffer, OI_UINT strideShift);
+
+#if OI_SBC_SIMD_OPT
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OI_SBC_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define OI_SBC_SIMD_X86 0
+#endif
+
+#if defined(__ARM_NEON)
+#define OI_SBC_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define OI_SBC_SIMD_NEON 0
+#endif
+
+#define OI_SBC_SIMD_ALIGN __attribute__((aligned(32)))
+
+static const OI_UINT8 synth80Load[10] = { 5, 9, 20, 25, 36, 41, 52, 57, 68, 72 };
+
+static const OI_UINT8 synth80Shuffle[10][16] OI_SBC_SIMD_ALIGN = {
+    {  0,  1,  0,  1,  2,  3,  4,  5,  6,  7,  4,  5,  2,  3,  0,  1 },
+    {  6,  7,  4,  5,  2,  3,  0,  1,  0,  1,  0,  1,  2,  3,  4,  5 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  6,  7,  4,  5,  2,  3 },
+    {  6,  7,  4,  5,  2,  3,  0,  1,  0,  1,  0,  1,  2,  3,  4,  5 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  6,  7,  4,  5,  2,  3 },
+    {  6,  7,  4,  5,  2,  3,  0,  1,  0,  1,  0,  1,  2,  3,  4,  5 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  6,  7,  4,  5,  2,  3 },
+    {  6,  7,  4,  5,  2,  3,  0,  1,  0,  1,  0,  1,  2,  3,  4,  5 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  6,  7,  4,  5,  2,  3 },
+    {  8,  9,  6,  7,  4,  5,  2,  3,  0,  1,  2,  3,  4,  5,  6,  7 },
+};
+
+static const OI_INT32 synth80Coeff[10][8] OI_SBC_SIMD_ALIGN = {
+    {      0,  -3263, -10385, -16457,  10445,  16913,  11167,   9293 },
+    {   8235,  29293,  24995,  19083,      0,  -8443, -10337,  -6087 },
+    { -23167,  -5229,   -309, -23641,  -5297,   3687,   1917,   1247 },
+    {  26479,  30835,   9161, -29015,      0,   -301, -30605,  -2893 },
+    { -17397, -27021, -23063, -12889,  22299,  15447,   8317,  23671 },
+    {   9399,  31633,  27561,   6145,      0,  10255,   9553,  18055 },
+    {  17397,  17319,   2309,  24211,  10603, -18233,  22117,  11537 },
+    {  26479,  26663,  12705,  23469,      0,   9405,  16383,   1747 },
+    {  23167,   4555,   6239,  21223,   9539,   1499,   7543,    685 },
+    {   8235,  12419,   9251,  26913,      0,  26189,   8603,   8721 },
+};
+
+static const OI_INT32 synth80Shift[10][8] OI_SBC_SIMD_ALIGN = {
+    {  0, -5, -6, -6, -4, -5, -4, -3 },
+    { -3, -5, -5, -5,  0, -7, -4, -2 },
+    { -3,  0,  4, -2,  1,  1,  2,  3 },
+    { -2, -3, -3, -4,  0,  5, -1,  3 },
+    {  1,  1,  1,  2,  2,  2,  3,  2 },
+    {  3,  1,  1,  3,  0,  2,  2,  1 },
+    {  1,  1,  3, -1,  0, -3, -4, -1 },
+    { -2, -2, -1, -2,  0, -1, -2,  1 },
+    { -3, -1, -3, -8, -4, -1, -3,  1 },
+    { -3, -4, -4, -6,  0, -7, -6, -7 },
+};
+
+static void storePcm(OI_INT16 *pcm, OI_INT16 const *out, OI_UINT strideShift)
+{
+    OI_UINT i;
+    for (i = 0; i < 8; i++) {
+        pcm[i << strideShift] = out[i];
+    }
+}
+
+#if OI_SBC_SIMD_X86
+__attribute__((target("avx2")))
+static void SynthWindow80_AVX2(OI_INT16 *pcm, SBC_BUFFER_T const * RESTRICT buffer, OI_UINT strideShift)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    __m256i x, shift;
+    __m128i out;
+    OI_INT16 tmp[8];
+    OI_UINT t;
+
+    for (t = 0; t < 10; t++) {
+        out = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) &buffer[synth80Load[t]]),
+                               _mm_load_si128((const __m128i *) synth80Shuffle[t]));
+        x = _mm256_mullo_epi32(_mm256_cvtepi16_epi32(out), _mm256_load_si256((const __m256i *) synth80Coeff[t]));
+        shift = _mm256_load_si256((const __m256i *) synth80Shift[t]);
+        x = _mm256_sllv_epi32(x, _mm256_max_epi32(shift, zero));
+        x = _mm256_srav_epi32(x, _mm256_sub_epi32(zero, _mm256_min_epi32(shift, zero)));
+        acc = _mm256_add_epi32(acc, x);
+    }
+
+    /* divide by 32768 rounding towards zero, then saturate to 16 bit */
+    acc = _mm256_srai_epi32(_mm256_add_epi32(acc, _mm256_srli_epi32(_mm256_srai_epi32(acc, 31), 17)), 15);
+    out = _mm_packs_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    if (strideShift == 0) {
+        _mm_storeu_si128((__m128i *) pcm, out);
+    } else {
+        _mm_storeu_si128((__m128i *) tmp, out);
+        storePcm(pcm, tmp, strideShift);
+    }
+}
+#endif
+
+#if OI_SBC_SIMD_NEON
+static void SynthWindow80_NEON(OI_INT16 *pcm, SBC_BUFFER_T const * RESTRICT buffer, OI_UINT strideShift)
+{
+    int32x4_t acc_lo = vdupq_n_s32(0);
+    int32x4_t acc_hi = vdupq_n_s32(0);
+    uint8x8x2_t table;
+    uint8x16_t raw;
+    int16x4_t x_lo, x_hi;
+    int16x8_t out;
+    OI_INT16 tmp[8];
+    OI_UINT t;
+
+    for (t = 0; t < 10; t++) {
+        raw = vreinterpretq_u8_s16(vld1q_s16(&buffer[synth80Load[t]]));
+        table.val[0] = vget_low_u8(raw);
+        table.val[1] = vget_high_u8(raw);
+        x_lo = vreinterpret_s16_u8(vtbl2_u8(table, vld1_u8(&synth80Shuffle[t][0])));
+        x_hi = vreinterpret_s16_u8(vtbl2_u8(table, vld1_u8(&synth80Shuffle[t][8])));
+        /* vshlq_s32 shifts right for negative shift values */
+        acc_lo = vaddq_s32(acc_lo, vshlq_s32(vmulq_s32(vmovl_s16(x_lo), vld1q_s32(&synth80Coeff[t][0])), vld1q_s32(&synth80Shift[t][0])));
+        acc_hi = vaddq_s32(acc_hi, vshlq_s32(vmulq_s32(vmovl_s16(x_hi), vld1q_s32(&synth80Coeff[t][4])), vld1q_s32(&synth80Shift[t][4])));
+    }
+
+    /* divide by 32768 rounding towards zero, then saturate to 16 bit */
+    acc_lo = vshrq_n_s32(vaddq_s32(acc_lo, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(acc_lo, 31)), 17))), 15);
+    acc_hi = vshrq_n_s32(vaddq_s32(acc_hi, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(acc_hi, 31)), 17))), 15);
+    out = vcombine_s16(vqmovn_s32(acc_lo), vqmovn_s32(acc_hi));
+    if (strideShift == 0) {
+        vst1q_s16(pcm, out);
+    } else {
+        vst1q_s16(tmp, out);
+        storePcm(pcm, tmp, strideShift);
+    }
+}
+#endif
+
+OI_SBC_SYNTH_WINDOW80 OI_SBC_SimdGetSynthWindow80(OI_UINT8 simd)
+{
+    switch (simd) {
+#if OI_SBC_SIMD_X86
+        case OI_CODEC_SBC_SIMD_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2") ? SynthWindow80_generated : NULL;
+        case OI_CODEC_SBC_SIMD_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? SynthWindow80_AVX2 : NULL;
+#endif
+#if OI_SBC_SIMD_NEON
+        case OI_CODEC_SBC_SIMD_NEON:
+            return SynthWindow80_NEON;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+#endif /* OI_SBC_SIMD_OPT */
+
+/* BK4BTSTACK_CHANGE END */
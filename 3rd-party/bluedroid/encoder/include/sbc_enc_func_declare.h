@@ -40,7 +40,9 @@ extern const SINT32 gas32CoeffFor8SBs[];
 extern void sbc_enc_bit_alloc_mono(SBC_ENC_PARAMS *CodecParams);
 extern void sbc_enc_bit_alloc_ste(SBC_ENC_PARAMS *CodecParams);
 
-extern void SbcAnalysisInit (void);
+/* BK4BTSTACK_CHANGE START */
+extern void SbcAnalysisInit (SBC_ENC_PARAMS *strEncParams);
+/* BK4BTSTACK_CHANGE END */
 
 extern void SbcAnalysisFilter4(SBC_ENC_PARAMS *strEncParams);
 extern void SbcAnalysisFilter8(SBC_ENC_PARAMS *strEncParams);
@@ -48,6 +50,25 @@ extern void SbcAnalysisFilter8(SBC_ENC_PARAMS *strEncParams);
 extern void SBC_FastIDCT8 (SINT32 *pInVect, SINT32 *pOutVect);
 extern void SBC_FastIDCT4 (SINT32 *x0, SINT32 *pOutVect);
 
+/* BK4BTSTACK_CHANGE START */
+#if (SBC_SIMD_OPT == TRUE)
+/* analysis window per tap: s32DCTY[i] = sum over k of gas16AnalysisWindowN[k][i] * s16X[ChOffset + i + k*2*N] */
+extern const SINT16 gas16AnalysisWindow4[5][8];
+extern const SINT16 gas16AnalysisWindow8[5][16];
+
+typedef struct
+{
+    void (*Window4)(const SINT16 *ps16X, SINT32 *ps32DCTY);
+    void (*Window8)(const SINT16 *ps16X, SINT32 *ps32DCTY);
+    /* s32Count vectors of 16 window outputs to s32Count vectors of 8 subband samples */
+    void (*FastIDCT8)(const SINT32 *ps32In, SINT32 *ps32Out, SINT32 s32Count);
+} SBC_ENC_SIMD_FUNCTIONS;
+
+/* returns NULL if not supported by the CPU */
+extern const SBC_ENC_SIMD_FUNCTIONS *SbcSimdGetFunctions(UINT8 u8Simd);
+#endif
+/* BK4BTSTACK_CHANGE END */
+
 extern void EncPacking(SBC_ENC_PARAMS *strEncParams);
 extern void EncQuantizer(SBC_ENC_PARAMS *);
 #if (SBC_DSP_OPT==TRUE)
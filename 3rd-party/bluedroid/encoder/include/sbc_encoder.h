@@ -131,6 +131,23 @@
 #define SBC_FAST_DCT  TRUE
 #endif /*SBC_FAST_DCT */
 
+/* BK4BTSTACK_CHANGE START */
+/* Set SBC_SIMD_OPT to TRUE to use SSE2/AVX2 or NEON for windowing and DCT in the analysis filter. */
+/* The implementation is selected at runtime and is bit-exact with the SBC_IPAQ_OPT configuration. */
+#ifndef SBC_SIMD_OPT
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__) || defined(__ARM_NEON))
+#define SBC_SIMD_OPT TRUE
+#else
+#define SBC_SIMD_OPT FALSE
+#endif
+#endif /* SBC_SIMD_OPT */
+
+#if (SBC_SIMD_OPT == TRUE) && ((SBC_ARM_ASM_OPT == TRUE) || (SBC_IPAQ_OPT == FALSE) || (SBC_IS_64_MULT_IN_WINDOW_ACCU == TRUE) || (SBC_IS_64_MULT_IN_IDCT == TRUE) || (SBC_FAST_DCT == FALSE))
+#undef  SBC_SIMD_OPT
+#define SBC_SIMD_OPT FALSE
+#endif
+/* BK4BTSTACK_CHANGE END */
+
 /* In case we do not use joint stereo mode the flag save some RAM and ROM in case it is set to FALSE */
 #ifndef SBC_JOINT_STE_INCLUDED
 #define SBC_JOINT_STE_INCLUDED TRUE
@@ -196,6 +213,10 @@ typedef struct SBC_ENC_PARAMS_TAG
     UINT16 u16PacketLength;
     /* BK4BTSTACK_CHANGE START */
     UINT8  mSBCEnabled;
+    /* analysis filter state, moved from globals to allow multiple encoder instances */
+    SINT32 as32X[ENC_VX_BUFFER_SIZE/2];             /* must be 32 bits aligned */
+    SINT16 s16ShiftCounter;
+    SINT16 s16MaxShiftCounter;
     /* BK4BTSTACK_CHANGE END */
 }SBC_ENC_PARAMS;
 
@@ -205,6 +226,16 @@ extern "C"
 #endif
 SBC_API extern void SBC_Encoder(SBC_ENC_PARAMS *strEncParams);
 SBC_API extern void SBC_Encoder_Init(SBC_ENC_PARAMS *strEncParams);
+/* BK4BTSTACK_CHANGE START */
+/* SIMD implementation of the analysis filter, shared by all encoder instances */
+#define SBC_ENC_SIMD_NONE   0
+#define SBC_ENC_SIMD_SSE2   1
+#define SBC_ENC_SIMD_AVX2   2
+#define SBC_ENC_SIMD_NEON   3
+#define SBC_ENC_SIMD_AUTO   0xff                    /* best implementation supported by the CPU */
+SBC_API extern UINT8 SBC_Encoder_SelectSimd(UINT8 u8Simd);    /* FALSE if not supported by build or CPU */
+SBC_API extern UINT8 SBC_Encoder_GetSimd(void);
+/* BK4BTSTACK_CHANGE END */
 #ifdef __cplusplus
 }
 #endif
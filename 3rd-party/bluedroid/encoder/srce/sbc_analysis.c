@@ -153,15 +153,81 @@
 #define WIND_8_SUBBANDS_8_2 (SINT16)0x12CF  /* 40 = 0x12CF6C75 */
 #endif
 
-#if (SBC_USE_ARM_PRAGMA==TRUE)
-#pragma arm section zidata = "sbc_s32_analysis_section"
-#endif
-static SINT32   s32DCTY[16]  = {0};
-static SINT32   s32X[ENC_VX_BUFFER_SIZE/2];
-static SINT16   *s16X=(SINT16*) s32X;      /* s16X must be 32 bits aligned cf  SHIFTUP_X8_2*/
-#if (SBC_USE_ARM_PRAGMA==TRUE)
-#pragma arm section zidata
+/* BK4BTSTACK_CHANGE START */
+/* s32DCTY, s16X, ShiftCounter and EncMaxShiftCounter are locals of the analysis filters, s16X points to SBC_ENC_PARAMS.as32X */
+/* BK4BTSTACK_CHANGE END */
+
+/* BK4BTSTACK_CHANGE START */
+#if (SBC_SIMD_OPT == TRUE)
+/* window coefficients per tap for the SIMD implementations, see WINDOW_PARTIAL_4 and WINDOW_PARTIAL_8 */
+const SINT16 gas16AnalysisWindow4[5][8] =
+{
+    {
+        0, WIND_4_SUBBANDS_1_0, WIND_4_SUBBANDS_2_0, WIND_4_SUBBANDS_3_0,
+        WIND_4_SUBBANDS_4_0, WIND_4_SUBBANDS_3_4, WIND_4_SUBBANDS_2_4, WIND_4_SUBBANDS_1_4
+    },
+    {
+        WIND_4_SUBBANDS_0_1, WIND_4_SUBBANDS_1_1, WIND_4_SUBBANDS_2_1, WIND_4_SUBBANDS_3_1,
+        WIND_4_SUBBANDS_4_1, WIND_4_SUBBANDS_3_3, WIND_4_SUBBANDS_2_3, WIND_4_SUBBANDS_1_3
+    },
+    {
+        WIND_4_SUBBANDS_0_2, WIND_4_SUBBANDS_1_2, WIND_4_SUBBANDS_2_2, WIND_4_SUBBANDS_3_2,
+        WIND_4_SUBBANDS_4_2, WIND_4_SUBBANDS_3_2, WIND_4_SUBBANDS_2_2, WIND_4_SUBBANDS_1_2
+    },
+    {
+        -WIND_4_SUBBANDS_0_2, WIND_4_SUBBANDS_1_3, WIND_4_SUBBANDS_2_3, WIND_4_SUBBANDS_3_3,
+        WIND_4_SUBBANDS_4_1, WIND_4_SUBBANDS_3_1, WIND_4_SUBBANDS_2_1, WIND_4_SUBBANDS_1_1
+    },
+    {
+        -WIND_4_SUBBANDS_0_1, WIND_4_SUBBANDS_1_4, WIND_4_SUBBANDS_2_4, WIND_4_SUBBANDS_3_4,
+        WIND_4_SUBBANDS_4_0, WIND_4_SUBBANDS_3_0, WIND_4_SUBBANDS_2_0, WIND_4_SUBBANDS_1_0
+    }
+};
+
+const SINT16 gas16AnalysisWindow8[5][16] =
+{
+    {
+        0, WIND_8_SUBBANDS_1_0, WIND_8_SUBBANDS_2_0, WIND_8_SUBBANDS_3_0,
+        WIND_8_SUBBANDS_4_0, WIND_8_SUBBANDS_5_0, WIND_8_SUBBANDS_6_0, WIND_8_SUBBANDS_7_0,
+        WIND_8_SUBBANDS_8_0, WIND_8_SUBBANDS_7_4, WIND_8_SUBBANDS_6_4, WIND_8_SUBBANDS_5_4,
+        WIND_8_SUBBANDS_4_4, WIND_8_SUBBANDS_3_4, WIND_8_SUBBANDS_2_4, WIND_8_SUBBANDS_1_4
+    },
+    {
+        WIND_8_SUBBANDS_0_1, WIND_8_SUBBANDS_1_1, WIND_8_SUBBANDS_2_1, WIND_8_SUBBANDS_3_1,
+        WIND_8_SUBBANDS_4_1, WIND_8_SUBBANDS_5_1, WIND_8_SUBBANDS_6_1, WIND_8_SUBBANDS_7_1,
+        WIND_8_SUBBANDS_8_1, WIND_8_SUBBANDS_7_3, WIND_8_SUBBANDS_6_3, WIND_8_SUBBANDS_5_3,
+        WIND_8_SUBBANDS_4_3, WIND_8_SUBBANDS_3_3, WIND_8_SUBBANDS_2_3, WIND_8_SUBBANDS_1_3
+    },
+    {
+        WIND_8_SUBBANDS_0_2, WIND_8_SUBBANDS_1_2, WIND_8_SUBBANDS_2_2, WIND_8_SUBBANDS_3_2,
+        WIND_8_SUBBANDS_4_2, WIND_8_SUBBANDS_5_2, WIND_8_SUBBANDS_6_2, WIND_8_SUBBANDS_7_2,
+        WIND_8_SUBBANDS_8_2, WIND_8_SUBBANDS_7_2, WIND_8_SUBBANDS_6_2, WIND_8_SUBBANDS_5_2,
+        WIND_8_SUBBANDS_4_2, WIND_8_SUBBANDS_3_2, WIND_8_SUBBANDS_2_2, WIND_8_SUBBANDS_1_2
+    },
+    {
+        -WIND_8_SUBBANDS_0_2, WIND_8_SUBBANDS_1_3, WIND_8_SUBBANDS_2_3, WIND_8_SUBBANDS_3_3,
+        WIND_8_SUBBANDS_4_3, WIND_8_SUBBANDS_5_3, WIND_8_SUBBANDS_6_3, WIND_8_SUBBANDS_7_3,
+        WIND_8_SUBBANDS_8_1, WIND_8_SUBBANDS_7_1, WIND_8_SUBBANDS_6_1, WIND_8_SUBBANDS_5_1,
+        WIND_8_SUBBANDS_4_1, WIND_8_SUBBANDS_3_1, WIND_8_SUBBANDS_2_1, WIND_8_SUBBANDS_1_1
+    },
+    {
+        -WIND_8_SUBBANDS_0_1, WIND_8_SUBBANDS_1_4, WIND_8_SUBBANDS_2_4, WIND_8_SUBBANDS_3_4,
+        WIND_8_SUBBANDS_4_4, WIND_8_SUBBANDS_5_4, WIND_8_SUBBANDS_6_4, WIND_8_SUBBANDS_7_4,
+        WIND_8_SUBBANDS_8_0, WIND_8_SUBBANDS_7_0, WIND_8_SUBBANDS_6_0, WIND_8_SUBBANDS_5_0,
+        WIND_8_SUBBANDS_4_0, WIND_8_SUBBANDS_3_0, WIND_8_SUBBANDS_2_0, WIND_8_SUBBANDS_1_0
+    }
+};
+
+static const SBC_ENC_SIMD_FUNCTIONS *pstrSimdFunctions = NULL;
+static UINT8 u8SimdSelected = SBC_ENC_SIMD_NONE;
+
+/* select the best implementation once at load time, so encoders never race on lazy init */
+__attribute__((constructor)) static void SbcAnalysisSelectSimdAuto(void)
+{
+    SBC_Encoder_SelectSimd(SBC_ENC_SIMD_AUTO);
+}
 #endif
+/* BK4BTSTACK_CHANGE END */
 
 /* This macro is for 4 subbands */
 #define SHIFTUP_X4                                                               \
@@ -897,8 +963,6 @@ static SINT16   *s16X=(SINT16*) s32X;      /* s16X must be 32 bits aligned cf  S
 #endif
 #endif
 
-static SINT16 ShiftCounter=0;
-extern SINT16 EncMaxShiftCounter;
 /****************************************************************************
 * SbcAnalysisFilter - performs Analysis of the input audio stream
 *
@@ -906,6 +970,15 @@ extern SINT16 EncMaxShiftCounter;
 */
 void SbcAnalysisFilter4(SBC_ENC_PARAMS *pstrEncParams)
 {
+    /* BK4BTSTACK_CHANGE START */
+    SINT32  s32DCTY[16];
+    SINT16 *s16X = (SINT16*) pstrEncParams->as32X;      /* s16X must be 32 bits aligned cf  SHIFTUP_X8_2*/
+    SINT16  ShiftCounter = pstrEncParams->s16ShiftCounter;
+    SINT16  EncMaxShiftCounter = pstrEncParams->s16MaxShiftCounter;
+#if (SBC_SIMD_OPT == TRUE)
+    const SBC_ENC_SIMD_FUNCTIONS *pstrSimd = pstrSimdFunctions;
+#endif
+    /* BK4BTSTACK_CHANGE END */
     SINT16 *ps16PcmBuf;
     SINT32 *ps32SbBuf;
     SINT32  s32Blk,s32Ch;
@@ -965,6 +1038,15 @@ void SbcAnalysisFilter4(SBC_ENC_PARAMS *pstrEncParams)
         {
             ChOffset=s32Ch*Offset2+Offset;
             
+            /* BK4BTSTACK_CHANGE START */
+#if (SBC_SIMD_OPT == TRUE)
+            if (pstrSimd)
+            {
+                pstrSimd->Window4(&s16X[ChOffset], s32DCTY);
+            }
+            else
+#endif
+            /* BK4BTSTACK_CHANGE END */
             WINDOW_PARTIAL_4
 
             SBC_FastIDCT4(s32DCTY, ps32SbBuf);
@@ -994,12 +1076,25 @@ void SbcAnalysisFilter4(SBC_ENC_PARAMS *pstrEncParams)
                 ShiftCounter+=SUB_BANDS_4;
             }
         }
-    }
+    }    /* BK4BTSTACK_CHANGE START */
+    pstrEncParams->s16ShiftCounter = ShiftCounter;
+    /* BK4BTSTACK_CHANGE END */
 }
 
 /* //////////////////////////////////////////////////////////////////////////////////////////////////////////////////// */
 void SbcAnalysisFilter8 (SBC_ENC_PARAMS *pstrEncParams)
 {
+    /* BK4BTSTACK_CHANGE START */
+    SINT32  s32DCTY[16];
+    SINT16 *s16X = (SINT16*) pstrEncParams->as32X;      /* s16X must be 32 bits aligned cf  SHIFTUP_X8_2*/
+    SINT16  ShiftCounter = pstrEncParams->s16ShiftCounter;
+    SINT16  EncMaxShiftCounter = pstrEncParams->s16MaxShiftCounter;
+#if (SBC_SIMD_OPT == TRUE)
+    const SBC_ENC_SIMD_FUNCTIONS *pstrSimd = pstrSimdFunctions;
+    SINT32  as32DCTY[SBC_MAX_NUM_OF_BLOCKS * SBC_MAX_NUM_OF_CHANNELS * 16];
+    SINT32 *ps32DCTY = as32DCTY;
+#endif
+    /* BK4BTSTACK_CHANGE END */
     SINT16 *ps16PcmBuf;
     SINT32 *ps32SbBuf;
     SINT32  s32Blk,s32Ch;                                     /* counter for block*/
@@ -1068,6 +1163,17 @@ void SbcAnalysisFilter8 (SBC_ENC_PARAMS *pstrEncParams)
         {
             ChOffset=s32Ch*Offset2+Offset;
 
+            /* BK4BTSTACK_CHANGE START */
+#if (SBC_SIMD_OPT == TRUE)
+            if (pstrSimd)
+            {
+                /* DCT is done for all blocks and channels at the end of the frame */
+                pstrSimd->Window8(&s16X[ChOffset], ps32DCTY);
+                ps32DCTY += 16;
+                continue;
+            }
+#endif
+            /* BK4BTSTACK_CHANGE END */
             WINDOW_PARTIAL_8
 
             SBC_FastIDCT8 (s32DCTY, ps32SbBuf);
@@ -1098,11 +1204,66 @@ void SbcAnalysisFilter8 (SBC_ENC_PARAMS *pstrEncParams)
                 ShiftCounter+=SUB_BANDS_8;
             }
         }
+    }    /* BK4BTSTACK_CHANGE START */
+    pstrEncParams->s16ShiftCounter = ShiftCounter;
+#if (SBC_SIMD_OPT == TRUE)
+    if (pstrSimd)
+    {
+        pstrSimd->FastIDCT8(as32DCTY, pstrEncParams->s32SbBuffer, s32NumOfBlocks * s32NumOfChannels);
     }
+#endif
+    /* BK4BTSTACK_CHANGE END */
+}
+
+/* BK4BTSTACK_CHANGE START */
+void SbcAnalysisInit (SBC_ENC_PARAMS *pstrEncParams)
+{
+    memset(pstrEncParams->as32X,0,ENC_VX_BUFFER_SIZE*sizeof(SINT16));
+    pstrEncParams->s16ShiftCounter=0;
 }
 
-void SbcAnalysisInit (void)
+UINT8 SBC_Encoder_SelectSimd(UINT8 u8Simd)
 {
-    memset(s16X,0,ENC_VX_BUFFER_SIZE*sizeof(SINT16));
-    ShiftCounter=0;
+#if (SBC_SIMD_OPT == TRUE)
+    static const UINT8 au8Preferred[] = { SBC_ENC_SIMD_AVX2, SBC_ENC_SIMD_SSE2, SBC_ENC_SIMD_NEON };
+    const SBC_ENC_SIMD_FUNCTIONS *pstrFunctions = NULL;
+    UINT8 i;
+
+    if (u8Simd == SBC_ENC_SIMD_AUTO)
+    {
+        u8Simd = SBC_ENC_SIMD_NONE;
+        for (i = 0; i < sizeof(au8Preferred); i++)
+        {
+            pstrFunctions = SbcSimdGetFunctions(au8Preferred[i]);
+            if (pstrFunctions)
+            {
+                u8Simd = au8Preferred[i];
+                break;
+            }
+        }
+    }
+    else if (u8Simd != SBC_ENC_SIMD_NONE)
+    {
+        pstrFunctions = SbcSimdGetFunctions(u8Simd);
+        if (!pstrFunctions)
+        {
+            return FALSE;
+        }
+    }
+    pstrSimdFunctions = pstrFunctions;
+    u8SimdSelected = u8Simd;
+    return TRUE;
+#else
+    return (u8Simd == SBC_ENC_SIMD_NONE) || (u8Simd == SBC_ENC_SIMD_AUTO);
+#endif
+}
+
+UINT8 SBC_Encoder_GetSimd(void)
+{
+#if (SBC_SIMD_OPT == TRUE)
+    return u8SimdSelected;
+#else
+    return SBC_ENC_SIMD_NONE;
+#endif
 }
+/* BK4BTSTACK_CHANGE END */
@@ -0,0 +1,487 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2017 BlueKitchen GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  SSE2, AVX2 and NEON versions of the analysis filter windowing and of the
+ *  fast DCT for 8 subbands. The results are bit-exact with the SBC_IPAQ_OPT
+ *  C code in sbc_analysis.c and sbc_dct.c:
+ *  - windowing multiplies 16 bit samples with 16 bit coefficients and sums
+ *    in 32 bit, which maps directly to pmaddwd and vmlal
+ *  - SBC_MULT_32_16_SIMPLIFIED is (SINT32)(((SINT64)c * x) >> 15). With
+ *    x = hi * 2^16 + b15 * 2^15 + lo15 this equals
+ *    2 * c * hi + c * b15 + ((c * lo15) >> 15) modulo 2^32, which only
+ *    needs 16x16 bit multiplications. NEON uses vmull_s32 instead.
+ *  - the DCT is done for four (SSE2, NEON) or eight (AVX2) blocks in
+ *    parallel, one block per vector lane.
+ *
+ ******************************************************************************/
+
+#include "sbc_encoder.h"
+#include "sbc_enc_func_declare.h"
+
+#if (SBC_SIMD_OPT == TRUE)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SBC_SIMD_X86 TRUE
+#include <immintrin.h>
+#define SBC_TARGET_SSE2 __attribute__((target("sse2")))
+#define SBC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SBC_SIMD_X86 FALSE
+#endif
+
+#if defined(__ARM_NEON)
+#define SBC_SIMD_NEON TRUE
+#include <arm_neon.h>
+#else
+#define SBC_SIMD_NEON FALSE
+#endif
+
+/* same as in sbc_dct.c */
+#define SBC_COS_PI_SUR_4            (0x00005a82)
+#define SBC_COS_PI_SUR_8            (0x00007641)
+#define SBC_COS_3PI_SUR_8           (0x000030fb)
+#define SBC_COS_PI_SUR_16           (0x00007d8a)
+#define SBC_COS_3PI_SUR_16          (0x00006a6d)
+#define SBC_COS_5PI_SUR_16          (0x0000471c)
+#define SBC_COS_7PI_SUR_16          (0x000018f8)
+
+/* SBC_FastIDCT8 with one block per vector lane, VEC and V_* are defined by each implementation */
+#define SBC_SIMD_FAST_IDCT8(in, out)                                \
+{                                                                   \
+    VEC x0, x1, x2, x3, x4, x5, x6, x7, temp;                       \
+    VEC even0, even1, even2, even3, odd0, odd1, odd2, odd3;         \
+    x0 = V_MULT(SBC_COS_PI_SUR_4, in[4]);                           \
+    x1 = V_SRAI(V_ADD(in[3], in[5]), 1);                            \
+    x2 = V_SRAI(V_ADD(in[2], in[6]), 1);                            \
+    x3 = V_SRAI(V_ADD(in[1], in[7]), 1);                            \
+    x4 = V_SRAI(V_ADD(in[0], in[8]), 1);                            \
+    x5 = V_SRAI(V_SUB(in[9], in[15]), 1);                           \
+    x6 = V_SRAI(V_SUB(in[10], in[14]), 1);                          \
+    x7 = V_SRAI(V_SUB(in[11], in[13]), 1);                          \
+    temp = x0;                                                      \
+    x0 = V_MULT(SBC_COS_PI_SUR_4, V_ADD(x0, x4));                   \
+    x4 = V_MULT(SBC_COS_PI_SUR_4, V_SUB(temp, x4));                 \
+    x2 = V_SUB(x2, x6);                                             \
+    x6 = V_MULT(SBC_COS_PI_SUR_4, V_SLLI(x6, 1));                   \
+    temp = x2;                                                      \
+    x2 = V_MULT(SBC_COS_PI_SUR_8, V_ADD(x2, x6));                   \
+    x6 = V_MULT(SBC_COS_3PI_SUR_8, V_SUB(temp, x6));                \
+    even0 = V_ADD(x0, x2);                                          \
+    even1 = V_ADD(x4, x6);                                          \
+    even2 = V_SUB(x4, x6);                                          \
+    even3 = V_SUB(x0, x2);                                          \
+    x7 = V_SLLI(x7, 1);                                             \
+    x5 = V_SUB(V_SLLI(x5, 1), x7);                                  \
+    x3 = V_SUB(V_SLLI(x3, 1), x5);                                  \
+    x1 = V_SUB(x1, V_SRAI(x3, 1));                                  \
+    x5 = V_MULT(SBC_COS_PI_SUR_4, x5);                              \
+    temp = x1;                                                      \
+    x1 = V_ADD(x1, x5);                                             \
+    x5 = V_SUB(temp, x5);                                           \
+    x3 = V_SUB(x3, x7);                                             \
+    x7 = V_MULT(SBC_COS_PI_SUR_4, V_SLLI(x7, 1));                   \
+    temp = x3;                                                      \
+    x3 = V_MULT(SBC_COS_PI_SUR_8, V_ADD(x3, x7));                   \
+    x7 = V_MULT(SBC_COS_3PI_SUR_8, V_SUB(temp, x7));                \
+    odd0 = V_MULT(SBC_COS_PI_SUR_16, V_ADD(x1, x3));                \
+    odd1 = V_MULT(SBC_COS_3PI_SUR_16, V_ADD(x5, x7));               \
+    odd2 = V_MULT(SBC_COS_5PI_SUR_16, V_SUB(x5, x7));               \
+    odd3 = V_MULT(SBC_COS_7PI_SUR_16, V_SUB(x1, x3));               \
+    out[0] = V_ADD(even0, odd0);                                    \
+    out[1] = V_ADD(even1, odd1);                                    \
+    out[2] = V_ADD(even2, odd2);                                    \
+    out[3] = V_ADD(even3, odd3);                                    \
+    out[7] = V_SUB(even0, odd0);                                    \
+    out[6] = V_SUB(even1, odd1);                                    \
+    out[5] = V_SUB(even2, odd2);                                    \
+    out[4] = V_SUB(even3, odd3);                                    \
+}
+
+#if (SBC_SIMD_X86 == TRUE)
+
+/* window coefficients of tap 2p and 2p+1 interleaved for pmaddwd, tap 5 is zero */
+static SINT16 as16Window4Pairs[3][16] __attribute__((aligned(32)));
+static SINT16 as16Window8Pairs[3][32] __attribute__((aligned(32)));
+/* same for AVX2, where unpack works on 128 bit lanes: outputs 0-3 & 8-11, then 4-7 & 12-15 */
+static SINT16 as16Window8PairsAvx2[3][32] __attribute__((aligned(32)));
+
+/* filled once at load time, before any encoder can read them */
+__attribute__((constructor)) static void SbcSimdInitTables(void)
+{
+    int p, i, k;
+    for (p = 0; p < 3; p++)
+    {
+        for (i = 0; i < 16; i++)
+        {
+            for (k = 0; k < 2; k++)
+            {
+                SINT16 s16Coeff4 = (2*p+k < 5 && i < 8) ? gas16AnalysisWindow4[2*p+k][i] : 0;
+                SINT16 s16Coeff8 = (2*p+k < 5) ? gas16AnalysisWindow8[2*p+k][i] : 0;
+                if (i < 8)
+                {
+                    as16Window4Pairs[p][2*i+k] = s16Coeff4;
+                }
+                as16Window8Pairs[p][2*i+k] = s16Coeff8;
+                /* output i goes to lane (i & 3) + 4 * ((i >> 3) & 1) of vector (i >> 2) & 1 */
+                as16Window8PairsAvx2[p][32/2 * ((i >> 2) & 1) + 2 * ((i & 3) + 4 * (i >> 3)) + k] = s16Coeff8;
+            }
+        }
+    }
+}
+
+/*************************** SSE2 ***************************/
+
+SBC_TARGET_SSE2 static inline __m128i SbcMult_SSE2(__m128i x, __m128i c)
+{
+    /* c * (x >> 16) * 2 + c * bit 15 of x + (c * (x & 0x7fff)) >> 15 */
+    __m128i r = _mm_slli_epi32(_mm_madd_epi16(_mm_srai_epi32(x, 16), c), 1);
+    r = _mm_add_epi32(r, _mm_and_si128(_mm_srai_epi32(_mm_slli_epi32(x, 16), 31), c));
+    return _mm_add_epi32(r, _mm_srli_epi32(_mm_madd_epi16(_mm_and_si128(x, _mm_set1_epi32(0x7fff)), c), 15));
+}
+
+#define SBC_TRANSPOSE4_SSE2(r0, r1, r2, r3)                         \
+{                                                                   \
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1);                        \
+    __m128i t1 = _mm_unpacklo_epi32(r2, r3);                        \
+    __m128i t2 = _mm_unpackhi_epi32(r0, r1);                        \
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3);                        \
+    r0 = _mm_unpacklo_epi64(t0, t1);                                \
+    r1 = _mm_unpackhi_epi64(t0, t1);                                \
+    r2 = _mm_unpacklo_epi64(t2, t3);                                \
+    r3 = _mm_unpackhi_epi64(t2, t3);                                \
+}
+
+SBC_TARGET_SSE2 static void SbcWindow4_SSE2(const SINT16 *ps16X, SINT32 *ps32DCTY)
+{
+    const __m128i *pCoeff = (const __m128i *) as16Window4Pairs;
+    __m128i a, b, lo, hi;
+
+    a  = _mm_loadu_si128((const __m128i *) &ps16X[0]);
+    b  = _mm_loadu_si128((const __m128i *) &ps16X[8]);
+    lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pCoeff[0]);
+    hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pCoeff[1]);
+    a  = _mm_loadu_si128((const __m128i *) &ps16X[16]);
+    b  = _mm_loadu_si128((const __m128i *) &ps16X[24]);
+    lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pCoeff[2]));
+    hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pCoeff[3]));
+    a  = _mm_loadu_si128((const __m128i *) &ps16X[32]);
+    b  = _mm_setzero_si128();
+    lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pCoeff[4]));
+    hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pCoeff[5]));
+    _mm_storeu_si128((__m128i *) &ps32DCTY[0], lo);
+    _mm_storeu_si128((__m128i *) &ps32DCTY[4], hi);
+}
+
+SBC_TARGET_SSE2 static void SbcWindow8_SSE2(const SINT16 *ps16X, SINT32 *ps32DCTY)
+{
+    const __m128i *pCoeff = (const __m128i *) as16Window8Pairs;
+    __m128i a, b, lo, hi;
+    int h;
+
+    for (h = 0; h < 2; h++)
+    {
+        a  = _mm_loadu_si128((const __m128i *) &ps16X[8*h]);
+        b  = _mm_loadu_si128((const __m128i *) &ps16X[8*h + 16]);
+        lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pCoeff[2*h]);
+        hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pCoeff[2*h + 1]);
+        a  = _mm_loadu_si128((const __m128i *) &ps16X[8*h + 32]);
+        b  = _mm_loadu_si128((const __m128i *) &ps16X[8*h + 48]);
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pCoeff[4 + 2*h]));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pCoeff[4 + 2*h + 1]));
+        a  = _mm_loadu_si128((const __m128i *) &ps16X[8*h + 64]);
+        b  = _mm_setzero_si128();
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pCoeff[8 + 2*h]));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pCoeff[8 + 2*h + 1]));
+        _mm_storeu_si128((__m128i *) &ps32DCTY[8*h], lo);
+        _mm_storeu_si128((__m128i *) &ps32DCTY[8*h + 4], hi);
+    }
+}
+
+#define VEC             __m128i
+#define V_ADD(a, b)     _mm_add_epi32(a, b)
+#define V_SUB(a, b)     _mm_sub_epi32(a, b)
+#define V_SRAI(a, n)    _mm_srai_epi32(a, n)
+#define V_SLLI(a, n)    _mm_slli_epi32(a, n)
+#define V_MULT(c, a)    SbcMult_SSE2(a, _mm_set1_epi32(c))
+
+SBC_TARGET_SSE2 static void SbcFastIDCT8_SSE2(const SINT32 *ps32In, SINT32 *ps32Out, SINT32 s32Count)
+{
+    __m128i in[16], out[8];
+    SINT32 n;
+    int g;
+
+    for (n = 0; n + 4 <= s32Count; n += 4)
+    {
+        for (g = 0; g < 4; g++)
+        {
+            in[4*g]   = _mm_loadu_si128((const __m128i *) &ps32In[(n+0)*16 + 4*g]);
+            in[4*g+1] = _mm_loadu_si128((const __m128i *) &ps32In[(n+1)*16 + 4*g]);
+            in[4*g+2] = _mm_loadu_si128((const __m128i *) &ps32In[(n+2)*16 + 4*g]);
+            in[4*g+3] = _mm_loadu_si128((const __m128i *) &ps32In[(n+3)*16 + 4*g]);
+            SBC_TRANSPOSE4_SSE2(in[4*g], in[4*g+1], in[4*g+2], in[4*g+3]);
+        }
+        SBC_SIMD_FAST_IDCT8(in, out);
+        for (g = 0; g < 2; g++)
+        {
+            SBC_TRANSPOSE4_SSE2(out[4*g], out[4*g+1], out[4*g+2], out[4*g+3]);
+            _mm_storeu_si128((__m128i *) &ps32Out[(n+0)*8 + 4*g], out[4*g]);
+            _mm_storeu_si128((__m128i *) &ps32Out[(n+1)*8 + 4*g], out[4*g+1]);
+            _mm_storeu_si128((__m128i *) &ps32Out[(n+2)*8 + 4*g], out[4*g+2]);
+            _mm_storeu_si128((__m128i *) &ps32Out[(n+3)*8 + 4*g], out[4*g+3]);
+        }
+    }
+    for (; n < s32Count; n++)
+    {
+        SBC_FastIDCT8((SINT32 *) &ps32In[n*16], &ps32Out[n*8]);
+    }
+}
+
+#undef VEC
+#undef V_ADD
+#undef V_SUB
+#undef V_SRAI
+#undef V_SLLI
+#undef V_MULT
+
+/*************************** AVX2 ***************************/
+
+SBC_TARGET_AVX2 static inline __m256i SbcMult_AVX2(__m256i x, __m256i c)
+{
+    __m256i r = _mm256_slli_epi32(_mm256_madd_epi16(_mm256_srai_epi32(x, 16), c), 1);
+    r = _mm256_add_epi32(r, _mm256_and_si256(_mm256_srai_epi32(_mm256_slli_epi32(x, 16), 31), c));
+    return _mm256_add_epi32(r, _mm256_srli_epi32(_mm256_madd_epi16(_mm256_and_si256(x, _mm256_set1_epi32(0x7fff)), c), 15));
+}
+
+SBC_TARGET_AVX2 static inline void SbcTranspose8_AVX2(__m256i *r)
+{
+    __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+SBC_TARGET_AVX2 static void SbcWindow8_AVX2(const SINT16 *ps16X, SINT32 *ps32DCTY)
+{
+    const __m256i *pCoeff = (const __m256i *) as16Window8PairsAvx2;
+    __m256i a, b, lo, hi;
+
+    a  = _mm256_loadu_si256((const __m256i *) &ps16X[0]);
+    b  = _mm256_loadu_si256((const __m256i *) &ps16X[16]);
+    lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), pCoeff[0]);
+    hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), pCoeff[1]);
+    a  = _mm256_loadu_si256((const __m256i *) &ps16X[32]);
+    b  = _mm256_loadu_si256((const __m256i *) &ps16X[48]);
+    lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), pCoeff[2]));
+    hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), pCoeff[3]));
+    a  = _mm256_loadu_si256((const __m256i *) &ps16X[64]);
+    b  = _mm256_setzero_si256();
+    lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), pCoeff[4]));
+    hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), pCoeff[5]));
+    _mm256_storeu_si256((__m256i *) &ps32DCTY[0], _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *) &ps32DCTY[8], _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+#define VEC             __m256i
+#define V_ADD(a, b)     _mm256_add_epi32(a, b)
+#define V_SUB(a, b)     _mm256_sub_epi32(a, b)
+#define V_SRAI(a, n)    _mm256_srai_epi32(a, n)
+#define V_SLLI(a, n)    _mm256_slli_epi32(a, n)
+#define V_MULT(c, a)    SbcMult_AVX2(a, _mm256_set1_epi32(c))
+
+SBC_TARGET_AVX2 static void SbcFastIDCT8_AVX2(const SINT32 *ps32In, SINT32 *ps32Out, SINT32 s32Count)
+{
+    __m256i in[16], out[8];
+    SINT32 n;
+    int i;
+
+    for (n = 0; n + 8 <= s32Count; n += 8)
+    {
+        for (i = 0; i < 8; i++)
+        {
+            in[i]     = _mm256_loadu_si256((const __m256i *) &ps32In[(n+i)*16]);
+            in[i + 8] = _mm256_loadu_si256((const __m256i *) &ps32In[(n+i)*16 + 8]);
+        }
+        SbcTranspose8_AVX2(&in[0]);
+        SbcTranspose8_AVX2(&in[8]);
+        SBC_SIMD_FAST_IDCT8(in, out);
+        SbcTranspose8_AVX2(out);
+        for (i = 0; i < 8; i++)
+        {
+            _mm256_storeu_si256((__m256i *) &ps32Out[(n+i)*8], out[i]);
+        }
+    }
+    SbcFastIDCT8_SSE2(&ps32In[n*16], &ps32Out[n*8], s32Count - n);
+}
+
+#undef VEC
+#undef V_ADD
+#undef V_SUB
+#undef V_SRAI
+#undef V_SLLI
+#undef V_MULT
+
+static const SBC_ENC_SIMD_FUNCTIONS strSimdSse2 = { SbcWindow4_SSE2, SbcWindow8_SSE2, SbcFastIDCT8_SSE2 };
+static const SBC_ENC_SIMD_FUNCTIONS strSimdAvx2 = { SbcWindow4_SSE2, SbcWindow8_AVX2, SbcFastIDCT8_AVX2 };
+
+#endif /* SBC_SIMD_X86 */
+
+#if (SBC_SIMD_NEON == TRUE)
+
+/*************************** NEON ***************************/
+
+static inline int32x4_t SbcMult_NEON(int32x4_t x, int32x2_t c)
+{
+    return vcombine_s32(vshrn_n_s64(vmull_s32(vget_low_s32(x), c), 15),
+                        vshrn_n_s64(vmull_s32(vget_high_s32(x), c), 15));
+}
+
+#define SBC_TRANSPOSE4_NEON(r0, r1, r2, r3)                                 \
+{                                                                           \
+    int32x4x2_t t01 = vtrnq_s32(r0, r1);                                    \
+    int32x4x2_t t23 = vtrnq_s32(r2, r3);                                    \
+    r0 = vcombine_s32(vget_low_s32(t01.val[0]),  vget_low_s32(t23.val[0])); \
+    r1 = vcombine_s32(vget_low_s32(t01.val[1]),  vget_low_s32(t23.val[1])); \
+    r2 = vcombine_s32(vget_high_s32(t01.val[0]), vget_high_s32(t23.val[0]));\
+    r3 = vcombine_s32(vget_high_s32(t01.val[1]), vget_high_s32(t23.val[1]));\
+}
+
+static void SbcWindow4_NEON(const SINT16 *ps16X, SINT32 *ps32DCTY)
+{
+    int g, k;
+    for (g = 0; g < 2; g++)
+    {
+        int32x4_t acc = vmull_s16(vld1_s16(&ps16X[4*g]), vld1_s16(&gas16AnalysisWindow4[0][4*g]));
+        for (k = 1; k < 5; k++)
+        {
+            acc = vmlal_s16(acc, vld1_s16(&ps16X[8*k + 4*g]), vld1_s16(&gas16AnalysisWindow4[k][4*g]));
+        }
+        vst1q_s32(&ps32DCTY[4*g], acc);
+    }
+}
+
+static void SbcWindow8_NEON(const SINT16 *ps16X, SINT32 *ps32DCTY)
+{
+    int g, k;
+    for (g = 0; g < 4; g++)
+    {
+        int32x4_t acc = vmull_s16(vld1_s16(&ps16X[4*g]), vld1_s16(&gas16AnalysisWindow8[0][4*g]));
+        for (k = 1; k < 5; k++)
+        {
+            acc = vmlal_s16(acc, vld1_s16(&ps16X[16*k + 4*g]), vld1_s16(&gas16AnalysisWindow8[k][4*g]));
+        }
+        vst1q_s32(&ps32DCTY[4*g], acc);
+    }
+}
+
+#define VEC             int32x4_t
+#define V_ADD(a, b)     vaddq_s32(a, b)
+#define V_SUB(a, b)     vsubq_s32(a, b)
+#define V_SRAI(a, n)    vshrq_n_s32(a, n)
+#define V_SLLI(a, n)    vshlq_n_s32(a, n)
+#define V_MULT(c, a)    SbcMult_NEON(a, vdup_n_s32(c))
+
+static void SbcFastIDCT8_NEON(const SINT32 *ps32In, SINT32 *ps32Out, SINT32 s32Count)
+{
+    int32x4_t in[16], out[8];
+    SINT32 n;
+    int g;
+
+    for (n = 0; n + 4 <= s32Count; n += 4)
+    {
+        for (g = 0; g < 4; g++)
+        {
+            in[4*g]   = vld1q_s32(&ps32In[(n+0)*16 + 4*g]);
+            in[4*g+1] = vld1q_s32(&ps32In[(n+1)*16 + 4*g]);
+            in[4*g+2] = vld1q_s32(&ps32In[(n+2)*16 + 4*g]);
+            in[4*g+3] = vld1q_s32(&ps32In[(n+3)*16 + 4*g]);
+            SBC_TRANSPOSE4_NEON(in[4*g], in[4*g+1], in[4*g+2], in[4*g+3]);
+        }
+        SBC_SIMD_FAST_IDCT8(in, out);
+        for (g = 0; g < 2; g++)
+        {
+            SBC_TRANSPOSE4_NEON(out[4*g], out[4*g+1], out[4*g+2], out[4*g+3]);
+            vst1q_s32(&ps32Out[(n+0)*8 + 4*g], out[4*g]);
+            vst1q_s32(&ps32Out[(n+1)*8 + 4*g], out[4*g+1]);
+            vst1q_s32(&ps32Out[(n+2)*8 + 4*g], out[4*g+2]);
+            vst1q_s32(&ps32Out[(n+3)*8 + 4*g], out[4*g+3]);
+        }
+    }
+    for (; n < s32Count; n++)
+    {
+        SBC_FastIDCT8((SINT32 *) &ps32In[n*16], &ps32Out[n*8]);
+    }
+}
+
+#undef VEC
+#undef V_ADD
+#undef V_SUB
+#undef V_SRAI
+#undef V_SLLI
+#undef V_MULT
+
+static const SBC_ENC_SIMD_FUNCTIONS strSimdNeon = { SbcWindow4_NEON, SbcWindow8_NEON, SbcFastIDCT8_NEON };
+
+#endif /* SBC_SIMD_NEON */
+
+const SBC_ENC_SIMD_FUNCTIONS *SbcSimdGetFunctions(UINT8 u8Simd)
+{
+    switch (u8Simd)
+    {
+#if (SBC_SIMD_X86 == TRUE)
+    case SBC_ENC_SIMD_SSE2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("sse2")) break;
+        return &strSimdSse2;
+    case SBC_ENC_SIMD_AVX2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2")) break;
+        return &strSimdAvx2;
+#endif
+#if (SBC_SIMD_NEON == TRUE)
+    case SBC_ENC_SIMD_NEON:
+        return &strSimdNeon;
+#endif
+    default:
+        break;
+    }
+    return NULL;
+}
+
+#endif /* SBC_SIMD_OPT */
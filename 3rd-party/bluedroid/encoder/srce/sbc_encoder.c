@@ -26,7 +26,9 @@
 #include "sbc_encoder.h"
 #include "sbc_enc_func_declare.h"
 
-SINT16 EncMaxShiftCounter;
+/* BK4BTSTACK_CHANGE START */
+/* EncMaxShiftCounter moved to SBC_ENC_PARAMS.s16MaxShiftCounter */
+/* BK4BTSTACK_CHANGE END */
 
 /*************************************************************************************************
  * SBC encoder scramble code
@@ -108,10 +110,9 @@ tSBC_PRTC_CB sbc_prtc_cb;
     if(idx > 0){if((idx&1)&&(pstrEncParams->u16PacketLength > (sbc_prtc_cb.base+(idx<<1)))) {tmp2=idx<<1; tmp=ar[idx];ar[idx]=ar[tmp2];ar[tmp2]=tmp;} \
                 else{tmp2=ar[idx]; tmp=(tmp2>>5)+(tmp2<<3);ar[idx]=(UINT8)tmp;}}}
 
-#if (SBC_JOINT_STE_INCLUDED == TRUE)
-SINT32   s32LRDiff[SBC_MAX_NUM_OF_BLOCKS]    = {0};
-SINT32   s32LRSum[SBC_MAX_NUM_OF_BLOCKS]     = {0};
-#endif
+/* BK4BTSTACK_CHANGE START */
+/* s32LRDiff and s32LRSum are locals of SBC_Encoder */
+/* BK4BTSTACK_CHANGE END */
 
 void SBC_Encoder(SBC_ENC_PARAMS *pstrEncParams)
 {
@@ -128,6 +129,10 @@ void SBC_Encoder(SBC_ENC_PARAMS *pstrEncParams)
     SINT32 s32MaxValue2;
     UINT32 u32CountSum,u32CountDiff;
     SINT32 *pSum, *pDiff;
+    /* BK4BTSTACK_CHANGE START */
+    SINT32 s32LRDiff[SBC_MAX_NUM_OF_BLOCKS];
+    SINT32 s32LRSum[SBC_MAX_NUM_OF_BLOCKS];
+    /* BK4BTSTACK_CHANGE END */
 #endif
     /* BK4BTSTACK_CHANGE START */
     // UINT8  *pu8;
@@ -393,23 +398,26 @@ void SBC_Encoder_Init(SBC_ENC_PARAMS *pstrEncParams)
     if (pstrEncParams->s16NumOfSubBands==4)
     {
         if (pstrEncParams->s16NumOfChannels==1)
-            EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-4*10)>>2)<<2;
+            pstrEncParams->s16MaxShiftCounter=((ENC_VX_BUFFER_SIZE-4*10)>>2)<<2;
         else
-            EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-4*10*2)>>3)<<2;
+            pstrEncParams->s16MaxShiftCounter=((ENC_VX_BUFFER_SIZE-4*10*2)>>3)<<2;
     }
     else
     {
         if (pstrEncParams->s16NumOfChannels==1)
-            EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-8*10)>>3)<<3;
+            pstrEncParams->s16MaxShiftCounter=((ENC_VX_BUFFER_SIZE-8*10)>>3)<<3;
         else
-            EncMaxShiftCounter=((ENC_VX_BUFFER_SIZE-8*10*2)>>4)<<3;
+            pstrEncParams->s16MaxShiftCounter=((ENC_VX_BUFFER_SIZE-8*10*2)>>4)<<3;
     }
 
     // APPL_TRACE_EVENT("SBC_Encoder_Init : bitrate %d, bitpool %d",
     //         pstrEncParams->u16BitRate, pstrEncParams->s16BitPool);
 
-    SbcAnalysisInit();
+    /* BK4BTSTACK_CHANGE START */
+    SbcAnalysisInit(pstrEncParams);
 
-    memset(&sbc_prtc_cb, 0, sizeof(tSBC_PRTC_CB));
-    sbc_prtc_cb.base = 6 + pstrEncParams->s16NumOfChannels*pstrEncParams->s16NumOfSubBands/2;
+    /* scrambling is disabled in SBC_Encoder, don't touch global scramble state to allow multiple encoder instances */
+    // memset(&sbc_prtc_cb, 0, sizeof(tSBC_PRTC_CB));
+    // sbc_prtc_cb.base = 6 + pstrEncParams->s16NumOfChannels*pstrEncParams->s16NumOfSubBands/2;
+    /* BK4BTSTACK_CHANGE END */
 }
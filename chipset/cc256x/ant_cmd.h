@@ -157,6 +157,8 @@ extern const hci_cmd_t btstack_get_state;
 } ant_cmd_t;
 
 uint16_t ant_create_cmd(uint8_t *hci_cmd_buffer, const ant_cmd_t *cmd, ...);
+
+// @returns 0 if ok, BTSTACK_ACL_BUFFERS_FULL if no outgoing packet buffer is available, see hci_send_cmd_packet
 int ant_send_cmd(const ant_cmd_t *cmd, ...);
 
 const ant_cmd_t ant_reset;
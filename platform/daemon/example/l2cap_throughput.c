@@ -64,6 +64,14 @@ void update_packet(void){
     big_endian_store_32( packet, 0, counter++);
 }
 
+void send_packets(uint16_t local_cid){
+	// use all credits handed out by BTdaemon
+	while (bt_can_send_l2cap(local_cid)){
+		update_packet();
+		bt_send_l2cap(local_cid, packet, PACKET_SIZE);
+	}
+}
+
 void prepare_packet(void){
     int i;
     counter = 0;
@@ -178,10 +186,9 @@ void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint
 					
 				case DAEMON_EVENT_L2CAP_CREDITS:
 					if (!serverMode) {
-						// can send! (assuming single credits are handet out)
-						update_packet();
+						// can send!
 						local_cid = little_endian_read_16(packet, 2);
-						bt_send_l2cap( local_cid, packet, PACKET_SIZE); 
+						send_packets(local_cid);
 					}
 				    break;
 				    	
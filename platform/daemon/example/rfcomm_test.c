@@ -124,8 +124,10 @@ void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint
                     break;
 
                 case DAEMON_EVENT_RFCOMM_CREDITS:
-                    sprintf((char*)test_data, "\n\r\n\r-> %09u <- ", counter++);
-                    bt_send_rfcomm(rfcomm_channel_id, test_data, mtu);
+                    while (bt_can_send_rfcomm(rfcomm_channel_id)){
+                        sprintf((char*)test_data, "\n\r\n\r-> %09u <- ", counter++);
+                        bt_send_rfcomm(rfcomm_channel_id, test_data, mtu);
+                    }
                     break;
                     
 				case HCI_EVENT_PIN_CODE_REQUEST:
@@ -54,12 +54,23 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 // static uint8_t hci_cmd_buffer[3+255]; // HCI Command Header + max payload
 static uint8_t hci_cmd_buffer[HCI_ACL_BUFFER_SIZE]; // BTstack command packets are not size restricted
 
 static connection_t *btstack_connection = NULL;
 
+// credits received from BTdaemon for L2CAP and RFCOMM channels
+typedef struct {
+    btstack_linked_item_t item;
+    uint16_t cid;
+    uint16_t credits;
+} channel_credits_t;
+
+static btstack_linked_list_t l2cap_credits = NULL;
+static btstack_linked_list_t rfcomm_credits = NULL;
+
 /** prototypes & dummy functions */
 static void dummy_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){};
 
@@ -76,8 +87,65 @@ void bt_use_tcp(const char * address, uint16_t port){
     daemon_tcp_port    = port;
 }
 
+static channel_credits_t * channel_credits_for_cid(btstack_linked_list_t * list, uint16_t cid){
+    btstack_linked_item_t *it;
+    for (it = (btstack_linked_item_t *) *list; it ; it = it->next){
+        channel_credits_t * item = (channel_credits_t *) it;
+        if (item->cid == cid) return item;
+    }
+    return NULL;
+}
+
+static void channel_credits_add(btstack_linked_list_t * list, uint16_t cid, uint8_t credits){
+    channel_credits_t * item = channel_credits_for_cid(list, cid);
+    if (!item){
+        item = calloc(sizeof(channel_credits_t), 1);
+        if (!item) return;
+        item->cid = cid;
+        btstack_linked_list_add(list, (btstack_linked_item_t *) item);
+    }
+    item->credits += credits;
+}
+
+static void channel_credits_remove(btstack_linked_list_t * list, uint16_t cid){
+    channel_credits_t * item = channel_credits_for_cid(list, cid);
+    if (!item) return;
+    btstack_linked_list_remove(list, (btstack_linked_item_t *) item);
+    free(item);
+}
+
+static int channel_credits_get(btstack_linked_list_t * list, uint16_t cid){
+    channel_credits_t * item = channel_credits_for_cid(list, cid);
+    if (!item) return 0;
+    return item->credits;
+}
+
+static void channel_credits_use(btstack_linked_list_t * list, uint16_t cid){
+    channel_credits_t * item = channel_credits_for_cid(list, cid);
+    if (!item || !item->credits) return;
+    item->credits--;
+}
+
 static int socket_packet_handler(connection_t *connection, uint16_t packet_type, uint16_t channel, uint8_t *data, uint16_t size){
     // log_info("BTstack client handler: packet type %u, data[0] %x", packet_type, data[0]);
+    if (packet_type == HCI_EVENT_PACKET){
+        switch (hci_event_packet_get_type(data)){
+            case DAEMON_EVENT_L2CAP_CREDITS:
+                channel_credits_add(&l2cap_credits, little_endian_read_16(data, 2), data[4]);
+                break;
+            case DAEMON_EVENT_RFCOMM_CREDITS:
+                channel_credits_add(&rfcomm_credits, little_endian_read_16(data, 2), data[4]);
+                break;
+            case L2CAP_EVENT_CHANNEL_CLOSED:
+                channel_credits_remove(&l2cap_credits, l2cap_event_channel_closed_get_local_cid(data));
+                break;
+            case RFCOMM_EVENT_CHANNEL_CLOSED:
+                channel_credits_remove(&rfcomm_credits, rfcomm_event_channel_closed_get_rfcomm_cid(data));
+                break;
+            default:
+                break;
+        }
+    }
     (*client_packet_handler)(packet_type, channel, data, size);
     return 0;
 }
@@ -94,6 +162,12 @@ int bt_open(void){
         btstack_connection = socket_connection_open_tcp(daemon_tcp_address,daemon_tcp_port);
     } else {
         btstack_connection = socket_connection_open_unix();
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+        // exchange packets via shared memory, fall back to socket if not supported
+        if (btstack_connection){
+            socket_connection_enable_shared_memory(btstack_connection);
+        }
+#endif
     }
     if (!btstack_connection) return -1;
 
@@ -123,15 +197,25 @@ btstack_packet_handler_t bt_register_packet_handler(btstack_packet_handler_t han
 }
 
 void bt_send_l2cap(uint16_t source_cid, uint8_t *data, uint16_t len){
+    channel_credits_use(&l2cap_credits, source_cid);
     // send
     socket_connection_send_packet(btstack_connection, L2CAP_DATA_PACKET, source_cid, data, len);
 }
 
 void bt_send_rfcomm(uint16_t rfcomm_cid, uint8_t *data, uint16_t len){
+    channel_credits_use(&rfcomm_credits, rfcomm_cid);
     // send
     socket_connection_send_packet(btstack_connection, RFCOMM_DATA_PACKET, rfcomm_cid, data, len);
 }
 
+int bt_can_send_l2cap(uint16_t local_cid){
+    return channel_credits_get(&l2cap_credits, local_cid);
+}
+
+int bt_can_send_rfcomm(uint16_t rfcomm_cid){
+    return channel_credits_get(&rfcomm_credits, rfcomm_cid);
+}
+
 void bt_send_acl(uint8_t * data, uint16_t len){
     // send
     socket_connection_send_packet(btstack_connection, HCI_ACL_DATA_PACKET, 0, data, len);
@@ -92,9 +92,14 @@ btstack_packet_handler_t bt_register_packet_handler(btstack_packet_handler_t han
 
 void bt_send_acl(uint8_t * data, uint16_t len);
 
+// packets that cannot be sent, e.g. exceed the MTU, are dropped and reported with DAEMON_EVENT_L2CAP_SEND_FAILED / DAEMON_EVENT_RFCOMM_SEND_FAILED
 void bt_send_l2cap(uint16_t local_cid, uint8_t *data, uint16_t len);
 void bt_send_rfcomm(uint16_t rfcom_cid, uint8_t *data, uint16_t len);
 
+// number of packets that can be sent on channel, based on DAEMON_EVENT_L2CAP_CREDITS / DAEMON_EVENT_RFCOMM_CREDITS
+int bt_can_send_l2cap(uint16_t local_cid);
+int bt_can_send_rfcomm(uint16_t rfcomm_cid);
+
 #if defined __cplusplus
 }
 #endif
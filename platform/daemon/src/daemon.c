@@ -63,6 +63,9 @@
 #include "btstack_linked_list.h"
 #include "btstack_run_loop.h"
 #include "btstack_run_loop_posix.h"
+#ifdef HAVE_EPOLL
+#include "btstack_run_loop_epoll.h"
+#endif
 #include "btstack_version.h"
 #include "classic/btstack_link_key_db.h"
 #include "classic/rfcomm.h"
@@ -111,6 +114,11 @@ const btstack_link_key_db_t * btstack_link_key_db_fs_instance(void);
 
 #define DAEMON_NO_ACTIVE_CLIENT_TIMEOUT 10000
 
+// clients get credits for the free ACL slots of a channel plus this number of packets buffered by the daemon
+#ifndef DAEMON_CLIENT_BUFFERED_CREDITS
+#define DAEMON_CLIENT_BUFFERED_CREDITS 2
+#endif
+
 #define ATT_MAX_LONG_ATTRIBUTE_SIZE 512
 
 
@@ -151,6 +159,14 @@ typedef struct btstack_linked_list_uint32 {
     uint32_t        value;
 } btstack_linked_list_uint32_t;
 
+typedef struct daemon_channel_credits {
+    btstack_linked_item_t   item;
+    connection_t          * connection;
+    hci_con_handle_t        con_handle;
+    uint16_t                cid;
+    uint8_t                 credits;    // handed out to client but not used yet
+} daemon_channel_credits_t;
+
 typedef struct btstack_linked_list_connection {
     btstack_linked_item_t   item;
     connection_t  * connection;
@@ -218,60 +234,106 @@ static void * sdp_client_query_connection;
     
 static int loggingEnabled;
 
-// stashed code from l2cap.c and rfcomm.c -- needed for new implementation
-#if 0
-static void l2cap_emit_credits(l2cap_channel_t *channel, uint8_t credits) {
-    
-    log_info("DAEMON_EVENT_L2CAP_CREDITS local_cid 0x%x credits %u", channel->local_cid, credits);
-    
-    uint8_t event[5];
-    event[0] = DAEMON_EVENT_L2CAP_CREDITS;
-    event[1] = sizeof(event) - 2;
-    little_endian_store_16(event, 2, channel->local_cid);
-    event[4] = credits;
-    hci_dump_packet( HCI_EVENT_PACKET, 0, event, sizeof(event));
-    l2cap_dispatch(channel, HCI_EVENT_PACKET, event, sizeof(event));
+// credits handed out to clients for their L2CAP and RFCOMM channels
+static btstack_linked_list_t l2cap_channel_credits = NULL;
+static btstack_linked_list_t rfcomm_channel_credits = NULL;
+
+static daemon_channel_credits_t * daemon_channel_credits_for_cid(btstack_linked_list_t * list, uint16_t cid){
+    btstack_linked_list_iterator_t it;
+    btstack_linked_list_iterator_init(&it, list);
+    while (btstack_linked_list_iterator_has_next(&it)){
+        daemon_channel_credits_t * item = (daemon_channel_credits_t *) btstack_linked_list_iterator_next(&it);
+        if (item->cid == cid) return item;
+    }
+    return NULL;
 }
 
-static void l2cap_hand_out_credits(void){
-    btstack_linked_list_iterator_t it;    
-    btstack_linked_list_iterator_init(&it, &l2cap_channels);
+static void daemon_channel_credits_add(btstack_linked_list_t * list, connection_t * connection, uint16_t cid, hci_con_handle_t con_handle){
+    if (daemon_channel_credits_for_cid(list, cid)) return;
+    daemon_channel_credits_t * item = calloc(sizeof(daemon_channel_credits_t), 1);
+    if (!item) return;
+    item->connection = connection;
+    item->cid        = cid;
+    item->con_handle = con_handle;
+    btstack_linked_list_add(list, (btstack_linked_item_t *) item);
+}
+
+static void daemon_channel_credits_remove(btstack_linked_list_t * list, uint16_t cid){
+    daemon_channel_credits_t * item = daemon_channel_credits_for_cid(list, cid);
+    if (!item) return;
+    btstack_linked_list_remove(list, (btstack_linked_item_t *) item);
+    free(item);
+}
+
+static void daemon_channel_credits_remove_connection(btstack_linked_list_t * list, connection_t * connection){
+    btstack_linked_list_iterator_t it;
+    btstack_linked_list_iterator_init(&it, list);
     while (btstack_linked_list_iterator_has_next(&it)){
-        l2cap_channel_t * channel = (l2cap_channel_t *) btstack_linked_list_iterator_next(&it);
-        if (channel->state != L2CAP_STATE_OPEN) continue;
-        if (!hci_number_free_acl_slots_for_handle(channel->handle)) return;
-        l2cap_emit_credits(channel, 1);
+        daemon_channel_credits_t * item = (daemon_channel_credits_t *) btstack_linked_list_iterator_next(&it);
+        if (item->connection != connection) continue;
+        btstack_linked_list_iterator_remove(&it);
+        free(item);
     }
 }
-static void rfcomm_emit_credits(rfcomm_channel_t * channel, uint8_t credits) {
-    log_info("DAEMON_EVENT_RFCOMM_CREDITS cid 0x%02x credits %u", channel->rfcomm_cid, credits);
+
+static void daemon_channel_credits_used(btstack_linked_list_t * list, uint16_t cid){
+    daemon_channel_credits_t * item = daemon_channel_credits_for_cid(list, cid);
+    if (!item || !item->credits) return;
+    item->credits--;
+}
+
+static void daemon_emit_credits(daemon_channel_credits_t * item, uint8_t event_type, uint8_t credits){
+    log_info("DAEMON_EVENT_%s_CREDITS cid 0x%02x credits %u", event_type == DAEMON_EVENT_L2CAP_CREDITS ? "L2CAP" : "RFCOMM", item->cid, credits);
     uint8_t event[5];
-    event[0] = DAEMON_EVENT_RFCOMM_CREDITS;
+    event[0] = event_type;
     event[1] = sizeof(event) - 2;
-    little_endian_store_16(event, 2, channel->rfcomm_cid);
+    little_endian_store_16(event, 2, item->cid);
     event[4] = credits;
     hci_dump_packet(HCI_EVENT_PACKET, 0, event, sizeof(event));
-    (*app_packet_handler)(HCI_EVENT_PACKET, 0, (uint8_t *) event, sizeof(event));
+    socket_connection_send_packet(item->connection, HCI_EVENT_PACKET, 0, event, sizeof(event));
+}
+
+// top up credits of client to window size once half of them have been used
+static void daemon_channel_credits_top_up(daemon_channel_credits_t * item, uint8_t event_type, int window){
+    if (socket_connection_is_congested(item->connection)) return;
+    if (window > 255) {
+        window = 255;
+    }
+    if (item->credits * 2 > window) return;
+    if (item->credits >= window) return;
+    uint8_t credits = window - item->credits;
+    item->credits += credits;
+    daemon_emit_credits(item, event_type, credits);
+}
+
+static void l2cap_hand_out_credits(void){
+    btstack_linked_list_iterator_t it;
+    btstack_linked_list_iterator_init(&it, &l2cap_channel_credits);
+    while (btstack_linked_list_iterator_has_next(&it)){
+        daemon_channel_credits_t * item = (daemon_channel_credits_t *) btstack_linked_list_iterator_next(&it);
+        int window = hci_number_free_acl_slots_for_handle(item->con_handle) + DAEMON_CLIENT_BUFFERED_CREDITS;
+        daemon_channel_credits_top_up(item, DAEMON_EVENT_L2CAP_CREDITS, window);
+    }
 }
+
 static void rfcomm_hand_out_credits(void){
-    btstack_linked_item_t * it;
-    for (it = (btstack_linked_item_t *) rfcomm_channels; it ; it = it->next){
-        rfcomm_channel_t * channel = (rfcomm_channel_t *) it;
-        if (channel->state != RFCOMM_CHANNEL_OPEN) {
-            // log_info("DAEMON_EVENT_RFCOMM_CREDITS: multiplexer not open");
-            continue;
-        }
-        if (!channel->credits_outgoing) {
-            // log_info("DAEMON_EVENT_RFCOMM_CREDITS: no outgoing credits");
-            continue;
+    btstack_linked_list_iterator_t it;
+    btstack_linked_list_iterator_init(&it, &rfcomm_channel_credits);
+    while (btstack_linked_list_iterator_has_next(&it)){
+        daemon_channel_credits_t * item = (daemon_channel_credits_t *) btstack_linked_list_iterator_next(&it);
+        // no ACL slots can be used without RFCOMM credits from remote
+        int window = DAEMON_CLIENT_BUFFERED_CREDITS;
+        if (rfcomm_can_send_packet_now(item->cid)){
+            window += hci_number_free_acl_slots_for_handle(item->con_handle);
         }
-        // channel open, multiplexer has l2cap credits and we didn't hand out credit before -> go!
-        // log_info("DAEMON_EVENT_RFCOMM_CREDITS: 1");
-        rfcomm_emit_credits(channel, 1);
-    }        
+        daemon_channel_credits_top_up(item, DAEMON_EVENT_RFCOMM_CREDITS, window);
+    }
 }
 
-#endif
+static void daemon_hand_out_credits(void){
+    l2cap_hand_out_credits();
+    rfcomm_hand_out_credits();
+}
 
 static void dummy_bluetooth_status_handler(BLUETOOTH_STATE state){
     log_info("Bluetooth status: %u\n", state);
@@ -676,6 +738,8 @@ static void daemon_disconnect_client(connection_t * connection){
     daemon_sdp_close_connection(client);
     daemon_rfcomm_close_connection(client);
     daemon_l2cap_close_connection(client);
+    daemon_channel_credits_remove_connection(&l2cap_channel_credits, connection);
+    daemon_channel_credits_remove_connection(&rfcomm_channel_credits, connection);
 #ifdef ENABLE_BLE
     // NOTE: experimental - disconnect all LE connections where GATT Client was used
     // gatt_client_disconnect_connection(connection);
@@ -726,6 +790,16 @@ static void send_l2cap_connection_open_failed(connection_t * connection, bd_addr
     socket_connection_send_packet(connection, HCI_EVENT_PACKET, 0, event, sizeof(event));
 }
 
+static void daemon_emit_send_failed(connection_t * connection, uint8_t event_type, uint16_t cid, uint8_t status){
+    uint8_t event[5];
+    event[0] = event_type;
+    event[1] = sizeof(event) - 2;
+    event[2] = status;
+    little_endian_store_16(event, 3, cid);
+    hci_dump_packet( HCI_EVENT_PACKET, 0, event, sizeof(event));
+    socket_connection_send_packet(connection, HCI_EVENT_PACKET, 0, event, sizeof(event));
+}
+
 static void l2cap_emit_service_registered(void *connection, uint8_t status, uint16_t psm){
     uint8_t event[5];
     event[0] = DAEMON_EVENT_L2CAP_SERVICE_REGISTERED;
@@ -1311,8 +1385,8 @@ static int daemon_client_handler(connection_t *connection, uint16_t packet_type,
     switch (packet_type){
         case HCI_COMMAND_DATA_PACKET:
             if (READ_CMD_OGF(data) != OGF_BTSTACK) { 
-                // HCI Command
-                hci_send_cmd_packet(data, length);
+                // HCI Command, BTSTACK_ACL_BUFFERS_FULL parks connection until outgoing packet buffer is available
+                err = hci_send_cmd_packet(data, length);
             } else {
                 // BTstack command
                 btstack_command_handler(connection, data, length);
@@ -1321,10 +1395,39 @@ static int daemon_client_handler(connection_t *connection, uint16_t packet_type,
         case L2CAP_DATA_PACKET:
             // process l2cap packet...
             err = l2cap_send(channel, data, length);
+            // BTSTACK_ACL_BUFFERS_FULL parks connection until outgoing packet buffer is available
+            if (err == BTSTACK_ACL_BUFFERS_FULL) break;
+            if (err){
+                // retry would fail again, drop packet
+                log_error("l2cap_send cid 0x%02x failed with 0x%02x, dropping packet", channel, err);
+                daemon_emit_send_failed(connection, DAEMON_EVENT_L2CAP_SEND_FAILED, channel, err);
+                err = 0;
+            }
+            daemon_channel_credits_used(&l2cap_channel_credits, channel);
+            l2cap_hand_out_credits();
             break;
         case RFCOMM_DATA_PACKET:
             // process l2cap packet...
             err = rfcomm_send(channel, data, length);
+            switch (err){
+                case 0:
+                    break;
+                case BTSTACK_ACL_BUFFERS_FULL:
+                case RFCOMM_NO_OUTGOING_CREDITS:
+                case RFCOMM_AGGREGATE_FLOW_OFF:
+                    // park connection and get notified when remote provides credits
+                    rfcomm_request_can_send_now_event(channel);
+                    break;
+                default:
+                    // retry would fail again, drop packet
+                    log_error("rfcomm_send cid 0x%02x failed with 0x%02x, dropping packet", channel, err);
+                    daemon_emit_send_failed(connection, DAEMON_EVENT_RFCOMM_SEND_FAILED, channel, err);
+                    err = 0;
+                    break;
+            }
+            if (err) break;
+            daemon_channel_credits_used(&rfcomm_channel_credits, channel);
+            rfcomm_hand_out_credits();
             break;
         case DAEMON_EVENT_PACKET:
             switch (data[0]) {
@@ -1440,6 +1543,14 @@ static void daemon_retry_parked(void){
     retry_mutex = 0;
 }
 
+static void daemon_flow_control_handler(connection_t * connection, int congested){
+    log_info("daemon_flow_control_handler: connection %p %s", connection, congested ? "congested" : "drained");
+    if (congested) return;
+    // client can receive again -> give parked clients a chance to send and hand out credits
+    daemon_retry_parked();
+    daemon_hand_out_credits();
+}
+
 #if 0
 
 Minimal Code for LE Peripheral
@@ -1511,9 +1622,16 @@ static void daemon_packet_handler(void * connection, uint8_t packet_type, uint16
                 case HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS:
                     // ACL buffer freed...
                     daemon_retry_parked();
+                    daemon_hand_out_credits();
                     // no need to tell clients
                     return;
 
+                case HCI_EVENT_TRANSPORT_PACKET_SENT:
+                    // transport ready for next packet
+                    daemon_retry_parked();
+                    daemon_hand_out_credits();
+                    break;
+
                 case HCI_EVENT_REMOTE_NAME_REQUEST_COMPLETE:
                     if (!btstack_device_name_db) break;
                     if (packet[2]) break; // status not ok
@@ -1562,18 +1680,30 @@ static void daemon_packet_handler(void * connection, uint8_t packet_type, uint16
                     daemon_retry_parked();
                     break;
                 
+                case RFCOMM_EVENT_CAN_SEND_NOW:
+                    // remote provided credits
+                    daemon_retry_parked();
+                    rfcomm_hand_out_credits();
+                    return;
+
                 case RFCOMM_EVENT_CHANNEL_OPENED:
-                    cid = little_endian_read_16(packet, 13);
+                    cid = rfcomm_event_channel_opened_get_rfcomm_cid(packet);
                     connection = connection_for_rfcomm_cid(cid);
                     if (!connection) break;
                     if (packet[2]) {
                         daemon_remove_client_rfcomm_channel(connection, cid);
                     } else {
                         daemon_add_client_rfcomm_channel(connection, cid);
+                        daemon_channel_credits_add(&rfcomm_channel_credits, connection, cid, rfcomm_event_channel_opened_get_con_handle(packet));
+                        // forward event before first credits
+                        daemon_emit_packet(connection, packet_type, channel, packet, size);
+                        rfcomm_hand_out_credits();
+                        return;
                     }
                     break;
                 case RFCOMM_EVENT_CHANNEL_CLOSED:
                     cid = little_endian_read_16(packet, 2);
+                    daemon_channel_credits_remove(&rfcomm_channel_credits, cid);
                     connection = connection_for_rfcomm_cid(cid);
                     if (!connection) break;
                     daemon_remove_client_rfcomm_channel(connection, cid);
@@ -1590,10 +1720,16 @@ static void daemon_packet_handler(void * connection, uint8_t packet_type, uint16
                         daemon_remove_client_l2cap_channel(connection, cid);
                     } else {
                         daemon_add_client_l2cap_channel(connection, cid);
+                        daemon_channel_credits_add(&l2cap_channel_credits, connection, cid, l2cap_event_channel_opened_get_handle(packet));
+                        // forward event before first credits
+                        daemon_emit_packet(connection, packet_type, channel, packet, size);
+                        l2cap_hand_out_credits();
+                        return;
                     }
                     break;
                 case L2CAP_EVENT_CHANNEL_CLOSED:
                     cid = little_endian_read_16(packet, 2);
+                    daemon_channel_credits_remove(&l2cap_channel_credits, cid);
                     connection = connection_for_l2cap_cid(cid);
                     if (!connection) break;
                     daemon_remove_client_l2cap_channel(connection, cid);
@@ -1614,7 +1750,7 @@ static void daemon_packet_handler(void * connection, uint8_t packet_type, uint16
             if (!connection) return;
             break;
         case RFCOMM_DATA_PACKET:        
-            connection = connection_for_l2cap_cid(channel);
+            connection = connection_for_rfcomm_cid(channel);
             if (!connection) return;
             break;
         default:
@@ -2016,7 +2152,11 @@ int main (int argc,  char * const * argv){
     btstack_device_name_db = BTSTACK_DEVICE_NAME_DB_INSTANCE();
 #endif
 
+#ifdef HAVE_EPOLL
+    btstack_run_loop_init(btstack_run_loop_epoll_get_instance());
+#else
     btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+#endif
     
     // init power management notifications
     if (control && control->register_for_power_notifications){
@@ -2098,6 +2238,7 @@ int main (int argc,  char * const * argv){
     }
 #endif
     socket_connection_register_packet_callback(&daemon_client_handler);
+    socket_connection_register_flow_control_callback(&daemon_flow_control_handler);
         
 #ifdef HAVE_PLATFORM_IPHONE_OS 
     // notify daemons
@@ -44,13 +44,19 @@
  *
  */
 
+// ENABLE_DAEMON_SHARED_MEMORY is set in btstack_config.h, which must not include system headers
+#include "btstack_config.h"
+
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+// memfd_create, file seals
+#define _GNU_SOURCE
+#endif
+
 #include "socket_connection.h"
 
 #include "hci.h"
 #include "btstack_debug.h"
 
-#include "btstack_config.h"
-
 #include "btstack.h"
 #include "btstack_client.h"
  
@@ -68,8 +74,14 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #endif
+
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#endif
  
 #ifdef _WIN32
 #include "Winsock2.h"
@@ -84,6 +96,22 @@ struct sockaddr_un {
 //
 #define S_IRWXG 0
 #define S_IRWXO 0
+//
+struct iovec {
+    void * iov_base;
+    size_t iov_len;
+};
+static int writev(int fd, const struct iovec * iov, int iovcnt){
+    int total = 0;
+    int i;
+    for (i = 0; i < iovcnt; i++){
+        int res = send(fd, iov[i].iov_base, iov[i].iov_len, 0);
+        if (res < 0) return total ? total : res;
+        total += res;
+        if ((size_t) res < iov[i].iov_len) break;
+    }
+    return total;
+}
 #endif
 
 #ifdef USE_LAUNCHD
@@ -92,9 +120,77 @@ struct sockaddr_un {
 
 #define MAX_PENDING_CONNECTIONS 10
 
+// outgoing packets are queued per connection and sent when the socket becomes writable
+#ifndef SOCKET_CONNECTION_SEND_BUFFER_SIZE
+#define SOCKET_CONNECTION_SEND_BUFFER_SIZE 16384
+#endif
+
+// connection is congested above high watermark until drained below low watermark
+#ifndef SOCKET_CONNECTION_SEND_BUFFER_HIGH_WATERMARK
+#define SOCKET_CONNECTION_SEND_BUFFER_HIGH_WATERMARK (SOCKET_CONNECTION_SEND_BUFFER_SIZE * 3 / 4)
+#endif
+#ifndef SOCKET_CONNECTION_SEND_BUFFER_LOW_WATERMARK
+#define SOCKET_CONNECTION_SEND_BUFFER_LOW_WATERMARK  (SOCKET_CONNECTION_SEND_BUFFER_SIZE / 4)
+#endif
+
+#if SOCKET_CONNECTION_SEND_BUFFER_LOW_WATERMARK >= SOCKET_CONNECTION_SEND_BUFFER_HIGH_WATERMARK
+#error "SOCKET_CONNECTION_SEND_BUFFER_LOW_WATERMARK must be below SOCKET_CONNECTION_SEND_BUFFER_HIGH_WATERMARK"
+#endif
+#if SOCKET_CONNECTION_SEND_BUFFER_HIGH_WATERMARK > SOCKET_CONNECTION_SEND_BUFFER_SIZE
+#error "SOCKET_CONNECTION_SEND_BUFFER_HIGH_WATERMARK must not exceed SOCKET_CONNECTION_SEND_BUFFER_SIZE"
+#endif
+
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+
+// size of each of the two rings in the shared memory region, power of two
+#ifndef SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE
+#define SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE 65536
+#endif
+
+#if (SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE & (SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE - 1)) != 0
+#error "SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE must be a power of two"
+#endif
+#if SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE < (6 + HCI_ACL_BUFFER_SIZE)
+#error "SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE must hold at least one packet of 6 + HCI_ACL_BUFFER_SIZE bytes"
+#endif
+
+// control packets between socket_connection instances, not passed to packet handler
+#define SOCKET_CONNECTION_SHARED_MEMORY_REQUEST  0xff00
+#define SOCKET_CONNECTION_SHARED_MEMORY_RESPONSE 0xff01
+
+// request carries memfd, doorbell of daemon and doorbell of client
+#define SOCKET_CONNECTION_SHARED_MEMORY_NUM_FDS  3
+
+/**
+ * single producer, single consumer byte stream ring in shared memory
+ * head and tail are free running and live on separate cache lines
+ * a waiting flag is set by a side before it goes to sleep, the other side then rings its doorbell
+ */
+typedef struct {
+    volatile uint32_t head;               // written by consumer
+    volatile uint32_t consumer_waiting;
+    uint8_t  padding_consumer[56];
+    volatile uint32_t tail;               // written by producer
+    volatile uint32_t producer_waiting;
+    uint8_t  padding_producer[56];
+} shared_memory_ring_t;
+
+// region: ring client->daemon, ring daemon->client, data client->daemon, data daemon->client
+#define SOCKET_CONNECTION_SHARED_MEMORY_REGION_SIZE (2 * sizeof(shared_memory_ring_t) + 2 * SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE)
+
+typedef enum {
+    SHARED_MEMORY_IDLE,
+    SHARED_MEMORY_W4_RESPONSE,
+    SHARED_MEMORY_ACTIVE
+} SHARED_MEMORY_STATE;
+
+#endif
+
 /** prototypes */
 static void socket_connection_hci_process(btstack_data_source_t *ds, btstack_data_source_callback_type_t callback_type);
 static int socket_connection_dummy_handler(connection_t *connection, uint16_t packet_type, uint16_t channel, uint8_t *data, uint16_t length);
+static void socket_connection_dummy_flow_control_handler(connection_t *connection, int congested);
+static int  socket_connection_dispatch(connection_t *conn, uint16_t length);
 
 /** globals */
 
@@ -116,13 +212,44 @@ typedef struct linked_connection {
     connection_t * connection;
 } linked_connection_t;
 
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+typedef struct doorbell_data_source {
+    btstack_data_source_t ds;
+    connection_t * connection;
+} doorbell_data_source_t;
+#endif
+
 struct connection {
     btstack_data_source_t ds;                // used for run loop
     linked_connection_t linked_connection;   // used for connection list
+    linked_connection_t parked_connection;   // used for parked list
     SOCKET_STATE state;
     uint16_t bytes_read;
     uint16_t bytes_to_read;
+    uint8_t  parked;
+    uint8_t  congested;
+    uint8_t  disconnecting;
+    uint8_t  is_client;     // connection to BTdaemon, keeps reading while congested to not deadlock with daemon
     uint8_t  buffer[6+HCI_ACL_BUFFER_SIZE]; // packet_header(6) + max packet: 3-DH5 = header(6) + payload (1021)
+    // outgoing ring buffer, first send_socket_len bytes go to socket, rest to shared memory
+    uint32_t send_pos;
+    uint32_t send_len;
+    uint32_t send_socket_len;
+    uint8_t  send_buffer[SOCKET_CONNECTION_SEND_BUFFER_SIZE];
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+    SHARED_MEMORY_STATE shm_state;
+    uint8_t  shm_tx_blocked;
+    uint8_t * shm_region;
+    shared_memory_ring_t * shm_tx;
+    uint8_t * shm_tx_data;
+    shared_memory_ring_t * shm_rx;
+    uint8_t * shm_rx_data;
+    int shm_doorbell_remote_fd;
+    doorbell_data_source_t shm_doorbell;
+    // file descriptors received with socket data
+    int received_fds[SOCKET_CONNECTION_SHARED_MEMORY_NUM_FDS];
+    int num_received_fds;
+#endif
 };
 
 /** list of socket connections */
@@ -138,12 +265,437 @@ static int socket_connection_dummy_handler(connection_t *connection, uint16_t pa
     return 0;
 }
 
+/** flow control handler */
+
+static void (*socket_connection_flow_control_callback)(connection_t *connection, int congested) = socket_connection_dummy_flow_control_handler;
+
+static void socket_connection_dummy_flow_control_handler(connection_t *connection, int congested){
+}
+
+// read from client unless parked or congested, write to client if data is queued
+static int socket_connection_read_blocked(connection_t *conn){
+    if (conn->disconnecting) return 0;
+    return conn->parked || (conn->congested && !conn->is_client);
+}
+
+static void socket_connection_update_callbacks(connection_t *conn){
+    if (socket_connection_read_blocked(conn)){
+        btstack_run_loop_disable_data_source_callbacks(&conn->ds, DATA_SOURCE_CALLBACK_READ);
+    } else {
+        btstack_run_loop_enable_data_source_callbacks(&conn->ds, DATA_SOURCE_CALLBACK_READ);
+    }
+    int can_flush = conn->send_socket_len > 0;
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+    // socket write readiness is also used to move queued data into shared memory on next run loop iteration
+    if (conn->shm_state == SHARED_MEMORY_ACTIVE && conn->send_len && !conn->shm_tx_blocked){
+        can_flush = 1;
+    }
+#endif
+    if (can_flush){
+        btstack_run_loop_enable_data_source_callbacks(&conn->ds, DATA_SOURCE_CALLBACK_WRITE);
+    } else {
+        btstack_run_loop_disable_data_source_callbacks(&conn->ds, DATA_SOURCE_CALLBACK_WRITE);
+    }
+}
+
+static void socket_connection_store_bytes(connection_t *conn, const uint8_t *data, uint32_t len){
+    uint32_t pos = (conn->send_pos + conn->send_len) % SOCKET_CONNECTION_SEND_BUFFER_SIZE;
+    uint32_t bytes_till_end = SOCKET_CONNECTION_SEND_BUFFER_SIZE - pos;
+    if (len <= bytes_till_end){
+        memcpy(&conn->send_buffer[pos], data, len);
+    } else {
+        memcpy(&conn->send_buffer[pos], data, bytes_till_end);
+        memcpy(&conn->send_buffer[0], &data[bytes_till_end], len - bytes_till_end);
+    }
+    conn->send_len += len;
+}
+
+static void socket_connection_consume_bytes(connection_t *conn, uint32_t len){
+    conn->send_pos  = (conn->send_pos + len) % SOCKET_CONNECTION_SEND_BUFFER_SIZE;
+    conn->send_len -= len;
+}
+
+/**
+ * close connection instead of losing packets, e.g. if client does not keep up
+ * queued data is discarded, connection gets freed by read handler on next run loop iteration
+ */
+static void socket_connection_disconnect(connection_t *conn){
+    if (conn->disconnecting) return;
+    log_error("socket_connection_disconnect: closing connection %p", conn);
+    conn->disconnecting = 1;
+    conn->send_pos = 0;
+    conn->send_len = 0;
+    conn->send_socket_len = 0;
+#ifdef _WIN32
+    shutdown(conn->ds.fd, SD_BOTH);
+#else
+    shutdown(conn->ds.fd, SHUT_RDWR);
+#endif
+    socket_connection_update_callbacks(conn);
+}
+
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+
+static void socket_connection_shared_memory_ring_doorbell(int fd){
+    uint64_t value = 1;
+    if (write(fd, &value, sizeof(value)) < 0){
+        log_error("socket_connection_shared_memory_ring_doorbell: write failed (%s)", strerror(errno));
+    }
+}
+
+static void socket_connection_shared_memory_kick(connection_t *conn){
+    if (conn->shm_state != SHARED_MEMORY_ACTIVE) return;
+    // let run loop call doorbell handler to continue reading
+    socket_connection_shared_memory_ring_doorbell(conn->shm_doorbell.ds.fd);
+}
+
+/**
+ * move queued data into shared memory ring
+ */
+static void socket_connection_shared_memory_flush(connection_t *conn){
+    shared_memory_ring_t * ring = conn->shm_tx;
+    while (conn->send_len){
+        uint32_t tail = ring->tail;
+        __sync_synchronize();
+        uint32_t free_space = SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE - (tail - ring->head);
+        if (free_space == 0){
+            // ask consumer for doorbell, check again to not miss it
+            ring->producer_waiting = 1;
+            __sync_synchronize();
+            if (tail - ring->head < SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE) {
+                ring->producer_waiting = 0;
+                continue;
+            }
+            conn->shm_tx_blocked = 1;
+            break;
+        }
+        uint32_t len = btstack_min(free_space, conn->send_len);
+        uint32_t ring_pos = tail & (SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE - 1);
+        uint32_t copied = 0;
+        while (copied < len){
+            uint32_t chunk = len - copied;
+            uint32_t src_pos = (conn->send_pos + copied) % SOCKET_CONNECTION_SEND_BUFFER_SIZE;
+            uint32_t dst_pos = (ring_pos + copied) & (SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE - 1);
+            chunk = btstack_min(chunk, SOCKET_CONNECTION_SEND_BUFFER_SIZE - src_pos);
+            chunk = btstack_min(chunk, SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE - dst_pos);
+            memcpy(&conn->shm_tx_data[dst_pos], &conn->send_buffer[src_pos], chunk);
+            copied += chunk;
+        }
+        // publish data, then check if consumer went to sleep
+        __sync_synchronize();
+        ring->tail = tail + len;
+        __sync_synchronize();
+        if (ring->consumer_waiting){
+            ring->consumer_waiting = 0;
+            socket_connection_shared_memory_ring_doorbell(conn->shm_doorbell_remote_fd);
+        }
+        socket_connection_consume_bytes(conn, len);
+    }
+}
+#endif
+
+/**
+ * send as much of the queued data as the socket accepts without blocking
+ */
+static void socket_connection_flush(connection_t *conn){
+    while (conn->send_socket_len){
+        struct iovec iov[2];
+        int iovcnt = 1;
+        uint32_t bytes_till_end = SOCKET_CONNECTION_SEND_BUFFER_SIZE - conn->send_pos;
+        iov[0].iov_base = &conn->send_buffer[conn->send_pos];
+        iov[0].iov_len  = conn->send_socket_len;
+        if (conn->send_socket_len > bytes_till_end){
+            iov[0].iov_len  = bytes_till_end;
+            iov[1].iov_base = &conn->send_buffer[0];
+            iov[1].iov_len  = conn->send_socket_len - bytes_till_end;
+            iovcnt = 2;
+        }
+        int bytes_written = writev(conn->ds.fd, iov, iovcnt);
+        if (bytes_written < 0){
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            // connection broken
+            log_error("socket_connection_flush: write failed (%s)", strerror(errno));
+            socket_connection_disconnect(conn);
+            return;
+        }
+        socket_connection_consume_bytes(conn, bytes_written);
+        conn->send_socket_len -= bytes_written;
+    }
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+    if (conn->send_socket_len == 0 && conn->shm_state == SHARED_MEMORY_ACTIVE){
+        socket_connection_shared_memory_flush(conn);
+    }
+#endif
+    if (conn->send_len == 0){
+        conn->send_pos = 0;
+    }
+    if (conn->congested && conn->send_len <= SOCKET_CONNECTION_SEND_BUFFER_LOW_WATERMARK){
+        log_info("socket_connection_flush: connection %p drained", conn);
+        conn->congested = 0;
+        socket_connection_update_callbacks(conn);
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+        socket_connection_shared_memory_kick(conn);
+#endif
+        (*socket_connection_flow_control_callback)(conn, 0);
+        return;
+    }
+    socket_connection_update_callbacks(conn);
+}
+
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+
+static void socket_connection_shared_memory_read(connection_t *conn, uint32_t pos, uint8_t *buffer, uint32_t len){
+    pos &= SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE - 1;
+    uint32_t bytes_till_end = SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE - pos;
+    if (len <= bytes_till_end){
+        memcpy(buffer, &conn->shm_rx_data[pos], len);
+    } else {
+        memcpy(buffer, &conn->shm_rx_data[pos], bytes_till_end);
+        memcpy(&buffer[bytes_till_end], &conn->shm_rx_data[0], len - bytes_till_end);
+    }
+}
+
+/**
+ * dispatch all complete packets from shared memory ring
+ * client can modify the ring at any time, so each packet is copied into the connection buffer exactly once
+ */
+static void socket_connection_shared_memory_drain(connection_t *conn){
+    shared_memory_ring_t * ring = conn->shm_rx;
+    while (1){
+        // resumed by kick
+        if (conn->disconnecting || socket_connection_read_blocked(conn)) return;
+
+        uint32_t head = ring->head;
+        uint32_t tail = ring->tail;
+        __sync_synchronize();
+        uint32_t available = tail - head;
+        if (available >= sizeof(packet_header_t)){
+            socket_connection_shared_memory_read(conn, head, conn->buffer, sizeof(packet_header_t));
+            uint16_t length = little_endian_read_16(conn->buffer, 4);
+            uint32_t packet_size = sizeof(packet_header_t) + length;
+            if (packet_size > sizeof(conn->buffer) || available > SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE){
+                // stream is corrupt
+                log_error("socket_connection_shared_memory_drain: invalid packet size %u, available %u", (unsigned int) packet_size, (unsigned int) available);
+                socket_connection_disconnect(conn);
+                return;
+            }
+            if (available >= packet_size){
+                socket_connection_shared_memory_read(conn, head + sizeof(packet_header_t), &conn->buffer[sizeof(packet_header_t)], length);
+                socket_connection_dispatch(conn, length);
+                // release space, wake producer if it waits for it
+                __sync_synchronize();
+                ring->head = head + packet_size;
+                __sync_synchronize();
+                if (ring->producer_waiting){
+                    ring->producer_waiting = 0;
+                    socket_connection_shared_memory_ring_doorbell(conn->shm_doorbell_remote_fd);
+                }
+                continue;
+            }
+        }
+        // ask producer for doorbell, check again to not miss it
+        ring->consumer_waiting = 1;
+        __sync_synchronize();
+        if (ring->tail != tail){
+            ring->consumer_waiting = 0;
+            continue;
+        }
+        return;
+    }
+}
+
+static void socket_connection_shared_memory_doorbell_process(btstack_data_source_t *ds, btstack_data_source_callback_type_t callback_type){
+    connection_t * conn = ((doorbell_data_source_t *) ds)->connection;
+    uint64_t value;
+    if (read(ds->fd, &value, sizeof(value)) < 0 && errno != EAGAIN){
+        log_error("socket_connection_shared_memory_doorbell_process: read failed (%s)", strerror(errno));
+    }
+    if (conn->shm_tx_blocked){
+        conn->shm_tx_blocked = 0;
+        socket_connection_flush(conn);
+    }
+    socket_connection_shared_memory_drain(conn);
+}
+
+static void socket_connection_shared_memory_close_received_fds(connection_t *conn){
+    int i;
+    for (i = 0; i < conn->num_received_fds; i++){
+        close(conn->received_fds[i]);
+    }
+    conn->num_received_fds = 0;
+}
+
+static void socket_connection_shared_memory_free(connection_t *conn){
+    if (conn->shm_state == SHARED_MEMORY_ACTIVE){
+        btstack_run_loop_remove_data_source(&conn->shm_doorbell.ds);
+    }
+    if (conn->shm_doorbell.ds.fd >= 0){
+        close(conn->shm_doorbell.ds.fd);
+        conn->shm_doorbell.ds.fd = -1;
+    }
+    if (conn->shm_doorbell_remote_fd >= 0){
+        close(conn->shm_doorbell_remote_fd);
+        conn->shm_doorbell_remote_fd = -1;
+    }
+    if (conn->shm_region){
+        munmap(conn->shm_region, SOCKET_CONNECTION_SHARED_MEMORY_REGION_SIZE);
+        conn->shm_region = NULL;
+    }
+    socket_connection_shared_memory_close_received_fds(conn);
+    conn->shm_state = SHARED_MEMORY_IDLE;
+}
+
+static int socket_connection_shared_memory_setup(connection_t *conn, int memfd, int doorbell_local_fd, int doorbell_remote_fd, int is_client){
+    // region provided by client must not shrink after mmap, accessing pages beyond its end would raise SIGBUS
+    struct stat memfd_stat;
+    if (fstat(memfd, &memfd_stat) < 0 || memfd_stat.st_size < (off_t) SOCKET_CONNECTION_SHARED_MEMORY_REGION_SIZE){
+        log_error("socket_connection_shared_memory_setup: memfd too small");
+        return -1;
+    }
+    int seals = fcntl(memfd, F_GET_SEALS);
+    if (seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW)){
+        log_error("socket_connection_shared_memory_setup: memfd size not sealed");
+        return -1;
+    }
+    void * region = mmap(NULL, SOCKET_CONNECTION_SHARED_MEMORY_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (region == MAP_FAILED){
+        log_error("socket_connection_shared_memory_setup: mmap failed (%s)", strerror(errno));
+        return -1;
+    }
+    conn->shm_region = (uint8_t *) region;
+    shared_memory_ring_t * ring_to_daemon = (shared_memory_ring_t *) conn->shm_region;
+    shared_memory_ring_t * ring_to_client = ring_to_daemon + 1;
+    uint8_t * data_to_daemon = conn->shm_region + 2 * sizeof(shared_memory_ring_t);
+    uint8_t * data_to_client = data_to_daemon + SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE;
+    if (is_client){
+        conn->shm_tx = ring_to_daemon;
+        conn->shm_tx_data = data_to_daemon;
+        conn->shm_rx = ring_to_client;
+        conn->shm_rx_data = data_to_client;
+    } else {
+        conn->shm_tx = ring_to_client;
+        conn->shm_tx_data = data_to_client;
+        conn->shm_rx = ring_to_daemon;
+        conn->shm_rx_data = data_to_daemon;
+    }
+    conn->shm_tx_blocked = 0;
+    conn->shm_doorbell_remote_fd = doorbell_remote_fd;
+    conn->shm_doorbell.connection = conn;
+    btstack_run_loop_set_data_source_fd(&conn->shm_doorbell.ds, doorbell_local_fd);
+    btstack_run_loop_set_data_source_handler(&conn->shm_doorbell.ds, &socket_connection_shared_memory_doorbell_process);
+    btstack_run_loop_enable_data_source_callbacks(&conn->shm_doorbell.ds, DATA_SOURCE_CALLBACK_READ);
+    return 0;
+}
+
+static void socket_connection_shared_memory_activate(connection_t *conn){
+    log_info("socket_connection_shared_memory_activate: connection %p", conn);
+    conn->shm_state = SHARED_MEMORY_ACTIVE;
+    btstack_run_loop_add_data_source(&conn->shm_doorbell.ds);
+    // data might have been queued before doorbell was watched
+    socket_connection_shared_memory_kick(conn);
+    socket_connection_update_callbacks(conn);
+}
+
+static void socket_connection_shared_memory_handle_request(connection_t *conn, uint8_t *data, uint16_t length){
+    uint8_t status = 1;
+    if (conn->shm_state == SHARED_MEMORY_IDLE
+    && conn->num_received_fds == SOCKET_CONNECTION_SHARED_MEMORY_NUM_FDS
+    && length >= 4 && little_endian_read_32(data, 0) == SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE){
+        int memfd = conn->received_fds[0];
+        conn->num_received_fds = 0;
+        // daemon gets woken by first doorbell and rings the second one
+        if (socket_connection_shared_memory_setup(conn, memfd, conn->received_fds[1], conn->received_fds[2], 0) == 0){
+            status = 0;
+        } else {
+            close(conn->received_fds[1]);
+            close(conn->received_fds[2]);
+        }
+        close(memfd);
+    } else {
+        log_error("socket_connection_shared_memory_handle_request: invalid request, %u fds", conn->num_received_fds);
+    }
+    socket_connection_shared_memory_close_received_fds(conn);
+
+    // response is the last packet sent over the socket
+    socket_connection_send_packet(conn, SOCKET_CONNECTION_SHARED_MEMORY_RESPONSE, 0, &status, 1);
+    if (status == 0){
+        socket_connection_shared_memory_activate(conn);
+    }
+}
+
+static void socket_connection_shared_memory_handle_response(connection_t *conn, uint8_t *data, uint16_t length){
+    if (conn->shm_state != SHARED_MEMORY_W4_RESPONSE) return;
+    if (length >= 1 && data[0] == 0){
+        socket_connection_shared_memory_activate(conn);
+    } else {
+        log_info("socket_connection_shared_memory_handle_response: shared memory declined, using socket");
+        socket_connection_shared_memory_free(conn);
+        conn->send_socket_len = conn->send_len;
+        socket_connection_update_callbacks(conn);
+    }
+}
+
+static void socket_connection_shared_memory_store_fds(connection_t *conn, struct msghdr *msg){
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)){
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        int num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int i;
+        for (i = 0; i < num_fds; i++){
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (conn->num_received_fds < SOCKET_CONNECTION_SHARED_MEMORY_NUM_FDS){
+                conn->received_fds[conn->num_received_fds++] = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+}
+#endif
+
+// dispatch packet in connection buffer, length has been checked against buffer size
+// returns 1 if packet could not be dispatched and connection got parked
+static int socket_connection_dispatch(connection_t *conn, uint16_t length){
+    uint8_t * packet     = conn->buffer;
+    uint16_t packet_type = little_endian_read_16(packet, 0);
+    uint16_t channel     = little_endian_read_16(packet, 2);
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+    switch (packet_type){
+        case SOCKET_CONNECTION_SHARED_MEMORY_REQUEST:
+            socket_connection_shared_memory_handle_request(conn, &packet[sizeof(packet_header_t)], length);
+            return 0;
+        case SOCKET_CONNECTION_SHARED_MEMORY_RESPONSE:
+            socket_connection_shared_memory_handle_response(conn, &packet[sizeof(packet_header_t)], length);
+            return 0;
+        default:
+            break;
+    }
+#endif
+    // dispatch packet !!! connection, type, channel, data, size
+    int dispatch_err = (*socket_connection_packet_callback)(conn, packet_type, channel, &packet[sizeof(packet_header_t)], length);
+    if (!dispatch_err) return 0;
+
+    // "park" if dispatch failed, packet stays in buffer for retry
+    log_info("socket_connection_hci_process dispatch failed -> park connection");
+    conn->parked = 1;
+    socket_connection_update_callbacks(conn);
+    btstack_linked_list_add_tail(&parked, &conn->parked_connection.item);
+    return 1;
+}
+
 void socket_connection_free_connection(connection_t *conn){
     // remove from run_loop 
     btstack_run_loop_remove_data_source(&conn->ds);
     
-    // and from connection list
+    // and from connection and parked list
     btstack_linked_list_remove(&connections, &conn->linked_connection.item);
+    btstack_linked_list_remove(&parked, &conn->parked_connection.item);
+
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+    socket_connection_shared_memory_free(conn);
+#endif
     
     // destroy
     free(conn);
@@ -163,6 +715,29 @@ connection_t * socket_connection_register_new_connection(int fd){
 
     // store reference from linked item to base object
     conn->linked_connection.connection = conn;
+    conn->parked_connection.connection = conn;
+
+    // outgoing data is queued, don't block on write
+#ifdef _WIN32
+    u_long non_blocking = 1;
+    ioctlsocket(fd, FIONBIO, &non_blocking);
+#else
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    conn->parked    = 0;
+    conn->congested = 0;
+    conn->disconnecting = 0;
+    conn->is_client = 0;
+    conn->send_pos  = 0;
+    conn->send_len  = 0;
+    conn->send_socket_len = 0;
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+    conn->shm_state = SHARED_MEMORY_IDLE;
+    conn->shm_region = NULL;
+    conn->shm_doorbell.ds.fd = -1;
+    conn->shm_doorbell_remote_fd = -1;
+    conn->num_received_fds = 0;
+#endif
 
     btstack_run_loop_set_data_source_handler(&conn->ds, &socket_connection_hci_process);
     btstack_run_loop_set_data_source_fd(&conn->ds, fd);
@@ -194,9 +769,37 @@ void static socket_connection_emit_connection_closed(connection_t *connection){
 
 void socket_connection_hci_process(btstack_data_source_t *ds, btstack_data_source_callback_type_t callback_type) {
     connection_t *conn = (connection_t *) ds;
+
+    if (callback_type == DATA_SOURCE_CALLBACK_WRITE){
+        socket_connection_flush(conn);
+        return;
+    }
+
     int fd = btstack_run_loop_get_data_source_fd(ds);
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+    // file descriptors for shared memory are passed along with the request
+    struct iovec iov;
+    iov.iov_base = &conn->buffer[conn->bytes_read];
+    iov.iov_len  = conn->bytes_to_read;
+    union {
+        struct cmsghdr header;
+        uint8_t data[CMSG_SPACE(SOCKET_CONNECTION_SHARED_MEMORY_NUM_FDS * sizeof(int))];
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data;
+    msg.msg_controllen = sizeof(control.data);
+    int bytes_read = recvmsg(fd, &msg, 0);
+    if (bytes_read > 0){
+        socket_connection_shared_memory_store_fds(conn, &msg);
+    }
+#else
     int bytes_read = read(fd, &conn->buffer[conn->bytes_read], conn->bytes_to_read);
-    if (bytes_read <= 0){
+#endif
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) && !conn->disconnecting) return;
+    if (bytes_read <= 0 || conn->disconnecting){
         // connection broken (no particular channel, no date yet)
         socket_connection_emit_connection_closed(conn);
         
@@ -226,19 +829,9 @@ void socket_connection_hci_process(btstack_data_source_t *ds, btstack_data_sourc
     }
     
     if (dispatch){
-        // dispatch packet !!! connection, type, channel, data, size
-        int dispatch_err = (*socket_connection_packet_callback)(conn, little_endian_read_16( conn->buffer, 0), little_endian_read_16( conn->buffer, 2),
-                                                            &conn->buffer[sizeof(packet_header_t)], little_endian_read_16( conn->buffer, 4));
-        
-        // reset state machine
+        // reset state machine, packet stays in buffer if connection gets parked
         socket_connection_init_statemachine(conn);
-        
-        // "park" if dispatch failed
-        if (dispatch_err) {
-            log_info("socket_connection_hci_process dispatch failed -> park connection");
-            btstack_run_loop_remove_data_source(ds);
-            btstack_linked_list_add_tail(&parked, (btstack_linked_item_t *) ds);
-        }
+        socket_connection_dispatch(conn, little_endian_read_16(conn->buffer, 4));
     }
 }
 
@@ -251,7 +844,7 @@ void socket_connection_retry_parked(void){
     // log_info("socket_connection_hci_process retry parked");
     btstack_linked_item_t *it = (btstack_linked_item_t *) &parked;
     while (it->next) {
-        connection_t * conn = (connection_t *) it->next;
+        connection_t * conn = ((linked_connection_t *) it->next)->connection;
         
         // dispatch packet !!! connection, type, channel, data, size
         uint16_t packet_type = little_endian_read_16( conn->buffer, 0);
@@ -263,7 +856,11 @@ void socket_connection_retry_parked(void){
         if (!dispatch_err) {
             log_info("socket_connection_hci_process dispatch succeeded -> un-park connection %p", conn);
             it->next = it->next->next;
-            btstack_run_loop_add_data_source( (btstack_data_source_t *) conn);
+            conn->parked = 0;
+            socket_connection_update_callbacks(conn);
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+            socket_connection_shared_memory_kick(conn);
+#endif
         } else {
             it = it->next;
         }
@@ -499,15 +1096,54 @@ void socket_connection_register_packet_callback( int (*packet_callback)(connecti
 }
 
 /**
- * send HCI packet to single connection
+ * set handler for congestion changes of a connection
+ */
+void socket_connection_register_flow_control_callback(void (*flow_control_callback)(connection_t *connection, int congested)){
+    socket_connection_flow_control_callback = flow_control_callback;
+}
+
+/**
+ * query if outgoing queue of connection is above high watermark
+ */
+int socket_connection_is_congested(connection_t *conn){
+    if (!conn) return 0;
+    return conn->congested;
+}
+
+/**
+ * queue HCI packet for single connection
  */
 void socket_connection_send_packet(connection_t *conn, uint16_t type, uint16_t channel, uint8_t *packet, uint16_t size){
+    if (conn->disconnecting) return;
+    uint32_t total_size = sizeof(packet_header_t) + size;
+    if (total_size > SOCKET_CONNECTION_SEND_BUFFER_SIZE - conn->send_len){
+        // client did not drain queue although congested, losing packets would break its state
+        log_error("socket_connection_send_packet: send buffer full for packet type %u, channel %04x, len %u", type, channel, size);
+        socket_connection_disconnect(conn);
+        return;
+    }
     uint8_t header[sizeof(packet_header_t)];
     little_endian_store_16(header, 0, type);
     little_endian_store_16(header, 2, channel);
     little_endian_store_16(header, 4, size);
-    write(conn->ds.fd, header, 6);
-    write(conn->ds.fd, packet, size);
+    socket_connection_store_bytes(conn, header, sizeof(header));
+    socket_connection_store_bytes(conn, packet, size);
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+    // packets queued while waiting for response go through shared memory if accepted to keep them ordered
+    if (conn->shm_state == SHARED_MEMORY_IDLE)
+#endif
+    {
+        conn->send_socket_len += total_size;
+    }
+
+    if (!conn->congested && conn->send_len >= SOCKET_CONNECTION_SEND_BUFFER_HIGH_WATERMARK){
+        log_info("socket_connection_send_packet: connection %p congested", conn);
+        conn->congested = 1;
+        socket_connection_update_callbacks(conn);
+        (*socket_connection_flow_control_callback)(conn, 1);
+        return;
+    }
+    socket_connection_update_callbacks(conn);
 }
 
 /**
@@ -523,6 +1159,81 @@ void socket_connection_send_packet_all(uint16_t type, uint16_t channel, uint8_t
     }
 }
 
+/**
+ * request shared memory rings for packets to and from BTdaemon
+ */
+int socket_connection_enable_shared_memory(connection_t *conn){
+#ifdef ENABLE_DAEMON_SHARED_MEMORY
+    // request has to be first in the stream to pass file descriptors reliably
+    if (conn->shm_state != SHARED_MEMORY_IDLE || conn->send_len) return -1;
+
+    int memfd = memfd_create("btstack", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0){
+        log_error("socket_connection_enable_shared_memory: memfd_create failed (%s)", strerror(errno));
+        return -1;
+    }
+    if (ftruncate(memfd, SOCKET_CONNECTION_SHARED_MEMORY_REGION_SIZE) < 0){
+        log_error("socket_connection_enable_shared_memory: ftruncate failed (%s)", strerror(errno));
+        close(memfd);
+        return -1;
+    }
+    // daemon only accepts memfd with fixed size
+    if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0){
+        log_error("socket_connection_enable_shared_memory: sealing failed (%s)", strerror(errno));
+        close(memfd);
+        return -1;
+    }
+    int doorbell_daemon_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int doorbell_client_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (doorbell_daemon_fd < 0 || doorbell_client_fd < 0 ||
+        socket_connection_shared_memory_setup(conn, memfd, doorbell_client_fd, doorbell_daemon_fd, 1) < 0){
+        if (doorbell_daemon_fd >= 0) close(doorbell_daemon_fd);
+        if (doorbell_client_fd >= 0) close(doorbell_client_fd);
+        close(memfd);
+        return -1;
+    }
+
+    // send request with file descriptors
+    uint8_t packet[sizeof(packet_header_t) + 4];
+    little_endian_store_16(packet, 0, SOCKET_CONNECTION_SHARED_MEMORY_REQUEST);
+    little_endian_store_16(packet, 2, 0);
+    little_endian_store_16(packet, 4, 4);
+    little_endian_store_32(packet, 6, SOCKET_CONNECTION_SHARED_MEMORY_RING_SIZE);
+    int fds[SOCKET_CONNECTION_SHARED_MEMORY_NUM_FDS] = { memfd, doorbell_daemon_fd, doorbell_client_fd };
+    union {
+        struct cmsghdr header;
+        uint8_t data[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct iovec iov;
+    iov.iov_base = packet;
+    iov.iov_len  = sizeof(packet);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data;
+    msg.msg_controllen = sizeof(control.data);
+    struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    int res = sendmsg(conn->ds.fd, &msg, 0);
+    close(memfd);
+    if (res != (int) sizeof(packet)){
+        log_error("socket_connection_enable_shared_memory: sending request failed");
+        // doorbell fds are closed by free
+        socket_connection_shared_memory_free(conn);
+        return -1;
+    }
+    conn->shm_state = SHARED_MEMORY_W4_RESPONSE;
+    return 0;
+#else
+    UNUSED(conn);
+    return -1;
+#endif
+}
+
 /**
  * create socket connection to BTdaemon 
  */
@@ -549,7 +1260,11 @@ connection_t * socket_connection_open_tcp(const char *address, uint16_t port){
 		return NULL;
 	}
     
-    return socket_connection_register_new_connection(btsocket);
+    connection_t * conn = socket_connection_register_new_connection(btsocket);
+    if (conn){
+        conn->is_client = 1;
+    }
+    return conn;
 }
 
 
@@ -558,6 +1273,7 @@ connection_t * socket_connection_open_tcp(const char *address, uint16_t port){
  */
 int socket_connection_close_tcp(connection_t * connection){
     if (!connection) return -1;
+    socket_connection_flush(connection);
 #ifdef _WIN32
     shutdown(connection->ds.fd, SD_BOTH);
 #else    
@@ -586,7 +1302,11 @@ connection_t * socket_connection_open_unix(void){
         return NULL;
     };
     
-    return socket_connection_register_new_connection(btsocket);
+    connection_t * conn = socket_connection_register_new_connection(btsocket);
+    if (conn){
+        conn->is_client = 1;
+    }
+    return conn;
 }
 
 
@@ -595,6 +1315,7 @@ connection_t * socket_connection_open_unix(void){
  */
 int socket_connection_close_unix(connection_t * connection){
     if (!connection) return -1;
+    socket_connection_flush(connection);
 #ifdef _WIN32
     shutdown(connection->ds.fd, SD_BOTH);
 #else    
@@ -101,6 +101,13 @@ connection_t * socket_connection_open_unix(void);
  */
 int socket_connection_close_unix(connection_t *connection);
 
+/**
+ * request shared memory rings for packets to and from BTdaemon, requires ENABLE_DAEMON_SHARED_MEMORY
+ * must be called on a unix socket connection before sending packets. socket is used until BTdaemon accepts
+ * @return 0 if request was sent
+ */
+int socket_connection_enable_shared_memory(connection_t *connection);
+
 /**
  * set packet handler for all auto-accepted connections 
  * -- packet_callback @return: 0 == OK/NO ERROR
@@ -108,12 +115,24 @@ int socket_connection_close_unix(connection_t *connection);
 void socket_connection_register_packet_callback( int (*packet_callback)(connection_t *connection, uint16_t packet_type, uint16_t channel, uint8_t *data, uint16_t length) );
 
 /**
- * send HCI packet to single connection
+ * set handler for congestion changes of a connection
+ * -- flow_control_callback: congested == 1 if outgoing queue reached high watermark, 0 if drained below low watermark
+ */
+void socket_connection_register_flow_control_callback(void (*flow_control_callback)(connection_t *connection, int congested));
+
+/**
+ * query if outgoing queue of connection is above high watermark
+ */
+int  socket_connection_is_congested(connection_t *connection);
+
+/**
+ * queue HCI packet for single connection
+ * if the queue is full, the connection is closed instead of dropping the packet
  */
 void socket_connection_send_packet(connection_t *connection, uint16_t packet_type, uint16_t channel, uint8_t *data, uint16_t size);
 
 /**
- * send event data to all clients
+ * queue event data for all clients
  */
 void socket_connection_send_packet_all(uint16_t type, uint16_t channel, uint8_t *packet, uint16_t size);
 
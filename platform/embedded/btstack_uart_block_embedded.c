@@ -154,7 +154,9 @@ static const btstack_uart_block_t btstack_uart_embedded = {
     /* void (*receive_block)(uint8_t *buffer, uint16_t len); */       &btstack_uart_embedded_receive_block,
     /* void (*send_block)(const uint8_t *buffer, uint16_t length); */ &btstack_uart_embedded_send_block,    
     /* int (*get_supported_sleep_modes); */                           NULL,
-    /* void (*set_sleep)(btstack_uart_sleep_mode_t sleep_mode); */    NULL
+    /* void (*set_sleep)(btstack_uart_sleep_mode_t sleep_mode); */    NULL,
+    /* void (*set_bytes_received)(void (*handler)(uint16_t)); */     NULL,
+    /* void (*receive_bytes)(uint8_t *buffer, uint16_t max_len); */   NULL,
 };
 
 const btstack_uart_block_t * btstack_uart_block_embedded_instance(void){
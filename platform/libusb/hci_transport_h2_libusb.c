@@ -59,6 +59,10 @@
 
 #include <libusb.h>
 
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
 #include "btstack_config.h"
 
 #include "btstack_debug.h"
@@ -69,10 +73,31 @@
 #define HAVE_USB_VENDOR_ID_AND_PRODUCT_ID
 #endif
 
-#define ACL_IN_BUFFER_COUNT    3
+// number of transfers queued for incoming ACL packets
+#ifndef HCI_TRANSPORT_USB_ACL_IN_BUFFER_COUNT
+#define HCI_TRANSPORT_USB_ACL_IN_BUFFER_COUNT 8
+#endif
+
+// number of transfers that can be in flight for outgoing ACL packets and HCI Commands
+#ifndef HCI_TRANSPORT_USB_ACL_OUT_BUFFER_COUNT
+#define HCI_TRANSPORT_USB_ACL_OUT_BUFFER_COUNT 4
+#endif
+#ifndef HCI_TRANSPORT_USB_COMMAND_OUT_BUFFER_COUNT
+#define HCI_TRANSPORT_USB_COMMAND_OUT_BUFFER_COUNT 2
+#endif
+
+#define ACL_IN_BUFFER_COUNT      HCI_TRANSPORT_USB_ACL_IN_BUFFER_COUNT
+#define ACL_OUT_BUFFER_COUNT     HCI_TRANSPORT_USB_ACL_OUT_BUFFER_COUNT
+#define COMMAND_OUT_BUFFER_COUNT HCI_TRANSPORT_USB_COMMAND_OUT_BUFFER_COUNT
 #define EVENT_IN_BUFFER_COUNT  3
 #define SCO_IN_BUFFER_COUNT   10
 
+#define OUT_TRANSFER_COUNT (ACL_OUT_BUFFER_COUNT + COMMAND_OUT_BUFFER_COUNT)
+
+// max number of file descriptors provided by libusb for event handling
+#define USB_MAX_POLLFDS 8
+
+// used if libusb does not provide file descriptors for event handling, e.g. on Windows
 #define ASYNC_POLLING_INTERVAL_MS 1
 
 //
@@ -87,9 +112,11 @@
 // --> support only a single SCO connection
 // #define ALT_SETTING (1)
 
+#ifdef ENABLE_SCO_OVER_HCI
 // alt setting for 1-3 connections and 8/16 bit
 static const int alt_setting_8_bit[]  = {1,2,3};      
 static const int alt_setting_16_bit[] = {2,4,5};
+#endif
 
 // for ALT_SETTING >= 1 and 8-bit channel, we need the following isochronous packets
 // One complete SCO packet with 24 frames every 3 frames (== 3 ms)
@@ -149,8 +176,8 @@ static libusb_device        * dev;
 #endif
 static libusb_device_handle * handle;
 
-static struct libusb_transfer *command_out_transfer;
-static struct libusb_transfer *acl_out_transfer;
+static struct libusb_transfer *command_out_transfer[COMMAND_OUT_BUFFER_COUNT];
+static struct libusb_transfer *acl_out_transfer[ACL_OUT_BUFFER_COUNT];
 static struct libusb_transfer *event_in_transfer[EVENT_IN_BUFFER_COUNT];
 static struct libusb_transfer *acl_in_transfer[ACL_IN_BUFFER_COUNT];
 
@@ -186,7 +213,18 @@ static uint16_t iso_packet_size;
 #endif
 
 // outgoing buffer for HCI Command packets
-static uint8_t hci_cmd_buffer[3 + 256 + LIBUSB_CONTROL_SETUP_SIZE];
+static uint8_t hci_cmd_buffer[COMMAND_OUT_BUFFER_COUNT][3 + 256 + LIBUSB_CONTROL_SETUP_SIZE];
+
+#if ACL_OUT_BUFFER_COUNT > 1
+// outgoing ACL packets need to be copied, as hci.c prepares the next ACL fragment in place by overwriting the end of the previous one
+static uint8_t hci_acl_out_buffer[ACL_OUT_BUFFER_COUNT][HCI_ACL_BUFFER_SIZE];
+#endif
+
+// outgoing transfers in order of submission, HCI_EVENT_TRANSPORT_PACKET_SENT is emitted in this order
+static struct libusb_transfer *out_transfer_queue[OUT_TRANSFER_COUNT];
+static uint8_t out_transfer_queue_completed[OUT_TRANSFER_COUNT];
+static int     out_transfer_queue_head;
+static int     out_transfer_queue_len;
 
 // incoming buffer for HCI Events and ACL Packets
 static uint8_t hci_event_in_buffer[EVENT_IN_BUFFER_COUNT][HCI_ACL_BUFFER_SIZE]; // bigger than largest packet
@@ -196,13 +234,14 @@ static uint8_t hci_acl_in_buffer[ACL_IN_BUFFER_COUNT][HCI_INCOMING_PRE_BUFFER_SI
 static struct libusb_transfer *handle_packet;
 
 static int doing_pollfds;
-static int num_pollfds;
-static btstack_data_source_t * pollfd_data_sources;
+static int pollfds_handle_timeouts;
+static btstack_data_source_t pollfd_data_sources[USB_MAX_POLLFDS];
+static int pollfd_data_source_active[USB_MAX_POLLFDS];
 static btstack_timer_source_t usb_timer;
 static int usb_timer_active;
 
-static int usb_acl_out_active = 0;
-static int usb_command_active = 0;
+static int usb_acl_out_active[ACL_OUT_BUFFER_COUNT];
+static int usb_command_active[COMMAND_OUT_BUFFER_COUNT];
 
 // endpoint addresses
 static int event_in_addr;
@@ -297,6 +336,18 @@ LIBUSB_CALL static void async_callback(struct libusb_transfer *transfer){
                 return;
             }
         }
+        for (c=0;c<ACL_OUT_BUFFER_COUNT;c++){
+            if (transfer == acl_out_transfer[c]){
+                usb_acl_out_active[c] = 0;
+                return;
+            }
+        }
+        for (c=0;c<COMMAND_OUT_BUFFER_COUNT;c++){
+            if (transfer == command_out_transfer[c]){
+                usb_command_active[c] = 0;
+                return;
+            }
+        }
         return;
     }
 
@@ -419,10 +470,57 @@ static void handle_isochronous_data(uint8_t * buffer, uint16_t size){
 }
 #endif
 
+static void out_transfer_queue_add(struct libusb_transfer *transfer){
+    int index = (out_transfer_queue_head + out_transfer_queue_len) % OUT_TRANSFER_COUNT;
+    out_transfer_queue[index] = transfer;
+    out_transfer_queue_completed[index] = 0;
+    out_transfer_queue_len++;
+}
+
+static void out_transfer_release(struct libusb_transfer *transfer){
+    int c;
+    for (c=0;c<ACL_OUT_BUFFER_COUNT;c++){
+        if (transfer == acl_out_transfer[c]){
+            usb_acl_out_active[c] = 0;
+            return;
+        }
+    }
+    for (c=0;c<COMMAND_OUT_BUFFER_COUNT;c++){
+        if (transfer == command_out_transfer[c]){
+            usb_command_active[c] = 0;
+            return;
+        }
+    }
+}
+
+static void out_transfer_completed(struct libusb_transfer *transfer){
+    int i;
+    for (i=0;i<out_transfer_queue_len;i++){
+        int index = (out_transfer_queue_head + i) % OUT_TRANSFER_COUNT;
+        if (out_transfer_queue[index] == transfer){
+            out_transfer_queue_completed[index] = 1;
+            break;
+        }
+    }
+
+    // release completed transfers in order of submission
+    while (out_transfer_queue_len && out_transfer_queue_completed[out_transfer_queue_head]){
+        out_transfer_release(out_transfer_queue[out_transfer_queue_head]);
+        out_transfer_queue_head = (out_transfer_queue_head + 1) % OUT_TRANSFER_COUNT;
+        out_transfer_queue_len--;
+
+        // notify upper stack that provided buffer can be used again
+        uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
+        packet_handler(HCI_EVENT_PACKET, &event[0], sizeof(event));
+
+        // handle case where libusb_close might be called by hci packet handler
+        if (libusb_state != LIB_USB_TRANSFERS_ALLOCATED) return;
+    }
+}
+
 static void handle_completed_transfer(struct libusb_transfer *transfer){
 
     int resubmit = 0;
-    int signal_done = 0;
 
     if (transfer->endpoint == event_in_addr) {
         packet_handler(HCI_EVENT_PACKET, transfer-> buffer, transfer->actual_length);
@@ -433,12 +531,10 @@ static void handle_completed_transfer(struct libusb_transfer *transfer){
         resubmit = 1;
     } else if (transfer->endpoint == 0){
         // log_info("command done, size %u", transfer->actual_length);
-        usb_command_active = 0;
-        signal_done = 1;
+        out_transfer_completed(transfer);
     } else if (transfer->endpoint == acl_out_addr){
         // log_info("acl out done, size %u", transfer->actual_length);
-        usb_acl_out_active = 0;
-        signal_done = 1;
+        out_transfer_completed(transfer);
 #ifdef ENABLE_SCO_OVER_HCI
     } else if (transfer->endpoint == sco_in_addr) {
         // log_info("handle_completed_transfer for SCO IN! num packets %u", transfer->NUM_ISO_PACKETS);
@@ -482,12 +578,6 @@ static void handle_completed_transfer(struct libusb_transfer *transfer){
         log_info("usb_process_ds endpoint unknown %x", transfer->endpoint);
     }
 
-    if (signal_done){
-        // notify upper stack that provided buffer can be used again
-        uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
-        packet_handler(HCI_EVENT_PACKET, &event[0], sizeof(event));
-    }
-
     if (libusb_state != LIB_USB_TRANSFERS_ALLOCATED) return;
 
     if (resubmit){
@@ -528,6 +618,20 @@ static void usb_process_ds(btstack_data_source_t *ds, btstack_data_source_callba
             handle_packet = NULL;
         }
     }
+
+    // libusb needs to be called for its internal timeouts if it cannot provide a timer fd
+    if (doing_pollfds && !pollfds_handle_timeouts){
+        struct timeval tv;
+        if (usb_timer_active){
+            btstack_run_loop_remove_timer(&usb_timer);
+            usb_timer_active = 0;
+        }
+        if (libusb_get_next_timeout(NULL, &tv) == 1){
+            btstack_run_loop_set_timer(&usb_timer, tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+            btstack_run_loop_add_timer(&usb_timer);
+            usb_timer_active = 1;
+        }
+    }
     // log_info("end usb_process_ds");
 }
 
@@ -545,6 +649,9 @@ static void usb_process_ts(btstack_timer_source_t *timer) {
     // actually handled the packet in the pollfds function
     usb_process_ds((struct btstack_data_source *) NULL, DATA_SOURCE_CALLBACK_READ);
 
+    // timeout requested by libusb, see usb_process_ds
+    if (doing_pollfds) return;
+
     // Get the amount of time until next event is due
     long msec = ASYNC_POLLING_INTERVAL_MS;
 
@@ -556,6 +663,80 @@ static void usb_process_ts(btstack_timer_source_t *timer) {
     return;
 }
 
+#ifdef _WIN32
+
+// libusb does not provide file descriptors on Windows
+static int usb_pollfds_start(void){
+    return 0;
+}
+
+static void usb_pollfds_stop(void){
+}
+
+#else
+
+// libusb file descriptors, on Linux completed transfers are signaled via POLLOUT on the usbfs file descriptor
+LIBUSB_CALL static void usb_pollfd_added(int fd, short events, void * user_data){
+    UNUSED(user_data);
+    int i;
+    for (i=0;i<USB_MAX_POLLFDS;i++){
+        if (pollfd_data_source_active[i]) continue;
+        btstack_data_source_t *ds = &pollfd_data_sources[i];
+        btstack_run_loop_set_data_source_fd(ds, fd);
+        btstack_run_loop_set_data_source_handler(ds, &usb_process_ds);
+        btstack_run_loop_add_data_source(ds);
+        uint16_t callbacks = 0;
+        if (events & POLLIN)  callbacks |= DATA_SOURCE_CALLBACK_READ;
+        if (events & POLLOUT) callbacks |= DATA_SOURCE_CALLBACK_WRITE;
+        btstack_run_loop_enable_data_source_callbacks(ds, callbacks);
+        pollfd_data_source_active[i] = 1;
+        log_info("pollfd %u: fd %u, events %x", i, fd, events);
+        return;
+    }
+    log_error("usb_pollfd_added: no data source for fd %u", fd);
+}
+
+LIBUSB_CALL static void usb_pollfd_removed(int fd, void * user_data){
+    UNUSED(user_data);
+    int i;
+    for (i=0;i<USB_MAX_POLLFDS;i++){
+        if (!pollfd_data_source_active[i]) continue;
+        if (pollfd_data_sources[i].fd != fd) continue;
+        btstack_run_loop_remove_data_source(&pollfd_data_sources[i]);
+        pollfd_data_source_active[i] = 0;
+        log_info("pollfd %u: fd %u removed", i, fd);
+        return;
+    }
+}
+
+static void usb_pollfds_stop(void){
+    libusb_set_pollfd_notifiers(NULL, NULL, NULL, NULL);
+    int i;
+    for (i=0;i<USB_MAX_POLLFDS;i++){
+        if (!pollfd_data_source_active[i]) continue;
+        btstack_run_loop_remove_data_source(&pollfd_data_sources[i]);
+        pollfd_data_source_active[i] = 0;
+    }
+    doing_pollfds = 0;
+}
+
+// use file descriptors provided by libusb, returns 0 if not available
+static int usb_pollfds_start(void){
+    const struct libusb_pollfd ** pollfd = libusb_get_pollfds(NULL);
+    if (!pollfd) return 0;
+    doing_pollfds = 1;
+    pollfds_handle_timeouts = libusb_pollfds_handle_timeouts(NULL);
+    int i;
+    for (i = 0 ; pollfd[i] ; i++) {
+        usb_pollfd_added(pollfd[i]->fd, pollfd[i]->events, NULL);
+    }
+    free(pollfd);
+    libusb_set_pollfd_notifiers(NULL, &usb_pollfd_added, &usb_pollfd_removed, NULL);
+    return 1;
+}
+
+#endif
+
 #ifndef HAVE_USB_VENDOR_ID_AND_PRODUCT_ID
 
 // list of known devices, using VendorID/ProductID tuples
@@ -753,6 +934,7 @@ static int prepare_device(libusb_device_handle * aHandle){
     return 0;
 }
 
+#ifndef HAVE_USB_VENDOR_ID_AND_PRODUCT_ID
 static libusb_device_handle * try_open_device(libusb_device * device){
     int r;
 
@@ -776,6 +958,7 @@ static libusb_device_handle * try_open_device(libusb_device * device){
     }
     return dev_handle;
 }
+#endif
 
 #ifdef ENABLE_SCO_OVER_HCI
 
@@ -1027,10 +1210,24 @@ static int usb_open(void){
         }
     }
 
-    command_out_transfer = libusb_alloc_transfer(0);
-    acl_out_transfer     = libusb_alloc_transfer(0);
-
-    // TODO check for error
+    for (c = 0 ; c < COMMAND_OUT_BUFFER_COUNT ; c++) {
+        command_out_transfer[c] = libusb_alloc_transfer(0);
+        usb_command_active[c] = 0;
+        if (!command_out_transfer[c]) {
+            usb_close();
+            return LIBUSB_ERROR_NO_MEM;
+        }
+    }
+    for (c = 0 ; c < ACL_OUT_BUFFER_COUNT ; c++) {
+        acl_out_transfer[c] = libusb_alloc_transfer(0);
+        usb_acl_out_active[c] = 0;
+        if (!acl_out_transfer[c]) {
+            usb_close();
+            return LIBUSB_ERROR_NO_MEM;
+        }
+    }
+    out_transfer_queue_head = 0;
+    out_transfer_queue_len  = 0;
 
     libusb_state = LIB_USB_TRANSFERS_ALLOCATED;
 
@@ -1060,35 +1257,12 @@ static int usb_open(void){
      }
 
     // Check for pollfds functionality
-    doing_pollfds = libusb_pollfds_handle_timeouts(NULL);
-    
-    // NOTE: using pollfds doesn't work on Linux, so it is disable until further investigation here
-    doing_pollfds = 0;
-
-    if (doing_pollfds) {
-        log_info("Async using pollfds:");
-
-        const struct libusb_pollfd ** pollfd = libusb_get_pollfds(NULL);
-        for (num_pollfds = 0 ; pollfd[num_pollfds] ; num_pollfds++);
-        pollfd_data_sources = malloc(sizeof(btstack_data_source_t) * num_pollfds);
-        if (!pollfd_data_sources){
-            log_error("Cannot allocate data sources for pollfds");
-            usb_close();
-            return 1;            
-        }
-        for (r = 0 ; r < num_pollfds ; r++) {
-            btstack_data_source_t *ds = &pollfd_data_sources[r];
-            btstack_run_loop_set_data_source_fd(ds, pollfd[r]->fd);
-            btstack_run_loop_set_data_source_handler(ds, &usb_process_ds);
-            btstack_run_loop_enable_data_source_callbacks(ds, DATA_SOURCE_CALLBACK_READ);
-            btstack_run_loop_add_data_source(ds);
-            log_info("%u: %p fd: %u, events %x", r, pollfd[r], pollfd[r]->fd, pollfd[r]->events);
-        }
-        free(pollfd);
+    usb_timer.process = usb_process_ts;
+    if (usb_pollfds_start()) {
+        log_info("Async using pollfds, libusb handles timeouts %u", pollfds_handle_timeouts);
     } else {
         log_info("Async using timers:");
 
-        usb_timer.process = usb_process_ts;
         btstack_run_loop_set_timer(&usb_timer, ASYNC_POLLING_INTERVAL_MS);
         btstack_run_loop_add_timer(&usb_timer);
         usb_timer_active = 1;
@@ -1112,25 +1286,50 @@ static int usb_close(void){
             }
 
             if (doing_pollfds){
-                int r;
-                for (r = 0 ; r < num_pollfds ; r++) {
-                    btstack_data_source_t *ds = &pollfd_data_sources[r];
-                    btstack_run_loop_remove_data_source(ds);
-                }
-                free(pollfd_data_sources);
-                pollfd_data_sources = NULL;
-                num_pollfds = 0;
-                doing_pollfds = 0;
+                usb_pollfds_stop();
             }
 
         case LIB_USB_INTERFACE_CLAIMED:
+            // completed transfers that have not been processed cannot be cancelled
+            while (handle_packet){
+                struct libusb_transfer * transfer = handle_packet;
+                handle_packet = (struct libusb_transfer *) transfer->user_data;
+                for (c=0;c<EVENT_IN_BUFFER_COUNT;c++){
+                    if (transfer == event_in_transfer[c]){
+                        libusb_free_transfer(transfer);
+                        event_in_transfer[c] = 0;
+                    }
+                }
+                for (c=0;c<ACL_IN_BUFFER_COUNT;c++){
+                    if (transfer == acl_in_transfer[c]){
+                        libusb_free_transfer(transfer);
+                        acl_in_transfer[c] = 0;
+                    }
+                }
+                out_transfer_release(transfer);
+            }
+
             // Cancel all transfers, ignore warnings for this
             libusb_set_debug(NULL, LIBUSB_LOG_LEVEL_ERROR);
             for (c = 0 ; c < EVENT_IN_BUFFER_COUNT ; c++) {
-                libusb_cancel_transfer(event_in_transfer[c]);
+                if (event_in_transfer[c]){
+                    libusb_cancel_transfer(event_in_transfer[c]);
+                }
             }
             for (c = 0 ; c < ACL_IN_BUFFER_COUNT ; c++) {
-                libusb_cancel_transfer(acl_in_transfer[c]);
+                if (acl_in_transfer[c]){
+                    libusb_cancel_transfer(acl_in_transfer[c]);
+                }
+            }
+            for (c = 0 ; c < ACL_OUT_BUFFER_COUNT ; c++) {
+                if (usb_acl_out_active[c]){
+                    libusb_cancel_transfer(acl_out_transfer[c]);
+                }
+            }
+            for (c = 0 ; c < COMMAND_OUT_BUFFER_COUNT ; c++) {
+                if (usb_command_active[c]){
+                    libusb_cancel_transfer(command_out_transfer[c]);
+                }
             }
 #ifdef ENABLE_SCO_OVER_HCI
             for (c = 0 ; c < SCO_IN_BUFFER_COUNT ; c++) {
@@ -1171,6 +1370,24 @@ static int usb_close(void){
                     }
                 }
 
+                if (!completed) continue;
+
+                for (c=0;c<ACL_OUT_BUFFER_COUNT;c++){
+                    if (usb_acl_out_active[c]) {
+                        completed = 0;
+                        break;
+                    }
+                }
+
+                if (!completed) continue;
+
+                for (c=0;c<COMMAND_OUT_BUFFER_COUNT;c++){
+                    if (usb_command_active[c]) {
+                        completed = 0;
+                        break;
+                    }
+                }
+
 #ifdef ENABLE_SCO_OVER_HCI
                 if (!completed) continue;
 
@@ -1193,6 +1410,17 @@ static int usb_close(void){
 #endif
             }
 
+            // free outgoing transfers
+            for (c=0;c<ACL_OUT_BUFFER_COUNT;c++){
+                libusb_free_transfer(acl_out_transfer[c]);
+                acl_out_transfer[c] = NULL;
+            }
+            for (c=0;c<COMMAND_OUT_BUFFER_COUNT;c++){
+                libusb_free_transfer(command_out_transfer[c]);
+                command_out_transfer[c] = NULL;
+            }
+            out_transfer_queue_len = 0;
+
             // finally release interface
             libusb_release_interface(handle, 0);
 #ifdef ENABLE_SCO_OVER_HCI
@@ -1213,32 +1441,46 @@ static int usb_close(void){
     return 0;
 }
 
+// returns index of free transfer or -1
+static int usb_free_out_transfer(const int * active, int count){
+    int c;
+    for (c = 0; c < count; c++){
+        if (!active[c]) return c;
+    }
+    return -1;
+}
+
 static int usb_send_cmd_packet(uint8_t *packet, int size){
     int r;
 
     if (libusb_state != LIB_USB_TRANSFERS_ALLOCATED) return -1;
 
+    int c = usb_free_out_transfer(usb_command_active, COMMAND_OUT_BUFFER_COUNT);
+    if (c < 0 || size > (int) (sizeof(hci_cmd_buffer[0]) - LIBUSB_CONTROL_SETUP_SIZE)) {
+        log_error("usb_send_cmd_packet: no free transfer or size %u too large", size);
+        return -1;
+    }
+
     // async
-    libusb_fill_control_setup(hci_cmd_buffer, LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE, 0, 0, 0, size);
-    memcpy(hci_cmd_buffer + LIBUSB_CONTROL_SETUP_SIZE, packet, size);
+    libusb_fill_control_setup(hci_cmd_buffer[c], LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE, 0, 0, 0, size);
+    memcpy(hci_cmd_buffer[c] + LIBUSB_CONTROL_SETUP_SIZE, packet, size);
 
     // prepare transfer
-    int completed = 0;
-    libusb_fill_control_transfer(command_out_transfer, handle, hci_cmd_buffer, async_callback, &completed, 0);
-    command_out_transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+    libusb_fill_control_transfer(command_out_transfer[c], handle, hci_cmd_buffer[c], async_callback, NULL, 0);
 
     // update stata before submitting transfer
-    usb_command_active = 1;
+    usb_command_active[c] = 1;
 
     // submit transfer
-    r = libusb_submit_transfer(command_out_transfer);
+    r = libusb_submit_transfer(command_out_transfer[c]);
     
     if (r < 0) {
-        usb_command_active = 0;
+        usb_command_active[c] = 0;
         log_error("Error submitting cmd transfer %d", r);
         return -1;
     }
 
+    out_transfer_queue_add(command_out_transfer[c]);
     return 0;
 }
 
@@ -1248,32 +1490,43 @@ static int usb_send_acl_packet(uint8_t *packet, int size){
     if (libusb_state != LIB_USB_TRANSFERS_ALLOCATED) return -1;
 
     // log_info("usb_send_acl_packet enter, size %u", size);
+
+    int c = usb_free_out_transfer(usb_acl_out_active, ACL_OUT_BUFFER_COUNT);
+    if (c < 0 || size > HCI_ACL_BUFFER_SIZE) {
+        log_error("usb_send_acl_packet: no free transfer or size %u too large", size);
+        return -1;
+    }
+
+#if ACL_OUT_BUFFER_COUNT > 1
+    memcpy(hci_acl_out_buffer[c], packet, size);
+    packet = hci_acl_out_buffer[c];
+#endif
     
     // prepare transfer
-    int completed = 0;
-    libusb_fill_bulk_transfer(acl_out_transfer, handle, acl_out_addr, packet, size,
-        async_callback, &completed, 0);
-    acl_out_transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+    libusb_fill_bulk_transfer(acl_out_transfer[c], handle, acl_out_addr, packet, size,
+        async_callback, NULL, 0);
+    acl_out_transfer[c]->type = LIBUSB_TRANSFER_TYPE_BULK;
 
     // update stata before submitting transfer
-    usb_acl_out_active = 1;
+    usb_acl_out_active[c] = 1;
 
-    r = libusb_submit_transfer(acl_out_transfer);
+    r = libusb_submit_transfer(acl_out_transfer[c]);
     if (r < 0) {
-        usb_acl_out_active = 0;
+        usb_acl_out_active[c] = 0;
         log_error("Error submitting acl transfer, %d", r);
         return -1;
     }
 
+    out_transfer_queue_add(acl_out_transfer[c]);
     return 0;
 }
 
 static int usb_can_send_packet_now(uint8_t packet_type){
     switch (packet_type){
         case HCI_COMMAND_DATA_PACKET:
-            return !usb_command_active;
+            return usb_free_out_transfer(usb_command_active, COMMAND_OUT_BUFFER_COUNT) >= 0;
         case HCI_ACL_DATA_PACKET:
-            return !usb_acl_out_active;
+            return usb_free_out_transfer(usb_acl_out_active, ACL_OUT_BUFFER_COUNT) >= 0;
 #ifdef ENABLE_SCO_OVER_HCI
         case HCI_SCO_DATA_PACKET:
             return sco_ring_have_space();
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  btstack_run_loop_bridge_posix.c
+ *
+ *  Wakes up the BTstack thread via eventfd on Linux or a self-pipe otherwise.
+ *  Works with all file descriptor based run loops (posix, epoll, corefoundation).
+ */
+
+#include "btstack_run_loop_bridge_posix.h"
+#include "btstack_run_loop_bridge.h"
+#include "btstack_run_loop.h"
+#include "btstack_debug.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+static btstack_data_source_t bridge_data_source;
+static int bridge_write_fd = -1;
+
+static void btstack_run_loop_bridge_posix_trigger(void){
+#ifdef __linux__
+    uint64_t value = 1;
+#else
+    uint8_t value = 1;
+#endif
+    // EAGAIN is fine, BTstack thread will wake up anyway
+    ssize_t res = write(bridge_write_fd, &value, sizeof(value));
+    (void) res;
+}
+
+static void btstack_run_loop_bridge_posix_process(btstack_data_source_t *ds, btstack_data_source_callback_type_t callback_type){
+    uint8_t buffer[64];
+    // reset eventfd counter / drain pipe
+    while (read(ds->fd, buffer, sizeof(buffer)) > 0);
+    btstack_run_loop_bridge_process();
+}
+
+void btstack_run_loop_bridge_posix_init(void){
+    int read_fd;
+#ifdef __linux__
+    read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (read_fd < 0){
+        log_error("btstack_run_loop_bridge_posix_init: eventfd failed, errno %u", errno);
+        return;
+    }
+    bridge_write_fd = read_fd;
+#else
+    int fds[2];
+    if (pipe(fds)){
+        log_error("btstack_run_loop_bridge_posix_init: pipe failed, errno %u", errno);
+        return;
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    read_fd = fds[0];
+    bridge_write_fd = fds[1];
+#endif
+    btstack_run_loop_bridge_init(&btstack_run_loop_bridge_posix_trigger);
+
+    btstack_run_loop_set_data_source_fd(&bridge_data_source, read_fd);
+    btstack_run_loop_set_data_source_handler(&bridge_data_source, &btstack_run_loop_bridge_posix_process);
+    btstack_run_loop_enable_data_source_callbacks(&bridge_data_source, DATA_SOURCE_CALLBACK_READ);
+    btstack_run_loop_add_data_source(&bridge_data_source);
+}
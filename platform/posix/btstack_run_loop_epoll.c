@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2014 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  btstack_run_loop_epoll.c
+ *
+ *  Linux run loop based on epoll. Data sources stay registered with the
+ *  epoll instance, timers are kept in a binary min-heap.
+ */
+
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_epoll.h"
+#include "btstack_linked_list.h"
+#include "btstack_debug.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EPOLL_MAX_EVENTS 32
+#define TIMER_HEAP_INITIAL_SIZE 16
+
+static void btstack_run_loop_epoll_dump_timer(void);
+
+// the run loop
+static int epoll_fd = -1;
+static btstack_linked_list_t data_sources;
+
+// events returned by last epoll_wait, entries are cleared if data source gets removed
+static struct epoll_event events[EPOLL_MAX_EVENTS];
+static int events_count;
+
+// timer min-heap. the heap index of a queued timer is stored in its (otherwise unused) item.next field
+static btstack_timer_source_t ** timer_heap;
+static int timer_heap_size;
+static int timer_heap_count;
+
+// start time
+static struct timespec init_ts;
+
+static inline int btstack_run_loop_epoll_timeout_before(uint32_t a, uint32_t b){
+    return (int32_t)(a - b) < 0;
+}
+
+static inline int btstack_run_loop_epoll_timer_get_index(btstack_timer_source_t * ts){
+    return (int)(uintptr_t) ts->item.next - 1;
+}
+
+static inline void btstack_run_loop_epoll_timer_set_index(btstack_timer_source_t * ts, int index){
+    ts->item.next = (btstack_linked_item_t *)(uintptr_t)(index + 1);
+    timer_heap[index] = ts;
+}
+
+static int btstack_run_loop_epoll_timer_queued(btstack_timer_source_t * ts){
+    int index = btstack_run_loop_epoll_timer_get_index(ts);
+    if (index < 0 || index >= timer_heap_count) return 0;
+    return timer_heap[index] == ts;
+}
+
+static void btstack_run_loop_epoll_timer_sift_up(int index){
+    btstack_timer_source_t * ts = timer_heap[index];
+    while (index > 0){
+        int parent = (index - 1) / 2;
+        if (!btstack_run_loop_epoll_timeout_before(ts->timeout, timer_heap[parent]->timeout)) break;
+        btstack_run_loop_epoll_timer_set_index(timer_heap[parent], index);
+        index = parent;
+    }
+    btstack_run_loop_epoll_timer_set_index(ts, index);
+}
+
+static void btstack_run_loop_epoll_timer_sift_down(int index){
+    btstack_timer_source_t * ts = timer_heap[index];
+    while (1){
+        int child = 2 * index + 1;
+        if (child >= timer_heap_count) break;
+        if (child + 1 < timer_heap_count && btstack_run_loop_epoll_timeout_before(timer_heap[child+1]->timeout, timer_heap[child]->timeout)){
+            child++;
+        }
+        if (!btstack_run_loop_epoll_timeout_before(timer_heap[child]->timeout, ts->timeout)) break;
+        btstack_run_loop_epoll_timer_set_index(timer_heap[child], index);
+        index = child;
+    }
+    btstack_run_loop_epoll_timer_set_index(ts, index);
+}
+
+static uint32_t btstack_run_loop_epoll_events_for_flags(uint16_t flags){
+    uint32_t epoll_events = 0;
+    if (flags & DATA_SOURCE_CALLBACK_READ)  epoll_events |= EPOLLIN;
+    if (flags & DATA_SOURCE_CALLBACK_WRITE) epoll_events |= EPOLLOUT;
+    return epoll_events;
+}
+
+static void btstack_run_loop_epoll_register(btstack_data_source_t * ds, int op, uint32_t epoll_events){
+    if (ds->fd < 0) return;
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events   = epoll_events;
+    event.data.ptr = ds;
+    int res = epoll_ctl(epoll_fd, op, ds->fd, &event);
+    if (res == 0) return;
+    // callbacks can be enabled before data source is added
+    if (op == EPOLL_CTL_MOD && errno == ENOENT) return;
+    // data source added twice
+    if (op == EPOLL_CTL_ADD && errno == EEXIST){
+        res = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, ds->fd, &event);
+        if (res == 0) return;
+    }
+    log_error("btstack_run_loop_epoll: epoll_ctl(%u) for fd %u failed, errno %u", op, ds->fd, errno);
+}
+
+/**
+ * Add data_source to run_loop
+ */
+static void btstack_run_loop_epoll_add_data_source(btstack_data_source_t *ds){
+    btstack_linked_list_add(&data_sources, (btstack_linked_item_t *) ds);
+    btstack_run_loop_epoll_register(ds, EPOLL_CTL_ADD, btstack_run_loop_epoll_events_for_flags(ds->flags));
+}
+
+/**
+ * Remove data_source from run loop
+ */
+static int btstack_run_loop_epoll_remove_data_source(btstack_data_source_t *ds){
+    int i;
+    if (ds->fd >= 0){
+        // ignore errors, fd might have been closed already
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, ds->fd, NULL);
+    }
+    // don't deliver pending events to removed data source
+    for (i = 0; i < events_count; i++){
+        if (events[i].data.ptr == ds){
+            events[i].data.ptr = NULL;
+        }
+    }
+    return btstack_linked_list_remove(&data_sources, (btstack_linked_item_t *) ds);
+}
+
+/**
+ * Add timer to run_loop
+ */
+static void btstack_run_loop_epoll_add_timer(btstack_timer_source_t *ts){
+    if (btstack_run_loop_epoll_timer_queued(ts)){
+        log_error( "btstack_run_loop_timer_add error: timer to add already in list!");
+        return;
+    }
+    if (timer_heap_count == timer_heap_size){
+        int new_size = timer_heap_size ? timer_heap_size * 2 : TIMER_HEAP_INITIAL_SIZE;
+        btstack_timer_source_t ** new_heap = realloc(timer_heap, new_size * sizeof(btstack_timer_source_t *));
+        if (!new_heap){
+            log_error("btstack_run_loop_epoll_add_timer: cannot grow timer heap");
+            return;
+        }
+        timer_heap = new_heap;
+        timer_heap_size = new_size;
+    }
+    btstack_run_loop_epoll_timer_set_index(ts, timer_heap_count++);
+    btstack_run_loop_epoll_timer_sift_up(timer_heap_count - 1);
+    log_debug("Added timer %p at %u\n", ts, ts->timeout);
+}
+
+/**
+ * Remove timer from run loop
+ */
+static int btstack_run_loop_epoll_remove_timer(btstack_timer_source_t *ts){
+    if (!btstack_run_loop_epoll_timer_queued(ts)) return 0;
+    int index = btstack_run_loop_epoll_timer_get_index(ts);
+    ts->item.next = NULL;
+    timer_heap_count--;
+    if (index == timer_heap_count) return 1;
+    // move last timer into hole and restore heap order
+    btstack_timer_source_t * last = timer_heap[timer_heap_count];
+    btstack_run_loop_epoll_timer_set_index(last, index);
+    btstack_run_loop_epoll_timer_sift_up(index);
+    btstack_run_loop_epoll_timer_sift_down(btstack_run_loop_epoll_timer_get_index(last));
+    return 1;
+}
+
+static void btstack_run_loop_epoll_dump_timer(void){
+    int i;
+    for (i = 0; i < timer_heap_count; i++){
+        log_info("timer %u, timeout %u\n", i, timer_heap[i]->timeout);
+    }
+}
+
+static void btstack_run_loop_epoll_enable_data_source_callbacks(btstack_data_source_t * ds, uint16_t callback_types){
+    uint16_t old_flags = ds->flags;
+    ds->flags |= callback_types;
+    if (ds->flags == old_flags) return;
+    btstack_run_loop_epoll_register(ds, EPOLL_CTL_MOD, btstack_run_loop_epoll_events_for_flags(ds->flags));
+}
+
+static void btstack_run_loop_epoll_disable_data_source_callbacks(btstack_data_source_t * ds, uint16_t callback_types){
+    uint16_t old_flags = ds->flags;
+    ds->flags &= ~callback_types;
+    if (ds->flags == old_flags) return;
+    btstack_run_loop_epoll_register(ds, EPOLL_CTL_MOD, btstack_run_loop_epoll_events_for_flags(ds->flags));
+}
+
+/**
+ * @brief Queries the current time in ms since start
+ */
+static uint32_t btstack_run_loop_epoll_get_time_ms(void){
+    struct timespec now_ts;
+    clock_gettime(CLOCK_MONOTONIC, &now_ts);
+    uint32_t time_ms = (uint32_t)((now_ts.tv_sec - init_ts.tv_sec) * 1000) + (uint32_t)(now_ts.tv_nsec / 1000000);
+    log_debug("btstack_run_loop_epoll_get_time_ms: %u <- %u / %u", time_ms, (int) now_ts.tv_sec, (int) now_ts.tv_nsec);
+    return time_ms;
+}
+
+/**
+ * Execute run_loop
+ */
+static void btstack_run_loop_epoll_execute(void) {
+    btstack_timer_source_t * ts;
+    uint32_t now_ms;
+    int timeout_ms;
+    int i;
+
+    while (1) {
+        // get next timeout
+        timeout_ms = -1;
+        if (timer_heap_count) {
+            now_ms = btstack_run_loop_epoll_get_time_ms();
+            int32_t delta = (int32_t)(timer_heap[0]->timeout - now_ms);
+            if (delta < 0){
+                delta = 0;
+            }
+            timeout_ms = delta;
+            log_debug("btstack_run_loop_execute next timeout in %u ms", delta);
+        }
+
+        // wait for ready FDs
+        events_count = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, timeout_ms);
+        if (events_count < 0){
+            if (errno != EINTR){
+                log_error("btstack_run_loop_epoll_execute: epoll_wait failed, errno %u", errno);
+            }
+            events_count = 0;
+        }
+
+        for (i = 0; i < events_count; i++){
+            btstack_data_source_t *ds = (btstack_data_source_t *) events[i].data.ptr;
+            uint32_t ready = events[i].events;
+            // removed by callback of previous event
+            if (!ds) continue;
+            // report hang-up and errors as readable and writable, as select would
+            if (ready & (EPOLLHUP | EPOLLERR)){
+                if (ds->flags & (DATA_SOURCE_CALLBACK_READ | DATA_SOURCE_CALLBACK_WRITE)){
+                    ready |= EPOLLIN | EPOLLOUT;
+                } else {
+                    // not interested, mute fd until callbacks get enabled again
+                    log_info("btstack_run_loop_epoll_execute: hang-up on fd %u", ds->fd);
+                    btstack_run_loop_epoll_register(ds, EPOLL_CTL_MOD, EPOLLONESHOT);
+                    continue;
+                }
+            }
+            if ((ready & EPOLLIN) && (ds->flags & DATA_SOURCE_CALLBACK_READ)){
+                log_debug("btstack_run_loop_epoll_execute: process read ds %p with fd %u\n", ds, ds->fd);
+                ds->process(ds, DATA_SOURCE_CALLBACK_READ);
+            }
+            // data source might have been removed by read callback
+            if (!events[i].data.ptr) continue;
+            if ((ready & EPOLLOUT) && (ds->flags & DATA_SOURCE_CALLBACK_WRITE)){
+                log_debug("btstack_run_loop_epoll_execute: process write ds %p with fd %u\n", ds, ds->fd);
+                ds->process(ds, DATA_SOURCE_CALLBACK_WRITE);
+            }
+        }
+        events_count = 0;
+        log_debug("btstack_run_loop_epoll_execute: after ds check\n");
+
+        // process timers
+        now_ms = btstack_run_loop_epoll_get_time_ms();
+        while (timer_heap_count) {
+            ts = timer_heap[0];
+            if (btstack_run_loop_epoll_timeout_before(now_ms, ts->timeout)) break;
+            log_debug("btstack_run_loop_epoll_execute: process timer %p\n", ts);
+
+            // remove timer before processing it to allow handler to re-register with run loop
+            btstack_run_loop_remove_timer(ts);
+            ts->process(ts);
+        }
+    }
+}
+
+// set timer
+static void btstack_run_loop_epoll_set_timer(btstack_timer_source_t *a, uint32_t timeout_in_ms){
+    uint32_t time_ms = btstack_run_loop_epoll_get_time_ms();
+    a->timeout = time_ms + timeout_in_ms;
+    log_debug("btstack_run_loop_epoll_set_timer to %u ms (now %u, timeout %u)", a->timeout, time_ms, timeout_in_ms);
+}
+
+static void btstack_run_loop_epoll_init(void){
+    data_sources = NULL;
+    events_count = 0;
+    timer_heap_count = 0;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0){
+        log_error("btstack_run_loop_epoll_init: epoll_create1 failed, errno %u", errno);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &init_ts);
+    log_debug("btstack_run_loop_epoll_init at %u", (int) init_ts.tv_sec);
+}
+
+
+static const btstack_run_loop_t btstack_run_loop_epoll = {
+    &btstack_run_loop_epoll_init,
+    &btstack_run_loop_epoll_add_data_source,
+    &btstack_run_loop_epoll_remove_data_source,
+    &btstack_run_loop_epoll_enable_data_source_callbacks,
+    &btstack_run_loop_epoll_disable_data_source_callbacks,
+    &btstack_run_loop_epoll_set_timer,
+    &btstack_run_loop_epoll_add_timer,
+    &btstack_run_loop_epoll_remove_timer,
+    &btstack_run_loop_epoll_execute,
+    &btstack_run_loop_epoll_dump_timer,
+    &btstack_run_loop_epoll_get_time_ms,
+};
+
+/**
+ * Provide btstack_run_loop_epoll instance
+ */
+const btstack_run_loop_t * btstack_run_loop_epoll_get_instance(void){
+    return &btstack_run_loop_epoll;
+}
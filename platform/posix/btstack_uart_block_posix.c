@@ -69,10 +69,12 @@ static const uint8_t * write_bytes_data;
 // block read
 static uint16_t  read_bytes_len;
 static uint8_t * read_bytes_data;
+static int       read_bytes_partial;
 
 // callbacks
 static void (*block_sent)(void);
 static void (*block_received)(void);
+static void (*bytes_received)(uint16_t num_bytes);
 
 
 static int btstack_uart_posix_init(const btstack_uart_config_t * config){
@@ -130,7 +132,17 @@ static void btstack_uart_posix_process_read(btstack_data_source_t *ds) {
     if (end - start > 10){
         log_info("h4_process: read took %u ms", end - start);
     }
-    if (bytes_read < 0) return;
+    if (bytes_read <= 0) return;
+
+    // streaming receive: report what we got
+    if (read_bytes_partial){
+        read_bytes_len = 0;
+        btstack_run_loop_disable_data_source_callbacks(ds, DATA_SOURCE_CALLBACK_READ);
+        if (bytes_received){
+            bytes_received((uint16_t) bytes_read);
+        }
+        return;
+    }
     
     read_bytes_len   -= bytes_read;
     read_bytes_data  += bytes_read;
@@ -350,9 +362,21 @@ static void btstack_uart_posix_send_block(const uint8_t *data, uint16_t size){
     btstack_run_loop_enable_data_source_callbacks(&transport_data_source, DATA_SOURCE_CALLBACK_WRITE);
 }
 
+static void btstack_uart_posix_set_bytes_received( void (*bytes_handler)(uint16_t num_bytes)){
+    bytes_received = bytes_handler;
+}
+
+static void btstack_uart_posix_receive_bytes(uint8_t *buffer, uint16_t max_len){
+    read_bytes_data = buffer;
+    read_bytes_len = max_len;
+    read_bytes_partial = 1;
+    btstack_run_loop_enable_data_source_callbacks(&transport_data_source, DATA_SOURCE_CALLBACK_READ);
+}
+
 static void btstack_uart_posix_receive_block(uint8_t *buffer, uint16_t len){
     read_bytes_data = buffer;
     read_bytes_len = len;
+    read_bytes_partial = 0;
     btstack_run_loop_enable_data_source_callbacks(&transport_data_source, DATA_SOURCE_CALLBACK_READ);
 
     // go
@@ -375,7 +399,9 @@ static const btstack_uart_block_t btstack_uart_posix = {
     /* void (*receive_block)(uint8_t *buffer, uint16_t len); */       &btstack_uart_posix_receive_block,
     /* void (*send_block)(const uint8_t *buffer, uint16_t length); */ &btstack_uart_posix_send_block,
     /* int (*get_supported_sleep_modes); */                           NULL,
-    /* void (*set_sleep)(btstack_uart_sleep_mode_t sleep_mode); */    NULL
+    /* void (*set_sleep)(btstack_uart_sleep_mode_t sleep_mode); */    NULL,
+    /* void (*set_bytes_received)(void (*handler)(uint16_t)); */     &btstack_uart_posix_set_bytes_received,
+    /* void (*receive_bytes)(uint8_t *buffer, uint16_t max_len); */   &btstack_uart_posix_receive_bytes,
 };
 
 const btstack_uart_block_t * btstack_uart_block_posix_instance(void){
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gatt_client_cache_fs.h"
+
+#include "ble/gatt_client_cache_table.h"
+#include "btstack_debug.h"
+#include "btstack_util.h"
+
+#define DB_PATH_TEMPLATE "/tmp/btstack_at_%s_gatt_client_cache.txt"
+static const char * csv_header_devices = "# le_device_index, service_changed_handle";
+static const char * csv_header = "# le_device_index, key, results_len, results";
+static char db_path[sizeof(DB_PATH_TEMPLATE) - 2 + 17 + 1];
+
+static gatt_client_cache_table_t cache_table;
+
+static char bd_addr_to_dash_str_buffer[6*3];  // 12-45-78-01-34-67\0
+static char * bd_addr_to_dash_str(bd_addr_t addr){
+    char * p = bd_addr_to_dash_str_buffer;
+    int i;
+    for (i = 0; i < 6 ; i++) {
+        *p++ = char_for_nibble((addr[i] >> 4) & 0x0F);
+        *p++ = char_for_nibble((addr[i] >> 0) & 0x0F);
+        *p++ = '-';
+    }
+    *--p = 0;
+    return (char *) bd_addr_to_dash_str_buffer;
+}
+
+static void write_hex(FILE * wFile, const uint8_t * value, int len){
+    int i;
+    for (i = 0; i < len; i++){
+        fprintf(wFile, "%02x", value[i]);
+    }
+}
+
+static int read_hex(FILE * rFile, uint8_t * buffer, int len){
+    int i;
+    for (i = 0; i < len; i++){
+        unsigned int value;
+        if (fscanf(rFile, "%2x", &value) != 1) return 0;
+        buffer[i] = (uint8_t) value;
+    }
+    return 1;
+}
+
+static void db_store(void){
+    FILE * wFile = fopen(db_path, "w+");
+    if (wFile == NULL) return;
+    fprintf(wFile, "%s\n", csv_header_devices);
+    int i;
+    for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+        gatt_client_cache_device_t * device = &cache_table.devices[i];
+        if (device->le_device_index < 0) continue;
+        fprintf(wFile, "%d, %04x\n", device->le_device_index, device->service_changed_handle);
+    }
+    fprintf(wFile, "%s\n", csv_header);
+    for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+        gatt_client_cache_entry_t * entry = &cache_table.entries[i];
+        if (entry->le_device_index < 0) continue;
+        fprintf(wFile, "%d, ", entry->le_device_index);
+        write_hex(wFile, entry->key, GATT_CLIENT_CACHE_KEY_LEN);
+        fprintf(wFile, ", %u, ", entry->results_len);
+        write_hex(wFile, entry->results, entry->results_len);
+        fprintf(wFile, "\n");
+    }
+    fclose(wFile);
+}
+
+// @returns 0 if end of file
+static int skip_line(FILE * rFile){
+    while (1) {
+        int c = fgetc(rFile);
+        if (feof(rFile)) return 0;
+        if (c == '\n') return 1;
+    }
+}
+
+static void db_read(void){
+    FILE * rFile = fopen(db_path, "r");
+    if (rFile == NULL) return;
+    // devices header, ignore files without it
+    char header[64];
+    if (fgets(header, sizeof(header), rFile) == NULL) goto exit;
+    if (strncmp(header, csv_header_devices, strlen(csv_header_devices)) != 0) goto exit;
+    int i;
+    for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+        gatt_client_cache_device_t * device = &cache_table.devices[i];
+        int le_device_index;
+        unsigned int service_changed_handle;
+        if (fscanf(rFile, "%d, %x\n", &le_device_index, &service_changed_handle) != 2) break;
+        device->le_device_index = le_device_index;
+        device->service_changed_handle = (uint16_t) service_changed_handle;
+    }
+    // entries header
+    if (!skip_line(rFile)) goto exit;
+    for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+        gatt_client_cache_entry_t * entry = &cache_table.entries[i];
+        int le_device_index;
+        unsigned int results_len;
+        if (fscanf(rFile, "%d, ", &le_device_index) != 1) break;
+        if (!read_hex(rFile, entry->key, GATT_CLIENT_CACHE_KEY_LEN)) break;
+        if (fscanf(rFile, ", %u, ", &results_len) != 1) break;
+        if (results_len > GATT_CLIENT_CACHE_RESULTS_SIZE) break;
+        if (!read_hex(rFile, entry->results, results_len)) break;
+        entry->le_device_index = le_device_index;
+        entry->results_len = results_len;
+        entry->last_used = ++cache_table.use_counter;
+    }
+exit:
+    fclose(rFile);
+}
+
+static void db_open(void){
+    gatt_client_cache_table_init(&cache_table);
+    sprintf(db_path, DB_PATH_TEMPLATE, "00-00-00-00-00-00");
+}
+
+static void db_set_local_bd_addr(bd_addr_t bd_addr){
+    gatt_client_cache_table_init(&cache_table);
+    sprintf(db_path, DB_PATH_TEMPLATE, bd_addr_to_dash_str(bd_addr));
+    log_info("gatt_client_cache_fs: path %s", db_path);
+    db_read();
+}
+
+static void db_close(void){
+}
+
+static int get_results(int le_device_index, const uint8_t * key, uint8_t * results, uint16_t results_size, uint16_t * results_len){
+    return gatt_client_cache_table_get_results(&cache_table, le_device_index, key, results, results_size, results_len);
+}
+
+static void put_results(int le_device_index, const uint8_t * key, const uint8_t * results, uint16_t results_len){
+    if (!gatt_client_cache_table_put_results(&cache_table, le_device_index, key, results, results_len)) return;
+    db_store();
+}
+
+static void delete_device(int le_device_index){
+    gatt_client_cache_table_delete_device(&cache_table, le_device_index);
+    db_store();
+}
+
+static uint16_t get_service_changed_handle(int le_device_index){
+    return gatt_client_cache_table_get_service_changed_handle(&cache_table, le_device_index);
+}
+
+static void put_service_changed_handle(int le_device_index, uint16_t service_changed_handle){
+    if (!gatt_client_cache_table_put_service_changed_handle(&cache_table, le_device_index, service_changed_handle)) return;
+    db_store();
+}
+
+const gatt_client_cache_t gatt_client_cache_fs = {
+    db_open,
+    db_set_local_bd_addr,
+    db_close,
+    get_results,
+    put_results,
+    delete_device,
+    get_service_changed_handle,
+    put_service_changed_handle,
+};
+
+const gatt_client_cache_t * gatt_client_cache_fs_instance(void){
+    return &gatt_client_cache_fs;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  btstack_run_loop_bridge_windows.c
+ *
+ *  Wakes up the BTstack thread via an auto-reset Event object.
+ */
+
+#include "btstack_run_loop_bridge_windows.h"
+#include "btstack_run_loop_bridge.h"
+#include "btstack_run_loop.h"
+#include "btstack_debug.h"
+
+#include <Windows.h>
+
+static btstack_data_source_t bridge_data_source;
+static HANDLE bridge_event;
+
+static void btstack_run_loop_bridge_windows_trigger(void){
+    SetEvent(bridge_event);
+}
+
+static void btstack_run_loop_bridge_windows_process(btstack_data_source_t *ds, btstack_data_source_callback_type_t callback_type){
+    btstack_run_loop_bridge_process();
+}
+
+void btstack_run_loop_bridge_windows_init(void){
+    bridge_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (bridge_event == NULL){
+        log_error("btstack_run_loop_bridge_windows_init: CreateEvent failed, error %u", (int) GetLastError());
+        return;
+    }
+    btstack_run_loop_bridge_init(&btstack_run_loop_bridge_windows_trigger);
+
+    bridge_data_source.handle = bridge_event;
+    btstack_run_loop_set_data_source_handler(&bridge_data_source, &btstack_run_loop_bridge_windows_process);
+    btstack_run_loop_enable_data_source_callbacks(&bridge_data_source, DATA_SOURCE_CALLBACK_READ);
+    btstack_run_loop_add_data_source(&bridge_data_source);
+}
@@ -62,6 +62,12 @@ static uint16_t uuid16_from_uuid(uint16_t uuid_len, uint8_t * uuid){
     return little_endian_read_16(uuid, 12);
 }
 
+#ifdef ENABLE_ATT_DB_INDEX
+#ifndef MAX_NR_ATT_DB_INDEX_ENTRIES
+#define MAX_NR_ATT_DB_INDEX_ENTRIES 128
+#endif
+#endif
+
 // ATT Database
 static uint8_t const * att_db = NULL;
 static att_read_callback_t  att_read_callback  = NULL;
@@ -71,6 +77,17 @@ static uint16_t att_prepare_write_error_handle = 0x0000;
 
 static btstack_linked_list_t service_handlers;
 
+#ifdef ENABLE_ATT_DB_INDEX
+// side index of att_db, built by att_set_db
+// - offsets of all attributes in handle order
+// - attribute positions sorted by UUID, then handle
+static uint16_t att_db_index_offsets[MAX_NR_ATT_DB_INDEX_ENTRIES];
+static uint16_t att_db_index_uuid_order[MAX_NR_ATT_DB_INDEX_ENTRIES];
+static uint16_t att_db_index_count;
+static uint16_t att_db_index_end_offset;
+static int      att_db_index_valid;
+#endif
+
 // new java-style iterator
 typedef struct att_iterator {
     // private
@@ -82,17 +99,38 @@ typedef struct att_iterator {
     uint8_t  const * uuid;
     uint16_t value_len;
     uint8_t  const * value;
+#ifdef ENABLE_ATT_DB_INDEX
+    // only return attributes with given UUID if uuid_pos >= 0
+    int      uuid_pos;
+    uint8_t  const * filter_uuid;
+    uint16_t filter_uuid_len;
+#endif
 } att_iterator_t;
 
 static void att_iterator_init(att_iterator_t *it){
     it->att_ptr = att_db;
+#ifdef ENABLE_ATT_DB_INDEX
+    it->uuid_pos = -1;
+#endif
 }
 
 static int att_iterator_has_next(att_iterator_t *it){
     return it->att_ptr != NULL;
 }
 
+static int att_iterator_match_uuid(att_iterator_t *it, uint8_t *uuid, uint16_t uuid_len);
+
 static void att_iterator_fetch_next(att_iterator_t *it){
+#ifdef ENABLE_ATT_DB_INDEX
+    if (it->uuid_pos >= 0){
+        // continue with next attribute in UUID order, end of db otherwise
+        if (it->uuid_pos < att_db_index_count){
+            it->att_ptr = &att_db[att_db_index_offsets[att_db_index_uuid_order[it->uuid_pos++]]];
+        } else {
+            it->att_ptr = &att_db[att_db_index_end_offset];
+        }
+    }
+#endif
     it->size   = little_endian_read_16(it->att_ptr, 0);
     if (it->size == 0){
         it->flags = 0;
@@ -116,6 +154,13 @@ static void att_iterator_fetch_next(att_iterator_t *it){
     }
     // advance AFTER setting values
     it->att_ptr += it->size;
+#ifdef ENABLE_ATT_DB_INDEX
+    // no more attributes with requested UUID, skip to end of db
+    if (it->uuid_pos >= 0 && !att_iterator_match_uuid(it, (uint8_t *) it->filter_uuid, it->filter_uuid_len)){
+        it->uuid_pos = att_db_index_count;
+        att_iterator_fetch_next(it);
+    }
+#endif
 }
 
 static int att_iterator_match_uuid16(att_iterator_t *it, uint16_t uuid){
@@ -142,9 +187,147 @@ static int att_iterator_match_uuid(att_iterator_t *it, uint8_t *uuid, uint16_t u
     return little_endian_read_16(uuid, 12) == little_endian_read_16(it->uuid, 0);
 }
 
+#ifdef ENABLE_ATT_DB_INDEX
+// UUIDs that can be represented as UUID16 are ordered before other UUID128s
+static int att_db_index_compare_uuid(uint8_t const * uuid_a, uint16_t uuid_a_len, uint8_t const * uuid_b, uint16_t uuid_b_len){
+    int a_is_uuid16 = uuid_a_len == 2 || is_Bluetooth_Base_UUID(uuid_a);
+    int b_is_uuid16 = uuid_b_len == 2 || is_Bluetooth_Base_UUID(uuid_b);
+    if (a_is_uuid16 != b_is_uuid16) return b_is_uuid16 - a_is_uuid16;
+    if (a_is_uuid16) return (int) uuid16_from_uuid(uuid_a_len, (uint8_t *) uuid_a) - (int) uuid16_from_uuid(uuid_b_len, (uint8_t *) uuid_b);
+    return memcmp(uuid_a, uuid_b, 16);
+}
+
+static uint16_t att_db_index_uuid_len(uint8_t const * att_ptr){
+    return (little_endian_read_16(att_ptr, 2) & ATT_PROPERTY_UUID128) ? 16 : 2;
+}
+
+static uint16_t att_db_index_handle(uint16_t pos){
+    return little_endian_read_16(att_db, att_db_index_offsets[pos] + 4);
+}
+
+// compare (uuid, handle) against attribute at given position
+static int att_db_index_compare(uint8_t const * uuid, uint16_t uuid_len, uint16_t handle, uint16_t pos){
+    uint8_t const * att_ptr = &att_db[att_db_index_offsets[pos]];
+    int res = att_db_index_compare_uuid(uuid, uuid_len, &att_ptr[6], att_db_index_uuid_len(att_ptr));
+    if (res) return res;
+    return (int) handle - (int) little_endian_read_16(att_ptr, 4);
+}
+
+static void att_db_index_build(void){
+    att_db_index_valid = 0;
+    att_db_index_count = 0;
+    if (att_db == NULL) return;
+    uint32_t offset = 0;
+    uint16_t prev_handle = 0;
+    while (1){
+        uint16_t size = little_endian_read_16(att_db, offset);
+        if (size == 0) break;
+        uint16_t handle = little_endian_read_16(att_db, offset + 4);
+        if (att_db_index_count >= MAX_NR_ATT_DB_INDEX_ENTRIES || offset + size > 0xffff){
+            log_error("att_db_index: ATT DB too large for index, use linear search");
+            return;
+        }
+        if (handle <= prev_handle){
+            log_error("att_db_index: handles not in ascending order, use linear search");
+            return;
+        }
+        uint16_t pos = att_db_index_count;
+        att_db_index_offsets[pos] = offset;
+        // insert into UUID order
+        uint8_t const * att_ptr = &att_db[offset];
+        uint16_t low  = 0;
+        uint16_t high = pos;
+        while (low < high){
+            uint16_t mid = (low + high) / 2;
+            if (att_db_index_compare(&att_ptr[6], att_db_index_uuid_len(att_ptr), handle, att_db_index_uuid_order[mid]) > 0){
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        memmove(&att_db_index_uuid_order[low+1], &att_db_index_uuid_order[low], (pos - low) * sizeof(uint16_t));
+        att_db_index_uuid_order[low] = pos;
+        att_db_index_count++;
+        prev_handle = handle;
+        offset += size;
+    }
+    att_db_index_end_offset = offset;
+    att_db_index_valid = att_db_index_count > 0;
+    log_info("att_db_index: %u attributes", att_db_index_count);
+}
+
+// returns position of first attribute with handle >= given handle
+static uint16_t att_db_index_lower_bound(uint16_t handle){
+    uint16_t low  = 0;
+    uint16_t high = att_db_index_count;
+    while (low < high){
+        uint16_t mid = (low + high) / 2;
+        if (att_db_index_handle(mid) < handle){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+#endif
+
+// start iteration at first attribute with handle >= start_handle
+static void att_iterator_init_for_handle(att_iterator_t *it, uint16_t start_handle){
+    att_iterator_init(it);
+#ifdef ENABLE_ATT_DB_INDEX
+    if (!att_db_index_valid) return;
+    uint16_t pos = att_db_index_lower_bound(start_handle);
+    if (pos < att_db_index_count){
+        it->att_ptr = &att_db[att_db_index_offsets[pos]];
+    } else {
+        it->att_ptr = &att_db[att_db_index_end_offset];
+    }
+#else
+    UNUSED(start_handle);
+#endif
+}
+
+// start iteration at first attribute with handle >= start_handle, may skip attributes that don't match UUID
+static void att_iterator_init_for_uuid(att_iterator_t *it, uint16_t start_handle, uint8_t * uuid, uint16_t uuid_len){
+#ifdef ENABLE_ATT_DB_INDEX
+    if (att_db_index_valid){
+        att_iterator_init(it);
+        uint16_t low  = 0;
+        uint16_t high = att_db_index_count;
+        while (low < high){
+            uint16_t mid = (low + high) / 2;
+            if (att_db_index_compare(uuid, uuid_len, start_handle, att_db_index_uuid_order[mid]) > 0){
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        it->uuid_pos = low;
+        it->filter_uuid = uuid;
+        it->filter_uuid_len = uuid_len;
+        return;
+    }
+#else
+    UNUSED(uuid);
+    UNUSED(uuid_len);
+#endif
+    att_iterator_init_for_handle(it, start_handle);
+}
 
 static int att_find_handle(att_iterator_t *it, uint16_t handle){
     if (handle == 0) return 0;
+#ifdef ENABLE_ATT_DB_INDEX
+    if (att_db_index_valid){
+        uint16_t pos = att_db_index_lower_bound(handle);
+        if (pos >= att_db_index_count) return 0;
+        if (att_db_index_handle(pos) != handle) return 0;
+        att_iterator_init(it);
+        it->att_ptr = &att_db[att_db_index_offsets[pos]];
+        att_iterator_fetch_next(it);
+        return 1;
+    }
+#endif
     att_iterator_init(it);
     while (att_iterator_has_next(it)){
         att_iterator_fetch_next(it);
@@ -217,6 +400,9 @@ static int att_copy_value(att_iterator_t *it, uint16_t offset, uint8_t * buffer,
 
 void att_set_db(uint8_t const * db){
     att_db = db;
+#ifdef ENABLE_ATT_DB_INDEX
+    att_db_index_build();
+#endif
 }
 
 void att_set_read_callback(att_read_callback_t callback){
@@ -361,7 +547,7 @@ static uint16_t handle_find_information_request2(att_connection_t * att_connecti
     uint16_t uuid_len = 0;
     
     att_iterator_t it;
-    att_iterator_init(&it);
+    att_iterator_init_for_handle(&it, start_handle);
     while (att_iterator_has_next(&it)){
         att_iterator_fetch_next(&it);
         if (!it.handle) break;
@@ -443,7 +629,7 @@ static uint16_t handle_find_by_type_value_request2(att_connection_t * att_connec
     uint16_t prev_handle = 0;
     
     att_iterator_t it;
-    att_iterator_init(&it);
+    att_iterator_init_for_handle(&it, start_handle);
     while (att_iterator_has_next(&it)){
         att_iterator_fetch_next(&it);
         
@@ -511,7 +697,7 @@ static uint16_t handle_read_by_type_request2(att_connection_t * att_connection,
     uint16_t pair_len = 0;
 
     att_iterator_t it;
-    att_iterator_init(&it);
+    att_iterator_init_for_uuid(&it, start_handle, attribute_type, attribute_type_len);
     uint8_t error_code = 0;
     uint16_t first_matching_but_unreadable_handle = 0;
 
@@ -806,7 +992,7 @@ static uint16_t handle_read_by_group_type_request2(att_connection_t * att_connec
     uint16_t prev_handle = 0;
 
     att_iterator_t it;
-    att_iterator_init(&it);
+    att_iterator_init_for_handle(&it, start_handle);
     while (att_iterator_has_next(&it)){
         att_iterator_fetch_next(&it);
         
@@ -1182,8 +1368,10 @@ int gatt_server_get_get_handle_range_for_service_with_uuid16(uint16_t uuid16, ui
 
 // returns 0 if not found
 uint16_t gatt_server_get_value_handle_for_characteristic_with_uuid16(uint16_t start_handle, uint16_t end_handle, uint16_t uuid16){
+    uint8_t attribute_type[2];
+    little_endian_store_16(attribute_type, 0, uuid16);
     att_iterator_t it;
-    att_iterator_init(&it);
+    att_iterator_init_for_uuid(&it, start_handle, attribute_type, sizeof(attribute_type));
     while (att_iterator_has_next(&it)){
         att_iterator_fetch_next(&it);
         if (it.handle && it.handle < start_handle) continue;
@@ -1197,7 +1385,7 @@ uint16_t gatt_server_get_value_handle_for_characteristic_with_uuid16(uint16_t st
 // returns 0 if not found
 uint16_t gatt_server_get_client_configuration_handle_for_characteristic_with_uuid16(uint16_t start_handle, uint16_t end_handle, uint16_t uuid16){
     att_iterator_t it;
-    att_iterator_init(&it);
+    att_iterator_init_for_handle(&it, start_handle);
     int characteristic_found = 0;
     while (att_iterator_has_next(&it)){
         att_iterator_fetch_next(&it);
@@ -1221,3 +1409,34 @@ uint16_t gatt_server_get_client_configuration_handle_for_characteristic_with_uui
     return 0;
 }
 
+// returns 0 if not found
+uint16_t gatt_server_get_client_configuration_handle_for_value_handle(uint16_t value_handle){
+    att_iterator_t it;
+    att_iterator_init_for_handle(&it, value_handle);
+    while (att_iterator_has_next(&it)){
+        att_iterator_fetch_next(&it);
+        if (it.handle == 0) break;
+        if (it.handle <= value_handle) continue;
+        if (att_iterator_match_uuid16(&it, GATT_PRIMARY_SERVICE_UUID) 
+         || att_iterator_match_uuid16(&it, GATT_SECONDARY_SERVICE_UUID)
+         || att_iterator_match_uuid16(&it, GATT_CHARACTERISTICS_UUID)){
+            break;
+        }
+        if (att_iterator_match_uuid16(&it, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION)){
+            return it.handle;
+        }
+    }
+    return 0;
+}
+
+// returns 0 if not found or not set
+uint16_t gatt_server_get_client_configuration(hci_con_handle_t con_handle, uint16_t client_configuration_handle){
+    att_iterator_t it;
+    if (!att_find_handle(&it, client_configuration_handle)) return 0;
+    if (!att_iterator_match_uuid16(&it, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION)) return 0;
+    att_update_value_len(&it, con_handle);
+    if (it.value_len < 2) return 0;
+    uint8_t value[2];
+    if (att_copy_value(&it, 0, value, sizeof(value), con_handle) < 2) return 0;
+    return little_endian_read_16(value, 0);
+}
@@ -98,6 +98,8 @@ typedef struct att_service_handler {
 
 /*
  * @brief setup ATT database
+ * @note  with ENABLE_ATT_DB_INDEX, the index is built here. If the ATT DB is changed afterwards,
+ *        e.g. by adding attributes with att_db_util, att_set_db has to be called again
  */
 void att_set_db(uint8_t const * db);
 
@@ -185,6 +187,12 @@ uint16_t gatt_server_get_value_handle_for_characteristic_with_uuid16(uint16_t st
 // returns 0 if not found
 uint16_t gatt_server_get_client_configuration_handle_for_characteristic_with_uuid16(uint16_t start_handle, uint16_t end_handle, uint16_t uuid16);
 
+// returns 0 if not found
+uint16_t gatt_server_get_client_configuration_handle_for_value_handle(uint16_t value_handle);
+
+// returns 0 if not found or not set
+uint16_t gatt_server_get_client_configuration(hci_con_handle_t con_handle, uint16_t client_configuration_handle);
+
 #if defined __cplusplus
 }
 #endif
@@ -64,6 +64,9 @@
 #include "l2cap.h"
 
 static void att_run_for_context(att_server_t * att_server);
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+static void att_server_notification_queue_run(void);
+#endif
 
 // global
 static btstack_packet_callback_registration_t hci_event_callback_registration;
@@ -167,6 +170,16 @@ static void att_event_packet_handler (uint8_t packet_type, uint16_t channel, uin
                             att_server->connection.authenticated = 0;
 		                	att_server->connection.authorized = 0;
                             att_server->ir_le_device_db_index = -1;
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+                            memset(att_server->subscriptions, 0, sizeof(att_server->subscriptions));
+                            att_server->notifications_sent           = 0;
+                            att_server->notifications_dropped        = 0;
+                            att_server->notifications_coalesced      = 0;
+                            att_server->notification_latency_last_ms = 0;
+                            att_server->notification_latency_max_ms  = 0;
+                            att_server->notification_queue_head  = 0;
+                            att_server->notification_queue_count = 0;
+#endif
                             break;
 
                         default:
@@ -193,6 +206,10 @@ static void att_event_packet_handler (uint8_t packet_type, uint16_t channel, uin
                     att_server->connection.con_handle = 0;
                     att_server->value_indication_handle = 0; // reset error state
                     att_server->state = ATT_SERVER_IDLE;
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+                    // drop pending notifications
+                    att_server->notification_queue_count = 0;
+#endif
                     break;
                     
                 case SM_EVENT_IDENTITY_RESOLVING_STARTED:
@@ -260,6 +277,153 @@ static void att_signed_write_handle_cmac_result(uint8_t hash[8]){
 }
 #endif
 
+// start timeout for indication, only one indication can be outstanding
+static void att_server_track_indication(att_server_t * att_server, uint16_t attribute_handle){
+    att_server->value_indication_handle = attribute_handle;
+    btstack_run_loop_set_timer_handler(&att_server->value_indication_timer, att_handle_value_indication_timeout);
+    btstack_run_loop_set_timer_context(&att_server->value_indication_timer, (void *) (uintptr_t) att_server->connection.con_handle);
+    btstack_run_loop_set_timer(&att_server->value_indication_timer, ATT_TRANSACTION_TIMEOUT_MS);
+    btstack_run_loop_add_timer(&att_server->value_indication_timer);
+}
+
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+// track Client Characteristic Configuration written by the client
+static void att_server_update_subscription(att_server_t * att_server, uint16_t client_configuration_handle, uint16_t client_configuration){
+    if (att_uuid_for_handle(client_configuration_handle) != GATT_CLIENT_CHARACTERISTICS_CONFIGURATION) return;
+    att_server_subscription_t * free_subscription = NULL;
+    int i;
+    for (i=0;i<ATT_SERVER_NOTIFICATION_QUEUE_MAX_SUBSCRIPTIONS;i++){
+        att_server_subscription_t * subscription = &att_server->subscriptions[i];
+        if (subscription->client_configuration_handle == client_configuration_handle){
+            subscription->client_configuration = client_configuration;
+            if (client_configuration == GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NONE){
+                subscription->client_configuration_handle = 0;
+            }
+            return;
+        }
+        if (subscription->client_configuration_handle == 0 && free_subscription == NULL){
+            free_subscription = subscription;
+        }
+    }
+    if (client_configuration == GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NONE) return;
+    if (!free_subscription){
+        log_error("att_server_update_subscription: no free subscription for handle 0x%04x, con_handle 0x%04x",
+            client_configuration_handle, att_server->connection.con_handle);
+        return;
+    }
+    free_subscription->client_configuration_handle = client_configuration_handle;
+    free_subscription->client_configuration        = client_configuration;
+}
+
+// track Client Characteristic Configuration as provided by the app
+static void att_server_refresh_subscription(att_server_t * att_server, uint16_t client_configuration_handle){
+    if (att_uuid_for_handle(client_configuration_handle) != GATT_CLIENT_CHARACTERISTICS_CONFIGURATION) return;
+    att_server_update_subscription(att_server, client_configuration_handle,
+        gatt_server_get_client_configuration(att_server->connection.con_handle, client_configuration_handle));
+}
+
+// returns Client Characteristic Configuration written by the client, or provided by the app, e.g. restored for a bonded device
+static uint16_t att_server_client_configuration(att_server_t * att_server, uint16_t client_configuration_handle){
+    int i;
+    for (i=0;i<ATT_SERVER_NOTIFICATION_QUEUE_MAX_SUBSCRIPTIONS;i++){
+        att_server_subscription_t * subscription = &att_server->subscriptions[i];
+        if (subscription->client_configuration_handle != client_configuration_handle) continue;
+        return subscription->client_configuration;
+    }
+    uint16_t client_configuration = gatt_server_get_client_configuration(att_server->connection.con_handle, client_configuration_handle);
+    att_server_update_subscription(att_server, client_configuration_handle, client_configuration);
+    return client_configuration;
+}
+
+static att_server_queued_notification_t * att_server_notification_queue_get(att_server_t * att_server, int pos){
+    return &att_server->notification_queue[(att_server->notification_queue_head + pos) % ATT_SERVER_NOTIFICATION_QUEUE_SIZE];
+}
+
+static void att_server_notification_queue_add(att_server_t * att_server, uint16_t attribute_handle, const uint8_t * value, uint16_t value_len, int coalesce, int indication, uint32_t now){
+    att_server_queued_notification_t * notification;
+    int i;
+    if (coalesce){
+        // replace most recent pending value, keep position in queue
+        for (i=att_server->notification_queue_count-1;i>=0;i--){
+            notification = att_server_notification_queue_get(att_server, i);
+            if (notification->attribute_handle != attribute_handle) continue;
+            if (notification->indication != indication) continue;
+            memcpy(notification->value, value, value_len);
+            notification->value_len = value_len;
+            att_server->notifications_coalesced++;
+            return;
+        }
+    }
+    if (att_server->notification_queue_count == ATT_SERVER_NOTIFICATION_QUEUE_SIZE){
+        // drop oldest
+        att_server->notification_queue_head = (att_server->notification_queue_head + 1) % ATT_SERVER_NOTIFICATION_QUEUE_SIZE;
+        att_server->notification_queue_count--;
+        att_server->notifications_dropped++;
+    }
+    notification = att_server_notification_queue_get(att_server, att_server->notification_queue_count);
+    notification->attribute_handle = attribute_handle;
+    notification->value_len = value_len;
+    notification->queued_ms = now;
+    notification->indication = indication;
+    memcpy(notification->value, value, value_len);
+    att_server->notification_queue_count++;
+}
+
+// send queued notifications, connection with oldest pending notification first
+// requests can send now event for a connection with pending notifications that cannot send right now
+static void att_server_notification_queue_run(void){
+    while (1){
+        att_server_t * next    = NULL;
+        att_server_t * blocked = NULL;
+        btstack_linked_list_iterator_t it;
+        hci_connections_get_iterator(&it);
+        while(btstack_linked_list_iterator_has_next(&it)){
+            hci_connection_t * connection = (hci_connection_t *) btstack_linked_list_iterator_next(&it);
+            att_server_t * att_server = &connection->att_server;
+            if (att_server->notification_queue_count == 0) continue;
+            att_server_queued_notification_t * notification = att_server_notification_queue_get(att_server, 0);
+            // wait for confirmation of previous indication
+            if (notification->indication && att_server->value_indication_handle) continue;
+            uint32_t queued_ms = notification->queued_ms;
+            if (att_dispatch_server_can_send_now(att_server->connection.con_handle)){
+                if (next && (int32_t)(queued_ms - att_server_notification_queue_get(next, 0)->queued_ms) >= 0) continue;
+                next = att_server;
+            } else {
+                if (blocked && (int32_t)(queued_ms - att_server_notification_queue_get(blocked, 0)->queued_ms) >= 0) continue;
+                blocked = att_server;
+            }
+        }
+
+        if (!next){
+            if (!blocked) return;
+            att_dispatch_server_request_can_send_now_event(blocked->connection.con_handle);
+            return;
+        }
+
+        att_server_queued_notification_t * notification = att_server_notification_queue_get(next, 0);
+        l2cap_reserve_packet_buffer();
+        uint8_t * packet_buffer = l2cap_get_outgoing_buffer();
+        uint16_t size;
+        if (notification->indication){
+            att_server_track_indication(next, notification->attribute_handle);
+            size = att_prepare_handle_value_indication(&next->connection, notification->attribute_handle, notification->value, notification->value_len, packet_buffer);
+        } else {
+            size = att_prepare_handle_value_notification(&next->connection, notification->attribute_handle, notification->value, notification->value_len, packet_buffer);
+        }
+        l2cap_send_prepared_connectionless(next->connection.con_handle, L2CAP_CID_ATTRIBUTE_PROTOCOL, size);
+
+        uint32_t latency_ms = btstack_run_loop_get_time_ms() - notification->queued_ms;
+        next->notifications_sent++;
+        next->notification_latency_last_ms = latency_ms;
+        if (latency_ms > next->notification_latency_max_ms){
+            next->notification_latency_max_ms = latency_ms;
+        }
+        next->notification_queue_head = (next->notification_queue_head + 1) % ATT_SERVER_NOTIFICATION_QUEUE_SIZE;
+        next->notification_queue_count--;
+    }
+}
+#endif
+
 // pre: att_server->state == ATT_SERVER_REQUEST_RECEIVED_AND_VALIDATED
 // pre: can send now
 // returns: 1 if packet was sent
@@ -294,6 +458,15 @@ static int att_server_process_validated_request(att_server_t * att_server){
         return 0;
     }
 
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+    // track subscriptions for att_server_notify_subscribers
+    if ((att_server->request_buffer[0] == ATT_WRITE_REQUEST)
+    && (att_server->request_size >= 5)
+    && (att_response_buffer[0] == ATT_WRITE_RESPONSE)){
+        att_server_update_subscription(att_server, little_endian_read_16(att_server->request_buffer, 1), little_endian_read_16(att_server->request_buffer, 3));
+    }
+#endif
+
     l2cap_send_prepared_connectionless(att_server->connection.con_handle, L2CAP_CID_ATTRIBUTE_PROTOCOL, att_response_size);
 
     // notify client about MTU exchange result
@@ -377,21 +550,27 @@ static void att_server_handle_can_send_now(void){
         }
     }
 
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+    // connections blocked with queued notifications get a can send now request, clients of other connections are served below
+    att_server_notification_queue_run();
+#endif
+
+    // clients of connections that cannot send wait for their next can send now event
+    btstack_linked_list_t waiting_clients = NULL;
     while (!btstack_linked_list_empty(&can_send_now_clients)){
         // handle first client
         btstack_context_callback_registration_t * client = (btstack_context_callback_registration_t*) can_send_now_clients;
         hci_con_handle_t con_handle = (uintptr_t) client->context;
         btstack_linked_list_remove(&can_send_now_clients, (btstack_linked_item_t *) client);
-        client->callback(client->context);
-
-        // request again if needed
         if (!att_dispatch_server_can_send_now(con_handle)){
-            if (!btstack_linked_list_empty(&can_send_now_clients) || att_client_waiting_for_can_send){
-                att_dispatch_server_request_can_send_now_event(con_handle);
-            }
-            return;
+            btstack_linked_list_add_tail(&waiting_clients, (btstack_linked_item_t *) client);
+            att_dispatch_server_request_can_send_now_event(con_handle);
+            continue;
         }
+        client->callback(client->context);
     }
+    can_send_now_clients = waiting_clients;
+    if (!btstack_linked_list_empty(&can_send_now_clients)) return;
 
     if (att_client_waiting_for_can_send){
         att_client_waiting_for_can_send = 0;
@@ -421,6 +600,12 @@ static void att_packet_handler(uint8_t packet_type, uint16_t handle, uint8_t *pa
                 uint16_t att_handle = att_server->value_indication_handle;
                 att_server->value_indication_handle = 0;    
                 att_handle_value_indication_notify_client(0, att_server->connection.con_handle, att_handle);
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+                // queued notifications might wait for the confirmation
+                if (att_server->notification_queue_count){
+                    att_dispatch_server_request_can_send_now_event(att_server->connection.con_handle);
+                }
+#endif
                 return;
             }
 
@@ -428,6 +613,12 @@ static void att_packet_handler(uint8_t packet_type, uint16_t handle, uint8_t *pa
             // note: signed write cannot be handled directly as authentication needs to be verified
             if (packet[0] == ATT_WRITE_COMMAND){
                 att_handle_request(&att_server->connection, packet, size, 0);
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+                // track subscriptions written without response, there's no response that tells if the app accepted it
+                if (size >= 5){
+                    att_server_refresh_subscription(att_server, little_endian_read_16(packet, 1));
+                }
+#endif
                 return;
             }
 
@@ -517,11 +708,7 @@ int att_server_indicate(hci_con_handle_t con_handle, uint16_t attribute_handle,
     if (att_server->value_indication_handle) return ATT_HANDLE_VALUE_INDICATION_IN_PORGRESS;
     if (!att_dispatch_server_can_send_now(con_handle)) return BTSTACK_ACL_BUFFERS_FULL;
 
-    // track indication
-    att_server->value_indication_handle = attribute_handle;
-    btstack_run_loop_set_timer_handler(&att_server->value_indication_timer, att_handle_value_indication_timeout);
-    btstack_run_loop_set_timer(&att_server->value_indication_timer, ATT_TRANSACTION_TIMEOUT_MS);
-    btstack_run_loop_add_timer(&att_server->value_indication_timer);
+    att_server_track_indication(att_server, attribute_handle);
 
     l2cap_reserve_packet_buffer();
     uint8_t * packet_buffer = l2cap_get_outgoing_buffer();
@@ -529,3 +716,41 @@ int att_server_indicate(hci_con_handle_t con_handle, uint16_t attribute_handle,
 	l2cap_send_prepared_connectionless(att_server->connection.con_handle, L2CAP_CID_ATTRIBUTE_PROTOCOL, size);
     return 0;
 }
+
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+int att_server_notify_subscribers(uint16_t attribute_handle, const uint8_t * value, uint16_t value_len, int coalesce){
+    if (value_len > ATT_SERVER_NOTIFICATION_QUEUE_VALUE_SIZE) return ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LENGTH;
+
+    uint16_t client_configuration_handle = gatt_server_get_client_configuration_handle_for_value_handle(attribute_handle);
+    if (client_configuration_handle == 0) return ATT_ERROR_INVALID_HANDLE;
+
+    uint32_t now = btstack_run_loop_get_time_ms();
+    btstack_linked_list_iterator_t it;
+    hci_connections_get_iterator(&it);
+    while(btstack_linked_list_iterator_has_next(&it)){
+        hci_connection_t * connection = (hci_connection_t *) btstack_linked_list_iterator_next(&it);
+        att_server_t * att_server = &connection->att_server;
+        if (att_server->connection.con_handle == 0) continue;
+        uint16_t client_configuration = att_server_client_configuration(att_server, client_configuration_handle);
+        if (client_configuration & GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION){
+            att_server_notification_queue_add(att_server, attribute_handle, value, value_len, coalesce, 0, now);
+        } else if (client_configuration & GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_INDICATION){
+            att_server_notification_queue_add(att_server, attribute_handle, value, value_len, coalesce, 1, now);
+        }
+    }
+
+    att_server_notification_queue_run();
+    return 0;
+}
+
+int att_server_get_notification_stats(hci_con_handle_t con_handle, att_server_notification_stats_t * stats){
+    att_server_t * att_server = att_server_for_handle(con_handle);
+    if (!att_server) return ERROR_CODE_UNKNOWN_CONNECTION_IDENTIFIER;
+    stats->sent            = att_server->notifications_sent;
+    stats->dropped         = att_server->notifications_dropped;
+    stats->coalesced       = att_server->notifications_coalesced;
+    stats->latency_last_ms = att_server->notification_latency_last_ms;
+    stats->latency_max_ms  = att_server->notification_latency_max_ms;
+    return 0;
+}
+#endif
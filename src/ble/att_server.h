@@ -106,6 +106,41 @@ int att_server_notify(hci_con_handle_t con_handle, uint16_t attribute_handle, ui
  */
 int att_server_indicate(hci_con_handle_t con_handle, uint16_t attribute_handle, uint8_t *value, uint16_t value_len);
 
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+/*
+ * @brief queue notification of attribute value change for all connections that enabled notifications
+ *        or indications in the Client Characteristic Configuration of the Characteristic. Queued
+ *        notifications are sent as soon as possible, the connection with the oldest pending notification
+ *        first. An indication is only sent after the previous one was confirmed, later notifications for
+ *        the same connection wait for it. If the queue of a connection is full, its oldest notification
+ *        is dropped.
+ * @note  Client Characteristic Configurations not written by the client on the current connection, e.g.
+ *        restored for a bonded device, are read via the att_read_callback_t
+ * @param attribute_handle of Characteristic Value
+ * @param value
+ * @param value_len up to ATT_SERVER_NOTIFICATION_QUEUE_VALUE_SIZE
+ * @param coalesce if set, a pending notification for the same attribute handle is replaced by the new value
+ * @return 0 if ok, error otherwise
+ */
+int att_server_notify_subscribers(uint16_t attribute_handle, const uint8_t * value, uint16_t value_len, int coalesce);
+
+typedef struct {
+    uint32_t sent;
+    uint32_t dropped;
+    uint32_t coalesced;
+    uint32_t latency_last_ms;
+    uint32_t latency_max_ms;
+} att_server_notification_stats_t;
+
+/*
+ * @brief get counters for notifications queued by att_server_notify_subscribers
+ * @param con_handle
+ * @param stats
+ * @return 0 if ok, error otherwise
+ */
+int att_server_get_notification_stats(hci_con_handle_t con_handle, att_server_notification_stats_t * stats);
+#endif
+
 /* API_END */
 
 #if defined __cplusplus
@@ -64,15 +64,26 @@ static btstack_linked_list_t gatt_client_connections;
 static btstack_linked_list_t gatt_client_value_listeners;
 static btstack_packet_callback_registration_t hci_event_callback_registration;
 static uint8_t  pts_suppress_mtu_exchange;
+static uint16_t gatt_client_operation_id;
+static int      gatt_client_operations_running;
+
+#ifdef ENABLE_GATT_CLIENT_CACHE
+static const gatt_client_cache_t * gatt_client_cache;
+#endif
 
 static void gatt_client_att_packet_handler(uint8_t packet_type, uint16_t handle, uint8_t *packet, uint16_t size);
 static void gatt_client_hci_event_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size);
 static void gatt_client_report_error_if_pending(gatt_client_t *peripheral, uint8_t error_code);
+static int  gatt_client_operations_run(gatt_client_t * peripheral);
 
 #ifdef ENABLE_LE_SIGNED_WRITE
 static void att_signed_write_handle_cmac_result(uint8_t hash[8]);
 #endif
 
+#ifdef ENABLE_GATT_CLIENT_CACHE
+static void gatt_client_cache_load_service_changed_handle(gatt_client_t * peripheral);
+#endif
+
 static uint16_t peripheral_mtu(gatt_client_t *peripheral){
     if (peripheral->mtu > l2cap_max_le_mtu()){
         log_error("Peripheral mtu is not initialized");
@@ -157,6 +168,10 @@ static gatt_client_t * provide_context_for_conn_handle(hci_con_handle_t con_hand
     if (pts_suppress_mtu_exchange){
          context->mtu_state = MTU_EXCHANGED;
     }
+
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    gatt_client_cache_load_service_changed_handle(context);
+#endif
     return context;
 }
 
@@ -479,7 +494,90 @@ static void emit_event_to_registered_listeners(hci_con_handle_t con_handle, uint
     } 
 }
 
+#ifdef ENABLE_GATT_CLIENT_CACHE
+void gatt_client_set_cache(const gatt_client_cache_t * cache){
+    gatt_client_cache = cache;
+    if (!gatt_client_cache) return;
+    gatt_client_cache->open();
+}
+
+// Service Changed handle is stored per device, so that its indications invalidate the cache in later connections
+static void gatt_client_cache_save_service_changed_handle(gatt_client_t * peripheral){
+    if (!gatt_client_cache) return;
+    if (!peripheral->service_changed_handle) return;
+    int le_device_index = sm_le_device_index(peripheral->con_handle);
+    if (le_device_index < 0) return;
+    gatt_client_cache->put_service_changed_handle(le_device_index, peripheral->service_changed_handle);
+}
+
+static void gatt_client_cache_load_service_changed_handle(gatt_client_t * peripheral){
+    if (peripheral->service_changed_handle) return;
+    if (!gatt_client_cache) return;
+    int le_device_index = sm_le_device_index(peripheral->con_handle);
+    if (le_device_index < 0) return;
+    peripheral->service_changed_handle = gatt_client_cache->get_service_changed_handle(le_device_index);
+}
+
+static void gatt_client_cache_check_service_changed(gatt_client_t * peripheral, const uint8_t * packet){
+    if (packet[0] != GATT_EVENT_CHARACTERISTIC_QUERY_RESULT) return;
+    uint8_t uuid128[16];
+    reverse_128(&packet[12], uuid128);
+    if (!uuid_has_bluetooth_prefix(uuid128)) return;
+    if (big_endian_read_32(uuid128, 0) != GAP_SERVICE_CHANGED) return;
+    uint16_t service_changed_handle = little_endian_read_16(packet, 6);
+    if (peripheral->service_changed_handle == service_changed_handle) return;
+    peripheral->service_changed_handle = service_changed_handle;
+    gatt_client_cache_save_service_changed_handle(peripheral);
+}
+
+// results are stored as list of { event type, payload len, payload without connection handle }
+static void gatt_client_cache_record(gatt_client_t * peripheral, const uint8_t * packet, uint16_t size){
+    gatt_client_cache_check_service_changed(peripheral, packet);
+    if (!peripheral->cache_recording) return;
+    uint16_t payload_len = size - 4;
+    if (peripheral->cache_results_len + 2 + payload_len > GATT_CLIENT_CACHE_RESULTS_SIZE){
+        log_info("GATT client cache: results exceed GATT_CLIENT_CACHE_RESULTS_SIZE, not cached");
+        peripheral->cache_recording = 0;
+        return;
+    }
+    uint8_t * record = &peripheral->cache_results[peripheral->cache_results_len];
+    record[0] = packet[0];
+    record[1] = (uint8_t) payload_len;
+    memcpy(&record[2], &packet[4], payload_len);
+    peripheral->cache_results_len += 2 + payload_len;
+}
+
+static void gatt_client_cache_store(gatt_client_t * peripheral, uint8_t status){
+    if (!peripheral->cache_recording) return;
+    peripheral->cache_recording = 0;
+    if (status) return;
+    if (!gatt_client_cache) return;
+    gatt_client_cache->put_results(peripheral->cache_le_device_index, peripheral->cache_key, peripheral->cache_results, peripheral->cache_results_len);
+    // retry if table of devices was full before
+    gatt_client_cache_save_service_changed_handle(peripheral);
+}
+
+static void gatt_client_cache_invalidate(gatt_client_t * peripheral){
+    peripheral->cache_recording = 0;
+    if (!gatt_client_cache) return;
+    int le_device_index = sm_le_device_index(peripheral->con_handle);
+    if (le_device_index < 0) return;
+    log_info("GATT client cache: service changed, clear cache for device %u", le_device_index);
+    gatt_client_cache->delete_device(le_device_index);
+}
+#endif
+
+static void emit_gatt_discovery_result_event(gatt_client_t * peripheral, uint8_t * packet, uint16_t size){
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    gatt_client_cache_record(peripheral, packet, size);
+#endif
+    emit_event_new(peripheral->callback, packet, size);
+}
+
 static void emit_gatt_complete_event(gatt_client_t * peripheral, uint8_t status){
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    gatt_client_cache_store(peripheral, status);
+#endif
     // @format H1
     uint8_t packet[5];
     packet[0] = GATT_EVENT_QUERY_COMPLETE;
@@ -489,6 +587,17 @@ static void emit_gatt_complete_event(gatt_client_t * peripheral, uint8_t status)
     emit_event_new(peripheral->callback, packet, sizeof(packet));
 }
 
+static void emit_gatt_operation_complete_event(gatt_client_t * peripheral, gatt_client_operation_t * operation, uint8_t status){
+    // @format H21
+    uint8_t packet[7];
+    packet[0] = GATT_EVENT_OPERATION_COMPLETE;
+    packet[1] = sizeof(packet) - 2;
+    little_endian_store_16(packet, 2, peripheral->con_handle);
+    little_endian_store_16(packet, 4, operation->operation_id);
+    packet[6] = status;
+    emit_event_new(operation->callback, packet, sizeof(packet));
+}
+
 static void emit_gatt_service_query_result_event(gatt_client_t * peripheral, uint16_t start_group_handle, uint16_t end_group_handle, uint8_t * uuid128){
     // @format HX
     uint8_t packet[24];
@@ -499,7 +608,7 @@ static void emit_gatt_service_query_result_event(gatt_client_t * peripheral, uin
     little_endian_store_16(packet, 4, start_group_handle);
     little_endian_store_16(packet, 6, end_group_handle);
     reverse_128(uuid128, &packet[8]);
-    emit_event_new(peripheral->callback, packet, sizeof(packet));
+    emit_gatt_discovery_result_event(peripheral, packet, sizeof(packet));
 }
 
 static void emit_gatt_included_service_query_result_event(gatt_client_t * peripheral, uint16_t include_handle, uint16_t start_group_handle, uint16_t end_group_handle, uint8_t * uuid128){
@@ -514,7 +623,7 @@ static void emit_gatt_included_service_query_result_event(gatt_client_t * periph
     little_endian_store_16(packet, 6, start_group_handle);
     little_endian_store_16(packet, 8, end_group_handle);
     reverse_128(uuid128, &packet[10]);
-    emit_event_new(peripheral->callback, packet, sizeof(packet));
+    emit_gatt_discovery_result_event(peripheral, packet, sizeof(packet));
 }
 
 static void emit_gatt_characteristic_query_result_event(gatt_client_t * peripheral, uint16_t start_handle, uint16_t value_handle, uint16_t end_handle,
@@ -530,7 +639,7 @@ static void emit_gatt_characteristic_query_result_event(gatt_client_t * peripher
     little_endian_store_16(packet, 8,  end_handle);
     little_endian_store_16(packet, 10, properties);
     reverse_128(uuid128, &packet[12]);
-    emit_event_new(peripheral->callback, packet, sizeof(packet));
+    emit_gatt_discovery_result_event(peripheral, packet, sizeof(packet));
 }
 
 static void emit_gatt_all_characteristic_descriptors_result_event(
@@ -543,7 +652,7 @@ static void emit_gatt_all_characteristic_descriptors_result_event(
     ///
     little_endian_store_16(packet, 4,  descriptor_handle);
     reverse_128(uuid128, &packet[6]);
-    emit_event_new(peripheral->callback, packet, sizeof(packet));
+    emit_gatt_discovery_result_event(peripheral, packet, sizeof(packet));
 }
 ///
 
@@ -826,6 +935,9 @@ static void gatt_client_run(void){
             att_confirmation(peripheral->con_handle);
             return;
         }
+
+        // start next queued operation
+        if (gatt_client_operations_run(peripheral)) continue;
         
         // check MTU for writes
         switch (peripheral->gatt_client_state){
@@ -988,6 +1100,7 @@ static void gatt_client_run(void){
                 peripheral->gatt_client_state = P_READY;
                 // finally, notifiy client that write is complete
                 gatt_client_handle_transaction_complete(peripheral);
+                emit_gatt_complete_event(peripheral, 0);
                 return;
             }
 #endif
@@ -1012,13 +1125,33 @@ static void gatt_client_hci_event_packet_handler(uint8_t packet_type, uint16_t c
     if (packet_type != HCI_EVENT_PACKET) return;
 
     switch (hci_event_packet_get_type(packet)) {
+#ifdef ENABLE_GATT_CLIENT_CACHE
+        case BTSTACK_EVENT_STATE:
+            if (!gatt_client_cache) break;
+            if (btstack_event_state_get_state(packet) != HCI_STATE_WORKING) break;
+            {
+                // cache is stored per controller
+                bd_addr_t local_bd_addr;
+                gap_local_bd_addr(local_bd_addr);
+                gatt_client_cache->set_local_bd_addr(local_bd_addr);
+            }
+            break;
+#endif
         case HCI_EVENT_DISCONNECTION_COMPLETE:
         {
             log_info("GATT Client: HCI_EVENT_DISCONNECTION_COMPLETE");
             hci_con_handle_t con_handle = little_endian_read_16(packet,3);
             gatt_client_t * peripheral = get_gatt_client_context_for_handle(con_handle);
             if (!peripheral) break;
+
+            // detach queued operations first, so that they don't get started by the active one's completion
+            btstack_linked_list_t operations = peripheral->operations;
+            peripheral->operations = NULL;
             gatt_client_report_error_if_pending(peripheral, ATT_ERROR_HCI_DISCONNECT_RECEIVED);
+            while (operations){
+                gatt_client_operation_t * operation = (gatt_client_operation_t *) btstack_linked_list_pop(&operations);
+                emit_gatt_operation_complete_event(peripheral, operation, ATT_ERROR_HCI_DISCONNECT_RECEIVED);
+            }
             
             btstack_linked_list_remove(&gatt_client_connections, (btstack_linked_item_t *) peripheral);
             btstack_memory_gatt_client_free(peripheral);
@@ -1077,6 +1210,13 @@ static void gatt_client_att_packet_handler(uint8_t packet_type, uint16_t handle,
             }
             break;
         case ATT_HANDLE_VALUE_INDICATION:
+#ifdef ENABLE_GATT_CLIENT_CACHE
+            // device might not have been identified when context was created
+            gatt_client_cache_load_service_changed_handle(peripheral);
+            if (peripheral->service_changed_handle && little_endian_read_16(packet, 1) == peripheral->service_changed_handle){
+                gatt_client_cache_invalidate(peripheral);
+            }
+#endif
             report_gatt_indication(handle, little_endian_read_16(packet,1), &packet[3], size-3);
             peripheral->send_confirmation = 1;
             break;
@@ -1389,6 +1529,74 @@ uint8_t gatt_client_signed_write_without_response(btstack_packet_handler_t callb
 }
 #endif
 
+#ifdef ENABLE_GATT_CLIENT_CACHE
+// @returns 1 if discovery query was answered from cache
+static int gatt_client_cache_replay(gatt_client_t * peripheral){
+    peripheral->cache_recording = 0;
+    if (!gatt_client_cache) return 0;
+    int le_device_index = sm_le_device_index(peripheral->con_handle);
+    if (le_device_index < 0) return 0;
+
+    // key: identity address, query state, handle range, and uuid for queries that filter by it
+    int addr_type;
+    bd_addr_t addr;
+    sm_key_t irk;
+    le_device_db_info(le_device_index, &addr_type, addr, irk);
+    uint8_t * key = peripheral->cache_key;
+    memset(key, 0, GATT_CLIENT_CACHE_KEY_LEN);
+    key[0] = (uint8_t) addr_type;
+    memcpy(&key[1], addr, 6);
+    key[7] = (uint8_t) peripheral->gatt_client_state;
+    little_endian_store_16(key,  8, peripheral->start_group_handle);
+    little_endian_store_16(key, 10, peripheral->end_group_handle);
+    switch (peripheral->gatt_client_state){
+        case P_W2_SEND_SERVICE_WITH_UUID_QUERY:
+        case P_W2_SEND_CHARACTERISTIC_WITH_UUID_QUERY:
+            memcpy(&key[12], peripheral->uuid128, 16);
+            break;
+        default:
+            break;
+    }
+
+    uint16_t results_len;
+    if (!gatt_client_cache->get_results(le_device_index, key, peripheral->cache_results, GATT_CLIENT_CACHE_RESULTS_SIZE, &results_len)){
+        // not cached yet, record results
+        peripheral->cache_le_device_index = le_device_index;
+        peripheral->cache_results_len = 0;
+        peripheral->cache_recording = 1;
+        return 0;
+    }
+
+    log_info("GATT client cache: answer query from cache, %u bytes", results_len);
+    peripheral->gatt_client_state = P_W4_CACHE_REPLAY;
+    uint8_t packet[4 + 32];
+    uint16_t pos = 0;
+    while (pos + 2 <= results_len){
+        uint8_t payload_len = peripheral->cache_results[pos+1];
+        if (payload_len > sizeof(packet) - 4) break;
+        if (pos + 2 + payload_len > results_len) break;
+        packet[0] = peripheral->cache_results[pos];
+        packet[1] = payload_len + 2;
+        little_endian_store_16(packet, 2, peripheral->con_handle);
+        memcpy(&packet[4], &peripheral->cache_results[pos+2], payload_len);
+        pos += 2 + payload_len;
+        gatt_client_cache_check_service_changed(peripheral, packet);
+        emit_event_new(peripheral->callback, packet, 4 + payload_len);
+    }
+    gatt_client_handle_transaction_complete(peripheral);
+    emit_gatt_complete_event(peripheral, 0);
+    return 1;
+}
+#endif
+
+// answers discovery queries from cache if possible
+static void gatt_client_run_discovery(gatt_client_t * peripheral){
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    if (gatt_client_cache_replay(peripheral)) return;
+#endif
+    gatt_client_run();
+}
+
 uint8_t gatt_client_discover_primary_services(btstack_packet_handler_t callback, hci_con_handle_t con_handle){
     gatt_client_t * peripheral = provide_context_for_conn_handle_and_start_timer(con_handle);
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
@@ -1399,7 +1607,7 @@ uint8_t gatt_client_discover_primary_services(btstack_packet_handler_t callback,
     peripheral->end_group_handle   = 0xffff;
     peripheral->gatt_client_state = P_W2_SEND_SERVICE_QUERY;
     peripheral->uuid16 = 0;
-    gatt_client_run();
+    gatt_client_run_discovery(peripheral);
     return 0;
 }
 
@@ -1416,7 +1624,7 @@ uint8_t gatt_client_discover_primary_services_by_uuid16(btstack_packet_handler_t
     peripheral->gatt_client_state = P_W2_SEND_SERVICE_WITH_UUID_QUERY;
     peripheral->uuid16 = uuid16;
     uuid_add_bluetooth_prefix((uint8_t*) &(peripheral->uuid128), peripheral->uuid16);
-    gatt_client_run();
+    gatt_client_run_discovery(peripheral);
     return 0;
 }
 
@@ -1432,7 +1640,7 @@ uint8_t gatt_client_discover_primary_services_by_uuid128(btstack_packet_handler_
     peripheral->uuid16 = 0;
     memcpy(peripheral->uuid128, uuid128, 16);
     peripheral->gatt_client_state = P_W2_SEND_SERVICE_WITH_UUID_QUERY;
-    gatt_client_run();
+    gatt_client_run_discovery(peripheral);
     return 0;
 }
 
@@ -1448,7 +1656,7 @@ uint8_t gatt_client_discover_characteristics_for_service(btstack_packet_handler_
     peripheral->filter_with_uuid = 0;
     peripheral->characteristic_start_handle = 0;
     peripheral->gatt_client_state = P_W2_SEND_ALL_CHARACTERISTICS_OF_SERVICE_QUERY;
-    gatt_client_run();
+    gatt_client_run_discovery(peripheral);
     return 0;
 }
 
@@ -1463,7 +1671,7 @@ uint8_t gatt_client_find_included_services_for_service(btstack_packet_handler_t
     peripheral->end_group_handle   = service->end_group_handle;
     peripheral->gatt_client_state = P_W2_SEND_INCLUDED_SERVICE_QUERY;
     
-    gatt_client_run();
+    gatt_client_run_discovery(peripheral);
     return 0;
 }
 
@@ -1482,7 +1690,7 @@ uint8_t gatt_client_discover_characteristics_for_handle_range_by_uuid16(btstack_
     peripheral->characteristic_start_handle = 0;
     peripheral->gatt_client_state = P_W2_SEND_CHARACTERISTIC_WITH_UUID_QUERY;
     
-    gatt_client_run();
+    gatt_client_run_discovery(peripheral);
     return 0;
 }
 
@@ -1501,7 +1709,7 @@ uint8_t gatt_client_discover_characteristics_for_handle_range_by_uuid128(btstack
     peripheral->characteristic_start_handle = 0;
     peripheral->gatt_client_state = P_W2_SEND_CHARACTERISTIC_WITH_UUID_QUERY;
     
-    gatt_client_run();
+    gatt_client_run_discovery(peripheral);
     return 0;
 }
 
@@ -1520,16 +1728,17 @@ uint8_t gatt_client_discover_characteristic_descriptors(btstack_packet_handler_t
     if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED; 
     if (!is_ready(peripheral)) return GATT_CLIENT_IN_WRONG_STATE;
     
+    peripheral->callback = callback;
     if (characteristic->value_handle == characteristic->end_handle){
+        gatt_client_handle_transaction_complete(peripheral);
         emit_gatt_complete_event(peripheral, 0);
         return 0;
     }
-    peripheral->callback = callback;
     peripheral->start_group_handle = characteristic->value_handle + 1;
     peripheral->end_group_handle   = characteristic->end_handle;
     peripheral->gatt_client_state = P_W2_SEND_ALL_CHARACTERISTIC_DESCRIPTORS_QUERY;
     
-    gatt_client_run();
+    gatt_client_run_discovery(peripheral);
     return 0;
 }
 
@@ -1847,6 +2056,120 @@ uint8_t gatt_client_cancel_write(btstack_packet_handler_t callback, hci_con_hand
     return 0;    
 }
 
+static void gatt_client_operation_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    if (packet_type != HCI_EVENT_PACKET) return;
+    // all GATT events start with the connection handle
+    gatt_client_t * peripheral = get_gatt_client_context_for_handle(little_endian_read_16(packet, 2));
+    if (!peripheral) return;
+    gatt_client_operation_t * operation = peripheral->active_operation;
+    if (!operation) return;
+    if (hci_event_packet_get_type(packet) != GATT_EVENT_QUERY_COMPLETE){
+        (*operation->callback)(packet_type, channel, packet, size);
+        return;
+    }
+    peripheral->active_operation = NULL;
+    emit_gatt_operation_complete_event(peripheral, operation, gatt_event_query_complete_get_status(packet));
+    gatt_client_operations_run(peripheral);
+}
+
+static uint8_t gatt_client_operation_start(gatt_client_t * peripheral, gatt_client_operation_t * operation){
+    hci_con_handle_t con_handle = peripheral->con_handle;
+    gatt_client_service_t service;
+    gatt_client_characteristic_t characteristic;
+    switch (operation->type){
+        case GATT_CLIENT_OPERATION_DISCOVER_PRIMARY_SERVICES:
+            return gatt_client_discover_primary_services(&gatt_client_operation_handler, con_handle);
+        case GATT_CLIENT_OPERATION_DISCOVER_CHARACTERISTICS:
+            memset(&service, 0, sizeof(service));
+            service.start_group_handle = operation->start_handle;
+            service.end_group_handle   = operation->end_handle;
+            return gatt_client_discover_characteristics_for_service(&gatt_client_operation_handler, con_handle, &service);
+        case GATT_CLIENT_OPERATION_DISCOVER_CHARACTERISTIC_DESCRIPTORS:
+            memset(&characteristic, 0, sizeof(characteristic));
+            characteristic.value_handle = operation->start_handle;
+            characteristic.end_handle   = operation->end_handle;
+            return gatt_client_discover_characteristic_descriptors(&gatt_client_operation_handler, con_handle, &characteristic);
+        case GATT_CLIENT_OPERATION_READ_VALUE:
+            return gatt_client_read_value_of_characteristic_using_value_handle(&gatt_client_operation_handler, con_handle, operation->start_handle);
+        case GATT_CLIENT_OPERATION_READ_LONG_VALUE:
+            return gatt_client_read_long_value_of_characteristic_using_value_handle_with_offset(&gatt_client_operation_handler, con_handle, operation->start_handle, operation->offset);
+        case GATT_CLIENT_OPERATION_READ_DESCRIPTOR:
+            return gatt_client_read_characteristic_descriptor_using_descriptor_handle(&gatt_client_operation_handler, con_handle, operation->start_handle);
+        case GATT_CLIENT_OPERATION_READ_LONG_DESCRIPTOR:
+            return gatt_client_read_long_characteristic_descriptor_using_descriptor_handle_with_offset(&gatt_client_operation_handler, con_handle, operation->start_handle, operation->offset);
+        case GATT_CLIENT_OPERATION_WRITE_VALUE:
+            return gatt_client_write_value_of_characteristic(&gatt_client_operation_handler, con_handle, operation->start_handle, operation->value_length, operation->value);
+        case GATT_CLIENT_OPERATION_WRITE_LONG_VALUE:
+            return gatt_client_write_long_value_of_characteristic_with_offset(&gatt_client_operation_handler, con_handle, operation->start_handle, operation->offset, operation->value_length, operation->value);
+        case GATT_CLIENT_OPERATION_WRITE_DESCRIPTOR:
+            return gatt_client_write_characteristic_descriptor_using_descriptor_handle(&gatt_client_operation_handler, con_handle, operation->start_handle, operation->value_length, operation->value);
+        case GATT_CLIENT_OPERATION_WRITE_LONG_DESCRIPTOR:
+            return gatt_client_write_long_characteristic_descriptor_using_descriptor_handle_with_offset(&gatt_client_operation_handler, con_handle, operation->start_handle, operation->offset, operation->value_length, operation->value);
+#ifdef ENABLE_LE_SIGNED_WRITE
+        case GATT_CLIENT_OPERATION_SIGNED_WRITE_WITHOUT_RESPONSE:
+            return gatt_client_signed_write_without_response(&gatt_client_operation_handler, con_handle, operation->start_handle, operation->value_length, operation->value);
+#endif
+        default:
+            return ERROR_CODE_UNSUPPORTED_FEATURE_OR_PARAMETER_VALUE;
+    }
+}
+
+// @returns 1 if an operation was sent or completed
+static int gatt_client_operations_run(gatt_client_t * peripheral){
+    // operations are started from their predecessor's completion, avoid recursion
+    if (gatt_client_operations_running) return 0;
+    if (peripheral->active_operation) return 0;
+    if (peripheral->mtu_state != MTU_EXCHANGED) return 0;
+
+    gatt_client_operations_running = 1;
+    int progress = 0;
+    while (peripheral->operations && is_ready(peripheral)){
+        gatt_client_operation_t * operation = (gatt_client_operation_t *) peripheral->operations;
+        uint8_t status;
+
+        if (operation->type == GATT_CLIENT_OPERATION_WRITE_WITHOUT_RESPONSE){
+            // Write Commands are not acknowledged, send back-to-back while ACL buffers are available
+            if (operation->value_length > peripheral_mtu(peripheral) - 3){
+                status = GATT_CLIENT_VALUE_TOO_LONG;
+            } else if (att_dispatch_client_can_send_now(peripheral->con_handle)){
+                att_write_request(ATT_WRITE_COMMAND, peripheral->con_handle, operation->start_handle, operation->value_length, operation->value);
+                status = 0;
+            } else {
+                att_dispatch_client_request_can_send_now_event(peripheral->con_handle);
+                break;
+            }
+            btstack_linked_list_remove(&peripheral->operations, (btstack_linked_item_t *) operation);
+            progress = 1;
+            emit_gatt_operation_complete_event(peripheral, operation, status);
+            continue;
+        }
+
+        btstack_linked_list_remove(&peripheral->operations, (btstack_linked_item_t *) operation);
+        progress = 1;
+        peripheral->active_operation = operation;
+        status = gatt_client_operation_start(peripheral, operation);
+        if (status){
+            peripheral->active_operation = NULL;
+            emit_gatt_operation_complete_event(peripheral, operation, status);
+            continue;
+        }
+        // operation may have completed already
+        if (peripheral->active_operation) break;
+    }
+    gatt_client_operations_running = 0;
+    return progress;
+}
+
+uint8_t gatt_client_queue_operation(btstack_packet_handler_t callback, hci_con_handle_t con_handle, gatt_client_operation_t * operation){
+    gatt_client_t * peripheral = provide_context_for_conn_handle(con_handle);
+    if (!peripheral) return BTSTACK_MEMORY_ALLOC_FAILED;
+    operation->callback = callback;
+    operation->operation_id = ++gatt_client_operation_id;
+    btstack_linked_list_add_tail(&peripheral->operations, (btstack_linked_item_t *) operation);
+    gatt_client_run();
+    return 0;
+}
+
 void gatt_client_pts_suppress_mtu_exchange(void){
     pts_suppress_mtu_exchange = 1;
 }
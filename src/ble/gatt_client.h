@@ -40,6 +40,7 @@
 #define btstack_gatt_client_h
 
 #include "hci.h"
+#include "ble/gatt_client_cache.h"
 
 #if defined __cplusplus
 extern "C" {
@@ -120,6 +121,8 @@ typedef enum {
     P_W4_CMAC_RESULT,
     P_W2_SEND_SIGNED_WRITE,
     P_W4_SEND_SINGED_WRITE_DONE,
+
+    P_W4_CACHE_REPLAY,
 } gatt_client_state_t;
     
     
@@ -175,6 +178,20 @@ typedef struct gatt_client{
     uint8_t  cmac[8];
 
     btstack_timer_source_t gc_timeout;
+
+    // operation queue
+    btstack_linked_list_t operations;
+    struct gatt_client_operation * active_operation;
+
+#ifdef ENABLE_GATT_CLIENT_CACHE
+    // discovery cache
+    uint8_t  cache_recording;
+    int      cache_le_device_index;
+    uint8_t  cache_key[GATT_CLIENT_CACHE_KEY_LEN];
+    uint16_t cache_results_len;
+    uint8_t  cache_results[GATT_CLIENT_CACHE_RESULTS_SIZE];
+    uint16_t service_changed_handle;
+#endif
 } gatt_client_t;
 
 typedef struct gatt_client_notification {
@@ -208,11 +225,56 @@ typedef struct {
     uint8_t  uuid128[16];
 } gatt_client_characteristic_descriptor_t;
 
+typedef enum {
+    GATT_CLIENT_OPERATION_DISCOVER_PRIMARY_SERVICES,
+    GATT_CLIENT_OPERATION_DISCOVER_CHARACTERISTICS,
+    GATT_CLIENT_OPERATION_DISCOVER_CHARACTERISTIC_DESCRIPTORS,
+    GATT_CLIENT_OPERATION_READ_VALUE,
+    GATT_CLIENT_OPERATION_READ_LONG_VALUE,
+    GATT_CLIENT_OPERATION_READ_DESCRIPTOR,
+    GATT_CLIENT_OPERATION_READ_LONG_DESCRIPTOR,
+    GATT_CLIENT_OPERATION_WRITE_VALUE,
+    GATT_CLIENT_OPERATION_WRITE_LONG_VALUE,
+    GATT_CLIENT_OPERATION_WRITE_DESCRIPTOR,
+    GATT_CLIENT_OPERATION_WRITE_LONG_DESCRIPTOR,
+    GATT_CLIENT_OPERATION_WRITE_WITHOUT_RESPONSE,
+    GATT_CLIENT_OPERATION_SIGNED_WRITE_WITHOUT_RESPONSE,
+} gatt_client_operation_type_t;
+
+// Queued GATT operation, storage provided by the application until GATT_EVENT_OPERATION_COMPLETE
+//  - discover characteristics: start_handle/end_handle of the service
+//  - discover characteristic descriptors: start_handle = value handle, end_handle = end handle of the characteristic
+//  - read/write value or descriptor: start_handle = attribute handle, offset for long read/write
+typedef struct gatt_client_operation {
+    btstack_linked_item_t    item;
+    btstack_packet_handler_t callback;
+    gatt_client_operation_type_t type;
+    uint16_t operation_id;
+    uint16_t start_handle;
+    uint16_t end_handle;
+    uint16_t offset;
+    uint16_t value_length;
+    uint8_t * value;
+} gatt_client_operation_t;
+
 /** 
  * @brief Set up GATT client.
  */
 void gatt_client_init(void);
 
+#ifdef ENABLE_GATT_CLIENT_CACHE
+/**
+ * @brief Set cache for discovery results of bonded devices. Service, characteristic and descriptor discovery
+ * queries that have been completed before are answered from the cache. The cache of a device is cleared when
+ * a Service Changed indication is received, also in later connections. Call before hci_power_control.
+ * @note The cache does not enable Service Changed indications itself. After bonding, the application must
+ * discover the Service Changed characteristic and enable its indications with
+ * gatt_client_write_client_characteristic_configuration, otherwise cached handles can become stale.
+ * @param cache implementation, e.g. gatt_client_cache_memory_instance() or gatt_client_cache_fs_instance()
+ */
+void gatt_client_set_cache(const gatt_client_cache_t * cache);
+#endif
+
 /** 
  * @brief MTU is available after the first query has completed. If status is equal to 0, it returns the real value, otherwise the default value of 23. 
  */
@@ -341,6 +403,18 @@ uint8_t gatt_client_write_client_characteristic_configuration(btstack_packet_han
  */
 void gatt_client_listen_for_characteristic_value_updates(gatt_client_notification_t * notification, btstack_packet_handler_t packet_handler, hci_con_handle_t con_handle, gatt_client_characteristic_t * characteristic);
 
+/**
+ * @brief Queue GATT operation. Operations on the same connection are started back-to-back in the order they were
+ * queued, consecutive Write Commands and Signed Writes are sent as long as ACL buffers are available.
+ * Query results are passed to the operation's callback, followed by GATT_EVENT_OPERATION_COMPLETE with the operation_id
+ * assigned here. Operations still queued on disconnect complete with ATT_ERROR_HCI_DISCONNECT_RECEIVED.
+ * @param callback
+ * @param con_handle
+ * @param operation with type and parameters set, must stay valid until completion
+ * @return status
+ */
+uint8_t gatt_client_queue_operation(btstack_packet_handler_t callback, hci_con_handle_t con_handle, gatt_client_operation_t * operation);
+
 /**
  * @brief -> gatt complete event
  */
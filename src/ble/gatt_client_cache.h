@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/**
+ * interface to provide GATT client discovery cache storage
+ */
+
+#ifndef __GATT_CLIENT_CACHE_H
+#define __GATT_CLIENT_CACHE_H
+
+#include <stdint.h>
+
+#include "btstack_config.h"
+#include "bluetooth.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// identity address type, identity address, query, start handle, end handle, uuid128
+#define GATT_CLIENT_CACHE_KEY_LEN 28
+
+// max size of the stored results of a single discovery query
+#ifndef GATT_CLIENT_CACHE_RESULTS_SIZE
+#define GATT_CLIENT_CACHE_RESULTS_SIZE 512
+#endif
+
+/* API_START */
+
+typedef struct {
+
+    // management
+    void (*open)(void);
+    void (*set_local_bd_addr)(bd_addr_t bd_addr);
+    void (*close)(void);
+
+    // discovery results, stored per le_device_db index
+    int  (*get_results)(int le_device_index, const uint8_t * key, uint8_t * results, uint16_t results_size, uint16_t * results_len);
+    void (*put_results)(int le_device_index, const uint8_t * key, const uint8_t * results, uint16_t results_len);
+    void (*delete_device)(int le_device_index);
+
+    // value handle of the Service Changed characteristic, stored per le_device_db index and kept by delete_device
+    uint16_t (*get_service_changed_handle)(int le_device_index);
+    void (*put_service_changed_handle)(int le_device_index, uint16_t service_changed_handle);
+
+} gatt_client_cache_t;
+
+/* API_END */
+
+#if defined __cplusplus
+}
+#endif
+
+#endif // __GATT_CLIENT_CACHE_H
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+#include "ble/gatt_client_cache_memory.h"
+#include "ble/gatt_client_cache_table.h"
+
+static gatt_client_cache_table_t cache_table;
+
+static void db_open(void){
+    gatt_client_cache_table_init(&cache_table);
+}
+
+static void db_set_local_bd_addr(bd_addr_t bd_addr){
+    (void)bd_addr;
+}
+
+static void db_close(void){
+}
+
+static int get_results(int le_device_index, const uint8_t * key, uint8_t * results, uint16_t results_size, uint16_t * results_len){
+    return gatt_client_cache_table_get_results(&cache_table, le_device_index, key, results, results_size, results_len);
+}
+
+static void put_results(int le_device_index, const uint8_t * key, const uint8_t * results, uint16_t results_len){
+    gatt_client_cache_table_put_results(&cache_table, le_device_index, key, results, results_len);
+}
+
+static void delete_device(int le_device_index){
+    gatt_client_cache_table_delete_device(&cache_table, le_device_index);
+}
+
+static uint16_t get_service_changed_handle(int le_device_index){
+    return gatt_client_cache_table_get_service_changed_handle(&cache_table, le_device_index);
+}
+
+static void put_service_changed_handle(int le_device_index, uint16_t service_changed_handle){
+    gatt_client_cache_table_put_service_changed_handle(&cache_table, le_device_index, service_changed_handle);
+}
+
+const gatt_client_cache_t gatt_client_cache_memory = {
+    db_open,
+    db_set_local_bd_addr,
+    db_close,
+    get_results,
+    put_results,
+    delete_device,
+    get_service_changed_handle,
+    put_service_changed_handle,
+};
+
+const gatt_client_cache_t * gatt_client_cache_memory_instance(void){
+    return &gatt_client_cache_memory;
+}
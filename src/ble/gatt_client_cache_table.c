@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+#include <string.h>
+
+#include "ble/gatt_client_cache_table.h"
+
+void gatt_client_cache_table_init(gatt_client_cache_table_t * table){
+    int i;
+    for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+        table->entries[i].le_device_index = -1;
+        table->devices[i].le_device_index = -1;
+    }
+    table->use_counter = 0;
+}
+
+static gatt_client_cache_entry_t * get_entry(gatt_client_cache_table_t * table, int le_device_index, const uint8_t * key){
+    int i;
+    for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+        if (table->entries[i].le_device_index != le_device_index) continue;
+        if (memcmp(table->entries[i].key, key, GATT_CLIENT_CACHE_KEY_LEN) != 0) continue;
+        return &table->entries[i];
+    }
+    return NULL;
+}
+
+int gatt_client_cache_table_get_results(gatt_client_cache_table_t * table, int le_device_index, const uint8_t * key, uint8_t * results, uint16_t results_size, uint16_t * results_len){
+    gatt_client_cache_entry_t * entry = get_entry(table, le_device_index, key);
+    if (!entry) return 0;
+    if (entry->results_len > results_size) return 0;
+    entry->last_used = ++table->use_counter;
+    memcpy(results, entry->results, entry->results_len);
+    *results_len = entry->results_len;
+    return 1;
+}
+
+int gatt_client_cache_table_put_results(gatt_client_cache_table_t * table, int le_device_index, const uint8_t * key, const uint8_t * results, uint16_t results_len){
+    if (results_len > GATT_CLIENT_CACHE_RESULTS_SIZE) return 0;
+
+    // replace existing entry, otherwise use free or least recently used one
+    gatt_client_cache_entry_t * entry = get_entry(table, le_device_index, key);
+    if (!entry){
+        int i;
+        entry = &table->entries[0];
+        for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+            if (table->entries[i].le_device_index < 0){
+                entry = &table->entries[i];
+                break;
+            }
+            if (table->entries[i].last_used < entry->last_used){
+                entry = &table->entries[i];
+            }
+        }
+    }
+    entry->le_device_index = le_device_index;
+    entry->last_used = ++table->use_counter;
+    memcpy(entry->key, key, GATT_CLIENT_CACHE_KEY_LEN);
+    entry->results_len = results_len;
+    memcpy(entry->results, results, results_len);
+    return 1;
+}
+
+void gatt_client_cache_table_delete_device(gatt_client_cache_table_t * table, int le_device_index){
+    int i;
+    for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+        if (table->entries[i].le_device_index != le_device_index) continue;
+        table->entries[i].le_device_index = -1;
+    }
+}
+
+static gatt_client_cache_device_t * get_device(gatt_client_cache_table_t * table, int le_device_index){
+    int i;
+    for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+        if (table->devices[i].le_device_index != le_device_index) continue;
+        return &table->devices[i];
+    }
+    return NULL;
+}
+
+static int device_has_results(gatt_client_cache_table_t * table, int le_device_index){
+    int i;
+    for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+        if (table->entries[i].le_device_index == le_device_index) return 1;
+    }
+    return 0;
+}
+
+uint16_t gatt_client_cache_table_get_service_changed_handle(gatt_client_cache_table_t * table, int le_device_index){
+    gatt_client_cache_device_t * device = get_device(table, le_device_index);
+    if (!device) return 0;
+    return device->service_changed_handle;
+}
+
+int gatt_client_cache_table_put_service_changed_handle(gatt_client_cache_table_t * table, int le_device_index, uint16_t service_changed_handle){
+    gatt_client_cache_device_t * device = get_device(table, le_device_index);
+    if (device && device->service_changed_handle == service_changed_handle) return 0;
+    if (!device){
+        // use free device, otherwise one without cached results
+        int i;
+        for (i=0;i<MAX_NR_GATT_CLIENT_CACHE_ENTRIES;i++){
+            if (table->devices[i].le_device_index < 0){
+                device = &table->devices[i];
+                break;
+            }
+            if (!device && !device_has_results(table, table->devices[i].le_device_index)){
+                device = &table->devices[i];
+            }
+        }
+        if (!device) return 0;
+    }
+    device->le_device_index = le_device_index;
+    device->service_changed_handle = service_changed_handle;
+    return 1;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/**
+ * table of GATT client cache entries with least recently used replacement,
+ * shared by the memory and file system cache implementations
+ */
+
+#ifndef __GATT_CLIENT_CACHE_TABLE_H
+#define __GATT_CLIENT_CACHE_TABLE_H
+
+#include <stdint.h>
+
+#include "btstack_config.h"
+#include "ble/gatt_client_cache.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#ifndef MAX_NR_GATT_CLIENT_CACHE_ENTRIES
+#define MAX_NR_GATT_CLIENT_CACHE_ENTRIES 8
+#endif
+
+typedef struct {
+    int      le_device_index;   // -1 if unused
+    uint32_t last_used;
+    uint8_t  key[GATT_CLIENT_CACHE_KEY_LEN];
+    uint16_t results_len;
+    uint8_t  results[GATT_CLIENT_CACHE_RESULTS_SIZE];
+} gatt_client_cache_entry_t;
+
+typedef struct {
+    int      le_device_index;   // -1 if unused
+    uint16_t service_changed_handle;
+} gatt_client_cache_device_t;
+
+typedef struct {
+    gatt_client_cache_entry_t entries[MAX_NR_GATT_CLIENT_CACHE_ENTRIES];
+    gatt_client_cache_device_t devices[MAX_NR_GATT_CLIENT_CACHE_ENTRIES];
+    uint32_t use_counter;
+} gatt_client_cache_table_t;
+
+/**
+ * @brief Mark all entries as unused
+ */
+void gatt_client_cache_table_init(gatt_client_cache_table_t * table);
+
+/**
+ * @brief Copy results for key into buffer
+ * @returns 1 if found and results fit into buffer
+ */
+int gatt_client_cache_table_get_results(gatt_client_cache_table_t * table, int le_device_index, const uint8_t * key, uint8_t * results, uint16_t results_size, uint16_t * results_len);
+
+/**
+ * @brief Store results for key, replaces existing entry for key, a free entry, or the least recently used one
+ * @returns 1 if stored
+ */
+int gatt_client_cache_table_put_results(gatt_client_cache_table_t * table, int le_device_index, const uint8_t * key, const uint8_t * results, uint16_t results_len);
+
+/**
+ * @brief Mark entries of device as unused, Service Changed handle is kept
+ */
+void gatt_client_cache_table_delete_device(gatt_client_cache_table_t * table, int le_device_index);
+
+/**
+ * @brief Get Service Changed handle of device
+ * @returns handle or 0 if not known
+ */
+uint16_t gatt_client_cache_table_get_service_changed_handle(gatt_client_cache_table_t * table, int le_device_index);
+
+/**
+ * @brief Store Service Changed handle of device, replaces a device without cached results if table is full
+ * @returns 1 if stored handle changed
+ */
+int gatt_client_cache_table_put_service_changed_handle(gatt_client_cache_table_t * table, int le_device_index, uint16_t service_changed_handle);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif // __GATT_CLIENT_CACHE_TABLE_H
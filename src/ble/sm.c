@@ -51,6 +51,10 @@
 #include "hci_dump.h"
 #include "l2cap.h"
 
+#ifdef ENABLE_SOFTWARE_AES128
+#include "rijndael.h"
+#endif
+
 #if !defined(ENABLE_LE_PERIPHERAL) && !defined(ENABLE_LE_CENTRAL)
 #error "LE Security Manager used, but neither ENABLE_LE_PERIPHERAL nor ENABLE_LE_CENTRAL defined. Please add at least one to btstack_config.h."
 #endif
@@ -87,6 +91,11 @@
 #define ENABLE_CMAC_ENGINE
 #endif
 
+// number of recently resolved private addresses remembered by the address resolution
+#ifndef SM_RESOLVED_ADDRESS_CACHE_SIZE
+#define SM_RESOLVED_ADDRESS_CACHE_SIZE 8
+#endif
+
 //
 // SM internal types and globals
 //
@@ -153,6 +162,11 @@ typedef enum {
     ADDRESS_RESOLUTION_FAILED,
 } address_resolution_event_t;
 
+typedef struct {
+    bd_addr_t address;
+    int       le_db_index;
+} sm_resolved_address_t;
+
 typedef enum {
     EC_KEY_GENERATION_IDLE,
     EC_KEY_GENERATION_ACTIVE,
@@ -232,11 +246,22 @@ static bd_addr_t sm_address_resolution_address;
 static void *    sm_address_resolution_context;
 static address_resolution_mode_t sm_address_resolution_mode;
 static btstack_linked_list_t sm_address_resolution_general_queue;
+static int       sm_address_resolution_cache_hit;
+
+// resolved private addresses, most recently used first
+static sm_resolved_address_t sm_resolved_address_cache[SM_RESOLVED_ADDRESS_CACHE_SIZE];
+static int                   sm_resolved_address_cache_count;
 
 // aes128 crypto engine. store current sm_connection_t in sm_aes128_context
 static sm_aes128_state_t  sm_aes128_state;
 static void *             sm_aes128_context;
 
+// optional synchronous aes128 engine, result is stored in HCI byte order until processed by sm_run
+static void (*sm_aes128_engine)(const sm_key_t key, const sm_key_t plaintext, sm_key_t ciphertext);
+static int                sm_aes128_result_ready;
+static sm_key_t           sm_aes128_result;
+static int                sm_run_active;
+
 // random engine. store context (ususally sm_connection_t)
 static void * sm_random_context;
 
@@ -382,6 +407,7 @@ static const stk_generation_method_t stk_generation_method_with_secure_connectio
 #endif
 
 static void sm_run(void);
+static void sm_handle_encryption_result(uint8_t * data);
 static void sm_done_for_handle(hci_con_handle_t con_handle);
 static sm_connection_t * sm_get_connection_for_handle(hci_con_handle_t con_handle);
 static inline int sm_calc_actual_encryption_key_size(int other);
@@ -500,17 +526,33 @@ static void sm_random_start(void * context){
     hci_send_cmd(&hci_le_rand);
 }
 
-// pre: sm_aes128_state != SM_AES128_ACTIVE, hci_can_send_command == 1
+// pre: sm_aes128_state != SM_AES128_ACTIVE, hci_can_send_command == 1 (unless sm_aes128_engine is set)
 // context is made availabe to aes128 result handler by this
 static void sm_aes128_start(sm_key_t key, sm_key_t plaintext, void * context){
     sm_aes128_state = SM_AES128_ACTIVE;
+    sm_aes128_context = context;
+    if (sm_aes128_engine){
+        // calculate synchronously, store result in HCI byte order for sm_run to process
+        sm_key_t ciphertext;
+        (*sm_aes128_engine)(key, plaintext, ciphertext);
+        reverse_128(ciphertext, sm_aes128_result);
+        sm_aes128_result_ready = 1;
+        return;
+    }
     sm_key_t key_flipped, plaintext_flipped;
     reverse_128(key, key_flipped);
     reverse_128(plaintext, plaintext_flipped);
-    sm_aes128_context = context;
     hci_send_cmd(&hci_le_encrypt, key_flipped, plaintext_flipped);
 }
 
+#ifdef ENABLE_SOFTWARE_AES128
+static void sm_aes128_software_engine(const sm_key_t key, const sm_key_t plaintext, sm_key_t ciphertext){
+    uint32_t rk[RKLENGTH(KEYBITS)];
+    int nrounds = rijndaelSetupEncrypt(rk, &key[0], KEYBITS);
+    rijndaelEncrypt(rk, nrounds, plaintext, ciphertext);
+}
+#endif
+
 // ah(k,r) helper
 // r = padding || r
 // r - 24 bit value
@@ -594,92 +636,10 @@ static void sm_s1_r_prime(sm_key_t r1, sm_key_t r2, uint8_t * r_prime){
 }
 
 #ifdef ENABLE_LE_SECURE_CONNECTIONS
-// Software implementations of crypto toolbox for LE Secure Connection
-// TODO: replace with code to use AES Engine of HCI Controller
 typedef uint8_t sm_key24_t[3];
 typedef uint8_t sm_key56_t[7];
 typedef uint8_t sm_key256_t[32];
 
-#if 0
-static void aes128_calc_cyphertext(const uint8_t key[16], const uint8_t plaintext[16], uint8_t cyphertext[16]){
-    uint32_t rk[RKLENGTH(KEYBITS)];
-    int nrounds = rijndaelSetupEncrypt(rk, &key[0], KEYBITS);
-    rijndaelEncrypt(rk, nrounds, plaintext, cyphertext);
-}
-
-static void calc_subkeys(sm_key_t k0, sm_key_t k1, sm_key_t k2){
-    memcpy(k1, k0, 16);
-    sm_shift_left_by_one_bit_inplace(16, k1);
-    if (k0[0] & 0x80){
-        k1[15] ^= 0x87;
-    }
-    memcpy(k2, k1, 16);
-    sm_shift_left_by_one_bit_inplace(16, k2);
-    if (k1[0] & 0x80){
-        k2[15] ^= 0x87;
-    } 
-}
-
-static void aes_cmac(sm_key_t aes_cmac, const sm_key_t key, const uint8_t * data, int cmac_message_len){
-    sm_key_t k0, k1, k2, zero;
-    memset(zero, 0, 16);
-
-    aes128_calc_cyphertext(key, zero, k0);
-    calc_subkeys(k0, k1, k2);
-
-    int cmac_block_count = (cmac_message_len + 15) / 16;
-
-    // step 3: ..
-    if (cmac_block_count==0){
-        cmac_block_count = 1;
-    }
-
-    // step 4: set m_last
-    sm_key_t cmac_m_last;
-    int sm_cmac_last_block_complete = cmac_message_len != 0 && (cmac_message_len & 0x0f) == 0;
-    int i;
-    if (sm_cmac_last_block_complete){
-        for (i=0;i<16;i++){
-            cmac_m_last[i] = data[cmac_message_len - 16 + i] ^ k1[i];
-        }
-    } else {
-        int valid_octets_in_last_block = cmac_message_len & 0x0f;
-        for (i=0;i<16;i++){
-            if (i < valid_octets_in_last_block){
-                cmac_m_last[i] = data[(cmac_message_len & 0xfff0) + i] ^ k2[i];
-                continue;
-            }
-            if (i == valid_octets_in_last_block){
-                cmac_m_last[i] = 0x80 ^ k2[i];
-                continue;
-            }
-            cmac_m_last[i] = k2[i];
-        }
-    }
-
-    // printf("sm_cmac_start: len %u, block count %u\n", cmac_message_len, cmac_block_count);
-    // LOG_KEY(cmac_m_last);
-
-    // Step 5
-    sm_key_t cmac_x;
-    memset(cmac_x, 0, 16);
-
-    // Step 6
-    sm_key_t sm_cmac_y;
-    for (int block = 0 ; block < cmac_block_count-1 ; block++){
-        for (i=0;i<16;i++){
-            sm_cmac_y[i] = cmac_x[i] ^ data[block * 16 + i];
-        }
-        aes128_calc_cyphertext(key, sm_cmac_y, cmac_x);
-    }
-    for (i=0;i<16;i++){
-        sm_cmac_y[i] = cmac_x[i] ^ cmac_m_last[i];
-    }
-
-    // Step 7
-    aes128_calc_cyphertext(key, sm_cmac_y, aes_cmac);
-}
-#endif
 #endif
 
 static void sm_setup_event_base(uint8_t * event, int event_size, uint8_t type, hci_con_handle_t con_handle, uint8_t addr_type, bd_addr_t address){
@@ -829,6 +789,40 @@ static void sm_setup_key_distribution(uint8_t key_set){
 // CSRK Key Lookup
 
 
+// returns le_db_index of cached entry and moves it to front, or -1
+static int sm_resolved_address_cache_lookup(bd_addr_t address){
+    int i;
+    for (i=0;i<sm_resolved_address_cache_count;i++){
+        if (memcmp(sm_resolved_address_cache[i].address, address, 6) != 0) continue;
+        sm_resolved_address_t entry = sm_resolved_address_cache[i];
+        memmove(&sm_resolved_address_cache[1], &sm_resolved_address_cache[0], i * sizeof(sm_resolved_address_t));
+        sm_resolved_address_cache[0] = entry;
+        return entry.le_db_index;
+    }
+    return -1;
+}
+
+static void sm_resolved_address_cache_remove(bd_addr_t address){
+    int i;
+    for (i=0;i<sm_resolved_address_cache_count;i++){
+        if (memcmp(sm_resolved_address_cache[i].address, address, 6) != 0) continue;
+        sm_resolved_address_cache_count--;
+        memmove(&sm_resolved_address_cache[i], &sm_resolved_address_cache[i+1], (sm_resolved_address_cache_count - i) * sizeof(sm_resolved_address_t));
+        return;
+    }
+}
+
+// add entry to front, drops least recently used entry if full
+static void sm_resolved_address_cache_add(bd_addr_t address, int le_db_index){
+    sm_resolved_address_cache_remove(address);
+    if (sm_resolved_address_cache_count < SM_RESOLVED_ADDRESS_CACHE_SIZE){
+        sm_resolved_address_cache_count++;
+    }
+    memmove(&sm_resolved_address_cache[1], &sm_resolved_address_cache[0], (sm_resolved_address_cache_count - 1) * sizeof(sm_resolved_address_t));
+    memcpy(sm_resolved_address_cache[0].address, address, 6);
+    sm_resolved_address_cache[0].le_db_index = le_db_index;
+}
+
 static int sm_address_resolution_idle(void){
     return sm_address_resolution_mode == ADDRESS_RESOLUTION_IDLE;
 }
@@ -839,6 +833,16 @@ static void sm_address_resolution_start_lookup(uint8_t addr_type, hci_con_handle
     sm_address_resolution_test = 0;
     sm_address_resolution_mode = mode;
     sm_address_resolution_context = context;
+    // start with cached device, it is verified by a single ah() calculation
+    sm_address_resolution_cache_hit = 0;
+    if (addr_type){
+        int le_db_index = sm_resolved_address_cache_lookup(addr);
+        if (le_db_index >= 0 && le_db_index < le_device_db_count()){
+            log_info("LE Device Lookup: cached device %u", le_db_index);
+            sm_address_resolution_test = le_db_index;
+            sm_address_resolution_cache_hit = 1;
+        }
+    }
     sm_notify_client_base(SM_EVENT_IDENTITY_RESOLVING_STARTED, con_handle, addr_type, addr);
 }
 
@@ -1209,6 +1213,18 @@ static int sm_stk_generation_init(sm_connection_t * sm_conn){
     return 0;
 }
 
+// ah() did not match current device
+static void sm_address_resolution_try_next(void){
+    if (sm_address_resolution_cache_hit){
+        // cached device is stale, do full lookup
+        sm_address_resolution_cache_hit = 0;
+        sm_resolved_address_cache_remove(sm_address_resolution_address);
+        sm_address_resolution_test = 0;
+        return;
+    }
+    sm_address_resolution_test++;
+}
+
 static void sm_address_resolution_handle_event(address_resolution_event_t event){
 
     // cache and reset context
@@ -1220,8 +1236,13 @@ static void sm_address_resolution_handle_event(address_resolution_event_t event)
     sm_address_resolution_mode = ADDRESS_RESOLUTION_IDLE;
     sm_address_resolution_context = NULL;
     sm_address_resolution_test = -1;
+    sm_address_resolution_cache_hit = 0;
     hci_con_handle_t con_handle = 0;
 
+    if (event == ADDRESS_RESOLUTION_SUCEEDED && sm_address_resolution_addr_type){
+        sm_resolved_address_cache_add(sm_address_resolution_address, matched_device_id);
+    }
+
     sm_connection_t * sm_connection;
 #ifdef ENABLE_LE_CENTRAL
     sm_key_t ltk;
@@ -1819,7 +1840,7 @@ static void sm_start_calculating_ltk_from_ediv_and_rand(sm_connection_t * sm_con
 }
 #endif
 
-static void sm_run(void){
+static void sm_run_step(void){
 
     btstack_linked_list_iterator_t it;    
 
@@ -1904,6 +1925,12 @@ static void sm_run(void){
             // already busy?
             if (sm_aes128_state == SM_AES128_ACTIVE) break;
             sm_cmac_handle_aes_engine_ready();
+            // software engine: process all blocks but the last one here, m_last result is handled by sm_run
+            while (sm_aes128_result_ready && sm_cmac_state != CMAC_W4_MLAST){
+                sm_aes128_result_ready = 0;
+                sm_handle_encryption_result(sm_aes128_result);
+                sm_cmac_handle_aes_engine_ready();
+            }
             return;
         default:
             break;
@@ -1957,13 +1984,27 @@ static void sm_run(void){
                 continue;
             }
 
+            sm_key_t r_prime;
+            sm_ah_r_prime(sm_address_resolution_address, r_prime);
+
+            if (sm_aes128_engine){
+                // check all IRKs in a single pass
+                sm_key_t ah;
+                (*sm_aes128_engine)(irk, r_prime, ah);
+                if (memcmp(&ah[13], &sm_address_resolution_address[3], 3) == 0){
+                    log_info("LE Device Lookup: matched resolvable private address");
+                    sm_address_resolution_handle_event(ADDRESS_RESOLUTION_SUCEEDED);
+                    break;
+                }
+                sm_address_resolution_try_next();
+                continue;
+            }
+
             if (sm_aes128_state == SM_AES128_ACTIVE) break;
 
             log_info("LE Device Lookup: calculate AH");
             log_info_key("IRK", irk);
 
-            sm_key_t r_prime;
-            sm_ah_r_prime(sm_address_resolution_address, r_prime);
             sm_address_resolution_ah_calculation_active = 1;
             sm_aes128_start(irk, r_prime, sm_address_resolution_context);   // keep context
             return;
@@ -2609,7 +2650,7 @@ static void sm_handle_encryption_result(uint8_t * data){
             return;
         }
         // no match, try next
-        sm_address_resolution_test++;
+        sm_address_resolution_try_next();
         return;
     }
 
@@ -2766,6 +2807,22 @@ static void sm_handle_encryption_result(uint8_t * data){
     }
 }
 
+static void sm_run(void){
+    // results from a synchronous aes128 engine are processed by the outermost invocation only
+    if (sm_run_active) {
+        sm_run_step();
+        return;
+    }
+    sm_run_active = 1;
+    sm_run_step();
+    while (sm_aes128_result_ready){
+        sm_aes128_result_ready = 0;
+        sm_handle_encryption_result(sm_aes128_result);
+        sm_run_step();
+    }
+    sm_run_active = 0;
+}
+
 #ifdef USE_MBEDTLS_FOR_ECDH
 
 static int sm_generate_f_rng(void * context, unsigned char * buffer, size_t size){
@@ -3674,6 +3731,10 @@ void sm_set_ir(sm_key_t ir){
     memcpy(sm_persistent_ir, ir, 16);
 }
 
+void sm_set_aes128_engine(void (*aes128_encrypt)(const sm_key_t key, const sm_key_t plaintext, sm_key_t ciphertext)){
+    sm_aes128_engine = aes128_encrypt;
+}
+
 // Testing support only
 void sm_test_set_irk(sm_key_t irk){
     memcpy(sm_persistent_irk, irk, 16);
@@ -3710,10 +3771,15 @@ void sm_init(void){
     dkg_state = DKG_W4_WORKING;
     rau_state = RAU_W4_WORKING;
     sm_aes128_state = SM_AES128_IDLE;
+    sm_aes128_result_ready = 0;
+#ifdef ENABLE_SOFTWARE_AES128
+    sm_aes128_engine = &sm_aes128_software_engine;
+#endif
     sm_address_resolution_test = -1;    // no private address to resolve yet
     sm_address_resolution_ah_calculation_active = 0;
     sm_address_resolution_mode = ADDRESS_RESOLUTION_IDLE;
     sm_address_resolution_general_queue = NULL;
+    sm_resolved_address_cache_count = 0;
     
     gap_random_adress_update_period = 15 * 60 * 1000L;
     sm_active_connection = 0;
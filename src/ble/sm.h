@@ -115,6 +115,14 @@ void sm_set_er(sm_key_t er);
  */
 void sm_set_ir(sm_key_t ir);
 
+/**
+ * @brief Provide synchronous AES-128 implementation used instead of the HCI LE Encrypt command
+ * @note With ENABLE_SOFTWARE_AES128, the bundled rijndael implementation is installed by sm_init
+ * @note Key, plaintext and ciphertext are in big endian. Pass NULL to use the Controller again.
+ * @param aes128_encrypt
+ */
+void sm_set_aes128_engine(void (*aes128_encrypt)(const sm_key_t key, const sm_key_t plaintext, sm_key_t ciphertext));
+
 /**
  *
  * @brief Registers OOB Data Callback. The callback should set the oob_data and return 1 if OOB data is availble
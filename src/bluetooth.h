@@ -51,6 +51,11 @@
  */
 typedef uint16_t hci_con_handle_t;
 
+/**
+ * @brief invalid connection handle, valid handles are in the range 0x0000-0x0EFF
+ */
+#define HCI_CON_HANDLE_INVALID 0xffff
+
 /**
  * @brief Length of a bluetooth device address.
  */
@@ -661,7 +666,34 @@ typedef enum {
 #define L2CAP_CID_SECURITY_MANAGER_PROTOCOL 0x0006
 
 // L2CAP Configuration Result Codes
-#define L2CAP_CONF_RESULT_UNKNOWN_OPTIONS   0x0003
+#define L2CAP_CONF_RESULT_SUCCESS                   0x0000
+#define L2CAP_CONF_RESULT_UNACCEPTABLE_PARAMETERS   0x0001
+#define L2CAP_CONF_RESULT_REJECT                    0x0002
+#define L2CAP_CONF_RESULT_UNKNOWN_OPTIONS           0x0003
+#define L2CAP_CONF_RESULT_PENDING                   0x0004
+
+// L2CAP Configuration Option Types
+#define L2CAP_CONF_OPTION_TYPE_MTU                  0x01
+#define L2CAP_CONF_OPTION_TYPE_FLUSH_TIMEOUT        0x02
+#define L2CAP_CONF_OPTION_TYPE_RETRANSMISSION_AND_FLOW_CONTROL 0x04
+#define L2CAP_CONF_OPTION_TYPE_FRAME_CHECK_SEQUENCE 0x05
+
+// L2CAP Channel Modes
+#define L2CAP_CHANNEL_MODE_BASIC                    0x00
+#define L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION  0x03
+#define L2CAP_CHANNEL_MODE_STREAMING                0x04
+
+// L2CAP Information Request Info Types
+#define L2CAP_INFO_TYPE_CONNECTIONLESS_MTU          0x0001
+#define L2CAP_INFO_TYPE_EXTENDED_FEATURES           0x0002
+#define L2CAP_INFO_TYPE_FIXED_CHANNELS              0x0003
+
+// L2CAP Extended Feature Mask
+#define L2CAP_EXTENDED_FEATURE_ENHANCED_RETRANSMISSION_MODE 0x0008
+#define L2CAP_EXTENDED_FEATURE_STREAMING_MODE       0x0010
+#define L2CAP_EXTENDED_FEATURE_FCS_OPTION           0x0020
+#define L2CAP_EXTENDED_FEATURE_FIXED_CHANNELS       0x0080
+#define L2CAP_EXTENDED_FEATURE_UNICAST_CONNECTIONLESS_DATA 0x0200
 
 // L2CAP Reject Result Codes
 #define L2CAP_REJ_CMD_UNKNOWN               0x0000
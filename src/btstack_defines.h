@@ -131,6 +131,7 @@ typedef uint8_t sm_key_t[16];
 #define L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU                  0x6A
 #define L2CAP_SERVICE_DOES_NOT_EXIST                       0x6B
 #define L2CAP_LOCAL_CID_DOES_NOT_EXIST                     0x6C
+#define L2CAP_CONNECTION_RESPONSE_RESULT_ERTM_NOT_SUPPORTED 0x6D
     
 #define RFCOMM_MULTIPLEXER_STOPPED                         0x70
 #define RFCOMM_CHANNEL_ALREADY_REGISTERED                  0x71
@@ -333,6 +334,13 @@ typedef uint8_t sm_key_t[16];
  */
 #define DAEMON_EVENT_L2CAP_SERVICE_REGISTERED              0x75
 
+/**
+ * @format 12
+ * @param status
+ * @param local_cid
+ */
+#define DAEMON_EVENT_L2CAP_SEND_FAILED                     0x7A
+
 /**
  * @format 21
  * @param rfcomm_cid
@@ -354,6 +362,13 @@ typedef uint8_t sm_key_t[16];
  */
 #define DAEMON_EVENT_RFCOMM_PERSISTENT_CHANNEL             0x86
 
+/**
+ * @format 12
+ * @param status
+ * @param rfcomm_cid
+ */
+#define DAEMON_EVENT_RFCOMM_SEND_FAILED                    0x8A
+
 /**
   * @format 14
   * @param status
@@ -681,6 +696,14 @@ typedef uint8_t sm_key_t[16];
  */    
 #define GATT_EVENT_MTU                                           0xAB
 
+/**
+ * @format H21
+ * @param handle
+ * @param operation_id
+ * @param status
+ */
+#define GATT_EVENT_OPERATION_COMPLETE                            0xAC
+
 /** 
  * @format H2
  * @param handle
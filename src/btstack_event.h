@@ -2028,6 +2028,36 @@ static inline uint16_t gatt_event_mtu_get_MTU(const uint8_t * event){
 }
 #endif
 
+#ifdef ENABLE_BLE
+/**
+ * @brief Get field handle from event GATT_EVENT_OPERATION_COMPLETE
+ * @param event packet
+ * @return handle
+ * @note: btstack_type H
+ */
+static inline hci_con_handle_t gatt_event_operation_complete_get_handle(const uint8_t * event){
+    return little_endian_read_16(event, 2);
+}
+/**
+ * @brief Get field operation_id from event GATT_EVENT_OPERATION_COMPLETE
+ * @param event packet
+ * @return operation_id
+ * @note: btstack_type 2
+ */
+static inline uint16_t gatt_event_operation_complete_get_operation_id(const uint8_t * event){
+    return little_endian_read_16(event, 4);
+}
+/**
+ * @brief Get field status from event GATT_EVENT_OPERATION_COMPLETE
+ * @param event packet
+ * @return status
+ * @note: btstack_type 1
+ */
+static inline uint8_t gatt_event_operation_complete_get_status(const uint8_t * event){
+    return event[6];
+}
+#endif
+
 /**
  * @brief Get field handle from event ATT_EVENT_MTU_EXCHANGE_COMPLETE
  * @param event packet
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  btstack_run_loop_bridge.c
+ *
+ *  Items are passed to the BTstack thread via an intrusive multi-producer/single-consumer queue
+ *  (D. Vyukov). Producers only need a single atomic exchange, the BTstack thread never blocks.
+ *  The run loop is only triggered if no wakeup is pending already.
+ */
+
+#include "btstack_run_loop_bridge.h"
+#include "btstack_debug.h"
+
+#include <stddef.h>
+
+#if defined(__GNUC__)
+#define BRIDGE_EXCHANGE_POINTER(ptr, value) __atomic_exchange_n(ptr, value, __ATOMIC_ACQ_REL)
+#define BRIDGE_EXCHANGE_INT(ptr, value)     __atomic_exchange_n(ptr, value, __ATOMIC_ACQ_REL)
+#define BRIDGE_LOAD_POINTER(ptr)            __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define BRIDGE_STORE_POINTER(ptr, value)    __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#include <windows.h>
+#define BRIDGE_EXCHANGE_POINTER(ptr, value) InterlockedExchangePointer((PVOID volatile *) (ptr), (PVOID) (value))
+#define BRIDGE_EXCHANGE_INT(ptr, value)     InterlockedExchange((LONG volatile *) (ptr), (LONG) (value))
+#define BRIDGE_LOAD_POINTER(ptr)            (*(ptr))
+#define BRIDGE_STORE_POINTER(ptr, value)    (*(ptr) = (value))
+#else
+#error "btstack_run_loop_bridge requires atomic exchange, please provide BRIDGE_EXCHANGE_POINTER/INT for your compiler"
+#endif
+
+// queue: producers add at head, BTstack thread removes at tail
+static btstack_run_loop_bridge_item_t * volatile bridge_head;
+static btstack_run_loop_bridge_item_t *          bridge_tail;
+static btstack_run_loop_bridge_item_t            bridge_stub;
+
+static volatile int32_t bridge_trigger_pending;
+
+static void (*bridge_trigger)(void);
+
+static void btstack_run_loop_bridge_push(btstack_run_loop_bridge_item_t * item){
+    item->next = NULL;
+    btstack_run_loop_bridge_item_t * prev = BRIDGE_EXCHANGE_POINTER(&bridge_head, item);
+    // queue is inconsistent until prev->next is set, consumer will wait for it
+    BRIDGE_STORE_POINTER(&prev->next, item);
+}
+
+static btstack_run_loop_bridge_item_t * btstack_run_loop_bridge_pop(void){
+    btstack_run_loop_bridge_item_t * tail = bridge_tail;
+    btstack_run_loop_bridge_item_t * next = BRIDGE_LOAD_POINTER(&tail->next);
+    if (tail == &bridge_stub){
+        if (!next) return NULL;
+        bridge_tail = next;
+        tail = next;
+        next = BRIDGE_LOAD_POINTER(&next->next);
+    }
+    if (next){
+        bridge_tail = next;
+        return tail;
+    }
+    // producer is between exchange and link, it will trigger the run loop afterwards
+    if (tail != BRIDGE_LOAD_POINTER(&bridge_head)) return NULL;
+    // last item: re-insert stub to detach it
+    btstack_run_loop_bridge_push(&bridge_stub);
+    next = BRIDGE_LOAD_POINTER(&tail->next);
+    if (next){
+        bridge_tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static void btstack_run_loop_bridge_post(btstack_run_loop_bridge_item_t * item){
+    btstack_run_loop_bridge_push(item);
+    if (BRIDGE_EXCHANGE_INT(&bridge_trigger_pending, 1)) return;
+    if (bridge_trigger){
+        (*bridge_trigger)();
+    }
+}
+
+void btstack_run_loop_bridge_init(void (*trigger)(void)){
+    bridge_stub.next = NULL;
+    bridge_head = &bridge_stub;
+    bridge_tail = &bridge_stub;
+    bridge_trigger_pending = 0;
+    bridge_trigger = trigger;
+}
+
+void btstack_run_loop_bridge_post_callback(btstack_run_loop_bridge_item_t * item, void (*callback)(void * context), void * context){
+    item->callback = callback;
+    item->context  = context;
+    item->packet_handler = NULL;
+    btstack_run_loop_bridge_post(item);
+}
+
+void btstack_run_loop_bridge_post_packet(btstack_run_loop_bridge_item_t * item, btstack_packet_handler_t packet_handler,
+    uint8_t packet_type, uint16_t channel, uint8_t * packet, uint16_t size){
+    item->callback       = NULL;
+    item->packet_handler = packet_handler;
+    item->packet_type    = packet_type;
+    item->channel        = channel;
+    item->packet         = packet;
+    item->size           = size;
+    btstack_run_loop_bridge_post(item);
+}
+
+void btstack_run_loop_bridge_process(void){
+    // clear before draining queue, items posted from now on will trigger again
+    BRIDGE_EXCHANGE_INT(&bridge_trigger_pending, 0);
+    while (1){
+        btstack_run_loop_bridge_item_t * item = btstack_run_loop_bridge_pop();
+        if (!item) break;
+        // item might get reused or freed by callback
+        if (item->packet_handler){
+            btstack_packet_handler_t packet_handler = item->packet_handler;
+            (*packet_handler)(item->packet_type, item->channel, item->packet, item->size);
+        } else if (item->callback){
+            void (*callback)(void * context) = item->callback;
+            (*callback)(item->context);
+        } else {
+            log_error("btstack_run_loop_bridge_process: item %p without callback", item);
+        }
+    }
+}
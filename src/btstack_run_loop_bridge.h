@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  btstack_run_loop_bridge.h
+ *
+ *  Post callbacks and packets from other threads into the BTstack thread
+ */
+
+#ifndef __BTSTACK_RUN_LOOP_BRIDGE_H
+#define __BTSTACK_RUN_LOOP_BRIDGE_H
+
+#include "btstack_defines.h"
+
+#include <stdint.h>
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+typedef struct btstack_run_loop_bridge_item {
+    // next item in queue, managed by bridge
+    struct btstack_run_loop_bridge_item * volatile next;
+
+    // either callback with context ...
+    void (*callback)(void * context);
+    void * context;
+
+    // ... or packet handler with packet
+    btstack_packet_handler_t packet_handler;
+    uint8_t  * packet;
+    uint16_t   channel;
+    uint16_t   size;
+    uint8_t    packet_type;
+} btstack_run_loop_bridge_item_t;
+
+/* API_START */
+
+/**
+ * @brief Init bridge. Called by run loop specific bridge init function on the BTstack thread.
+ * @param trigger function to wake up the BTstack thread. It can be called from any thread.
+ */
+void btstack_run_loop_bridge_init(void (*trigger)(void));
+
+/**
+ * @brief Execute callback on BTstack thread. Can be called from any thread.
+ * @note The item is owned by the bridge until the callback gets called. It can be reused or freed from within the callback.
+ * @param item
+ * @param callback
+ * @param context
+ */
+void btstack_run_loop_bridge_post_callback(btstack_run_loop_bridge_item_t * item, void (*callback)(void * context), void * context);
+
+/**
+ * @brief Deliver packet to packet handler on BTstack thread. Can be called from any thread.
+ * @note The item and the packet are owned by the bridge until the packet handler gets called. Both can be reused or freed from within the packet handler.
+ * @param item
+ * @param packet_handler
+ * @param packet_type
+ * @param channel
+ * @param packet
+ * @param size
+ */
+void btstack_run_loop_bridge_post_packet(btstack_run_loop_bridge_item_t * item, btstack_packet_handler_t packet_handler,
+    uint8_t packet_type, uint16_t channel, uint8_t * packet, uint16_t size);
+
+/**
+ * @brief Execute all posted callbacks. Called by run loop specific bridge on the BTstack thread.
+ */
+void btstack_run_loop_bridge_process(void);
+
+/* API_END */
+
+#if defined __cplusplus
+}
+#endif
+
+#endif // __BTSTACK_RUN_LOOP_BRIDGE_H
@@ -40,6 +40,8 @@
  *  SLIP encoder/decoder
  */
 
+#include <string.h>
+
 #include "btstack_slip.h"
 #include "btstack_debug.h"
 
@@ -216,6 +218,41 @@ void btstack_slip_decoder_process(uint8_t input){
     }
 }
 
+/**
+ * @brief Process block of received data
+ * @note stops after a complete frame has been decoded, call btstack_slip_decoder_init before processing the remaining data
+ * @param data
+ * @param len
+ * @return number of bytes consumed
+ */
+uint16_t btstack_slip_decoder_process_data(const uint8_t * data, uint16_t len){
+    uint16_t pos = 0;
+    while (pos < len && decoder_state != SLIP_DECODER_COMPLETE){
+        if (decoder_state == SLIP_DECODER_ACTIVE){
+            // copy run of unescaped bytes directly
+            uint16_t run = 0;
+            while ((pos + run) < len){
+                uint8_t input = data[pos + run];
+                if (input == BTSTACK_SLIP_SOF || input == 0xdb) break;
+                run++;
+            }
+            if (run){
+                if ((decoder_pos + run) > decoder_max_size){
+                    log_error("btstack_slip_decoder_process_data: packet to long");
+                    btstack_slip_decoder_reset();
+                } else {
+                    memcpy(&decoder_buffer[decoder_pos], &data[pos], run);
+                    decoder_pos += run;
+                }
+                pos += run;
+                continue;
+            }
+        }
+        btstack_slip_decoder_process(data[pos++]);
+    }
+    return pos;
+}
+
 /**
  * @brief Get size of decoded frame
  * @return size of frame. Size = 0 => frame not complete
@@ -88,6 +88,15 @@ void btstack_slip_decoder_init(uint8_t * buffer, uint16_t max_size);
 
 void btstack_slip_decoder_process(uint8_t input);
 
+/**
+ * @brief Process block of received data
+ * @note stops after a complete frame has been decoded, call btstack_slip_decoder_init before processing the remaining data
+ * @param data
+ * @param len
+ * @return number of bytes consumed
+ */
+uint16_t btstack_slip_decoder_process_data(const uint8_t * data, uint16_t len);
+
 /**
  * @brief Get size of decoded frame
  * @return size of frame. Size = 0 => frame not complete
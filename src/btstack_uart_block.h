@@ -132,6 +132,18 @@ typedef struct {
      */
     void (*set_sleep)(btstack_uart_sleep_mode_t sleep_mode);
 
+    // optional support for streaming receive, used by H4 to process multiple packets per read
+
+    /**
+     * set callback for bytes received, NULL if streaming receive is not supported
+     */
+    void (*set_bytes_received)(void (*bytes_handler)(uint16_t num_bytes));
+
+    /**
+     * receive available bytes up to max_len, bytes handler is called as soon as at least one byte was received
+     */
+    void (*receive_bytes)(uint8_t *buffer, uint16_t max_len);
+
 } btstack_uart_block_t;
 
 // common implementations
@@ -244,7 +244,8 @@ void log_info_key(const char * name, sm_key_t key){
     log_info("%-6s %s", name, buffer);
 #else
     UNUSED(name);
-    UNUSED(key);
+    // sizeof on array parameter warns
+    (void) key;
 #endif
 }
 
@@ -391,6 +391,8 @@ static void stream_endpoint_state_machine(avdtp_connection_t * connection, avdtp
                         stream_endpoint->state = AVDTP_STREAM_ENDPOINT_OPENED;
                         stream_endpoint->connection = connection;
                         stream_endpoint->l2cap_media_cid = l2cap_event_channel_opened_get_local_cid(packet);;
+                        // media packets are time critical
+                        l2cap_set_channel_priority(stream_endpoint->l2cap_media_cid, L2CAP_CHANNEL_PRIORITY_HIGH);
                         printf(" -> AVDTP_STREAM_ENDPOINT_OPENED, stream endpoint %p, connection %p\n", stream_endpoint, connection);
                         break;
                     }
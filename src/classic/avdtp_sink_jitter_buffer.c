@@ -0,0 +1,413 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ * avdtp_sink_jitter_buffer.c
+ * 
+ * Media packets are stored by sequence number and decoded in order. A missing packet
+ * is considered lost after AVDTP_SINK_JITTER_BUFFER_REORDER_PACKETS later packets have 
+ * been received or the PCM buffer runs low. The gap is then filled by the SBC PLC, 
+ * with its length derived from the RTP timestamps.
+ *
+ * The target latency is derived from the interarrival jitter (RFC 3550), and raised
+ * after underruns and late packets. On playback, PCM data is resampled by linear 
+ * interpolation with a ratio that keeps the buffer level at the target latency. 
+ * If the buffer level is far below the target, concealment of lost packets is extended.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+#include "avdtp_sink_jitter_buffer.h"
+
+#define AVDTP_MEDIA_PACKET_HEADER_SIZE  12
+#define AVDTP_SBC_CODEC_HEADER_SIZE     1
+#define AVDTP_SBC_FRAGMENTED_FLAG       0x80
+
+#define PHASE_ONE                       (1 << 24)
+#define UNDERRUN_LATENCY_INCREASE_MS    20
+#define LATE_PACKET_LATENCY_INCREASE_MS 10
+
+static uint32_t frames_to_ms(avdtp_sink_jitter_buffer_t * jb, uint32_t frames){
+    return (uint32_t) (((uint64_t) frames * 1000) / jb->sample_rate);
+}
+
+static uint32_t ms_to_frames(avdtp_sink_jitter_buffer_t * jb, uint32_t ms){
+    return (uint32_t) (((uint64_t) ms * jb->sample_rate) / 1000);
+}
+
+static uint32_t pcm_frames_available(avdtp_sink_jitter_buffer_t * jb){
+    return jb->pcm_frames_written - jb->pcm_frames_read;
+}
+
+static uint32_t pcm_frames_free(avdtp_sink_jitter_buffer_t * jb){
+    return AVDTP_SINK_JITTER_BUFFER_PCM_FRAMES - pcm_frames_available(jb);
+}
+
+static uint16_t packets_buffered(avdtp_sink_jitter_buffer_t * jb){
+    uint16_t count = 0;
+    int i;
+    for (i=0;i<AVDTP_SINK_JITTER_BUFFER_NUM_PACKETS;i++){
+        if (jb->packets[i].in_use) count++;
+    }
+    return count;
+}
+
+// PCM buffer
+
+static void pcm_write(avdtp_sink_jitter_buffer_t * jb, const int16_t * data, int num_frames){
+    if ((uint32_t) num_frames > pcm_frames_free(jb)){
+        log_error("jitter buffer: PCM buffer full, dropping %u frames", num_frames);
+        return;
+    }
+    uint32_t pos = jb->pcm_frames_written;
+    int i;
+    for (i=0;i<num_frames;i++){
+        memcpy(&jb->pcm_storage[((pos + i) % AVDTP_SINK_JITTER_BUFFER_PCM_FRAMES) * jb->num_channels], 
+            &data[i * jb->num_channels], jb->num_channels * sizeof(int16_t));
+    }
+    jb->pcm_frames_written = pos + num_frames;
+}
+
+// packet loss concealment, works on SBC_FS frames per channel
+
+static void plc_process_frame(avdtp_sink_jitter_buffer_t * jb, int bad_frame){
+    int16_t zir[SBC_OLAL];
+    int16_t in[SBC_FS];
+    int16_t out[SBC_FS];
+    int16_t interleaved[SBC_FS * 2];
+    int ch;
+    int i;
+    memset(zir, 0, sizeof(zir));
+    for (ch=0;ch<jb->num_channels;ch++){
+        if (bad_frame){
+            btstack_sbc_plc_bad_frame(&jb->plc_state[ch], zir, out);
+        } else {
+            for (i=0;i<SBC_FS;i++){
+                in[i] = jb->plc_frame[i * jb->num_channels + ch];
+            }
+            btstack_sbc_plc_good_frame(&jb->plc_state[ch], in, out);
+        }
+        for (i=0;i<SBC_FS;i++){
+            interleaved[i * jb->num_channels + ch] = out[i];
+        }
+    }
+    pcm_write(jb, interleaved, SBC_FS);
+}
+
+static void conceal(avdtp_sink_jitter_buffer_t * jb, uint32_t num_frames){
+    // limit to max latency and free space, partial PLC frame is replaced as well
+    num_frames = btstack_min(num_frames, ms_to_frames(jb, AVDTP_SINK_JITTER_BUFFER_MAX_LATENCY_MS));
+    num_frames = btstack_min(num_frames + jb->plc_frame_len, pcm_frames_free(jb));
+    // round to PLC frames, carry rounding error over to next concealment
+    int32_t num_plc_frames = ((int32_t) num_frames - jb->plc_excess_frames + SBC_FS / 2) / SBC_FS;
+    if (num_plc_frames <= 0) return;
+    jb->plc_excess_frames += num_plc_frames * SBC_FS - (int32_t) num_frames;
+    jb->plc_frame_len = 0;
+    int i;
+    for (i=0;i<num_plc_frames;i++){
+        plc_process_frame(jb, 1);
+    }
+    jb->metrics.samples_concealed += num_plc_frames * SBC_FS;
+}
+
+static void handle_pcm_data(int16_t * data, int num_samples, int num_channels, int sample_rate, void * context){
+    avdtp_sink_jitter_buffer_t * jb = (avdtp_sink_jitter_buffer_t *) context;
+    if (sample_rate != jb->sample_rate){
+        log_error("jitter buffer: sample rate %u does not match configuration %u", sample_rate, jb->sample_rate);
+    }
+    int i;
+    for (i=0;i<num_samples;i++){
+        int ch;
+        for (ch=0;ch<jb->num_channels;ch++){
+            jb->plc_frame[jb->plc_frame_len * jb->num_channels + ch] = data[i * num_channels + btstack_min(ch, num_channels - 1)];
+        }
+        jb->plc_frame_len++;
+        if (jb->plc_frame_len < SBC_FS) continue;
+        plc_process_frame(jb, 0);
+        jb->plc_frame_len = 0;
+    }
+}
+
+// packet processing
+
+static void decode_packet(avdtp_sink_jitter_buffer_t * jb, avdtp_sink_jitter_buffer_packet_t * packet){
+    // fill gap from lost packets or skipped samples, extend concealment if buffer is below target latency
+    int32_t gap = (int32_t) (packet->timestamp - jb->next_timestamp);
+    if (gap > 0){
+        uint32_t fill  = jb->fill_avg_q8 >> 8;
+        uint32_t limit = jb->target_frames - btstack_min(jb->packet_duration_frames, jb->target_frames);
+        if (jb->playing && fill < limit){
+            gap += btstack_min(limit - fill, gap);
+        }
+        conceal(jb, gap);
+    }
+    uint8_t num_frames = packet->data[0] & 0x0f;
+    btstack_sbc_decoder_process_data(&jb->decoder_state, 0, &packet->data[AVDTP_SBC_CODEC_HEADER_SIZE], packet->len - AVDTP_SBC_CODEC_HEADER_SIZE);
+    jb->next_timestamp = packet->timestamp + num_frames * btstack_sbc_decoder_num_samples_per_frame(&jb->decoder_state);
+}
+
+static void process_packets(avdtp_sink_jitter_buffer_t * jb){
+    while (1){
+        avdtp_sink_jitter_buffer_packet_t * packet = &jb->packets[jb->next_sequence_number % AVDTP_SINK_JITTER_BUFFER_NUM_PACKETS];
+        if (packet->in_use && packet->sequence_number == jb->next_sequence_number){
+            // wait for playback if decoded packet might not fit into PCM buffer
+            uint32_t max_frames = (packet->data[0] & 0x0f) * 128 + SBC_FS;
+            if (pcm_frames_free(jb) < max_frames) return;
+            decode_packet(jb, packet);
+            packet->in_use = 0;
+            jb->next_sequence_number++;
+            continue;
+        }
+
+        // next packet missing, wait for reordered packet unless enough later packets received or 
+        // PCM buffer might run empty before next packet arrives
+        uint16_t num_buffered = packets_buffered(jb);
+        if (num_buffered == 0) return;
+        uint32_t min_frames = jb->packet_duration_frames + 4 * (jb->jitter_q4 >> 4);
+        if (num_buffered < AVDTP_SINK_JITTER_BUFFER_REORDER_PACKETS && pcm_frames_available(jb) >= min_frames) return;
+
+        // declare packets up to the earliest buffered one as lost
+        avdtp_sink_jitter_buffer_packet_t * earliest = NULL;
+        int i;
+        for (i=0;i<AVDTP_SINK_JITTER_BUFFER_NUM_PACKETS;i++){
+            avdtp_sink_jitter_buffer_packet_t * candidate = &jb->packets[i];
+            if (!candidate->in_use) continue;
+            if (earliest && (int16_t)(candidate->sequence_number - earliest->sequence_number) >= 0) continue;
+            earliest = candidate;
+        }
+        uint16_t num_lost = earliest->sequence_number - jb->next_sequence_number;
+        log_info("jitter buffer: lost %u packets, seq %u", num_lost, jb->next_sequence_number);
+        jb->metrics.packets_lost += num_lost;
+        jb->next_sequence_number = earliest->sequence_number;
+        // gap is concealed by decode_packet based on timestamp
+    }
+}
+
+static void update_target_latency(avdtp_sink_jitter_buffer_t * jb, uint32_t packet_duration_frames){
+    // increase latency after underruns, boost decays over time
+    uint32_t underruns = jb->metrics.underruns;
+    if (underruns != jb->underruns_seen){
+        jb->latency_boost_frames += (underruns - jb->underruns_seen) * ms_to_frames(jb, UNDERRUN_LATENCY_INCREASE_MS);
+        jb->underruns_seen = underruns;
+    }
+    jb->latency_boost_frames -= (jb->latency_boost_frames + 511) / 512;
+    jb->packet_duration_frames = packet_duration_frames;
+
+    uint32_t jitter_frames = jb->jitter_q4 >> 4;
+    uint32_t target_ms = frames_to_ms(jb, packet_duration_frames + 4 * jitter_frames + jb->latency_boost_frames);
+    target_ms = btstack_max(target_ms, AVDTP_SINK_JITTER_BUFFER_MIN_LATENCY_MS);
+    target_ms = btstack_min(target_ms, AVDTP_SINK_JITTER_BUFFER_MAX_LATENCY_MS);
+    uint32_t target_frames = ms_to_frames(jb, target_ms);
+    target_frames = btstack_min(target_frames, AVDTP_SINK_JITTER_BUFFER_PCM_FRAMES / 2);
+
+    // follow jitter estimate smoothly as buffer level can only be adjusted by resampling, raise faster than lower
+    if (target_frames > jb->target_frames){
+        jb->target_frames += (target_frames - jb->target_frames) / 16;
+    } else {
+        jb->target_frames -= (jb->target_frames - target_frames) / 256;
+    }
+}
+
+static void update_jitter(avdtp_sink_jitter_buffer_t * jb, uint32_t timestamp){
+    uint32_t now_ms = btstack_run_loop_get_time_ms();
+    int32_t  transit_delta = (int32_t) ms_to_frames(jb, now_ms - jb->last_arrival_ms) - (int32_t) (timestamp - jb->last_timestamp);
+    uint32_t d = transit_delta < 0 ? -transit_delta : transit_delta;
+    jb->jitter_q4 += d - (jb->jitter_q4 >> 4);
+    jb->last_arrival_ms = now_ms;
+    jb->last_timestamp  = timestamp;
+}
+
+void avdtp_sink_jitter_buffer_init(avdtp_sink_jitter_buffer_t * jb, int num_channels, int sample_rate){
+    memset(jb, 0, sizeof(avdtp_sink_jitter_buffer_t));
+    jb->num_channels = btstack_max(1, btstack_min(num_channels, 2));
+    jb->sample_rate  = sample_rate;
+    jb->target_frames = ms_to_frames(jb, AVDTP_SINK_JITTER_BUFFER_MIN_LATENCY_MS);
+    btstack_sbc_decoder_init(&jb->decoder_state, SBC_MODE_STANDARD, &handle_pcm_data, jb);
+    btstack_sbc_plc_init(&jb->plc_state[0]);
+    btstack_sbc_plc_init(&jb->plc_state[1]);
+}
+
+void avdtp_sink_jitter_buffer_put_media_packet(avdtp_sink_jitter_buffer_t * jb, const uint8_t * packet, uint16_t size){
+    if (size < AVDTP_MEDIA_PACKET_HEADER_SIZE + AVDTP_SBC_CODEC_HEADER_SIZE) return;
+    uint8_t  version      = packet[0] >> 6;
+    uint8_t  csrc_count   = packet[0] & 0x0f;
+    uint16_t sequence_number = big_endian_read_16(packet, 2);
+    uint32_t timestamp    = big_endian_read_32(packet, 4);
+    uint16_t pos = AVDTP_MEDIA_PACKET_HEADER_SIZE + csrc_count * 4;
+    if (version != 2 || size < pos + AVDTP_SBC_CODEC_HEADER_SIZE) return;
+    if (packet[pos] & AVDTP_SBC_FRAGMENTED_FLAG){
+        log_error("jitter buffer: fragmented SBC frames not supported");
+        return;
+    }
+    uint16_t payload_len = size - pos;
+    if (payload_len > AVDTP_SINK_JITTER_BUFFER_PACKET_SIZE){
+        log_error("jitter buffer: media packet too large %u", payload_len);
+        return;
+    }
+    jb->metrics.packets_received++;
+
+    if (!jb->started){
+        jb->started = 1;
+        jb->next_sequence_number = sequence_number;
+        jb->next_timestamp  = timestamp;
+        jb->highest_sequence_number = sequence_number;
+        jb->highest_timestamp_end = timestamp;
+        jb->last_arrival_ms = btstack_run_loop_get_time_ms();
+        jb->last_timestamp  = timestamp;
+    }
+
+    int16_t offset = (int16_t)(sequence_number - jb->next_sequence_number);
+    if (offset < 0){
+        // packet was already concealed, increase latency
+        jb->metrics.packets_late++;
+        jb->latency_boost_frames += ms_to_frames(jb, LATE_PACKET_LATENCY_INCREASE_MS);
+        return;
+    }
+    if (offset >= AVDTP_SINK_JITTER_BUFFER_NUM_PACKETS){
+        // PCM buffer full or lost more packets than buffered, drop incoming packet unless playback consumes all buffered packets 
+        if (pcm_frames_free(jb) < AVDTP_SINK_JITTER_BUFFER_PCM_FRAMES / 2){
+            jb->metrics.packets_late++;
+            return;
+        }
+        // resync
+        log_info("jitter buffer: resync at seq %u", sequence_number);
+        int i;
+        for (i=0;i<AVDTP_SINK_JITTER_BUFFER_NUM_PACKETS;i++){
+            if (jb->packets[i].in_use) jb->metrics.packets_lost++;
+            jb->packets[i].in_use = 0;
+        }
+        jb->metrics.packets_lost += offset;
+        jb->next_sequence_number = sequence_number;
+        jb->next_timestamp = timestamp;
+        jb->highest_sequence_number = sequence_number;
+    }
+
+    avdtp_sink_jitter_buffer_packet_t * slot = &jb->packets[sequence_number % AVDTP_SINK_JITTER_BUFFER_NUM_PACKETS];
+    if (slot->in_use && slot->sequence_number == sequence_number){
+        jb->metrics.packets_duplicate++;
+        return;
+    }
+
+    slot->in_use = 1;
+    slot->sequence_number = sequence_number;
+    slot->timestamp = timestamp;
+    slot->len = payload_len;
+    memcpy(slot->data, &packet[pos], payload_len);
+
+    uint32_t packet_duration_frames = (packet[pos] & 0x0f) * btstack_sbc_decoder_num_samples_per_frame(&jb->decoder_state);
+    if ((int16_t)(sequence_number - jb->highest_sequence_number) > 0){
+        if ((uint16_t)(sequence_number - jb->highest_sequence_number) == 1){
+            update_jitter(jb, timestamp);
+        } 
+        jb->highest_sequence_number = sequence_number;
+        jb->highest_timestamp_end = timestamp + packet_duration_frames;
+    } else if (sequence_number != jb->highest_sequence_number){
+        jb->metrics.packets_reordered++;
+    }
+    update_target_latency(jb, packet_duration_frames);
+
+    process_packets(jb);
+}
+
+int avdtp_sink_jitter_buffer_read_audio(avdtp_sink_jitter_buffer_t * jb, int16_t * buffer, int num_frames){
+    uint32_t available = pcm_frames_available(jb);
+    uint32_t target    = jb->target_frames;
+
+    if (!jb->playing){
+        if (available < target || available < 2){
+            memset(buffer, 0, num_frames * jb->num_channels * sizeof(int16_t));
+            return 0;
+        }
+        jb->playing = 1;
+        jb->phase = 0;
+        jb->fill_avg_q8 = available << 8;
+    }
+
+    // steer resampling ratio to keep smoothed buffer level at target
+    jb->fill_avg_q8 += (int32_t)((available << 8) - jb->fill_avg_q8) / 16;
+    int32_t fill_error = (int32_t)(jb->fill_avg_q8 >> 8) - (int32_t) target;
+    int32_t ppm = (int32_t)(((int64_t) fill_error * 20000) / (int32_t) btstack_max(target, 1));
+    if (ppm >  AVDTP_SINK_JITTER_BUFFER_MAX_RESAMPLING_PPM) ppm =  AVDTP_SINK_JITTER_BUFFER_MAX_RESAMPLING_PPM;
+    if (ppm < -AVDTP_SINK_JITTER_BUFFER_MAX_RESAMPLING_PPM) ppm = -AVDTP_SINK_JITTER_BUFFER_MAX_RESAMPLING_PPM;
+    jb->metrics.resampling_ppm = ppm;
+    uint32_t step = PHASE_ONE + (int32_t)(((int64_t) ppm * PHASE_ONE) / 1000000);
+
+    uint32_t read_pos = jb->pcm_frames_read;
+    int frames_read = 0;
+    while (frames_read < num_frames){
+        // interpolation needs current and next frame
+        if (jb->pcm_frames_written - read_pos < 2){
+            log_info("jitter buffer: underrun");
+            jb->playing = 0;
+            jb->metrics.underruns++;
+            break;
+        }
+        int32_t frac = jb->phase >> 9;
+        const int16_t * a = &jb->pcm_storage[(read_pos % AVDTP_SINK_JITTER_BUFFER_PCM_FRAMES) * jb->num_channels];
+        const int16_t * b = &jb->pcm_storage[((read_pos + 1) % AVDTP_SINK_JITTER_BUFFER_PCM_FRAMES) * jb->num_channels];
+        int ch;
+        for (ch=0;ch<jb->num_channels;ch++){
+            buffer[frames_read * jb->num_channels + ch] = a[ch] + (((b[ch] - a[ch]) * frac) >> 15);
+        }
+        frames_read++;
+        jb->phase += step;
+        read_pos += jb->phase >> 24;
+        jb->phase &= PHASE_ONE - 1;
+    }
+    jb->pcm_frames_read = read_pos;
+
+    memset(&buffer[frames_read * jb->num_channels], 0, (num_frames - frames_read) * jb->num_channels * sizeof(int16_t));
+    return frames_read;
+}
+
+void avdtp_sink_jitter_buffer_get_metrics(avdtp_sink_jitter_buffer_t * jb, avdtp_sink_jitter_buffer_metrics_t * metrics){
+    *metrics = jb->metrics;
+    uint32_t pcm_frames = pcm_frames_available(jb);
+    uint32_t packet_frames = 0;
+    if (jb->started && (int32_t)(jb->highest_timestamp_end - jb->next_timestamp) > 0){
+        packet_frames = jb->highest_timestamp_end - jb->next_timestamp;
+    }
+    metrics->packets_buffered  = packets_buffered(jb);
+    metrics->pcm_buffered_ms   = frames_to_ms(jb, pcm_frames);
+    metrics->latency_ms        = frames_to_ms(jb, pcm_frames + packet_frames);
+    metrics->target_latency_ms = frames_to_ms(jb, jb->target_frames);
+    metrics->jitter_us         = (uint32_t)(((uint64_t)(jb->jitter_q4 >> 4) * 1000000) / jb->sample_rate);
+}
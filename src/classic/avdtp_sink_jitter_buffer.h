@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ * avdtp_sink_jitter_buffer.h
+ * 
+ * Jitter buffer for SBC media packets received by an AVDTP Sink
+ *
+ * Media packets are reordered by RTP sequence number and decoded into a PCM buffer.
+ * Lost packets are concealed with the SBC Packet Loss Concealment. The target latency
+ * follows the measured packet jitter, and the PCM data is resampled to keep the 
+ * buffer level at the target latency even if source and output clocks drift.
+ */
+
+#ifndef __AVDTP_SINK_JITTER_BUFFER_H
+#define __AVDTP_SINK_JITTER_BUFFER_H
+
+#include <stdint.h>
+#include "btstack_sbc.h"
+#include "btstack_sbc_plc.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// number of media packets that can be stored for reordering
+#ifndef AVDTP_SINK_JITTER_BUFFER_NUM_PACKETS
+#define AVDTP_SINK_JITTER_BUFFER_NUM_PACKETS 16
+#endif
+
+// max size of a media packet
+#ifndef AVDTP_SINK_JITTER_BUFFER_PACKET_SIZE
+#define AVDTP_SINK_JITTER_BUFFER_PACKET_SIZE 1024
+#endif
+
+// size of decoded PCM buffer in frames (samples per channel)
+#ifndef AVDTP_SINK_JITTER_BUFFER_PCM_FRAMES
+#define AVDTP_SINK_JITTER_BUFFER_PCM_FRAMES 8192
+#endif
+
+// bounds for adaptive target latency
+#ifndef AVDTP_SINK_JITTER_BUFFER_MIN_LATENCY_MS
+#define AVDTP_SINK_JITTER_BUFFER_MIN_LATENCY_MS 40
+#endif
+#ifndef AVDTP_SINK_JITTER_BUFFER_MAX_LATENCY_MS
+#define AVDTP_SINK_JITTER_BUFFER_MAX_LATENCY_MS 150
+#endif
+
+// number of later packets received before a missing packet is considered lost
+#ifndef AVDTP_SINK_JITTER_BUFFER_REORDER_PACKETS
+#define AVDTP_SINK_JITTER_BUFFER_REORDER_PACKETS 3
+#endif
+
+// max deviation of resampling ratio from 1
+#ifndef AVDTP_SINK_JITTER_BUFFER_MAX_RESAMPLING_PPM
+#define AVDTP_SINK_JITTER_BUFFER_MAX_RESAMPLING_PPM 2000
+#endif
+
+typedef struct {
+    uint8_t  in_use;
+    uint16_t sequence_number;
+    uint32_t timestamp;
+    uint16_t len;
+    uint8_t  data[AVDTP_SINK_JITTER_BUFFER_PACKET_SIZE];
+} avdtp_sink_jitter_buffer_packet_t;
+
+typedef struct {
+    // occupancy
+    uint16_t packets_buffered;
+    uint32_t pcm_buffered_ms;
+    uint32_t latency_ms;            // buffered packets and PCM data
+    uint32_t target_latency_ms;
+    uint32_t jitter_us;             // RFC 3550 interarrival jitter
+    int32_t  resampling_ppm;        // > 0: playback faster than source
+
+    // counters
+    uint32_t packets_received;
+    uint32_t packets_reordered;
+    uint32_t packets_duplicate;
+    uint32_t packets_late;          // received after playout or while buffer full
+    uint32_t packets_lost;
+    uint32_t samples_concealed;
+    uint32_t underruns;
+} avdtp_sink_jitter_buffer_metrics_t;
+
+typedef struct {
+    int num_channels;
+    int sample_rate;
+
+    // media packets, indexed by sequence number
+    avdtp_sink_jitter_buffer_packet_t packets[AVDTP_SINK_JITTER_BUFFER_NUM_PACKETS];
+    uint8_t  started;
+    uint16_t next_sequence_number;
+    uint32_t next_timestamp;
+    uint16_t highest_sequence_number;
+    uint32_t highest_timestamp_end;
+
+    // jitter estimate
+    uint32_t last_arrival_ms;
+    uint32_t last_timestamp;
+    uint32_t jitter_q4;             // in samples, 4 fractional bits
+    uint32_t packet_duration_frames;
+    uint32_t underruns_seen;
+    uint32_t latency_boost_frames;  // after underruns and late packets
+
+    // decoder and packet loss concealment
+    btstack_sbc_decoder_state_t decoder_state;
+    btstack_sbc_plc_state_t     plc_state[2];
+    int16_t  plc_frame[SBC_FS * 2];
+    uint16_t plc_frame_len;         // frames in plc_frame
+    int32_t  plc_excess_frames;     // concealed frames exceeding gaps
+
+    // decoded PCM data, written by avdtp_sink_jitter_buffer_put_media_packet, read by avdtp_sink_jitter_buffer_read_audio
+    int16_t  pcm_storage[AVDTP_SINK_JITTER_BUFFER_PCM_FRAMES * 2];
+    volatile uint32_t pcm_frames_written;
+    volatile uint32_t pcm_frames_read;
+    volatile uint32_t target_frames;
+
+    // playout
+    uint8_t  playing;
+    uint32_t phase;                 // fractional read position, 24 fractional bits
+    uint32_t fill_avg_q8;
+
+    avdtp_sink_jitter_buffer_metrics_t metrics;
+} avdtp_sink_jitter_buffer_t;
+
+/* API_START */
+
+/**
+ * @brief Init jitter buffer and SBC decoder for configured stream
+ * @param jitter_buffer
+ * @param num_channels
+ * @param sample_rate
+ */
+void avdtp_sink_jitter_buffer_init(avdtp_sink_jitter_buffer_t * jitter_buffer, int num_channels, int sample_rate);
+
+/**
+ * @brief Add received media packet with RTP and SBC header, e.g. from media handler registered with avdtp_sink_register_media_handler
+ * @param jitter_buffer
+ * @param packet
+ * @param size
+ */
+void avdtp_sink_jitter_buffer_put_media_packet(avdtp_sink_jitter_buffer_t * jitter_buffer, const uint8_t * packet, uint16_t size);
+
+/**
+ * @brief Read audio for playback. Fills buffer with silence while not enough data is buffered.
+ * @note Can be called from an audio thread, if all other functions are called from the run loop thread.
+ * @param jitter_buffer
+ * @param buffer for interleaved samples
+ * @param num_frames (samples per channel)
+ * @return number of frames read from buffer, remaining frames are silent
+ */
+int avdtp_sink_jitter_buffer_read_audio(avdtp_sink_jitter_buffer_t * jitter_buffer, int16_t * buffer, int num_frames);
+
+/**
+ * @brief Get occupancy, latency, and counters
+ * @param jitter_buffer
+ * @param metrics
+ */
+void avdtp_sink_jitter_buffer_get_metrics(avdtp_sink_jitter_buffer_t * jitter_buffer, avdtp_sink_jitter_buffer_metrics_t * metrics);
+
+/* API_END */
+
+#if defined __cplusplus
+}
+#endif
+
+#endif // __AVDTP_SINK_JITTER_BUFFER_H
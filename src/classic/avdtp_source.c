@@ -45,6 +45,42 @@
 #include "btstack.h"
 #include "avdtp.h"
 #include "avdtp_source.h"
+#include "btstack_sbc.h"
+
+#define AVDTP_MEDIA_PAYLOAD_TYPE_DYNAMIC 96
+#define AVDTP_MEDIA_PACKET_HEADER_SIZE   12
+#define AVDTP_SBC_CODEC_HEADER_SIZE      1
+#define AVDTP_SBC_MAX_FRAMES_PER_PACKET  15
+
+typedef struct {
+    avdtp_stream_endpoint_t * stream_endpoint;
+    avdtp_source_fill_audio_callback_t fill_audio;
+    void * context;
+
+    btstack_sbc_encoder_state_t sbc_encoder_state;
+    btstack_timer_source_t      timer;
+    int      num_channels;
+    int      sampling_frequency;
+    int      samples_per_frame;
+
+    // sample clock
+    uint32_t time_ms;
+    uint32_t samples_remainder;  // sample clock remainder in 1/1000 samples
+    uint32_t samples_due;
+
+    // RTP
+    uint16_t sequence_number;
+    uint32_t timestamp;         // of first frame in storage
+
+    uint8_t  sbc_storage[AVDTP_SOURCE_SBC_STORAGE_SIZE];
+    uint16_t sbc_storage_count;
+    uint16_t sbc_frames_in_storage;
+
+    avdtp_source_stream_stats_t stats;
+} avdtp_source_media_stream_t;
+
+static avdtp_source_media_stream_t media_stream;
+static int16_t pcm_buffer[16 * 8 * 2];   // max blocks * max subbands * max channels
 
 
 static const char * default_avdtp_sink_service_name = "BTstack AVDTP Sink Service";
@@ -129,6 +165,154 @@ void a2dp_source_create_sdp_record(uint8_t * service,  uint32_t service_record_h
     de_add_number(service, DE_UINT, DE_SIZE_16, supported_features);
 }
 
+static int avdtp_source_write_media_packet_header(uint8_t * buffer, const avdtp_media_packet_header_t * header){
+    int pos = 0;
+    buffer[pos++] = (header->version << 6) | (header->padding << 5) | (header->extension << 4) | header->csrc_count;
+    buffer[pos++] = (header->marker << 7) | header->payload_type;
+    big_endian_store_16(buffer, pos, header->sequence_number);
+    pos += 2;
+    big_endian_store_32(buffer, pos, header->timestamp);
+    pos += 4;
+    big_endian_store_32(buffer, pos, header->synchronization_source);
+    pos += 4;
+    return pos;
+}
+
+static int avdtp_source_write_sbc_codec_header(uint8_t * buffer, const avdtp_sbc_codec_header_t * header){
+    buffer[0] = (header->fragmentation << 7) | (header->starting_packet << 6) | (header->last_packet << 5) | (header->num_frames & 0x0f);
+    return 1;
+}
+
+static int avdtp_source_max_frames_per_packet(avdtp_source_media_stream_t * stream, uint16_t frame_len){
+    uint16_t mtu = l2cap_get_remote_mtu_for_local_cid(stream->stream_endpoint->l2cap_media_cid);
+    int num_frames = (mtu - AVDTP_MEDIA_PACKET_HEADER_SIZE - AVDTP_SBC_CODEC_HEADER_SIZE) / frame_len;
+    if (num_frames > AVDTP_SBC_MAX_FRAMES_PER_PACKET) num_frames = AVDTP_SBC_MAX_FRAMES_PER_PACKET;
+    if (num_frames < 1) num_frames = 1;
+    return num_frames;
+}
+
+static void avdtp_source_send_media_packet(avdtp_source_media_stream_t * stream, int num_frames, uint16_t frame_len){
+    uint16_t cid = stream->stream_endpoint->l2cap_media_cid;
+    uint16_t payload_len = num_frames * frame_len;
+
+    avdtp_media_packet_header_t media_header;
+    memset(&media_header, 0, sizeof(media_header));
+    media_header.version = 2;
+    media_header.payload_type = AVDTP_MEDIA_PAYLOAD_TYPE_DYNAMIC;
+    media_header.sequence_number = stream->sequence_number++;
+    media_header.timestamp = stream->timestamp;
+
+    avdtp_sbc_codec_header_t sbc_header;
+    memset(&sbc_header, 0, sizeof(sbc_header));
+    sbc_header.num_frames = num_frames;
+
+    l2cap_reserve_packet_buffer();
+    uint8_t * packet = l2cap_get_outgoing_buffer();
+    int pos = avdtp_source_write_media_packet_header(packet, &media_header);
+    pos += avdtp_source_write_sbc_codec_header(&packet[pos], &sbc_header);
+    memcpy(&packet[pos], stream->sbc_storage, payload_len);
+    pos += payload_len;
+    l2cap_send_prepared(cid, pos);
+
+    // remove sent frames
+    stream->sbc_storage_count -= payload_len;
+    memmove(stream->sbc_storage, &stream->sbc_storage[payload_len], stream->sbc_storage_count);
+    stream->sbc_frames_in_storage -= num_frames;
+    stream->timestamp += num_frames * stream->samples_per_frame;
+    stream->stats.packets_sent++;
+}
+
+static void avdtp_source_media_timeout_handler(btstack_timer_source_t * timer){
+    avdtp_source_media_stream_t * stream = (avdtp_source_media_stream_t *) btstack_run_loop_get_timer_context(timer);
+    if (stream->stream_endpoint->state != AVDTP_STREAM_ENDPOINT_STREAMING){
+        log_info("avdtp_source: stream endpoint not streaming anymore, stop media timer");
+        stream->stream_endpoint = NULL;
+        return;
+    }
 
+    // advance sample clock
+    uint32_t now = btstack_run_loop_get_time_ms();
+    stream->samples_remainder += (now - stream->time_ms) * stream->sampling_frequency;
+    stream->time_ms = now;
+    stream->samples_due += stream->samples_remainder / 1000;
+    stream->samples_remainder = stream->samples_remainder % 1000;
 
+    // encode all frames that are due directly into storage
+    uint16_t frame_len = btstack_sbc_encoder_sbc_frame_length(&stream->sbc_encoder_state);
+    while (stream->samples_due >= (uint32_t) stream->samples_per_frame){
+        stream->samples_due -= stream->samples_per_frame;
+        (*stream->fill_audio)(pcm_buffer, stream->samples_per_frame, stream->num_channels, stream->context);
+        // stopped by callback
+        if (stream->stream_endpoint == NULL) return;
 
+        if (stream->sbc_storage_count + frame_len > sizeof(stream->sbc_storage)){
+            // media channel congested, drop stored frames to keep latency low and RTP timestamp in sync
+            log_info("avdtp_source: media channel congested, drop %u frames", stream->sbc_frames_in_storage);
+            stream->stats.frames_dropped += stream->sbc_frames_in_storage;
+            stream->timestamp += stream->sbc_frames_in_storage * stream->samples_per_frame;
+            stream->sbc_frames_in_storage = 0;
+            stream->sbc_storage_count = 0;
+        }
+        btstack_sbc_encoder_process_data(&stream->sbc_encoder_state, pcm_buffer, &stream->sbc_storage[stream->sbc_storage_count]);
+        stream->stats.frames_encoded++;
+        stream->sbc_storage_count += frame_len;
+        stream->sbc_frames_in_storage++;
+    }
+
+    // send full media packets
+    if (frame_len){
+        int max_frames = avdtp_source_max_frames_per_packet(stream, frame_len);
+        while (stream->sbc_frames_in_storage >= max_frames){
+            if (!l2cap_can_send_packet_now(stream->stream_endpoint->l2cap_media_cid)) break;
+            avdtp_source_send_media_packet(stream, max_frames, frame_len);
+        }
+    }
+
+    btstack_run_loop_set_timer(timer, AVDTP_SOURCE_MEDIA_TIMER_PERIOD_MS);
+    btstack_run_loop_add_timer(timer);
+}
+
+uint8_t avdtp_source_stream_start(avdtp_stream_endpoint_t * stream_endpoint, const avdtp_source_sbc_configuration_t * configuration, 
+    avdtp_source_fill_audio_callback_t callback, void * context){
+
+    if (!stream_endpoint || !configuration || !callback) return ERROR_CODE_INVALID_HCI_COMMAND_PARAMETERS;
+    if (media_stream.stream_endpoint && media_stream.stream_endpoint != stream_endpoint){
+        log_error("avdtp_source_stream_start: stream already active for seid %u", media_stream.stream_endpoint->sep.seid);
+        return ERROR_CODE_COMMAND_DISALLOWED;
+    }
+    if (stream_endpoint->state != AVDTP_STREAM_ENDPOINT_STREAMING){
+        log_error("avdtp_source_stream_start: stream endpoint with seid %u not streaming", stream_endpoint->sep.seid);
+        return ERROR_CODE_COMMAND_DISALLOWED;
+    }
+    if (media_stream.stream_endpoint){
+        btstack_run_loop_remove_timer(&media_stream.timer);
+    }
+
+    memset(&media_stream, 0, sizeof(media_stream));
+    media_stream.stream_endpoint = stream_endpoint;
+    media_stream.fill_audio = callback;
+    media_stream.context = context;
+    media_stream.sampling_frequency = configuration->sampling_frequency;
+    media_stream.num_channels = (configuration->channel_mode == SBC_CHANNEL_MODE_MONO) ? 1 : 2;
+    media_stream.samples_per_frame = configuration->block_length * configuration->subbands;
+
+    btstack_sbc_encoder_init(&media_stream.sbc_encoder_state, SBC_MODE_STANDARD, configuration->block_length, configuration->subbands,
+        configuration->allocation_method, configuration->sampling_frequency, configuration->bitpool, configuration->channel_mode);
+
+    media_stream.time_ms = btstack_run_loop_get_time_ms();
+    btstack_run_loop_set_timer_handler(&media_stream.timer, &avdtp_source_media_timeout_handler);
+    btstack_run_loop_set_timer_context(&media_stream.timer, &media_stream);
+    btstack_run_loop_set_timer(&media_stream.timer, AVDTP_SOURCE_MEDIA_TIMER_PERIOD_MS);
+    btstack_run_loop_add_timer(&media_stream.timer);
+    return ERROR_CODE_SUCCESS;
+}
+
+void avdtp_source_stream_stop(avdtp_stream_endpoint_t * stream_endpoint){
+    if (media_stream.stream_endpoint != stream_endpoint) return;
+    btstack_run_loop_remove_timer(&media_stream.timer);
+    media_stream.stream_endpoint = NULL;
+}
+
+void avdtp_source_stream_get_stats(avdtp_source_stream_stats_t * stats){
+    *stats = media_stream.stats;
+}
@@ -47,11 +47,47 @@
 #define __AVDTP_SOURCE_H
 
 #include <stdint.h>
+#include "avdtp.h"
+#include "btstack_sbc.h"
 
 #if defined __cplusplus
 extern "C" {
 #endif
 
+// period of media timer that encodes and sends SBC frames
+#ifndef AVDTP_SOURCE_MEDIA_TIMER_PERIOD_MS
+#define AVDTP_SOURCE_MEDIA_TIMER_PERIOD_MS 10
+#endif
+
+// storage for encoded SBC frames, should hold at least two media packets
+#ifndef AVDTP_SOURCE_SBC_STORAGE_SIZE
+#define AVDTP_SOURCE_SBC_STORAGE_SIZE 2048
+#endif
+
+typedef struct {
+    int sampling_frequency;
+    btstack_sbc_channel_mode_t channel_mode;
+    int block_length;       // 4, 8, 12 or 16
+    int subbands;           // 4 or 8
+    int allocation_method;  // 0 = loudness, 1 = SNR
+    int bitpool;
+} avdtp_source_sbc_configuration_t;
+
+typedef struct {
+    uint32_t packets_sent;
+    uint32_t frames_encoded;
+    uint32_t frames_dropped;    // encoded frames could not be stored as media channel was congested
+} avdtp_source_stream_stats_t;
+
+/**
+ * @brief Callback to provide PCM data for the media stream
+ * @param pcm_buffer to fill with interleaved samples in host endianess
+ * @param num_samples_per_channel
+ * @param num_channels
+ * @param context
+ */
+typedef void (*avdtp_source_fill_audio_callback_t)(int16_t * pcm_buffer, int num_samples_per_channel, int num_channels, void * context);
+
 /* API_START */
 
 /**
@@ -63,6 +99,33 @@ extern "C" {
  * @param service_provider_name
  */
 void a2dp_source_create_sdp_record(uint8_t * service,  uint32_t service_record_handle, uint16_t supported_features, const char * service_name, const char * service_provider_name);
+
+/**
+ * @brief Start sending media packets on a streaming stream endpoint. PCM data is requested from the
+ *        fill audio callback as dictated by the sample clock, encoded as SBC, and sent with as many SBC
+ *        frames per media packet as the L2CAP MTU allows. Only a single stream is supported, as the media
+ *        stream state incl. its SBC encoder instance is kept in avdtp_source.c. Sending stops automatically
+ *        when the stream endpoint leaves streaming state.
+ * @param stream_endpoint in AVDTP_STREAM_ENDPOINT_STREAMING state
+ * @param configuration of SBC encoder
+ * @param callback to provide PCM data
+ * @param context provided in callback
+ * @return 0 if ok, error otherwise
+ */
+uint8_t avdtp_source_stream_start(avdtp_stream_endpoint_t * stream_endpoint, const avdtp_source_sbc_configuration_t * configuration, 
+    avdtp_source_fill_audio_callback_t callback, void * context);
+
+/**
+ * @brief Stop sending media packets
+ * @param stream_endpoint
+ */
+void avdtp_source_stream_stop(avdtp_stream_endpoint_t * stream_endpoint);
+
+/**
+ * @brief Get counters of active or last stream
+ * @param stats
+ */
+void avdtp_source_stream_get_stats(avdtp_source_stream_stats_t * stats);
 /* API_END */
 
 #if defined __cplusplus
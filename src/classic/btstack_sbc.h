@@ -55,6 +55,21 @@ typedef enum{
     SBC_MODE_mSBC
 } btstack_sbc_mode_t;
 
+typedef enum{
+    SBC_CHANNEL_MODE_MONO = 0,
+    SBC_CHANNEL_MODE_DUAL_CHANNEL,
+    SBC_CHANNEL_MODE_STEREO,
+    SBC_CHANNEL_MODE_JOINT_STEREO
+} btstack_sbc_channel_mode_t;
+
+typedef enum{
+    SBC_SIMD_NONE = 0,
+    SBC_SIMD_SSE2,
+    SBC_SIMD_AVX2,
+    SBC_SIMD_NEON,
+    SBC_SIMD_AUTO
+} btstack_sbc_simd_t;
+
 typedef struct {
     void * context;
     void (*handle_pcm_data)(int16_t * data, int num_samples, int num_channels, int sample_rate, void * context);
@@ -69,9 +84,18 @@ typedef struct {
     int zero_frames_nr;
 } btstack_sbc_decoder_state_t;
 
+// storage for encoder instance of SBC codec implementation, checked in btstack_sbc_bludroid.c
+#ifndef BTSTACK_SBC_ENCODER_STORAGE_SIZE
+#define BTSTACK_SBC_ENCODER_STORAGE_SIZE 1664
+#endif
+
 typedef struct {
     // private
-    void * encoder_state;
+    union {
+        uint8_t  storage[BTSTACK_SBC_ENCODER_STORAGE_SIZE];
+        uint32_t align_32;
+        void *   align_ptr;
+    } encoder;
     btstack_sbc_mode_t mode;
 } btstack_sbc_encoder_state_t;
 
@@ -115,7 +139,7 @@ int btstack_sbc_decoder_sample_rate(btstack_sbc_decoder_state_t * state);
 
 /* BTstack SBC Encoder */
 /**
- * @brief Init SBC encoder
+ * @brief Init SBC encoder. Each state is an independent encoder instance.
  * @param state
  * @param mode 
  * @param blocks
@@ -123,30 +147,45 @@ int btstack_sbc_decoder_sample_rate(btstack_sbc_decoder_state_t * state);
  * @param allocation_method
  * @param sample_rate
  * @param bitpool
+ * @param channel_mode, ignored for mSBC
  */
 void btstack_sbc_encoder_init(btstack_sbc_encoder_state_t * state, btstack_sbc_mode_t mode, 
-                        int blocks, int subbands, int allocation_method, int sample_rate, int bitpool);
+                        int blocks, int subbands, int allocation_method, int sample_rate, int bitpool, btstack_sbc_channel_mode_t channel_mode);
+
+/**
+ * @brief Encode one PCM frame into SBC frame
+ * @param state
+ * @param pcm_in with btstack_sbc_encoder_num_audio_samples samples in host endianess
+ * @param sbc_out buffer with at least btstack_sbc_encoder_sbc_frame_length bytes
+ * @return length of SBC frame
+ */
+uint16_t btstack_sbc_encoder_process_data(btstack_sbc_encoder_state_t * state, int16_t * pcm_in, uint8_t * sbc_out);
 
 /**
- * @brief Encode PCM data
- * @param buffer with samples in host endianess
+ * @brief Return SBC frame length for current configuration
+ * @param state
  */
-void btstack_sbc_encoder_process_data(int16_t * input_buffer);
+uint16_t btstack_sbc_encoder_sbc_frame_length(btstack_sbc_encoder_state_t * state);
 
 /**
- * @brief Return SBC frame
+ * @brief Return number of audio samples in one PCM frame
+ * @param state
  */
-uint8_t * btstack_sbc_encoder_sbc_buffer(void);
+int  btstack_sbc_encoder_num_audio_samples(btstack_sbc_encoder_state_t * state);
 
 /**
- * @brief Return SBC frame length
+ * @brief Select SIMD implementation for SBC encoder and decoder filterbanks, default: SBC_SIMD_AUTO
+ * @note decoder uses portable C code for SSE2
+ * @note selection is shared by all encoders and decoders, call before any of them runs
+ * @param simd
+ * @return 0 if ok, 1 if not supported by build or CPU
  */
-uint16_t  btstack_sbc_encoder_sbc_buffer_length(void);
+int btstack_sbc_set_simd(btstack_sbc_simd_t simd);
 
 /**
- * @brief Return number of audio samples in one PCM frame
+ * @brief Return SIMD implementation used by SBC encoder
  */
-int  btstack_sbc_encoder_num_audio_samples(void);
+btstack_sbc_simd_t btstack_sbc_get_simd(void);
 
 /* API_END */
 
@@ -92,20 +92,6 @@ static int corrupt_frame_period = -1;
 // *****************************************************************************
 
 
-// *****************************************************************************
-// SBC encoder start
-
-typedef struct {
-    SBC_ENC_PARAMS context;
-    int num_data_bytes;
-    uint8_t sbc_packet[1000];
-} bludroid_encoder_state_t;
-
-static btstack_sbc_encoder_state_t * sbc_encoder_state_singleton = NULL;
-static bludroid_encoder_state_t bd_encoder_state;
-
-// SBC encoder start
-// *****************************************************************************
 
 
 
@@ -500,81 +486,140 @@ void btstack_sbc_decoder_process_data(btstack_sbc_decoder_state_t * state, int p
 //
 // *****************************************************************************
 
-void btstack_sbc_encoder_init(btstack_sbc_encoder_state_t * state, btstack_sbc_mode_t mode, 
-                        int blocks, int subbands, int allmethod, int sample_rate, int bitpool){
+// SBC_ENC_PARAMS lives in opaque storage of btstack_sbc_encoder_state_t
+typedef char btstack_sbc_encoder_storage_too_small[(sizeof(SBC_ENC_PARAMS) <= BTSTACK_SBC_ENCODER_STORAGE_SIZE) ? 1 : -1];
 
-    UNUSED(bitpool);
+static SBC_ENC_PARAMS * btstack_sbc_encoder_context(btstack_sbc_encoder_state_t * state){
+    return (SBC_ENC_PARAMS *) (void *) state->encoder.storage;
+}
 
-    if (sbc_encoder_state_singleton && sbc_encoder_state_singleton != state ){
-        log_error("SBC encoder: different sbc decoder state is allready registered");
-    } 
-    
-    sbc_encoder_state_singleton = state;
+void btstack_sbc_encoder_init(btstack_sbc_encoder_state_t * state, btstack_sbc_mode_t mode, 
+                        int blocks, int subbands, int allmethod, int sample_rate, int bitpool, btstack_sbc_channel_mode_t channel_mode){
 
-    if (!sbc_encoder_state_singleton){
+    if (!state){
         log_error("SBC encoder init: sbc state is NULL");
+        return;
     }
 
-    sbc_encoder_state_singleton->mode = mode;
+    memset(state, 0, sizeof(btstack_sbc_encoder_state_t));
+    state->mode = mode;
 
-    switch (sbc_encoder_state_singleton->mode){
+    SBC_ENC_PARAMS * context = btstack_sbc_encoder_context(state);
+    switch (state->mode){
         case SBC_MODE_STANDARD:
-            bd_encoder_state.context.s16NumOfBlocks = blocks;                          
-            bd_encoder_state.context.s16NumOfSubBands = subbands;                       
-            bd_encoder_state.context.s16AllocationMethod = allmethod;                     
-            bd_encoder_state.context.s16BitPool = 31;  
-            bd_encoder_state.context.mSBCEnabled = 0;
+            context->s16NumOfBlocks = blocks;                          
+            context->s16NumOfSubBands = subbands;                       
+            context->s16AllocationMethod = allmethod;                     
+            context->s16BitPool = bitpool;
+            context->mSBCEnabled = 0;
+            context->s16ChannelMode = channel_mode;
+            context->s16NumOfChannels = (channel_mode == SBC_CHANNEL_MODE_MONO) ? 1 : 2;
             
             switch(sample_rate){
-                case 16000: bd_encoder_state.context.s16SamplingFreq = SBC_sf16000; break;
-                case 32000: bd_encoder_state.context.s16SamplingFreq = SBC_sf32000; break;
-                case 44100: bd_encoder_state.context.s16SamplingFreq = SBC_sf44100; break;
-                case 48000: bd_encoder_state.context.s16SamplingFreq = SBC_sf48000; break;
-                default: bd_encoder_state.context.s16SamplingFreq = 0; break;
+                case 16000: context->s16SamplingFreq = SBC_sf16000; break;
+                case 32000: context->s16SamplingFreq = SBC_sf32000; break;
+                case 44100: context->s16SamplingFreq = SBC_sf44100; break;
+                case 48000: context->s16SamplingFreq = SBC_sf48000; break;
+                default: context->s16SamplingFreq = 0; break;
             }
             break;
         case SBC_MODE_mSBC:
-            bd_encoder_state.context.s16NumOfBlocks    = 15;
-            bd_encoder_state.context.s16NumOfSubBands  = 8;
-            bd_encoder_state.context.s16AllocationMethod = SBC_LOUDNESS;
-            bd_encoder_state.context.s16BitPool   = 26;
-            bd_encoder_state.context.s16ChannelMode = SBC_MONO;
-            bd_encoder_state.context.s16NumOfChannels = 1;
-            bd_encoder_state.context.mSBCEnabled = 1;
-            bd_encoder_state.context.s16SamplingFreq = SBC_sf16000;
+            context->s16NumOfBlocks    = 15;
+            context->s16NumOfSubBands  = 8;
+            context->s16AllocationMethod = SBC_LOUDNESS;
+            context->s16BitPool   = 26;
+            context->s16ChannelMode = SBC_MONO;
+            context->s16NumOfChannels = 1;
+            context->mSBCEnabled = 1;
+            context->s16SamplingFreq = SBC_sf16000;
             break;
     }
-    bd_encoder_state.context.pu8Packet = bd_encoder_state.sbc_packet;
-    
-    sbc_encoder_state_singleton->encoder_state = &bd_encoder_state;
-    SBC_ENC_PARAMS * context = &((bludroid_encoder_state_t *)sbc_encoder_state_singleton->encoder_state)->context;
     SBC_Encoder_Init(context);
 }
 
-
-void btstack_sbc_encoder_process_data(int16_t * input_buffer){
-    if (!sbc_encoder_state_singleton){
-        log_error("SBC encoder: sbc state is NULL, call btstack_sbc_encoder_init to initialize it");
-    }
-    SBC_ENC_PARAMS * context = &((bludroid_encoder_state_t *)sbc_encoder_state_singleton->encoder_state)->context;
-    context->ps16PcmBuffer = input_buffer;
+uint16_t btstack_sbc_encoder_process_data(btstack_sbc_encoder_state_t * state, int16_t * pcm_in, uint8_t * sbc_out){
+    SBC_ENC_PARAMS * context = btstack_sbc_encoder_context(state);
+    context->ps16PcmBuffer = pcm_in;
+    context->pu8Packet = sbc_out;
     if (context->mSBCEnabled){
         context->pu8Packet[0] = 0xad;
     }
     SBC_Encoder(context);
+    return context->u16PacketLength;
 }
 
-int btstack_sbc_encoder_num_audio_samples(void){
-    SBC_ENC_PARAMS * context = &((bludroid_encoder_state_t *)sbc_encoder_state_singleton->encoder_state)->context;
+int btstack_sbc_encoder_num_audio_samples(btstack_sbc_encoder_state_t * state){
+    SBC_ENC_PARAMS * context = btstack_sbc_encoder_context(state);
     return context->s16NumOfSubBands * context->s16NumOfBlocks * context->s16NumOfChannels;
 }
 
-uint8_t * btstack_sbc_encoder_sbc_buffer(void){
-    SBC_ENC_PARAMS * context = &((bludroid_encoder_state_t *)sbc_encoder_state_singleton->encoder_state)->context;
-    return context->pu8Packet;
+uint16_t btstack_sbc_encoder_sbc_frame_length(btstack_sbc_encoder_state_t * state){
+    SBC_ENC_PARAMS * context = btstack_sbc_encoder_context(state);
+    // header and scale factors
+    int length = 4 + (4 * context->s16NumOfSubBands * context->s16NumOfChannels) / 8;
+    int bits;
+    switch (context->s16ChannelMode){
+        case SBC_MONO:
+        case SBC_DUAL:
+            bits = context->s16NumOfBlocks * context->s16NumOfChannels * context->s16BitPool;
+            break;
+        case SBC_JOINT_STEREO:
+            bits = context->s16NumOfSubBands + context->s16NumOfBlocks * context->s16BitPool;
+            break;
+        default:
+            bits = context->s16NumOfBlocks * context->s16BitPool;
+            break;
+    }
+    return length + (bits + 7) / 8;
+}
+
+int btstack_sbc_set_simd(btstack_sbc_simd_t simd){
+    uint8_t encoder_simd;
+    uint8_t decoder_simd;
+    switch (simd){
+        case SBC_SIMD_NONE:
+            encoder_simd = SBC_ENC_SIMD_NONE;
+            decoder_simd = OI_CODEC_SBC_SIMD_NONE;
+            break;
+        case SBC_SIMD_SSE2:
+            encoder_simd = SBC_ENC_SIMD_SSE2;
+            decoder_simd = OI_CODEC_SBC_SIMD_SSE2;
+            break;
+        case SBC_SIMD_AVX2:
+            encoder_simd = SBC_ENC_SIMD_AVX2;
+            decoder_simd = OI_CODEC_SBC_SIMD_AVX2;
+            break;
+        case SBC_SIMD_NEON:
+            encoder_simd = SBC_ENC_SIMD_NEON;
+            decoder_simd = OI_CODEC_SBC_SIMD_NEON;
+            break;
+        case SBC_SIMD_AUTO:
+            encoder_simd = SBC_ENC_SIMD_AUTO;
+            decoder_simd = OI_CODEC_SBC_SIMD_AUTO;
+            break;
+        default:
+            return 1;
+    }
+    if (!SBC_Encoder_SelectSimd(encoder_simd)) {
+        log_error("SBC: SIMD %u not supported", simd);
+        return 1;
+    }
+    if (OI_CODEC_SBC_SelectSimd(decoder_simd) != OI_STATUS_SUCCESS){
+        log_error("SBC: SIMD %u not supported by decoder", simd);
+        return 1;
+    }
+    return 0;
 }
 
-uint16_t  btstack_sbc_encoder_sbc_buffer_length(void){
-    SBC_ENC_PARAMS * context = &((bludroid_encoder_state_t *)sbc_encoder_state_singleton->encoder_state)->context;
-    return context->u16PacketLength;
+btstack_sbc_simd_t btstack_sbc_get_simd(void){
+    switch (SBC_Encoder_GetSimd()){
+        case SBC_ENC_SIMD_SSE2:
+            return SBC_SIMD_SSE2;
+        case SBC_ENC_SIMD_AVX2:
+            return SBC_SIMD_AVX2;
+        case SBC_ENC_SIMD_NEON:
+            return SBC_SIMD_NEON;
+        default:
+            return SBC_SIMD_NONE;
+    }
 }
@@ -47,44 +47,57 @@
 #include "btstack_config.h"
 
 #include <stdint.h>
+#include "btstack_sbc.h"
 
 #if defined __cplusplus
 extern "C" {
 #endif
 
+// mSBC frame with H2 header and padding
+#define HFP_MSBC_H2_FRAME_SIZE 60
+
+typedef struct {
+    // private
+    btstack_sbc_encoder_state_t sbc_encoder_state;
+    int sequence_number;
+    uint8_t buffer[2*HFP_MSBC_H2_FRAME_SIZE];
+    int buffer_offset;
+} hfp_msbc_state_t;
+
 /* API_START */
 
 /**
- *
+ * @param state for one mSBC stream
  */
-void hfp_msbc_init(void);
+void hfp_msbc_init(hfp_msbc_state_t * state);
 
 /**
- *
+ * @param state
  */
-int  hfp_msbc_num_audio_samples_per_frame(void);
+int  hfp_msbc_num_audio_samples_per_frame(hfp_msbc_state_t * state);
 
 /**
- *
+ * @param state
  */
-int  hfp_msbc_can_encode_audio_frame_now(void);
+int  hfp_msbc_can_encode_audio_frame_now(hfp_msbc_state_t * state);
 
 /**
+ * @param state
  * @param pcm_samples - complete audio frame of hfp_msbc_num_audio_samples_per_frame int16 samples
  */
-void hfp_msbc_encode_audio_frame(int16_t * pcm_samples);
+void hfp_msbc_encode_audio_frame(hfp_msbc_state_t * state, int16_t * pcm_samples);
 
 /**
- *
+ * @param state
  */
-int  hfp_msbc_num_bytes_in_stream(void);
+int  hfp_msbc_num_bytes_in_stream(hfp_msbc_state_t * state);
 
 /**
- *
+ * @param state
  * @param buffer to store stream
  * @param size num bytes to read from stream
  */
-void hfp_msbc_read_from_stream(uint8_t * buffer, int size);
+void hfp_msbc_read_from_stream(hfp_msbc_state_t * state, uint8_t * buffer, int size);
 
 /* API_END */
 
@@ -449,6 +449,7 @@ void sdp_client_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
             }
             sdp_cid = channel;
             mtu = little_endian_read_16(packet, 17);
+            l2cap_set_channel_priority(sdp_cid, L2CAP_CHANNEL_PRIORITY_LOW);
             // handle = little_endian_read_16(packet, 9);
             log_info("SDP Client Connected, cid %x, mtu %u.", sdp_cid, mtu);
 
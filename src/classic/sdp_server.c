@@ -504,6 +504,7 @@ static void sdp_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
                     l2cap_cid = channel;
                     sdp_response_size = 0;
                     l2cap_accept_connection(channel);
+                    l2cap_set_channel_priority(channel, L2CAP_CHANNEL_PRIORITY_LOW);
 					break;
                     
                 case L2CAP_EVENT_CHANNEL_OPENED:
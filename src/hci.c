@@ -76,6 +76,7 @@
 
 #define HCI_CONNECTION_TIMEOUT_MS 10000
 #define HCI_RESET_RESEND_TIMEOUT_MS 200
+#define HCI_COMMAND_TIMEOUT_MS 2000
 
 // prototypes
 #ifdef ENABLE_CLASSIC
@@ -101,6 +102,7 @@ static void hci_emit_dedicated_bonding_result(bd_addr_t address, uint8_t status)
 static void hci_emit_event(uint8_t * event, uint16_t size, int dump);
 static void hci_emit_acl_packet(uint8_t * packet, uint16_t size);
 static void hci_run(void);
+static void hci_acl_recombination_done(hci_connection_t * conn);
 static int  hci_is_le_connection(hci_connection_t * connection);
 static int  hci_number_free_acl_slots_for_connection_type( bd_addr_type_t address_type);
 
@@ -123,6 +125,58 @@ static hci_stack_t * hci_stack = NULL;
 static uint8_t disable_l2cap_timeouts = 0;
 #endif
 
+#if (HCI_CONNECTION_HASH_SIZE == 0) || (HCI_CONNECTION_HASH_SIZE & (HCI_CONNECTION_HASH_SIZE - 1))
+#error "HCI_CONNECTION_HASH_SIZE must be a power of two"
+#endif
+
+static hci_connection_t ** hci_connection_con_handle_bucket(hci_con_handle_t con_handle){
+    return &hci_stack->connections_by_con_handle[con_handle & (HCI_CONNECTION_HASH_SIZE - 1)];
+}
+
+static hci_connection_t ** hci_connection_address_bucket(const bd_addr_t addr, bd_addr_type_t addr_type){
+    // lower address bytes are most random
+    uint8_t hash = addr[5] ^ addr[4] ^ addr[3] ^ addr_type;
+    return &hci_stack->connections_by_address[hash & (HCI_CONNECTION_HASH_SIZE - 1)];
+}
+
+static void hci_connection_con_handle_hash_remove(hci_connection_t * conn){
+    if (conn->con_handle == HCI_CON_HANDLE_INVALID) return;
+    hci_connection_t ** it = hci_connection_con_handle_bucket(conn->con_handle);
+    for (; *it; it = &(*it)->con_handle_hash_next){
+        if (*it != conn) continue;
+        *it = conn->con_handle_hash_next;
+        return;
+    }
+}
+
+static void hci_connection_address_hash_remove(hci_connection_t * conn){
+    hci_connection_t ** it = hci_connection_address_bucket(conn->address, conn->address_type);
+    for (; *it; it = &(*it)->address_hash_next){
+        if (*it != conn) continue;
+        *it = conn->address_hash_next;
+        return;
+    }
+}
+
+// con handle gets assigned on connection complete
+static void hci_connection_set_con_handle(hci_connection_t * conn, hci_con_handle_t con_handle){
+    hci_connection_con_handle_hash_remove(conn);
+    conn->con_handle = con_handle;
+    if (con_handle == HCI_CON_HANDLE_INVALID) return;
+    hci_connection_t ** bucket = hci_connection_con_handle_bucket(con_handle);
+    conn->con_handle_hash_next = *bucket;
+    *bucket = conn;
+}
+
+// also returns reassembly buffer
+static void hci_connection_free(hci_connection_t * conn){
+    hci_acl_recombination_done(conn);
+    hci_connection_con_handle_hash_remove(conn);
+    hci_connection_address_hash_remove(conn);
+    btstack_linked_list_remove(&hci_stack->connections, (btstack_linked_item_t *) conn);
+    btstack_memory_hci_connection_free(conn);
+}
+
 /**
  * create connection for given address
  *
@@ -135,7 +189,7 @@ static hci_connection_t * create_connection_for_bd_addr_and_type(bd_addr_t addr,
     memset(conn, 0, sizeof(hci_connection_t));
     bd_addr_copy(conn->address, addr);
     conn->address_type = addr_type;
-    conn->con_handle = 0xffff;
+    conn->con_handle = HCI_CON_HANDLE_INVALID;
     conn->authentication_flags = AUTH_FLAGS_NONE;
     conn->bonding_flags = 0;
     conn->requested_security_level = LEVEL_0;
@@ -150,6 +204,9 @@ static hci_connection_t * create_connection_for_bd_addr_and_type(bd_addr_t addr,
     conn->num_sco_packets_sent = 0;
     conn->le_con_parameter_update_state = CON_PARAMETER_UPDATE_NONE;
     btstack_linked_list_add(&hci_stack->connections, (btstack_linked_item_t *) conn);
+    hci_connection_t ** bucket = hci_connection_address_bucket(addr, addr_type);
+    conn->address_hash_next = *bucket;
+    *bucket = conn;
     return conn;
 }
 
@@ -188,14 +245,12 @@ void hci_connections_get_iterator(btstack_linked_list_iterator_t *it){
  * @return connection OR NULL, if not found
  */
 hci_connection_t * hci_connection_for_handle(hci_con_handle_t con_handle){
-    btstack_linked_list_iterator_t it;
-    btstack_linked_list_iterator_init(&it, &hci_stack->connections);
-    while (btstack_linked_list_iterator_has_next(&it)){
-        hci_connection_t * item = (hci_connection_t *) btstack_linked_list_iterator_next(&it);
+    hci_connection_t * item = *hci_connection_con_handle_bucket(con_handle);
+    for (; item; item = item->con_handle_hash_next){
         if ( item->con_handle == con_handle ) {
             return item;
         }
-    } 
+    }
     return NULL;
 }
 
@@ -205,10 +260,8 @@ hci_connection_t * hci_connection_for_handle(hci_con_handle_t con_handle){
  * @return connection OR NULL, if not found
  */
 hci_connection_t * hci_connection_for_bd_addr_and_type(bd_addr_t  addr, bd_addr_type_t addr_type){
-    btstack_linked_list_iterator_t it;
-    btstack_linked_list_iterator_init(&it, &hci_stack->connections);
-    while (btstack_linked_list_iterator_has_next(&it)){
-        hci_connection_t * connection = (hci_connection_t *) btstack_linked_list_iterator_next(&it);
+    hci_connection_t * connection = *hci_connection_address_bucket(addr, addr_type);
+    for (; connection; connection = connection->address_hash_next){
         if (connection->address_type != addr_type)  continue;
         if (memcmp(addr, connection->address, 6) != 0) continue;
         return connection;   
@@ -398,9 +451,15 @@ static int hci_number_free_sco_slots(void){
 }
 #endif
 
+// outgoing packet buffer can be reserved if not reserved yet and not queued in transport
+static int hci_packet_buffer_available(void){
+    if (hci_stack->hci_packet_buffer_reserved) return 0;
+    return hci_stack->hci_packet_buffers_in_transport < HCI_OUTGOING_PACKET_BUFFERS;
+}
+
 // new functions replacing hci_can_send_packet_now[_using_packet_buffer]
 int hci_can_send_command_packet_now(void){
-    if (hci_stack->hci_packet_buffer_reserved) return 0;
+    if (!hci_packet_buffer_available()) return 0;
 
     // check for async hci transport implementations
     if (hci_stack->hci_transport->can_send_packet_now){
@@ -424,23 +483,35 @@ static int hci_can_send_prepared_acl_packet_for_address_type(bd_addr_type_t addr
 }
 
 int hci_can_send_acl_le_packet_now(void){
-    if (hci_stack->hci_packet_buffer_reserved) return 0;
+    if (!hci_packet_buffer_available()) return 0;
     return hci_can_send_prepared_acl_packet_for_address_type(BD_ADDR_TYPE_LE_PUBLIC);
 }
 
+// connection did not queue HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION buffers in the transport yet
+static int hci_connection_packet_buffer_available(hci_con_handle_t con_handle){
+#if HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION < HCI_OUTGOING_PACKET_BUFFERS
+    hci_connection_t * connection = hci_connection_for_handle(con_handle);
+    if (connection && connection->num_packet_buffers_in_transport >= HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION) return 0;
+#else
+    UNUSED(con_handle);
+#endif
+    return 1;
+}
+
 int hci_can_send_prepared_acl_packet_now(hci_con_handle_t con_handle) {
     if (!hci_transport_can_send_prepared_packet_now(HCI_ACL_DATA_PACKET)) return 0;
+    if (!hci_connection_packet_buffer_available(con_handle)) return 0;
     return hci_number_free_acl_slots_for_handle(con_handle) > 0;
 }
 
 int hci_can_send_acl_packet_now(hci_con_handle_t con_handle){
-    if (hci_stack->hci_packet_buffer_reserved) return 0;
+    if (!hci_packet_buffer_available()) return 0;
     return hci_can_send_prepared_acl_packet_now(con_handle);
 }
 
 #ifdef ENABLE_CLASSIC
 int hci_can_send_acl_classic_packet_now(void){
-    if (hci_stack->hci_packet_buffer_reserved) return 0;
+    if (!hci_packet_buffer_available()) return 0;
     return hci_can_send_prepared_acl_packet_for_address_type(BD_ADDR_TYPE_CLASSIC);
 }
 
@@ -451,7 +522,7 @@ int hci_can_send_prepared_sco_packet_now(void){
 }
 
 int hci_can_send_sco_packet_now(void){
-    if (hci_stack->hci_packet_buffer_reserved) return 0;
+    if (!hci_packet_buffer_available()) return 0;
     return hci_can_send_prepared_sco_packet_now();
 }
 
@@ -463,12 +534,12 @@ void hci_request_sco_can_send_now_event(void){
 
 // used for internal checks in l2cap.c
 int hci_is_packet_buffer_reserved(void){
-    return hci_stack->hci_packet_buffer_reserved;
+    return !hci_packet_buffer_available();
 }
 
 // reserves outgoing packet buffer. @returns 1 if successful
 int hci_reserve_packet_buffer(void){
-    if (hci_stack->hci_packet_buffer_reserved) {
+    if (!hci_packet_buffer_available()) {
         log_error("hci_reserve_packet_buffer called but buffer already reserved");
         return 0;
     }
@@ -485,6 +556,57 @@ static int hci_transport_synchronous(void){
     return hci_stack->hci_transport->can_send_packet_now == NULL;
 }
 
+static void hci_packet_buffer_select(uint8_t index){
+    hci_stack->hci_packet_buffer_index = index;
+    hci_stack->hci_packet_buffer = &hci_stack->hci_packet_buffer_data[index][HCI_OUTGOING_PRE_BUFFER_SIZE];
+}
+
+static void hci_packet_buffer_reset(void){
+    hci_stack->hci_packet_buffer_reserved = 0;
+    hci_stack->hci_packet_buffers_in_transport = 0;
+    memset(hci_stack->hci_packet_buffer_packets_in_transport, 0, sizeof(hci_stack->hci_packet_buffer_packets_in_transport));
+    hci_packet_buffer_select(0);
+}
+
+// count packet sent from current buffer via asynchronous transport, call before send_packet
+static void hci_packet_buffer_packet_queued(void){
+    if (hci_transport_synchronous()) return;
+    hci_stack->hci_packet_buffer_packets_in_transport[hci_stack->hci_packet_buffer_index]++;
+}
+
+// current buffer is complete: keep it until transport is done and continue with next buffer
+static void hci_packet_buffer_hand_over(hci_con_handle_t con_handle){
+    hci_stack->hci_packet_buffer_reserved = 0;
+    uint8_t index = hci_stack->hci_packet_buffer_index;
+    // all packets already sent
+    if (hci_stack->hci_packet_buffer_packets_in_transport[index] == 0) return;
+    hci_stack->hci_packet_buffer_con_handle[index] = con_handle;
+    hci_connection_t * connection = hci_connection_for_handle(con_handle);
+    if (connection){
+        connection->num_packet_buffers_in_transport++;
+    }
+    hci_stack->hci_packet_buffers_in_transport++;
+    hci_packet_buffer_select((index + 1) % HCI_OUTGOING_PACKET_BUFFERS);
+}
+
+// transport sent oldest packet, transports report HCI_EVENT_TRANSPORT_PACKET_SENT in order
+static void hci_packet_buffer_transport_done(void){
+    uint8_t index = (hci_stack->hci_packet_buffer_index + HCI_OUTGOING_PACKET_BUFFERS - hci_stack->hci_packet_buffers_in_transport) % HCI_OUTGOING_PACKET_BUFFERS;
+    if (hci_stack->hci_packet_buffer_packets_in_transport[index] == 0){
+        log_error("hci_packet_buffer_transport_done: no packet in transport");
+        return;
+    }
+    hci_stack->hci_packet_buffer_packets_in_transport[index]--;
+    if (hci_stack->hci_packet_buffer_packets_in_transport[index]) return;
+    // fragments of current buffer
+    if (hci_stack->hci_packet_buffers_in_transport == 0) return;
+    hci_stack->hci_packet_buffers_in_transport--;
+    hci_connection_t * connection = hci_connection_for_handle(hci_stack->hci_packet_buffer_con_handle[index]);
+    if (connection && connection->num_packet_buffers_in_transport){
+        connection->num_packet_buffers_in_transport--;
+    }
+}
+
 static int hci_send_acl_packet_fragments(hci_connection_t *connection){
 
     // log_info("hci_send_acl_packet_fragments  %u/%u (con 0x%04x)", hci_stack->acl_fragmentation_pos, hci_stack->acl_fragmentation_total_size, connection->con_handle);
@@ -545,6 +667,7 @@ static int hci_send_acl_packet_fragments(hci_connection_t *connection){
         uint8_t * packet = &hci_stack->hci_packet_buffer[acl_header_pos];
         const int size = current_acl_data_packet_length + 4;
         hci_dump_packet(HCI_ACL_DATA_PACKET, 0, packet, size);
+        hci_packet_buffer_packet_queued();
         err = hci_stack->hci_transport->send_packet(HCI_ACL_DATA_PACKET, packet, size);
 
         log_debug("hci_send_acl_packet_fragments loop after send (more fragments %d)", more_fragments);
@@ -564,6 +687,8 @@ static int hci_send_acl_packet_fragments(hci_connection_t *connection){
         // notify upper stack that it might be possible to send again
         uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
         hci_emit_event(&event[0], sizeof(event), 0);  // don't dump
+    } else {
+        hci_packet_buffer_hand_over(connection->con_handle);
     }
 
     return err;
@@ -644,6 +769,7 @@ int hci_send_sco_packet_buffer(int size){
     }
 
     hci_dump_packet( HCI_SCO_DATA_PACKET, 0, packet, size);
+    hci_packet_buffer_packet_queued();
     int err = hci_stack->hci_transport->send_packet(HCI_SCO_DATA_PACKET, packet, size);
 
     if (hci_transport_synchronous()){
@@ -651,12 +777,41 @@ int hci_send_sco_packet_buffer(int size){
         // notify upper stack that it might be possible to send again
         uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
         hci_emit_event(&event[0], sizeof(event), 0);    // don't dump
+    } else {
+        hci_packet_buffer_hand_over(HCI_CON_HANDLE_INVALID);
     }
 
     return err;
 }
 #endif
 
+#ifdef ENABLE_HCI_ACL_REASSEMBLY_POOL
+static uint8_t * hci_acl_recombination_buffer(hci_connection_t * conn){
+    if (!conn->acl_reassembly_buffer){
+        conn->acl_reassembly_buffer = btstack_memory_hci_acl_reassembly_buffer_get();
+        if (!conn->acl_reassembly_buffer) return NULL;
+    }
+    return conn->acl_reassembly_buffer->data;
+}
+
+static void hci_acl_recombination_done(hci_connection_t * conn){
+    conn->acl_recombination_length = 0;
+    conn->acl_recombination_pos = 0;
+    if (!conn->acl_reassembly_buffer) return;
+    btstack_memory_hci_acl_reassembly_buffer_free(conn->acl_reassembly_buffer);
+    conn->acl_reassembly_buffer = NULL;
+}
+#else
+static uint8_t * hci_acl_recombination_buffer(hci_connection_t * conn){
+    return conn->acl_recombination_buffer;
+}
+
+static void hci_acl_recombination_done(hci_connection_t * conn){
+    conn->acl_recombination_length = 0;
+    conn->acl_recombination_pos = 0;
+}
+#endif
+
 static void acl_handler(uint8_t *packet, int size){
 
     // log_info("acl_handler: size %u", size);
@@ -687,7 +842,7 @@ static void acl_handler(uint8_t *packet, int size){
     // handle different packet types
     switch (acl_flags & 0x03) {
             
-        case 0x01: // continuation fragment
+        case 0x01: { // continuation fragment
             
             // sanity checks
             if (conn->acl_recombination_pos == 0) {
@@ -697,12 +852,13 @@ static void acl_handler(uint8_t *packet, int size){
             if (conn->acl_recombination_pos + acl_length > 4 + HCI_ACL_BUFFER_SIZE){
                 log_error( "ACL Cont Fragment to large: combined packet %u > buffer size %u for handle 0x%02x",
                     conn->acl_recombination_pos + acl_length, 4 + HCI_ACL_BUFFER_SIZE, con_handle);
-                conn->acl_recombination_pos = 0;
+                hci_acl_recombination_done(conn);
                 return;
             }
 
             // append fragment payload (header already stored)
-            memcpy(&conn->acl_recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + conn->acl_recombination_pos], &packet[4], acl_length );
+            uint8_t * recombination_buffer = hci_acl_recombination_buffer(conn);
+            memcpy(&recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + conn->acl_recombination_pos], &packet[4], acl_length );
             conn->acl_recombination_pos += acl_length;
             
             // log_error( "ACL Cont Fragment: acl_len %u, combined_len %u, l2cap_len %u", acl_length,
@@ -710,19 +866,19 @@ static void acl_handler(uint8_t *packet, int size){
             
             // forward complete L2CAP packet if complete. 
             if (conn->acl_recombination_pos >= conn->acl_recombination_length + 4 + 4){ // pos already incl. ACL header
-                hci_emit_acl_packet(&conn->acl_recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE], conn->acl_recombination_pos);
+                hci_emit_acl_packet(&recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE], conn->acl_recombination_pos);
                 // reset recombination buffer
-                conn->acl_recombination_length = 0;
-                conn->acl_recombination_pos = 0;
+                hci_acl_recombination_done(conn);
             }
             break;
+        }
             
         case 0x02: { // first fragment
             
             // sanity check
             if (conn->acl_recombination_pos) {
                 log_error( "ACL First Fragment but data in buffer for handle 0x%02x, dropping stale fragments", con_handle);
-                conn->acl_recombination_pos = 0;
+                hci_acl_recombination_done(conn);
             }
 
             // peek into L2CAP packet!
@@ -736,17 +892,24 @@ static void acl_handler(uint8_t *packet, int size){
                 hci_emit_acl_packet(packet, acl_length + 4);
             } else {
 
-                if (acl_length > HCI_ACL_BUFFER_SIZE){
-                    log_error( "ACL First Fragment to large: fragment %u > buffer size %u for handle 0x%02x",
-                        4 + acl_length, 4 + HCI_ACL_BUFFER_SIZE, con_handle);
+                // L2CAP packet has to fit into reassembly buffer, continuation fragments get dropped as well
+                if (l2cap_length + 4 > HCI_ACL_BUFFER_SIZE){
+                    log_error( "ACL First Fragment to large: L2CAP packet %u > buffer size %u for handle 0x%02x",
+                        l2cap_length + 4, HCI_ACL_BUFFER_SIZE, con_handle);
+                    return;
+                }
+
+                uint8_t * recombination_buffer = hci_acl_recombination_buffer(conn);
+                if (!recombination_buffer){
+                    log_error( "ACL First Fragment but no reassembly buffer available for handle 0x%02x, dropping packet", con_handle);
                     return;
                 }
 
                 // store first fragment and tweak acl length for complete package
-                memcpy(&conn->acl_recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE], packet, acl_length + 4);
+                memcpy(&recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE], packet, acl_length + 4);
                 conn->acl_recombination_pos    = acl_length + 4;
                 conn->acl_recombination_length = l2cap_length;
-                little_endian_store_16(conn->acl_recombination_buffer, HCI_INCOMING_PRE_BUFFER_SIZE + 2, l2cap_length +4);
+                little_endian_store_16(recombination_buffer, HCI_INCOMING_PRE_BUFFER_SIZE + 2, l2cap_length +4);
             }
             break;
             
@@ -768,9 +931,8 @@ static void hci_shutdown_connection(hci_connection_t *conn){
 #endif
 
     btstack_run_loop_remove_timer(&conn->timeout);
-    
-    btstack_linked_list_remove(&hci_stack->connections, (btstack_linked_item_t *) conn);
-    btstack_memory_hci_connection_free( conn );
+
+    hci_connection_free(conn);
     
     // now it's gone
     hci_emit_nr_connections_changed();
@@ -1533,6 +1695,79 @@ static void hci_initializing_event_handler(uint8_t * packet, uint16_t size){
     hci_initializing_next_state();
 }
 
+static void hci_command_timeout_handler(btstack_timer_source_t * timer){
+    UNUSED(timer);
+    if (hci_stack->state != HCI_STATE_WORKING) return;
+    // no Command Complete / Command Status for a while, assume that the Controller can accept a command again
+    log_error("hci_command_timeout: no response for %u outstanding commands", hci_stack->num_outstanding_commands);
+    hci_stack->num_outstanding_commands = 0;
+    hci_stack->num_cmd_packets = 1;
+    hci_run();
+}
+
+// restart timeout for outstanding commands in working state, initialization and halting have their own timeouts
+static void hci_command_timeout_restart(void){
+    btstack_run_loop_remove_timer(&hci_stack->command_timeout);
+    if (hci_stack->state != HCI_STATE_WORKING) return;
+    if (!hci_stack->num_outstanding_commands) return;
+    btstack_run_loop_set_timer(&hci_stack->command_timeout, HCI_COMMAND_TIMEOUT_MS);
+    btstack_run_loop_set_timer_handler(&hci_stack->command_timeout, hci_command_timeout_handler);
+    btstack_run_loop_add_timer(&hci_stack->command_timeout);
+}
+
+// handle Command Complete / Command Status: update command credits and return request that sent the command, if any
+static hci_command_request_t * hci_command_done(uint16_t opcode, uint8_t num_hci_command_packets){
+    hci_command_request_t * request = NULL;
+    int i;
+    for (i = 0; i < hci_stack->num_outstanding_commands; i++){
+        if (hci_stack->outstanding_commands[i].opcode == opcode) break;
+    }
+    if (i < hci_stack->num_outstanding_commands){
+        request = hci_stack->outstanding_commands[i].request;
+    } else if (num_hci_command_packets && hci_stack->num_outstanding_commands == HCI_MAX_OUTSTANDING_COMMANDS){
+        // no tracked command matches, e.g. opcode 0x0000 (no operation), but the Controller reports free command slots.
+        // Its Command Complete / Command Status was lost or had a different opcode, consider the oldest command as done
+        log_info("hci_command_done: opcode %04x not outstanding, drop opcode %04x", opcode, hci_stack->outstanding_commands[0].opcode);
+        i = 0;
+    }
+    if (i < hci_stack->num_outstanding_commands){
+        hci_stack->num_outstanding_commands--;
+        memmove(&hci_stack->outstanding_commands[i], &hci_stack->outstanding_commands[i+1],
+            (hci_stack->num_outstanding_commands - i) * sizeof(hci_outstanding_command_t));
+    }
+    if (hci_stack->state != HCI_STATE_WORKING){
+        // single command at a time, vendor specific init commands might not get a Command Complete
+        hci_stack->num_outstanding_commands = 0;
+        hci_stack->num_cmd_packets = num_hci_command_packets ? 1 : 0;
+        hci_command_timeout_restart();
+        return request;
+    }
+    // Num_HCI_Command_Packets already accounts for commands received by the Controller
+    hci_stack->num_cmd_packets = btstack_min(num_hci_command_packets, HCI_MAX_OUTSTANDING_COMMANDS - hci_stack->num_outstanding_commands);
+    hci_command_timeout_restart();
+    return request;
+}
+
+// track command until Command Complete / Command Status
+static void hci_command_sent(uint16_t opcode){
+    hci_stack->num_commands_sent++;
+    if (hci_stack->num_outstanding_commands == HCI_MAX_OUTSTANDING_COMMANDS){
+        // command sent without credit, forget oldest one
+        log_error("hci_send_cmd_packet: too many outstanding commands, dropping opcode %04x", hci_stack->outstanding_commands[0].opcode);
+        hci_stack->num_outstanding_commands--;
+        memmove(&hci_stack->outstanding_commands[0], &hci_stack->outstanding_commands[1],
+            hci_stack->num_outstanding_commands * sizeof(hci_outstanding_command_t));
+    }
+    hci_outstanding_command_t * command = &hci_stack->outstanding_commands[hci_stack->num_outstanding_commands++];
+    command->opcode  = opcode;
+    // only first command sent from send_command callback belongs to request
+    command->request = hci_stack->command_request_active;
+    hci_stack->command_request_active = NULL;
+    if (hci_stack->num_outstanding_commands == 1){
+        hci_command_timeout_restart();
+    }
+}
+
 static void event_handler(uint8_t *packet, int size){
 
     uint16_t event_length = packet[1];
@@ -1548,6 +1783,7 @@ static void event_handler(uint8_t *packet, int size){
     uint8_t link_type;
     hci_con_handle_t handle;
     hci_connection_t * conn;
+    hci_command_request_t * command_request = NULL;
     int i;
         
     // warnings
@@ -1558,8 +1794,7 @@ static void event_handler(uint8_t *packet, int size){
     switch (hci_event_packet_get_type(packet)) {
                         
         case HCI_EVENT_COMMAND_COMPLETE:
-            // get num cmd packets - limit to 1 to reduce complexity
-            hci_stack->num_cmd_packets = packet[2] ? 1 : 0;
+            command_request = hci_command_done(little_endian_read_16(packet, 3), packet[2]);
 
             if (HCI_EVENT_IS_COMMAND_COMPLETE(packet, hci_read_local_name)){
                 if (packet[5]) break;
@@ -1658,8 +1893,7 @@ static void event_handler(uint8_t *packet, int size){
             break;
             
         case HCI_EVENT_COMMAND_STATUS:
-            // get num cmd packets - limit to 1 to reduce complexity
-            hci_stack->num_cmd_packets = packet[3] ? 1 : 0;
+            command_request = hci_command_done(little_endian_read_16(packet, 4), packet[3]);
             break;
             
         case HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS:{
@@ -1734,7 +1968,7 @@ static void event_handler(uint8_t *packet, int size){
             if (conn) {
                 if (!packet[2]){
                     conn->state = OPEN;
-                    conn->con_handle = little_endian_read_16(packet, 3);
+                    hci_connection_set_con_handle(conn, little_endian_read_16(packet, 3));
                     conn->bonding_flags |= BONDING_REQUEST_REMOTE_FEATURES;
 
                     // restart timer
@@ -1751,8 +1985,7 @@ static void event_handler(uint8_t *packet, int size){
                     memcpy(&bd_address, conn->address, 6);
 
                     // connection failed, remove entry
-                    btstack_linked_list_remove(&hci_stack->connections, (btstack_linked_item_t *) conn);
-                    btstack_memory_hci_connection_free( conn );
+                    hci_connection_free(conn);
                     
                     // notify client if dedicated bonding
                     if (notify_dedicated_bonding_failed){
@@ -1783,7 +2016,7 @@ static void event_handler(uint8_t *packet, int size){
                 break;
             }
             conn->state = OPEN;
-            conn->con_handle = little_endian_read_16(packet, 3);            
+            hci_connection_set_con_handle(conn, little_endian_read_16(packet, 3));
 
 #ifdef ENABLE_SCO_OVER_HCI
             // update SCO
@@ -1922,6 +2155,7 @@ static void event_handler(uint8_t *packet, int size){
                     log_info("hci: drop fragmented ACL data for closed connection");
                      hci_stack->acl_fragmentation_total_size = 0;
                      hci_stack->acl_fragmentation_pos = 0;
+                     hci_packet_buffer_hand_over(handle);
                 }
             }
 
@@ -1965,8 +2199,8 @@ static void event_handler(uint8_t *packet, int size){
                 log_error("Synchronous HCI Transport shouldn't send HCI_EVENT_TRANSPORT_PACKET_SENT");
                 return; // instead of break: to avoid re-entering hci_run()
             }
+            hci_packet_buffer_transport_done();
             if (hci_stack->acl_fragmentation_total_size) break;
-            hci_release_packet_buffer();
             
             // L2CAP receives this event via the hci_emit_event below
 
@@ -2010,8 +2244,7 @@ static void event_handler(uint8_t *packet, int size){
                         hci_stack->le_connecting_state = LE_CONNECTING_IDLE;
                         // remove entry
                         if (conn){
-                            btstack_linked_list_remove(&hci_stack->connections, (btstack_linked_item_t *) conn);
-                            btstack_memory_hci_connection_free( conn );
+                            hci_connection_free(conn);
                         }
                         break;
                     }
@@ -2041,7 +2274,7 @@ static void event_handler(uint8_t *packet, int size){
                     
                     conn->state = OPEN;
                     conn->role  = packet[6];
-                    conn->con_handle = little_endian_read_16(packet, 4);
+                    hci_connection_set_con_handle(conn, little_endian_read_16(packet, 4));
                     
                     // TODO: store - role, peer address type, conn_interval, conn_latency, supervision timeout, master clock
 
@@ -2080,6 +2313,11 @@ static void event_handler(uint8_t *packet, int size){
     // notify upper stack
 	hci_emit_event(packet, size, 0);   // don't dump, already happened in packet handler
 
+    // notify requester of completed command
+    if (command_request && command_request->command_complete){
+        (*command_request->command_complete)(command_request->context, packet, size);
+    }
+
     // moved here to give upper stack a chance to close down everything with hci_connection_t intact
     if (hci_event_packet_get_type(packet) == HCI_EVENT_DISCONNECTION_COMPLETE){
         if (!packet[2]){
@@ -2154,6 +2392,8 @@ void hci_register_sco_packet_handler(btstack_packet_handler_t handler){
 static void hci_state_reset(void){
     // no connections yet
     hci_stack->connections = NULL;
+    memset(hci_stack->connections_by_con_handle, 0, sizeof(hci_stack->connections_by_con_handle));
+    memset(hci_stack->connections_by_address, 0, sizeof(hci_stack->connections_by_address));
 
     // keep discoverable/connectable as this has been requested by the client(s)
     // hci_stack->discoverable = 0;
@@ -2161,8 +2401,13 @@ static void hci_state_reset(void){
     // hci_stack->bondable = 1;
     // hci_stack->own_addr_type = 0;
 
-    // buffer is free
-    hci_stack->hci_packet_buffer_reserved = 0;
+    // buffers are free
+    hci_packet_buffer_reset();
+
+    // no outstanding commands, command requests stay queued
+    hci_stack->num_outstanding_commands = 0;
+    btstack_run_loop_remove_timer(&hci_stack->command_timeout);
+    hci_stack->command_request_active = NULL;
 
     // no pending cmds
     hci_stack->decline_reason = 0;
@@ -2220,7 +2465,7 @@ void hci_init(const hci_transport_t *transport, const void *config){
     hci_stack->config = config;
     
     // setup pointer for outgoing packet buffer
-    hci_stack->hci_packet_buffer = &hci_stack->hci_packet_buffer_data[HCI_OUTGOING_PRE_BUFFER_SIZE];
+    hci_packet_buffer_select(0);
 
     // max acl payload size defined in config.h
     hci_stack->acl_data_packet_length = HCI_ACL_PAYLOAD_SIZE;
@@ -2422,7 +2667,7 @@ static int hci_power_control_wake(void){
 static void hci_power_transition_to_initializing(void){
     // set up state machine
     hci_stack->num_cmd_packets = 1; // assume that one cmd can be sent
-    hci_stack->hci_packet_buffer_reserved = 0;
+    hci_packet_buffer_reset();
     hci_stack->state = HCI_STATE_INITIALIZING;
     hci_stack->substate = HCI_INIT_SEND_RESET;
 }
@@ -2598,7 +2843,7 @@ void gap_local_bd_addr(bd_addr_t address_buffer){
     memcpy(address_buffer, hci_stack->local_bd_addr, 6);
 }
 
-static void hci_run(void){
+static void hci_run_single(void){
     
     // log_info("hci_run: entered");
     btstack_linked_item_t * it;
@@ -2617,6 +2862,7 @@ static void hci_run(void){
             log_info("hci_run: fragmented ACL packet no connection -> discard fragment");
             hci_stack->acl_fragmentation_total_size = 0;
             hci_stack->acl_fragmentation_pos = 0;
+            hci_packet_buffer_hand_over(con_handle);
         }
     }
 
@@ -2949,10 +3195,21 @@ static void hci_run(void){
     }
     
     hci_connection_t * connection;
+    hci_command_request_t * request;
     switch (hci_stack->state){
         case HCI_STATE_INITIALIZING:
             hci_initializing_run();
             break;
+
+        case HCI_STATE_WORKING:
+            // command requests last, stack commands above have priority
+            if (!hci_can_send_command_packet_now()) return;
+            request = (hci_command_request_t *) btstack_linked_list_pop(&hci_stack->command_requests);
+            if (!request) break;
+            hci_stack->command_request_active = request;
+            (*request->send_command)(request->context);
+            hci_stack->command_request_active = NULL;
+            break;
             
         case HCI_STATE_HALTING:
 
@@ -3065,7 +3322,43 @@ static void hci_run(void){
     }
 }
 
+static void hci_run(void){
+    while (1){
+        uint8_t num_commands_sent = hci_stack->num_commands_sent;
+        hci_run_single();
+        // pipeline commands only in working state, initialization and shutdown wait for each command to complete
+        if (hci_stack->state != HCI_STATE_WORKING) return;
+        // stop if nothing was sent or Controller cannot accept more commands
+        if (hci_stack->num_commands_sent == num_commands_sent) return;
+        if (!hci_can_send_command_packet_now()) return;
+    }
+}
+
+void hci_request_command(hci_command_request_t * request){
+    btstack_linked_list_add_tail(&hci_stack->command_requests, (btstack_linked_item_t *) request);
+    hci_run();
+}
+
+void hci_request_command_cancel(hci_command_request_t * request){
+    btstack_linked_list_remove(&hci_stack->command_requests, (btstack_linked_item_t *) request);
+    // command already sent, ignore its completion
+    int i;
+    for (i = 0; i < hci_stack->num_outstanding_commands; i++){
+        if (hci_stack->outstanding_commands[i].request != request) continue;
+        hci_stack->outstanding_commands[i].request = NULL;
+    }
+}
+
 int hci_send_cmd_packet(uint8_t *packet, int size){
+
+    // asynchronous transports keep the packet until HCI_EVENT_TRANSPORT_PACKET_SENT, external buffer gets copied below
+    if (!hci_transport_synchronous() && (packet != hci_stack->hci_packet_buffer)){
+        if (!hci_packet_buffer_available() || size > HCI_PACKET_BUFFER_SIZE){
+            log_error("hci_send_cmd_packet: no outgoing packet buffer available");
+            return BTSTACK_ACL_BUFFERS_FULL;
+        }
+    }
+
     // house-keeping
     
     if (IS_COMMAND(packet, hci_write_loopback_mode)){
@@ -3189,14 +3482,26 @@ int hci_send_cmd_packet(uint8_t *packet, int size){
 #endif
 #endif
 
+    // copy external buffer into packet buffer for asynchronous transports, checked above
+    if (!hci_transport_synchronous() && (packet != hci_stack->hci_packet_buffer)){
+        memcpy(hci_stack->hci_packet_buffer, packet, size);
+        packet = hci_stack->hci_packet_buffer;
+    }
+
     hci_stack->num_cmd_packets--;
+    hci_command_sent(little_endian_read_16(packet, 0));
 
     hci_dump_packet(HCI_COMMAND_DATA_PACKET, 0, packet, size);
+    hci_packet_buffer_packet_queued();
     int err = hci_stack->hci_transport->send_packet(HCI_COMMAND_DATA_PACKET, packet, size);
 
-    // release packet buffer for synchronous transport implementations    
-    if (hci_transport_synchronous() && (packet == hci_stack->hci_packet_buffer)){
-        hci_stack->hci_packet_buffer_reserved = 0;
+    // release packet buffer for synchronous transport implementations, or hand it over to asynchronous ones
+    if (hci_transport_synchronous()){
+        if (packet == hci_stack->hci_packet_buffer){
+            hci_stack->hci_packet_buffer_reserved = 0;
+        }
+    } else {
+        hci_packet_buffer_hand_over(HCI_CON_HANDLE_INVALID);
     }
 
     return err;
@@ -3646,8 +3951,7 @@ uint8_t gap_connect_cancel(void){
         case SEND_CREATE_CONNECTION:
             // skip sending create connection and emit event instead
             hci_emit_le_connection_complete(conn->address_type, conn->address, 0, ERROR_CODE_UNKNOWN_CONNECTION_IDENTIFIER);
-            btstack_linked_list_remove(&hci_stack->connections, (btstack_linked_item_t *) conn);
-            btstack_memory_hci_connection_free( conn );
+            hci_connection_free(conn);
             break;            
         case SENT_CREATE_CONNECTION:
             // request to send cancel connection
@@ -95,6 +95,31 @@ extern "C" {
 // additional pre-buffer space for packets to Bluetooth module, for now, used for HCI Transport H4 DMA
 #define HCI_OUTGOING_PRE_BUFFER_SIZE 1
 
+// number of outgoing packet buffers. with more than one, several packets can be queued in asynchronous HCI transports
+#ifndef HCI_OUTGOING_PACKET_BUFFERS
+#define HCI_OUTGOING_PACKET_BUFFERS 1
+#endif
+
+// max number of outgoing packet buffers a single connection can have queued in the HCI transport
+// by default, one buffer is left for commands and other connections
+#ifndef HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION
+#if HCI_OUTGOING_PACKET_BUFFERS > 1
+#define HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION (HCI_OUTGOING_PACKET_BUFFERS - 1)
+#else
+#define HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION 1
+#endif
+#endif
+
+// max number of HCI Commands sent without Command Complete / Command Status, further limited by Controller's Num_HCI_Command_Packets
+#ifndef HCI_MAX_OUTSTANDING_COMMANDS
+#define HCI_MAX_OUTSTANDING_COMMANDS 1
+#endif
+
+// number of buckets for connection lookup by con handle and by address, power of two
+#ifndef HCI_CONNECTION_HASH_SIZE
+#define HCI_CONNECTION_HASH_SIZE 16
+#endif
+
 // BNEP may uncompress the IP Header by 16 bytes
 #ifndef HCI_INCOMING_PRE_BUFFER_SIZE
 #define HCI_INCOMING_PRE_BUFFER_SIZE (16 - HCI_ACL_HEADER_SIZE - 4)
@@ -400,6 +425,38 @@ typedef enum {
     ATT_SERVER_REQUEST_RECEIVED_AND_VALIDATED,
 } att_server_state_t;
 
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+
+// max number of Client Characteristic Configurations tracked per connection
+#ifndef ATT_SERVER_NOTIFICATION_QUEUE_MAX_SUBSCRIPTIONS
+#define ATT_SERVER_NOTIFICATION_QUEUE_MAX_SUBSCRIPTIONS 4
+#endif
+
+// max number of pending notifications per connection
+#ifndef ATT_SERVER_NOTIFICATION_QUEUE_SIZE
+#define ATT_SERVER_NOTIFICATION_QUEUE_SIZE 4
+#endif
+
+// max size of a queued notification value, fits default ATT MTU
+#ifndef ATT_SERVER_NOTIFICATION_QUEUE_VALUE_SIZE
+#define ATT_SERVER_NOTIFICATION_QUEUE_VALUE_SIZE 20
+#endif
+
+typedef struct {
+    uint16_t client_configuration_handle;
+    uint16_t client_configuration;
+} att_server_subscription_t;
+
+typedef struct {
+    uint16_t attribute_handle;
+    uint16_t value_len;
+    uint32_t queued_ms;
+    uint8_t  indication;
+    uint8_t  value[ATT_SERVER_NOTIFICATION_QUEUE_VALUE_SIZE];
+} att_server_queued_notification_t;
+
+#endif
+
 typedef struct {
     att_server_state_t      state;
 
@@ -417,14 +474,51 @@ typedef struct {
     uint16_t                request_size;
     uint8_t                 request_buffer[ATT_REQUEST_BUFFER_SIZE];
 
+#ifdef ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+    att_server_subscription_t        subscriptions[ATT_SERVER_NOTIFICATION_QUEUE_MAX_SUBSCRIPTIONS];
+    att_server_queued_notification_t notification_queue[ATT_SERVER_NOTIFICATION_QUEUE_SIZE];
+    uint8_t                          notification_queue_head;
+    uint8_t                          notification_queue_count;
+    // counters for att_server_get_notification_stats
+    uint32_t                         notifications_sent;
+    uint32_t                         notifications_dropped;
+    uint32_t                         notifications_coalesced;
+    uint32_t                         notification_latency_last_ms;
+    uint32_t                         notification_latency_max_ms;
+#endif
+
 } att_server_t;
 
 #endif
 
-//
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+typedef enum {
+    L2CAP_INFORMATION_STATE_IDLE = 0,
+    L2CAP_INFORMATION_STATE_W2_SEND_EXTENDED_FEATURE_REQUEST,
+    L2CAP_INFORMATION_STATE_W4_EXTENDED_FEATURE_RESPONSE,
+    L2CAP_INFORMATION_STATE_DONE
+} l2cap_information_state_t;
+
+// L2CAP state per HCI connection
 typedef struct {
+    l2cap_information_state_t information_state;
+    uint16_t                  extended_feature_mask;
+} l2cap_state_t;
+#endif
+
+// buffer for reassembly of fragmented L2CAP packets, see ENABLE_HCI_ACL_REASSEMBLY_POOL
+typedef struct {
+    uint8_t data[HCI_INCOMING_PRE_BUFFER_SIZE + 4 + HCI_ACL_BUFFER_SIZE];
+} hci_acl_reassembly_buffer_t;
+
+//
+typedef struct hci_connection {
     // linked list - assert: first field
     btstack_linked_item_t    item;
+
+    // next connection in con handle and address hash buckets
+    struct hci_connection * con_handle_hash_next;
+    struct hci_connection * address_hash_next;
     
     // remote side
     bd_addr_t address;
@@ -462,7 +556,12 @@ typedef struct {
     uint32_t timestamp;
 
     // ACL packet recombination - PRE_BUFFER + ACL Header + ACL payload
+#ifdef ENABLE_HCI_ACL_REASSEMBLY_POOL
+    // taken from shared pool for first fragment, returned when L2CAP packet is complete
+    hci_acl_reassembly_buffer_t * acl_reassembly_buffer;
+#else
     uint8_t  acl_recombination_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + 4 + HCI_ACL_BUFFER_SIZE];
+#endif
     uint16_t acl_recombination_pos;
     uint16_t acl_recombination_length;
     
@@ -470,6 +569,14 @@ typedef struct {
     uint8_t num_acl_packets_sent;
     uint8_t num_sco_packets_sent;
 
+    // number of outgoing packet buffers queued in HCI transport
+    uint8_t num_packet_buffers_in_transport;
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    // extended features of remote L2CAP
+    l2cap_state_t l2cap_state;
+#endif
+
     // LE Connection parameter update
     le_con_parameter_update_state_t le_con_parameter_update_state;
     uint8_t  le_con_param_update_identifier;
@@ -601,6 +708,24 @@ typedef struct {
     uint8_t        state;   
 } whitelist_entry_t;
 
+/**
+ * HCI Command request, see hci_request_command
+ */
+typedef struct {
+    btstack_linked_item_t item;
+    // called when Controller can accept a command, has to send a single command with hci_send_cmd
+    void (*send_command)(void * context);
+    // called with Command Complete or Command Status event for the command, can be NULL
+    void (*command_complete)(void * context, uint8_t * event, uint16_t size);
+    void * context;
+} hci_command_request_t;
+
+// command sent to Controller, waiting for Command Complete / Command Status
+typedef struct {
+    uint16_t                opcode;
+    hci_command_request_t * request;
+} hci_outstanding_command_t;
+
 /**
  * main data structure
  */
@@ -620,6 +745,8 @@ typedef struct {
 
     // list of existing baseband connections
     btstack_linked_list_t     connections;
+    hci_connection_t *        connections_by_con_handle[HCI_CONNECTION_HASH_SIZE];
+    hci_connection_t *        connections_by_address[HCI_CONNECTION_HASH_SIZE];
 
     /* callback to L2CAP layer */
     btstack_packet_handler_t acl_packet_handler;
@@ -644,15 +771,21 @@ typedef struct {
     uint8_t            ssp_auto_accept;
     inquiry_mode_t     inquiry_mode;
 
-    // single buffer for HCI packet assembly + additional prebuffer for H4 drivers
+    // buffers for HCI packet assembly + additional prebuffer for H4 drivers
+    // hci_packet_buffer points to the current buffer, buffers queued in an asynchronous transport precede it
     uint8_t   * hci_packet_buffer;
-    uint8_t   hci_packet_buffer_data[HCI_OUTGOING_PRE_BUFFER_SIZE + HCI_PACKET_BUFFER_SIZE];
+    uint8_t   hci_packet_buffer_data[HCI_OUTGOING_PACKET_BUFFERS][HCI_OUTGOING_PRE_BUFFER_SIZE + HCI_PACKET_BUFFER_SIZE];
     uint8_t   hci_packet_buffer_reserved;
+    uint8_t   hci_packet_buffer_index;
+    uint8_t   hci_packet_buffers_in_transport;
+    uint8_t   hci_packet_buffer_packets_in_transport[HCI_OUTGOING_PACKET_BUFFERS];
+    hci_con_handle_t hci_packet_buffer_con_handle[HCI_OUTGOING_PACKET_BUFFERS];
     uint16_t  acl_fragmentation_pos;
     uint16_t  acl_fragmentation_total_size;
      
     /* host to controller flow control */
     uint8_t  num_cmd_packets;
+    uint8_t  num_commands_sent;
     uint8_t  acl_packets_total_num;
     uint16_t acl_data_packet_length;
     uint8_t  sco_packets_total_num;
@@ -691,6 +824,13 @@ typedef struct {
     
     uint16_t  last_cmd_opcode;
 
+    /* queued command requests and sent commands waiting for Command Complete / Command Status */
+    btstack_linked_list_t     command_requests;
+    hci_command_request_t   * command_request_active;
+    hci_outstanding_command_t outstanding_commands[HCI_MAX_OUTSTANDING_COMMANDS];
+    uint8_t                   num_outstanding_commands;
+    btstack_timer_source_t    command_timeout;
+
     uint8_t   discoverable;
     uint8_t   connectable;
     uint8_t   bondable;
@@ -851,6 +991,24 @@ int hci_can_send_command_packet_now(void);
  */
 int hci_send_cmd(const hci_cmd_t *cmd, ...);
 
+/**
+ * @brief Queue HCI Command request. send_command is called as soon as the Controller can accept another command
+ *        and has to send a single command with hci_send_cmd. The Command Complete or Command Status event for this command
+ *        is then passed to command_complete. Several commands are sent back to back if the Controller reports
+ *        Num_HCI_Command_Packets > 1 and HCI_MAX_OUTSTANDING_COMMANDS allows for it.
+ * @note send_command might be called during call to this function
+ * @note command_complete is not called if the Controller does not answer the command within 2 seconds
+ *       or answers it with a different opcode
+ * @param request
+ */
+void hci_request_command(hci_command_request_t * request);
+
+/**
+ * @brief Remove queued HCI Command request. If its command was already sent, command_complete won't be called
+ * @param request
+ */
+void hci_request_command_cancel(hci_command_request_t * request);
+
 
 // Sending SCO Packets
 
@@ -1005,6 +1163,9 @@ void hci_emit_state(void);
 
 /** 
  * Send complete CMD packet. Called by daemon
+ * @note With an asynchronous HCI transport, a packet that is not in the outgoing packet buffer is copied into it.
+ *       Check hci_can_send_command_packet_now before.
+ * @return 0 if ok, BTSTACK_ACL_BUFFERS_FULL if no outgoing packet buffer is available, or error from HCI transport
  */
 int hci_send_cmd_packet(uint8_t *packet, int size);
 
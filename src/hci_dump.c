@@ -42,6 +42,7 @@
  *
  *  - BlueZ's hcidump format
  *  - Apple's PacketLogger
+ *  - PCAPNG with Bluetooth H4 link type
  *  - stdout hexdump
  *
  *  Created by Matthias Ringwald on 5/26/09.
@@ -62,6 +63,7 @@
 #include <time.h>
 #include <sys/time.h>     // for timestamps
 #include <sys/stat.h>     // for mode flags
+#include <string.h>
 #endif
 
 // BLUEZ hcidump - struct not used directly, but left here as documentation
@@ -86,36 +88,179 @@ typedef struct {
 pktlog_hdr;
 #define PKTLOG_HDR_SIZE 13
 
+// PCAPNG - Enhanced Packet Block header followed by H4 with direction pseudo header
+#define PCAPNG_BLOCK_TYPE_SECTION_HEADER    0x0A0D0D0A
+#define PCAPNG_BLOCK_TYPE_INTERFACE         0x00000001
+#define PCAPNG_BLOCK_TYPE_ENHANCED_PACKET   0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC             0x1A2B3C4D
+#define PCAPNG_LINKTYPE_BLUETOOTH_HCI_H4_WITH_PHDR 201
+#define PCAPNG_EPB_HDR_SIZE 28
+#define PCAPNG_HDR_SIZE (PCAPNG_EPB_HDR_SIZE + 5)
+
+// records are collected in a buffer and written with a single write.
+// if HCI_DUMP_BUFFER_SIZE is defined, the buffer is only written if full, after HCI_DUMP_FLUSH_INTERVAL_MS, 
+// for error log messages, or by hci_dump_flush
+#ifdef HCI_DUMP_BUFFER_SIZE
+#define HCI_DUMP_BUFFERED
+#else
+#define HCI_DUMP_BUFFER_SIZE (PCAPNG_HDR_SIZE + HCI_ACL_PAYLOAD_SIZE + HCI_INCOMING_PRE_BUFFER_SIZE + 8)
+#endif
+
+#ifndef HCI_DUMP_FLUSH_INTERVAL_MS
+#define HCI_DUMP_FLUSH_INTERVAL_MS 1000
+#endif
+
 static int dump_file = -1;
 #ifdef HAVE_POSIX_FILE_IO
 static int dump_format;
 static uint8_t header_bluez[HCIDUMP_HDR_SIZE];
 static uint8_t header_packetlogger[PKTLOG_HDR_SIZE];
+static uint8_t header_pcapng[PCAPNG_HDR_SIZE];
 static char time_string[40];
 static int  max_nr_packets = -1;
 static int  nr_packets = 0;
 static char log_message_buffer[256];
+
+// write buffer
+static uint8_t  dump_buffer[HCI_DUMP_BUFFER_SIZE];
+static uint16_t dump_buffer_len;
+static struct timeval dump_buffer_flush_time;
+
+// file rotation
+static char     dump_filename[256];
+static int      rotation_num_files;
+static uint32_t rotation_max_file_size;
+static uint32_t rotation_max_duration_s;
+static uint32_t dump_file_size;
+static time_t   dump_file_start;
 #endif
 
 // levels: debug, info, error
 static int log_level_enabled[3] = { 1, 1, 1};
 
-void hci_dump_open(const char *filename, hci_dump_format_t format){
 #ifdef HAVE_POSIX_FILE_IO
-    dump_format = format;
-    if (dump_format == HCI_DUMP_STDOUT) {
-        dump_file = fileno(stdout);
-    } else {
+void hci_dump_flush(void){
+    if (dump_buffer_len == 0) return;
+    if (dump_file >= 0){
+        write(dump_file, dump_buffer, dump_buffer_len);
+    }
+    dump_buffer_len = 0;
+}
 
-        int oflags = O_WRONLY | O_CREAT | O_TRUNC;
+static void hci_dump_write(const uint8_t * data, uint16_t len){
+    dump_file_size += len;
+    if (dump_buffer_len + len > sizeof(dump_buffer)){
+        hci_dump_flush();
+        if (len > sizeof(dump_buffer)){
+            write(dump_file, data, len);
+            return;
+        }
+    }
+    memcpy(&dump_buffer[dump_buffer_len], data, len);
+    dump_buffer_len += len;
+}
+
+static void hci_dump_write_pcapng_file_header(void){
+    uint8_t header[48];
+    // Section Header Block, unspecified section length
+    little_endian_store_32(header,  0, PCAPNG_BLOCK_TYPE_SECTION_HEADER);
+    little_endian_store_32(header,  4, 28);
+    little_endian_store_32(header,  8, PCAPNG_BYTE_ORDER_MAGIC);
+    little_endian_store_16(header, 12, 1);
+    little_endian_store_16(header, 14, 0);
+    little_endian_store_32(header, 16, 0xffffffff);
+    little_endian_store_32(header, 20, 0xffffffff);
+    little_endian_store_32(header, 24, 28);
+    // Interface Description Block, no snap length
+    little_endian_store_32(header, 28, PCAPNG_BLOCK_TYPE_INTERFACE);
+    little_endian_store_32(header, 32, 20);
+    little_endian_store_16(header, 36, PCAPNG_LINKTYPE_BLUETOOTH_HCI_H4_WITH_PHDR);
+    little_endian_store_16(header, 38, 0);
+    little_endian_store_32(header, 40, 0);
+    little_endian_store_32(header, 44, 20);
+    hci_dump_write(header, sizeof(header));
+}
+
+// truncates file
+static void hci_dump_open_file(void){
+    int oflags = O_WRONLY | O_CREAT | O_TRUNC;
 #ifdef _WIN32
-        oflags |= O_BINARY;
+    oflags |= O_BINARY;
 #endif
+    dump_file = open(dump_filename, oflags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
+    if (dump_file < 0){
+        printf("hci_dump_open: failed to open file %s\n", dump_filename);
+        return;
+    }
+    dump_file_size = 0;
+    dump_file_start = time(NULL);
+    if (dump_format == HCI_DUMP_PCAPNG){
+        hci_dump_write_pcapng_file_header();
+    }
+}
 
-        dump_file = open(filename, oflags, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
-        if (dump_file < 0){
-            printf("hci_dump_open: failed to open file %s\n", filename);
+// keep previous files as filename.1 .. filename.(num_files-1)
+static void hci_dump_rotate(void){
+    hci_dump_flush();
+    close(dump_file);
+    char old_name[sizeof(dump_filename) + 16];
+    char new_name[sizeof(dump_filename) + 16];
+    int i;
+    for (i = rotation_num_files - 1; i > 0; i--){
+        if (i == 1){
+            strcpy(old_name, dump_filename);
+        } else {
+            snprintf(old_name, sizeof(old_name), "%s.%u", dump_filename, i - 1);
         }
+        snprintf(new_name, sizeof(new_name), "%s.%u", dump_filename, i);
+        rename(old_name, new_name);
+    }
+    hci_dump_open_file();
+}
+
+void hci_dump_set_rotation(int num_files, uint32_t max_file_size, uint32_t max_duration_s){
+    rotation_num_files      = num_files;
+    rotation_max_file_size  = max_file_size;
+    rotation_max_duration_s = max_duration_s;
+}
+
+// size of record for packet in file incl. header and trailer
+static uint32_t hci_dump_record_size(uint16_t len){
+    switch (dump_format){
+        case HCI_DUMP_BLUEZ:
+            return HCIDUMP_HDR_SIZE + len;
+        case HCI_DUMP_PACKETLOGGER:
+            return PKTLOG_HDR_SIZE + len;
+        case HCI_DUMP_PCAPNG:
+            // header, packet, padding to 32 bit, block length
+            return PCAPNG_HDR_SIZE + len + ((4 - ((5 + len) & 3)) & 3) + 4;
+        default:
+            return len;
+    }
+}
+#else
+// file i/o not available
+void hci_dump_flush(void){
+}
+
+void hci_dump_set_rotation(int num_files, uint32_t max_file_size, uint32_t max_duration_s){
+    UNUSED(num_files);
+    UNUSED(max_file_size);
+    UNUSED(max_duration_s);
+}
+#endif
+
+void hci_dump_open(const char *filename, hci_dump_format_t format){
+#ifdef HAVE_POSIX_FILE_IO
+    dump_format = format;
+    dump_buffer_len = 0;
+    if (dump_format == HCI_DUMP_STDOUT) {
+        dump_file = fileno(stdout);
+    } else {
+        strncpy(dump_filename, filename, sizeof(dump_filename) - 1);
+        dump_filename[sizeof(dump_filename) - 1] = 0;
+        hci_dump_open_file();
+        gettimeofday(&dump_buffer_flush_time, NULL);
     }
 #else
     UNUSED(filename);
@@ -129,6 +274,10 @@ void hci_dump_open(const char *filename, hci_dump_format_t format){
 void hci_dump_set_max_packets(int packets){
     max_nr_packets = packets;
 }
+#else
+void hci_dump_set_max_packets(int packets){
+    UNUSED(packets);
+}
 #endif
 
 static void printf_packet(uint8_t packet_type, uint8_t in, uint8_t * packet, uint16_t len){
@@ -185,8 +334,13 @@ void hci_dump_packet(uint8_t packet_type, uint8_t in, uint8_t *packet, uint16_t
     // don't grow bigger than max_nr_packets
     if (dump_format != HCI_DUMP_STDOUT && max_nr_packets > 0){
         if (nr_packets >= max_nr_packets){
+            dump_buffer_len = 0;
             lseek(dump_file, 0, SEEK_SET);
             ftruncate(dump_file, 0);
+            dump_file_size = 0;
+            if (dump_format == HCI_DUMP_PCAPNG){
+                hci_dump_write_pcapng_file_header();
+            }
             nr_packets = 0;
         }
         nr_packets++;
@@ -198,6 +352,15 @@ void hci_dump_packet(uint8_t packet_type, uint8_t in, uint8_t *packet, uint16_t
     gettimeofday(&curr_time, NULL);
     time_t curr_time_secs = curr_time.tv_sec;
 
+    // start new file if size or duration exceeded
+    if (dump_format != HCI_DUMP_STDOUT && rotation_num_files > 1){
+        if ((rotation_max_file_size  && dump_file_size + hci_dump_record_size(len) > rotation_max_file_size)
+        ||  (rotation_max_duration_s && (uint32_t) (curr_time_secs - dump_file_start) >= rotation_max_duration_s)){
+            hci_dump_rotate();
+            if (dump_file < 0) return;
+        }
+    }
+
     switch (dump_format){
         case HCI_DUMP_STDOUT: {
             /* Obtain the time of day, and convert it to a tm struct. */
@@ -221,8 +384,8 @@ void hci_dump_packet(uint8_t packet_type, uint8_t in, uint8_t *packet, uint16_t
             little_endian_store_32( header_bluez, 4, (uint32_t) curr_time.tv_sec);
             little_endian_store_32( header_bluez, 8,            curr_time.tv_usec);
             header_bluez[12] = packet_type;
-            write (dump_file, header_bluez, HCIDUMP_HDR_SIZE);
-            write (dump_file, packet, len );
+            hci_dump_write(header_bluez, HCIDUMP_HDR_SIZE);
+            hci_dump_write(packet, len);
             break;
             
         case HCI_DUMP_PACKETLOGGER:
@@ -256,13 +419,56 @@ void hci_dump_packet(uint8_t packet_type, uint8_t in, uint8_t *packet, uint16_t
                 default:
                     return;
             }
-            write (dump_file, &header_packetlogger, PKTLOG_HDR_SIZE);
-            write (dump_file, packet, len );
+            hci_dump_write(header_packetlogger, PKTLOG_HDR_SIZE);
+            hci_dump_write(packet, len);
             break;
-            
+
+        case HCI_DUMP_PCAPNG: {
+            switch (packet_type){
+                case HCI_COMMAND_DATA_PACKET:
+                case HCI_ACL_DATA_PACKET:
+                case HCI_SCO_DATA_PACKET:
+                case HCI_EVENT_PACKET:
+                    break;
+                default:
+                    // log messages are not supported by the H4 link type
+                    return;
+            }
+            uint32_t captured_len = 4 + 1 + len;
+            uint32_t padding = (4 - (captured_len & 3)) & 3;
+            uint32_t block_len = PCAPNG_EPB_HDR_SIZE + captured_len + padding + 4;
+            uint64_t timestamp_us = ((uint64_t) curr_time.tv_sec) * 1000000 + curr_time.tv_usec;
+            little_endian_store_32(header_pcapng,  0, PCAPNG_BLOCK_TYPE_ENHANCED_PACKET);
+            little_endian_store_32(header_pcapng,  4, block_len);
+            little_endian_store_32(header_pcapng,  8, 0);
+            little_endian_store_32(header_pcapng, 12, (uint32_t) (timestamp_us >> 32));
+            little_endian_store_32(header_pcapng, 16, (uint32_t) timestamp_us);
+            little_endian_store_32(header_pcapng, 20, captured_len);
+            little_endian_store_32(header_pcapng, 24, captured_len);
+            // direction: 0 = sent, 1 = received
+            big_endian_store_32(header_pcapng, 28, in ? 1 : 0);
+            header_pcapng[32] = packet_type;
+            hci_dump_write(header_pcapng, PCAPNG_HDR_SIZE);
+            hci_dump_write(packet, len);
+            uint8_t trailer[8];
+            memset(trailer, 0, padding);
+            little_endian_store_32(trailer, padding, block_len);
+            hci_dump_write(trailer, padding + 4);
+            break;
+        }
+
         default:
             break;
     }
+
+#ifdef HCI_DUMP_BUFFERED
+    // flush periodically
+    uint32_t delta_ms = (curr_time.tv_sec - dump_buffer_flush_time.tv_sec) * 1000 
+                      + (curr_time.tv_usec - dump_buffer_flush_time.tv_usec) / 1000;
+    if (delta_ms < HCI_DUMP_FLUSH_INTERVAL_MS) return;
+#endif
+    hci_dump_flush();
+    dump_buffer_flush_time = curr_time;
 #else
 
     printf_timestamp();
@@ -282,6 +488,10 @@ void hci_dump_log_va_arg(int log_level, const char * format, va_list argptr){
 #ifdef HAVE_POSIX_FILE_IO
         int len = vsnprintf(log_message_buffer, sizeof(log_message_buffer), format, argptr);
         hci_dump_packet(LOG_MESSAGE_PACKET, 0, (uint8_t*) log_message_buffer, len);
+        // make sure errors get written
+        if (log_level == LOG_LEVEL_ERROR){
+            hci_dump_flush();
+        }
 #else
         printf_timestamp();
         printf("LOG -- ");
@@ -312,6 +522,7 @@ void hci_dump_log_P(int log_level, PGM_P format, ...){
 
 void hci_dump_close(void){
 #ifdef HAVE_POSIX_FILE_IO
+    hci_dump_flush();
     close(dump_file);
 #endif
     dump_file = -1;
@@ -38,7 +38,7 @@
 /*
  *  hci_dump.h
  *
- *  Dump HCI trace as BlueZ's hcidump format, Apple's PacketLogger, or stdout
+ *  Dump HCI trace as BlueZ's hcidump format, Apple's PacketLogger, PCAPNG, or stdout
  * 
  *  Created by Matthias Ringwald on 5/26/09.
  */
@@ -66,7 +66,8 @@ extern "C" {
 typedef enum {
     HCI_DUMP_BLUEZ = 0,
     HCI_DUMP_PACKETLOGGER,
-    HCI_DUMP_STDOUT
+    HCI_DUMP_STDOUT,
+    HCI_DUMP_PCAPNG
 } hci_dump_format_t;
 
 /*
@@ -79,6 +80,18 @@ void hci_dump_open(const char *filename, hci_dump_format_t format);
  */
 void hci_dump_set_max_packets(int packets); // -1 for unlimited
 
+/*
+ * @brief Start new file if current file exceeds max_file_size bytes or max_duration_s seconds, 0 to ignore limit
+ * @note Previous files are kept as filename.1 (newest) to filename.(num_files-1)
+ * @param num_files incl. current file, rotation is disabled for num_files < 2
+ */
+void hci_dump_set_rotation(int num_files, uint32_t max_file_size, uint32_t max_duration_s);
+
+/*
+ * @brief Write buffered packets to file, only needed if HCI_DUMP_BUFFER_SIZE is defined
+ */
+void hci_dump_flush(void);
+
 /*
  * @brief 
  */
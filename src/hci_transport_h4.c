@@ -45,6 +45,8 @@
 
 #include "btstack_config.h"
 
+#include <string.h>
+
 #include "btstack_debug.h"
 #include "hci.h"
 #include "hci_transport.h"
@@ -133,8 +135,20 @@ static  H4_STATE h4_state;
 static int bytes_to_read;
 static int read_pos;
 
+// receive buffer for streaming mode, needs to hold at least a single packet
+#ifndef HCI_TRANSPORT_H4_RX_BUFFER_SIZE
+#define HCI_TRANSPORT_H4_RX_BUFFER_SIZE (1 + HCI_PACKET_BUFFER_SIZE)
+#endif
+#if HCI_TRANSPORT_H4_RX_BUFFER_SIZE < (1 + HCI_PACKET_BUFFER_SIZE)
+#error "HCI_TRANSPORT_H4_RX_BUFFER_SIZE must be at least 1 + HCI_PACKET_BUFFER_SIZE"
+#endif
+
+// streaming receive: read available bytes and parse all complete packets, used if supported by UART driver
+static int      rx_streaming;
+static uint16_t rx_len;
+
 // incoming packet buffer
-static uint8_t hci_packet_with_pre_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + 1 + HCI_PACKET_BUFFER_SIZE]; // packet type + max(acl header + acl payload, event header + event data)
+static uint8_t hci_packet_with_pre_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + HCI_TRANSPORT_H4_RX_BUFFER_SIZE]; // packet type + max(acl header + acl payload, event header + event data)
 static uint8_t * hci_packet = &hci_packet_with_pre_buffer[HCI_INCOMING_PRE_BUFFER_SIZE];
 
 static int hci_transport_h4_set_baudrate(uint32_t baudrate){
@@ -219,6 +233,70 @@ static void hci_transport_h4_block_read(void){
     hci_transport_h4_trigger_next_read();
 }
 
+static void hci_transport_h4_trigger_next_bytes_read(void){
+    btstack_uart->receive_bytes(&hci_packet[rx_len], HCI_TRANSPORT_H4_RX_BUFFER_SIZE - rx_len);
+}
+
+// parse all complete packets in place. previous packets serve as pre-buffer for the next one
+static void hci_transport_h4_bytes_read(uint16_t num_bytes){
+    rx_len += num_bytes;
+    uint16_t pos = 0;
+    while (pos < rx_len){
+        uint8_t * packet = &hci_packet[pos];
+        uint16_t available = rx_len - pos;
+        uint16_t header_size;
+        switch (packet[0]){
+            case HCI_EVENT_PACKET:
+                header_size = 1 + HCI_EVENT_HEADER_SIZE;
+                break;
+            case HCI_ACL_DATA_PACKET:
+                header_size = 1 + HCI_ACL_HEADER_SIZE;
+                break;
+            case HCI_SCO_DATA_PACKET:
+                header_size = 1 + HCI_SCO_HEADER_SIZE;
+                break;
+#ifdef ENABLE_EHCILL
+            case EHCILL_GO_TO_SLEEP_IND:
+            case EHCILL_GO_TO_SLEEP_ACK:
+            case EHCILL_WAKE_UP_IND:
+            case EHCILL_WAKE_UP_ACK:
+                hci_transport_h4_ehcill_handle_command(packet[0]);
+                pos++;
+                continue;
+#endif
+            default:
+                log_error("hci_transport_h4: invalid packet type 0x%02x", packet[0]);
+                pos++;
+                continue;
+        }
+        if (available < header_size) break;
+        uint16_t payload_len;
+        switch (packet[0]){
+            case HCI_EVENT_PACKET:
+                payload_len = packet[2];
+                break;
+            case HCI_ACL_DATA_PACKET:
+                payload_len = little_endian_read_16(packet, 3);
+                break;
+            default:
+                payload_len = packet[3];
+                break;
+        }
+        if (header_size - 1 + payload_len > HCI_PACKET_BUFFER_SIZE){
+            log_error("hci_transport_h4: invalid payload len %u - only space for %u", payload_len, HCI_PACKET_BUFFER_SIZE - (header_size - 1));
+            pos++;
+            continue;
+        }
+        if (available < header_size + payload_len) break;
+        packet_handler(packet[0], &packet[1], header_size - 1 + payload_len);
+        pos += header_size + payload_len;
+    }
+    // keep incomplete packet
+    rx_len -= pos;
+    memmove(hci_packet, &hci_packet[pos], rx_len);
+    hci_transport_h4_trigger_next_bytes_read();
+}
+
 static void hci_transport_h4_block_sent(void){
     switch (tx_state){
         case TX_W4_PACKET_SENT:
@@ -298,6 +376,13 @@ static void hci_transport_h4_init(const void * transport_config){
     btstack_uart->init(&uart_config);
     btstack_uart->set_block_received(&hci_transport_h4_block_read);
     btstack_uart->set_block_sent(&hci_transport_h4_block_sent);
+
+    // use streaming receive if available
+    rx_streaming = btstack_uart->set_bytes_received && btstack_uart->receive_bytes;
+    if (rx_streaming){
+        btstack_uart->set_bytes_received(&hci_transport_h4_bytes_read);
+    }
+    log_info("hci_transport_h4: streaming receive %u", rx_streaming);
 }
 
 static int hci_transport_h4_open(void){
@@ -305,8 +390,13 @@ static int hci_transport_h4_open(void){
     if (res){
         return res;
     }
-    hci_transport_h4_reset_statemachine();
-    hci_transport_h4_trigger_next_read();
+    if (rx_streaming){
+        rx_len = 0;
+        hci_transport_h4_trigger_next_bytes_read();
+    } else {
+        hci_transport_h4_reset_statemachine();
+        hci_transport_h4_trigger_next_read();
+    }
 
     tx_state = TX_IDLE;
 
@@ -43,8 +43,11 @@
  *  Created by Matthias Ringwald on 4/29/09.
  */
 
+#include <string.h>
+
 #include "hci.h"
 #include "btstack_slip.h"
+#include "btstack_util.h"
 #include "btstack_debug.h"
 #include "hci_transport.h"
 #include "btstack_uart_block.h"
@@ -69,10 +72,22 @@ typedef enum {
 
 } hci_transport_link_actions_t;
 
-// Configuration Field. No packet buffers -> sliding window = 1, no OOF flow control, no data integrity check
-#define LINK_CONFIG_SLIDING_WINDOW_SIZE 1
+// Sliding window size: number of unacknowledged reliable packets, 1..7
+#ifndef HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE
+#define HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE 1
+#endif
+#if (HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE < 1) || (HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE > 7)
+#error "HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE must be in range 1..7"
+#endif
+
+// Configuration Field. No OOF flow control, data integrity check if enabled
+#define LINK_CONFIG_SLIDING_WINDOW_SIZE HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE
 #define LINK_CONFIG_OOF_FLOW_CONTROL 0
+#ifdef ENABLE_H5_DATA_INTEGRITY_CHECK
+#define LINK_CONFIG_DATA_INTEGRITY_CHECK 1
+#else
 #define LINK_CONFIG_DATA_INTEGRITY_CHECK 0
+#endif
 #define LINK_CONFIG_VERSION_NR 0
 #define LINK_CONFIG_FIELD (LINK_CONFIG_SLIDING_WINDOW_SIZE | (LINK_CONFIG_OOF_FLOW_CONTROL << 3) | (LINK_CONFIG_DATA_INTEGRITY_CHECK << 4) | (LINK_CONFIG_VERSION_NR << 5))
 
@@ -89,6 +104,18 @@ typedef enum {
 // max size of write requests
 #define LINK_SLIP_TX_CHUNK_LEN 64
 
+// receive buffer for streaming mode
+#ifndef HCI_TRANSPORT_H5_RX_BUFFER_SIZE
+#define HCI_TRANSPORT_H5_RX_BUFFER_SIZE 64
+#endif
+
+// reliable packet in outgoing queue
+typedef struct {
+    uint8_t * packet;
+    uint16_t  size;
+    uint8_t   type;
+} hci_transport_link_packet_t;
+
 // ---
 static const uint8_t link_control_sync[] =   { 0x01, 0x7e};
 static const uint8_t link_control_sync_response[] = { 0x02, 0x7d};
@@ -107,6 +134,14 @@ static uint8_t   hci_packet_with_pre_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + 6 + H
 static uint8_t slip_outgoing_buffer[LINK_SLIP_TX_CHUNK_LEN+1];
 static int     slip_write_active;
 
+// data integrity check of outgoing frame, encoded after packet
+static uint8_t slip_outgoing_dic[2];
+static int     slip_outgoing_dic_present;
+
+// incoming data, single byte or available data in streaming mode
+static uint8_t hci_transport_h5_rx_buffer[HCI_TRANSPORT_H5_RX_BUFFER_SIZE];
+static int     rx_streaming;
+
 // H5 Link State
 static hci_transport_link_state_t link_state;
 static btstack_timer_source_t link_timer;
@@ -114,15 +149,23 @@ static uint8_t  link_seq_nr;
 static uint8_t  link_ack_nr;
 static uint16_t link_resend_timeout_ms;
 static uint8_t  link_peer_asleep;
+static uint8_t  link_window_size;               // negotiated
+static uint8_t  link_data_integrity_check;      // negotiated
 
 // auto sleep-mode
 static btstack_timer_source_t inactivity_timer;
 static uint16_t link_inactivity_timeout_ms; // auto-sleep if set
 
-// Outgoing packet
-static uint8_t   hci_packet_type;
-static uint16_t  hci_packet_size;
-static uint8_t * hci_packet;
+// Outgoing queue of unacknowledged packets, oldest one has seq nr link_seq_nr
+static hci_transport_link_packet_t link_tx_queue[HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE];
+static uint8_t link_tx_head;
+static uint8_t link_tx_count;
+static uint8_t link_tx_sent;    // number of queued packets that have been sent (again)
+
+#if HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE > 1
+// queued packets need to be copied, as hci.c prepares the next ACL fragment in place by overwriting the end of the previous one
+static uint8_t link_tx_storage[HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE][HCI_PACKET_BUFFER_SIZE];
+#endif
 
 // hci packet handler
 static  void (*packet_handler)(uint8_t packet_type, uint8_t *packet, uint16_t size);
@@ -168,10 +211,16 @@ static void hci_transport_inactivity_timer_set(void){
 
 // Fill chunk and write
 static void hci_transport_slip_encode_chunk_and_send(int pos){
-    while (btstack_slip_encoder_has_data() & (pos < LINK_SLIP_TX_CHUNK_LEN)) {
+    while (pos < LINK_SLIP_TX_CHUNK_LEN) {
+        if (!btstack_slip_encoder_has_data()){
+            if (!slip_outgoing_dic_present) break;
+            // continue with data integrity check
+            slip_outgoing_dic_present = 0;
+            btstack_slip_encoder_start(slip_outgoing_dic, sizeof(slip_outgoing_dic));
+        }
         slip_outgoing_buffer[pos++] = btstack_slip_encoder_get_byte();
     }
-    if (!btstack_slip_encoder_has_data()){
+    if (!btstack_slip_encoder_has_data() && !slip_outgoing_dic_present){
         // Start of Frame
         slip_outgoing_buffer[pos++] = BTSTACK_SLIP_SOF;
     }
@@ -184,12 +233,46 @@ static inline void hci_transport_slip_send_next_chunk(void){
     hci_transport_slip_encode_chunk_and_send(0);
 }
 
-// format: 0xc0 HEADER PACKER 0xc0
+// CRC-CCITT as used by BCSP: bits processed LSB first, initial value 0xffff
+static const uint16_t hci_transport_link_crc_table[] = {
+    0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
+    0x8408, 0x9489, 0xa50a, 0xb58b, 0xc60c, 0xd68d, 0xe70e, 0xf78f
+};
+
+static uint16_t hci_transport_link_crc_update(uint16_t crc, const uint8_t * data, uint16_t len){
+    while (len--){
+        uint8_t byte = *data++;
+        crc = (crc >> 4) ^ hci_transport_link_crc_table[(crc ^ byte) & 0x0f];
+        crc = (crc >> 4) ^ hci_transport_link_crc_table[(crc ^ (byte >> 4)) & 0x0f];
+    }
+    return crc;
+}
+
+// data integrity check over header and payload, bit-reversed and sent MSB first
+static uint16_t hci_transport_link_calc_data_integrity_check(const uint8_t * header, const uint8_t * payload, uint16_t payload_len){
+    uint16_t crc = hci_transport_link_crc_update(0xffff, header, 4);
+    crc = hci_transport_link_crc_update(crc, payload, payload_len);
+    uint16_t result = 0;
+    int i;
+    for (i=0;i<16;i++){
+        result = (result << 1) | (crc & 1);
+        crc >>= 1;
+    }
+    return result;
+}
+
+// format: 0xc0 HEADER PACKER [DIC] 0xc0
 // @param uint8_t header[4]
 static void hci_transport_slip_send_frame(const uint8_t * header, const uint8_t * packet, uint16_t packet_size){
     
     int pos = 0;
 
+    // prepare data integrity check if indicated in header
+    slip_outgoing_dic_present = (header[0] & 0x40) != 0;
+    if (slip_outgoing_dic_present){
+        big_endian_store_16(slip_outgoing_dic, 0, hci_transport_link_calc_data_integrity_check(header, packet, packet_size));
+    }
+
     // Start of Frame
     slip_outgoing_buffer[pos++] = BTSTACK_SLIP_SOF;
 
@@ -222,12 +305,6 @@ static void hci_transport_link_calc_header(uint8_t * header,
     uint8_t  packet_type,
     uint16_t payload_length){
 
-    // reset data integrity flag
-    if (data_integrity_check_present){
-        log_error("hci_transport_link_calc_header: data integrity not supported, dropping flag");
-        data_integrity_check_present = 0;
-    }
-
     header[0] = sequence_nr | (acknowledgement_nr << 3) | (data_integrity_check_present << 6) | (reliable_packet << 7);
     header[1] = packet_type | ((payload_length & 0x0f) << 4);
     header[2] = payload_length >> 4;
@@ -236,7 +313,7 @@ static void hci_transport_link_calc_header(uint8_t * header,
 
 static void hci_transport_link_send_control(const uint8_t * message, int message_len){
     uint8_t header[4];
-    hci_transport_link_calc_header(header, 0, 0, 0, 0, LINK_CONTROL_PACKET_TYPE, message_len);
+    hci_transport_link_calc_header(header, 0, 0, link_data_integrity_check, 0, LINK_CONTROL_PACKET_TYPE, message_len);
     hci_transport_slip_send_frame(header, message, message_len);
 }
 
@@ -276,12 +353,16 @@ static void hci_transport_link_send_sleep(void){
 }
 
 static void hci_transport_link_send_queued_packet(void){
-    log_info("hci_transport_link_send_queued_packet: seq %u, ack %u, size %u", link_seq_nr, link_ack_nr, hci_packet_size);
-    log_info_hexdump(hci_packet, hci_packet_size);
+    hci_transport_link_packet_t * queued_packet = &link_tx_queue[(link_tx_head + link_tx_sent) % HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE];
+    uint8_t seq_nr = (link_seq_nr + link_tx_sent) & 0x07;
+    link_tx_sent++;
+
+    log_info("hci_transport_link_send_queued_packet: seq %u, ack %u, size %u", seq_nr, link_ack_nr, queued_packet->size);
+    log_info_hexdump(queued_packet->packet, queued_packet->size);
 
     uint8_t header[4];
-    hci_transport_link_calc_header(header, link_seq_nr, link_ack_nr, 0, 1, hci_packet_type, hci_packet_size);
-    hci_transport_slip_send_frame(header, hci_packet, hci_packet_size);
+    hci_transport_link_calc_header(header, seq_nr, link_ack_nr, link_data_integrity_check, 1, queued_packet->type, queued_packet->size);
+    hci_transport_slip_send_frame(header, queued_packet->packet, queued_packet->size);
 
     // reset inactvitiy timer
     hci_transport_inactivity_timer_set();
@@ -290,7 +371,7 @@ static void hci_transport_link_send_queued_packet(void){
 static void hci_transport_link_send_ack_packet(void){
     log_info("link: send ack %u", link_ack_nr);
     uint8_t header[4];
-    hci_transport_link_calc_header(header, 0, link_ack_nr, 0, 0, LINK_ACKNOWLEDGEMENT_TYPE, 0);
+    hci_transport_link_calc_header(header, 0, link_ack_nr, link_data_integrity_check, 0, LINK_ACKNOWLEDGEMENT_TYPE, 0);
     hci_transport_slip_send_frame(header, NULL, 0);
 }
 
@@ -330,11 +411,16 @@ static void hci_transport_link_run(void){
         return;
     }
     if (hci_transport_link_actions & HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET){
+        if (link_tx_sent < link_tx_count){
+            // packet already contains ack, no need to send addtitional one
+            hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_ACK_PACKET;
+            hci_transport_link_send_queued_packet();
+            if (link_tx_sent >= link_tx_count){
+                hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET;
+            }
+            return;
+        }
         hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET;
-        // packet already contains ack, no need to send addtitional one
-        hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_ACK_PACKET;
-        hci_transport_link_send_queued_packet();
-        return;
     }
     if (hci_transport_link_actions & HCI_TRANSPORT_LINK_SEND_ACK_PACKET){
         hci_transport_link_actions &= ~HCI_TRANSPORT_LINK_SEND_ACK_PACKET;
@@ -353,6 +439,7 @@ static void hci_transport_link_run(void){
 static void hci_transport_link_set_timer(uint16_t timeout_ms){
     btstack_run_loop_set_timer_handler(&link_timer, &hci_transport_link_timeout_handler);
     btstack_run_loop_set_timer(&link_timer, timeout_ms);
+    btstack_run_loop_remove_timer(&link_timer);
     btstack_run_loop_add_timer(&link_timer);
 }
 
@@ -376,7 +463,8 @@ static void hci_transport_link_timeout_handler(btstack_timer_source_t * timer){
                 hci_transport_link_set_timer(LINK_WAKEUP_MS);
                 return;
             }
-            // resend packet
+            // resend all unacknowledged packets (go-back-n)
+            link_tx_sent = 0;
             hci_transport_link_actions |= HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET;
             hci_transport_link_set_timer(link_resend_timeout_ms);
             break;
@@ -390,6 +478,8 @@ static void hci_transport_link_timeout_handler(btstack_timer_source_t * timer){
 static void hci_transport_link_init(void){
     link_state = LINK_UNINITIALIZED;
     link_peer_asleep = 0;
+    link_window_size = 1;
+    link_data_integrity_check = 0;
  
     // get started
     hci_transport_link_actions |= HCI_TRANSPORT_LINK_SEND_SYNC;
@@ -402,18 +492,55 @@ static int hci_transport_link_inc_seq_nr(int seq_nr){
 }
 
 static int hci_transport_link_have_outgoing_packet(void){
-    return hci_packet != 0;
+    return link_tx_count > 0;
 }
 
 static void hci_transport_link_clear_queue(void){
     btstack_run_loop_remove_timer(&link_timer);
-    hci_packet = NULL;
+    link_tx_count = 0;
+    link_tx_sent  = 0;
 }
 
 static void hci_transport_h5_queue_packet(uint8_t packet_type, uint8_t *packet, int size){
-    hci_packet = packet;
-    hci_packet_type = packet_type;
-    hci_packet_size = size;
+    int index = (link_tx_head + link_tx_count) % HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE;
+#if HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE > 1
+    memcpy(link_tx_storage[index], packet, size);
+    packet = link_tx_storage[index];
+#endif
+    link_tx_queue[index].packet = packet;
+    link_tx_queue[index].size   = size;
+    link_tx_queue[index].type   = packet_type;
+    link_tx_count++;
+}
+
+static void hci_transport_link_packets_acknowledged(uint8_t num_packets){
+    log_info("h5: %u outgoing packet(s) starting with seq %u ack'ed", num_packets, link_seq_nr);
+    link_seq_nr   = (link_seq_nr + num_packets) & 0x07;
+    link_tx_head  = (link_tx_head + num_packets) % HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE;
+    link_tx_count -= num_packets;
+    link_tx_sent  = (link_tx_sent > num_packets) ? (link_tx_sent - num_packets) : 0;
+
+    // restart resend timer for remaining packets
+    btstack_run_loop_remove_timer(&link_timer);
+    if (link_tx_count){
+        hci_transport_link_set_timer(link_resend_timeout_ms);
+    }
+
+    // notify upper stack that it can send again, once per packet
+    while (num_packets--){
+        uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
+        packet_handler(HCI_EVENT_PACKET, &event[0], sizeof(event));
+    }
+}
+
+// use smaller sliding window and data integrity check only if supported by both sides
+static void hci_transport_link_apply_config(uint8_t config_field){
+    link_window_size = btstack_min(config_field & 0x07, HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE);
+    if (link_window_size == 0){
+        link_window_size = 1;
+    }
+    link_data_integrity_check = LINK_CONFIG_DATA_INTEGRITY_CHECK && (config_field & 0x10);
+    log_info("link: sliding window %u, data integrity check %u", link_window_size, link_data_integrity_check);
 }
 
 static void hci_transport_h5_process_frame(uint16_t frame_size){
@@ -459,7 +586,14 @@ static void hci_transport_h5_process_frame(uint16_t frame_size){
         return;
     }
 
-    // (TODO data integrity check)
+    // validate data integrity check
+    if (data_integrity_check_present){
+        uint16_t data_integrity_check = big_endian_read_16(slip_payload, link_payload_len);
+        if (data_integrity_check != hci_transport_link_calc_data_integrity_check(slip_header, slip_payload, link_payload_len)){
+            log_info("h5: data integrity check failed");
+            return;
+        }
+    }
 
     switch (link_state){
         case LINK_UNINITIALIZED:
@@ -493,9 +627,12 @@ static void hci_transport_h5_process_frame(uint16_t frame_size){
                 link_state = LINK_ACTIVE;
                 btstack_run_loop_remove_timer(&link_timer);
                 log_info("link activated");
-                // 
+                // config field is optional, missing field indicates sliding window 1 without data integrity check
+                hci_transport_link_apply_config(link_payload_len > link_control_config_response_prefix_len ? slip_payload[2] : 0x01);
                 link_seq_nr = 0;
                 link_ack_nr = 0;
+                link_tx_head = 0;
+                link_tx_sent = 0;
                 // notify upper stack that it can start
                 uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
                 packet_handler(HCI_EVENT_PACKET, &event[0], sizeof(event));
@@ -517,22 +654,18 @@ static void hci_transport_h5_process_frame(uint16_t frame_size){
           
             // Process ACKs in reliable packet and explicit ack packets
             if (reliable_packet || link_packet_type == LINK_ACKNOWLEDGEMENT_TYPE){
-                // our packet is good if the remote expects our seq nr + 1
-                int next_seq_nr = hci_transport_link_inc_seq_nr(link_seq_nr);
-                if (hci_transport_link_have_outgoing_packet() && next_seq_nr == ack_nr){
-                    log_info("h5: outoing packet with seq %u ack'ed", link_seq_nr);
-                    link_seq_nr = next_seq_nr;
-                    hci_transport_link_clear_queue();
-
-                    // notify upper stack that it can send again
-                    uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
-                    packet_handler(HCI_EVENT_PACKET, &event[0], sizeof(event));
+                // remote expects ack nr next -> all our packets before are good
+                uint8_t num_packets_acked = (ack_nr - link_seq_nr) & 0x07;
+                if (num_packets_acked > link_tx_count){
+                    log_info("h5: ack nr %u outside of window", ack_nr);
+                } else if (num_packets_acked){
+                    hci_transport_link_packets_acknowledged(num_packets_acked);
                 }
             } 
 
             switch (link_packet_type){
                 case LINK_CONTROL_PACKET_TYPE:
-                    if (memcmp(slip_payload, link_control_config, sizeof(link_control_config)) == 0){
+                    if (memcmp(slip_payload, link_control_config, link_control_config_prefix_len) == 0){
                         log_info("link: received config");
                         hci_transport_link_actions |= HCI_TRANSPORT_LINK_SEND_CONFIG_RESPONSE;
                         break;
@@ -599,28 +732,42 @@ static void hci_transport_link_update_resend_timeout(uint32_t baudrate){
 
 /// H5 Interface
 
-static uint8_t hci_transport_link_read_byte;
-
-static void hci_transport_h5_read_next_byte(void){
+static void hci_transport_h5_read_next_data(void){
     log_debug("h5: rx nxt");
-    btstack_uart->receive_block(&hci_transport_link_read_byte, 1);    
+    if (rx_streaming){
+        btstack_uart->receive_bytes(hci_transport_h5_rx_buffer, sizeof(hci_transport_h5_rx_buffer));
+    } else {
+        btstack_uart->receive_block(hci_transport_h5_rx_buffer, 1);
+    }
 }
 
-static void hci_transport_h5_block_received(){
-    log_debug("slip: process 0x%02x", hci_transport_link_read_byte);
-    btstack_slip_decoder_process(hci_transport_link_read_byte);
-    uint16_t frame_size = btstack_slip_decoder_frame_size();
-    if (frame_size) {
-        hci_transport_h5_process_frame(frame_size);
-        hci_transport_slip_init();
+static void hci_transport_h5_process_data(uint16_t len){
+    const uint8_t * data = hci_transport_h5_rx_buffer;
+    while (len){
+        uint16_t bytes_processed = btstack_slip_decoder_process_data(data, len);
+        data += bytes_processed;
+        len  -= bytes_processed;
+        uint16_t frame_size = btstack_slip_decoder_frame_size();
+        if (frame_size) {
+            hci_transport_h5_process_frame(frame_size);
+            hci_transport_slip_init();
+        }
     }
-    hci_transport_h5_read_next_byte();
+    hci_transport_h5_read_next_data();
+}
+
+static void hci_transport_h5_block_received(void){
+    hci_transport_h5_process_data(1);
+}
+
+static void hci_transport_h5_bytes_received(uint16_t num_bytes){
+    hci_transport_h5_process_data(num_bytes);
 }
 
 static void hci_transport_h5_block_sent(void){
 
     // check if more data to send
-    if (btstack_slip_encoder_has_data()){
+    if (btstack_slip_encoder_has_data() || slip_outgoing_dic_present){
         hci_transport_slip_send_next_chunk();
         return;
     }
@@ -663,6 +810,13 @@ static void hci_transport_h5_init(const void * transport_config){
     btstack_uart->init(&uart_config);
     btstack_uart->set_block_received(&hci_transport_h5_block_received);
     btstack_uart->set_block_sent(&hci_transport_h5_block_sent);
+
+    // use streaming receive if available
+    rx_streaming = btstack_uart->set_bytes_received && btstack_uart->receive_bytes;
+    if (rx_streaming){
+        btstack_uart->set_bytes_received(&hci_transport_h5_bytes_received);
+    }
+    log_info("hci_transport_h5: streaming receive %u", rx_streaming);
 }
 
 static int hci_transport_h5_open(void){
@@ -694,7 +848,7 @@ static int hci_transport_h5_open(void){
     hci_transport_link_init();
 
     // start receiving
-    hci_transport_h5_read_next_byte();
+    hci_transport_h5_read_next_data();
 
     return 0;
 }
@@ -709,7 +863,7 @@ static void hci_transport_h5_register_packet_handler(void (*handler)(uint8_t pac
 }
 
 static int hci_transport_h5_can_send_packet_now(uint8_t packet_type){
-    int res = !hci_transport_link_have_outgoing_packet() && link_state == LINK_ACTIVE;
+    int res = link_state == LINK_ACTIVE && link_tx_count < link_window_size;
     // log_info("hci_transport_h5_can_send_packet_now: %u", res);
     return res;
 }
@@ -733,7 +887,10 @@ static int hci_transport_h5_send_packet(uint8_t packet_type, uint8_t *packet, in
         hci_transport_link_set_timer(LINK_WAKEUP_MS);
     } else {
         hci_transport_link_actions |= HCI_TRANSPORT_LINK_SEND_QUEUED_PACKET;
-        hci_transport_link_set_timer(link_resend_timeout_ms);
+        // resend timer covers oldest unacknowledged packet
+        if (link_tx_count == 1){
+            hci_transport_link_set_timer(link_resend_timeout_ms);
+        }
     }
     hci_transport_link_run();
     return 0;
@@ -69,6 +69,35 @@
 #define L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_WATERMARK 5
 #define L2CAP_LE_DATA_CHANNELS_AUTOMATIC_CREDITS_INCREMENT 5
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+// S-frame supervisory functions
+#define L2CAP_ERTM_SUPERVISORY_FUNCTION_RR   0
+#define L2CAP_ERTM_SUPERVISORY_FUNCTION_REJ  1
+#define L2CAP_ERTM_SUPERVISORY_FUNCTION_RNR  2
+#define L2CAP_ERTM_SUPERVISORY_FUNCTION_SREJ 3
+
+// I-frame segmentation and reassembly
+#define L2CAP_SAR_UNSEGMENTED  0
+#define L2CAP_SAR_START        1
+#define L2CAP_SAR_END          2
+#define L2CAP_SAR_CONTINUATION 3
+
+// TxSeq/ReqSeq are 6 bit
+#define L2CAP_ERTM_SEQ_MASK   0x3f
+#define L2CAP_ERTM_MAX_WINDOW 63
+
+// control field + FCS
+#define L2CAP_ERTM_OVERHEAD 4
+
+#define L2CAP_ERTM_DEFAULT_RETRANSMISSION_TIMEOUT_MS  2000
+#define L2CAP_ERTM_DEFAULT_MONITOR_TIMEOUT_MS        12000
+
+// ERTM timer
+#define L2CAP_ERTM_TIMER_IDLE           0
+#define L2CAP_ERTM_TIMER_RETRANSMISSION 1
+#define L2CAP_ERTM_TIMER_MONITOR        2
+#endif
+
 // offsets for L2CAP SIGNALING COMMANDS
 #define L2CAP_SIGNALING_COMMAND_CODE_OFFSET   0
 #define L2CAP_SIGNALING_COMMAND_SIGID_OFFSET  1
@@ -89,6 +118,7 @@
 static void l2cap_hci_event_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size);
 static void l2cap_acl_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size );
 static void l2cap_notify_channel_can_send(void);
+static void l2cap_run(void);
 static void l2cap_emit_can_send_now(btstack_packet_handler_t packet_handler, uint16_t channel);
 #ifdef ENABLE_CLASSIC
 static void l2cap_finialize_channel_close(l2cap_channel_t *channel);
@@ -98,6 +128,11 @@ static void l2cap_emit_channel_closed(l2cap_channel_t *channel);
 static void l2cap_emit_incoming_connection(l2cap_channel_t *channel);
 static int  l2cap_channel_ready_for_open(l2cap_channel_t *channel);
 #endif
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+static int  l2cap_ertm_send(l2cap_channel_t * channel, uint8_t * data, uint16_t len);
+static int  l2cap_ertm_can_store_packet_now(l2cap_channel_t * channel);
+static void l2cap_ertm_timeout_handler(btstack_timer_source_t * ts);
+#endif
 #ifdef ENABLE_LE_DATA_CHANNELS
 static void l2cap_emit_le_channel_opened(l2cap_channel_t *channel, uint8_t status);
 static void l2cap_emit_le_incoming_connection(l2cap_channel_t *channel);
@@ -113,9 +148,29 @@ typedef struct l2cap_fixed_channel {
 } l2cap_fixed_channel_t;
 
 #ifdef ENABLE_CLASSIC
+// where a channel waiting for can send now is kept
+enum {
+    L2CAP_CAN_SEND_NOW_QUEUED = 0,      // in the group for its connection and priority
+    L2CAP_CAN_SEND_NOW_PARKED_ERTM,     // waiting for room in its tx window
+};
+
 static btstack_linked_list_t l2cap_channels;
 static btstack_linked_list_t l2cap_services;
 static uint8_t require_security_level2_for_outgoing_sdp;
+
+// channels waiting for can send now are grouped by connection and priority. a group is a circular FIFO
+// of channels and is referenced by its last channel. groups take turns in a FIFO per priority, groups
+// of connections that cannot send are parked until the connection can send again. this only decides
+// which channel is served next, l2cap_run() still checks all channels after every sent packet
+static l2cap_channel_t * l2cap_can_send_now_head[L2CAP_CHANNEL_PRIORITY_NUM_LEVELS];
+static l2cap_channel_t * l2cap_can_send_now_tail[L2CAP_CHANNEL_PRIORITY_NUM_LEVELS];
+static l2cap_channel_t * l2cap_can_send_now_parked;
+static uint8_t           l2cap_can_send_now_active;
+
+// stride scheduling between priorities: LOW : NORMAL : HIGH get 1 : 4 : 16 of the packets if all keep sending
+static const uint8_t     l2cap_can_send_now_stride[L2CAP_CHANNEL_PRIORITY_NUM_LEVELS] = { 16, 4, 1 };
+static uint32_t          l2cap_can_send_now_pass[L2CAP_CHANNEL_PRIORITY_NUM_LEVELS];
+static uint32_t          l2cap_can_send_now_virtual_time;
 #endif
 
 #ifdef ENABLE_LE_DATA_CHANNELS
@@ -169,6 +224,12 @@ void l2cap_init(void){
     l2cap_channels = NULL;
     l2cap_services = NULL;
     require_security_level2_for_outgoing_sdp = 0;
+    memset(l2cap_can_send_now_head, 0, sizeof(l2cap_can_send_now_head));
+    memset(l2cap_can_send_now_tail, 0, sizeof(l2cap_can_send_now_tail));
+    memset(l2cap_can_send_now_pass, 0, sizeof(l2cap_can_send_now_pass));
+    l2cap_can_send_now_parked = NULL;
+    l2cap_can_send_now_virtual_time = 0;
+    l2cap_can_send_now_active = 0;
 #endif
 
 #ifdef ENABLE_LE_DATA_CHANNELS
@@ -352,17 +413,200 @@ static l2cap_channel_t * l2cap_get_channel_for_local_cid(uint16_t local_cid){
 
 ///
 
+static int l2cap_channel_ready_to_send(l2cap_channel_t * channel){
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    // outgoing SDUs are stored in channel buffer
+    if (channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+        return l2cap_ertm_can_store_packet_now(channel);
+    }
+#endif
+    return hci_can_send_acl_packet_now(channel->con_handle);
+}
+
+// append group to FIFO of its priority
+static void l2cap_can_send_now_append_group(l2cap_channel_t * group){
+    int priority = group->priority;
+    if (l2cap_can_send_now_head[priority] == NULL){
+        // idle priority doesn't collect credit for the time it didn't send
+        if ((int32_t)(l2cap_can_send_now_pass[priority] - l2cap_can_send_now_virtual_time) < 0){
+            l2cap_can_send_now_pass[priority] = l2cap_can_send_now_virtual_time;
+        }
+    }
+    group->can_send_now_next_group = NULL;
+    if (l2cap_can_send_now_tail[priority]){
+        l2cap_can_send_now_tail[priority]->can_send_now_next_group = group;
+    } else {
+        l2cap_can_send_now_head[priority] = group;
+    }
+    l2cap_can_send_now_tail[priority] = group;
+}
+
+// returns link to group of channel in FIFO of its priority or in parked list, or NULL
+static l2cap_channel_t ** l2cap_can_send_now_find_group(l2cap_channel_t * channel){
+    l2cap_channel_t ** it;
+    for (it = &l2cap_can_send_now_head[channel->priority]; *it ; it = &(*it)->can_send_now_next_group){
+        if ((*it)->con_handle == channel->con_handle) return it;
+    }
+    for (it = &l2cap_can_send_now_parked; *it ; it = &(*it)->can_send_now_next_group){
+        if ((*it)->con_handle != channel->con_handle) continue;
+        if ((*it)->priority   != channel->priority)   continue;
+        return it;
+    }
+    return NULL;
+}
+
+// replace group reference after its last channel changed
+static void l2cap_can_send_now_replace_group(l2cap_channel_t ** it, l2cap_channel_t * group){
+    l2cap_channel_t * old_group = *it;
+    group->can_send_now_next_group = old_group->can_send_now_next_group;
+    *it = group;
+    if (l2cap_can_send_now_tail[group->priority] == old_group){
+        l2cap_can_send_now_tail[group->priority] = group;
+    }
+}
+
+// add channel at the end of the group for its connection and priority
+static void l2cap_can_send_now_add(l2cap_channel_t * channel){
+    channel->can_send_now_state = L2CAP_CAN_SEND_NOW_QUEUED;
+    l2cap_channel_t ** it = l2cap_can_send_now_find_group(channel);
+    if (!it){
+        // new group, connection is checked when it's the group's turn
+        channel->can_send_now_next = channel;
+        l2cap_can_send_now_append_group(channel);
+        return;
+    }
+    l2cap_channel_t * group = *it;
+    channel->can_send_now_next = group->can_send_now_next;
+    group->can_send_now_next = channel;
+    l2cap_can_send_now_replace_group(it, channel);
+}
+
+static void l2cap_can_send_now_remove(l2cap_channel_t * channel){
+    l2cap_channel_t ** it = l2cap_can_send_now_find_group(channel);
+    if (!it) return;
+    l2cap_channel_t * group = *it;
+    l2cap_channel_t * prev = group;
+    while (prev->can_send_now_next != channel){
+        prev = prev->can_send_now_next;
+    }
+    if (prev == channel){
+        // last channel in group, drop group
+        int priority = channel->priority;
+        *it = channel->can_send_now_next_group;
+        if (l2cap_can_send_now_tail[priority] == channel){
+            l2cap_channel_t * tail = NULL;
+            l2cap_channel_t * it_group;
+            for (it_group = l2cap_can_send_now_head[priority]; it_group ; it_group = it_group->can_send_now_next_group){
+                tail = it_group;
+            }
+            l2cap_can_send_now_tail[priority] = tail;
+        }
+        return;
+    }
+    prev->can_send_now_next = channel->can_send_now_next;
+    if (channel == group){
+        l2cap_can_send_now_replace_group(it, prev);
+    }
+}
+
+// move parked groups of connections that can send again back to the FIFO of their priority
+static void l2cap_can_send_now_unpark(void){
+    l2cap_channel_t ** it = &l2cap_can_send_now_parked;
+    while (*it){
+        l2cap_channel_t * group = *it;
+        if (!hci_can_send_acl_packet_now(group->con_handle)){
+            it = &group->can_send_now_next_group;
+            continue;
+        }
+        *it = group->can_send_now_next_group;
+        l2cap_can_send_now_append_group(group);
+    }
+}
+
+// returns next channel that can send for given priority and lets next group take its turn, or NULL
+static l2cap_channel_t * l2cap_can_send_now_pop(int priority){
+    l2cap_channel_t * group = l2cap_can_send_now_head[priority];
+    l2cap_can_send_now_head[priority] = group->can_send_now_next_group;
+    if (!l2cap_can_send_now_head[priority]){
+        l2cap_can_send_now_tail[priority] = NULL;
+    }
+    if (!hci_can_send_acl_packet_now(group->con_handle)){
+        group->can_send_now_next_group = l2cap_can_send_now_parked;
+        l2cap_can_send_now_parked = group;
+        return NULL;
+    }
+    l2cap_channel_t * channel = group->can_send_now_next;
+    if (channel != group){
+        group->can_send_now_next = channel->can_send_now_next;
+        l2cap_can_send_now_append_group(group);
+    }
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    if (!l2cap_channel_ready_to_send(channel)){
+        channel->can_send_now_state = L2CAP_CAN_SEND_NOW_PARKED_ERTM;
+        return NULL;
+    }
+#endif
+    return channel;
+}
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+// channel parked on its tx window can store packets again
+static void l2cap_can_send_now_resume(l2cap_channel_t * channel){
+    if (!channel->waiting_for_can_send_now) return;
+    if (channel->can_send_now_state != L2CAP_CAN_SEND_NOW_PARKED_ERTM) return;
+    l2cap_can_send_now_add(channel);
+}
+#endif
+
+// returns priority with lowest pass that has groups waiting, or -1
+static int l2cap_can_send_now_next_priority(void){
+    int next = -1;
+    int priority;
+    for (priority = L2CAP_CHANNEL_PRIORITY_NUM_LEVELS - 1; priority >= 0; priority--){
+        if (l2cap_can_send_now_head[priority] == NULL) continue;
+        if (next >= 0 && (int32_t)(l2cap_can_send_now_pass[priority] - l2cap_can_send_now_pass[next]) >= 0) continue;
+        next = priority;
+    }
+    return next;
+}
+
+static void l2cap_can_send_now_enqueue(l2cap_channel_t * channel){
+    if (channel->waiting_for_can_send_now) return;
+    channel->waiting_for_can_send_now = 1;
+    l2cap_can_send_now_add(channel);
+}
+
+static void l2cap_can_send_now_dequeue(l2cap_channel_t * channel){
+    if (!channel->waiting_for_can_send_now) return;
+    channel->waiting_for_can_send_now = 0;
+    if (channel->can_send_now_state == L2CAP_CAN_SEND_NOW_PARKED_ERTM) return;
+    l2cap_can_send_now_remove(channel);
+}
+
 void l2cap_request_can_send_now_event(uint16_t local_cid){
     l2cap_channel_t *channel = l2cap_get_channel_for_local_cid(local_cid);
     if (!channel) return;
-    channel->waiting_for_can_send_now = 1;
+    l2cap_can_send_now_enqueue(channel);
     l2cap_notify_channel_can_send();
 }
 
+void l2cap_set_channel_priority(uint16_t local_cid, l2cap_channel_priority_t priority){
+    l2cap_channel_t *channel = l2cap_get_channel_for_local_cid(local_cid);
+    if (!channel) return;
+    if (priority >= L2CAP_CHANNEL_PRIORITY_NUM_LEVELS) return;
+    // move to queue for new priority
+    int waiting = channel->waiting_for_can_send_now;
+    l2cap_can_send_now_dequeue(channel);
+    channel->priority = priority;
+    if (waiting){
+        l2cap_can_send_now_enqueue(channel);
+    }
+}
+
 int  l2cap_can_send_packet_now(uint16_t local_cid){
     l2cap_channel_t *channel = l2cap_get_channel_for_local_cid(local_cid);
     if (!channel) return 0;
-    return hci_can_send_acl_packet_now(channel->con_handle);
+    return l2cap_channel_ready_to_send(channel);
 }
 
 int  l2cap_can_send_prepared_packet_now(uint16_t local_cid){
@@ -403,6 +647,7 @@ static void l2cap_rtx_timeout(btstack_timer_source_t * ts){
 
     // discard channel
     // no need to stop timer here, it is removed from list during timer callback
+    l2cap_can_send_now_dequeue(channel);
     btstack_linked_list_remove(&l2cap_channels, (btstack_linked_item_t *) channel);
     btstack_memory_l2cap_channel_free(channel);
 }
@@ -467,6 +712,13 @@ int l2cap_send_prepared(uint16_t local_cid, uint16_t len){
         return -1;   // TODO: define error
     }
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    if (channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+        log_error("l2cap_send_prepared cid 0x%02x, not supported in mode %u, use l2cap_send", local_cid, channel->mode);
+        return ERROR_CODE_COMMAND_DISALLOWED;
+    }
+#endif
+
     if (!hci_can_send_prepared_acl_packet_now(channel->con_handle)){
         log_info("l2cap_send_prepared cid 0x%02x, cannot send", local_cid);
         return BTSTACK_ACL_BUFFERS_FULL;
@@ -496,6 +748,12 @@ int l2cap_send(uint16_t local_cid, uint8_t *data, uint16_t len){
         return L2CAP_DATA_LEN_EXCEEDS_REMOTE_MTU;
     }
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    if (channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+        return l2cap_ertm_send(channel, data, len);
+    }
+#endif
+
     if (!hci_can_send_acl_packet_now(channel->con_handle)){
         log_info("l2cap_send cid 0x%02x, cannot send", local_cid);
         return BTSTACK_ACL_BUFFERS_FULL;
@@ -520,6 +778,726 @@ static inline void channelStateVarSetFlag(l2cap_channel_t *channel, L2CAP_CHANNE
 static inline void channelStateVarClearFlag(l2cap_channel_t *channel, L2CAP_CHANNEL_STATE_VAR flag){
     channel->state_var = (L2CAP_CHANNEL_STATE_VAR) (channel->state_var & ~flag);
 }
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+
+// MARK: Enhanced Retransmission and Streaming Mode
+
+// CRC-16 with polynomial x^16 + x^15 + x^2 + 1, LSB first
+static const uint16_t l2cap_fcs_table[256] = {
+    0x0000, 0xc0c1, 0xc181, 0x0140, 0xc301, 0x03c0, 0x0280, 0xc241,
+    0xc601, 0x06c0, 0x0780, 0xc741, 0x0500, 0xc5c1, 0xc481, 0x0440,
+    0xcc01, 0x0cc0, 0x0d80, 0xcd41, 0x0f00, 0xcfc1, 0xce81, 0x0e40,
+    0x0a00, 0xcac1, 0xcb81, 0x0b40, 0xc901, 0x09c0, 0x0880, 0xc841,
+    0xd801, 0x18c0, 0x1980, 0xd941, 0x1b00, 0xdbc1, 0xda81, 0x1a40,
+    0x1e00, 0xdec1, 0xdf81, 0x1f40, 0xdd01, 0x1dc0, 0x1c80, 0xdc41,
+    0x1400, 0xd4c1, 0xd581, 0x1540, 0xd701, 0x17c0, 0x1680, 0xd641,
+    0xd201, 0x12c0, 0x1380, 0xd341, 0x1100, 0xd1c1, 0xd081, 0x1040,
+    0xf001, 0x30c0, 0x3180, 0xf141, 0x3300, 0xf3c1, 0xf281, 0x3240,
+    0x3600, 0xf6c1, 0xf781, 0x3740, 0xf501, 0x35c0, 0x3480, 0xf441,
+    0x3c00, 0xfcc1, 0xfd81, 0x3d40, 0xff01, 0x3fc0, 0x3e80, 0xfe41,
+    0xfa01, 0x3ac0, 0x3b80, 0xfb41, 0x3900, 0xf9c1, 0xf881, 0x3840,
+    0x2800, 0xe8c1, 0xe981, 0x2940, 0xeb01, 0x2bc0, 0x2a80, 0xea41,
+    0xee01, 0x2ec0, 0x2f80, 0xef41, 0x2d00, 0xedc1, 0xec81, 0x2c40,
+    0xe401, 0x24c0, 0x2580, 0xe541, 0x2700, 0xe7c1, 0xe681, 0x2640,
+    0x2200, 0xe2c1, 0xe381, 0x2340, 0xe101, 0x21c0, 0x2080, 0xe041,
+    0xa001, 0x60c0, 0x6180, 0xa141, 0x6300, 0xa3c1, 0xa281, 0x6240,
+    0x6600, 0xa6c1, 0xa781, 0x6740, 0xa501, 0x65c0, 0x6480, 0xa441,
+    0x6c00, 0xacc1, 0xad81, 0x6d40, 0xaf01, 0x6fc0, 0x6e80, 0xae41,
+    0xaa01, 0x6ac0, 0x6b80, 0xab41, 0x6900, 0xa9c1, 0xa881, 0x6840,
+    0x7800, 0xb8c1, 0xb981, 0x7940, 0xbb01, 0x7bc0, 0x7a80, 0xba41,
+    0xbe01, 0x7ec0, 0x7f80, 0xbf41, 0x7d00, 0xbdc1, 0xbc81, 0x7c40,
+    0xb401, 0x74c0, 0x7580, 0xb541, 0x7700, 0xb7c1, 0xb681, 0x7640,
+    0x7200, 0xb2c1, 0xb381, 0x7340, 0xb101, 0x71c0, 0x7080, 0xb041,
+    0x5000, 0x90c1, 0x9181, 0x5140, 0x9301, 0x53c0, 0x5280, 0x9241,
+    0x9601, 0x56c0, 0x5780, 0x9741, 0x5500, 0x95c1, 0x9481, 0x5440,
+    0x9c01, 0x5cc0, 0x5d80, 0x9d41, 0x5f00, 0x9fc1, 0x9e81, 0x5e40,
+    0x5a00, 0x9ac1, 0x9b81, 0x5b40, 0x9901, 0x59c0, 0x5880, 0x9841,
+    0x8801, 0x48c0, 0x4980, 0x8941, 0x4b00, 0x8bc1, 0x8a81, 0x4a40,
+    0x4e00, 0x8ec1, 0x8f81, 0x4f40, 0x8d01, 0x4dc0, 0x4c80, 0x8c41,
+    0x4400, 0x84c1, 0x8581, 0x4540, 0x8701, 0x47c0, 0x4680, 0x8641,
+    0x8201, 0x42c0, 0x4380, 0x8341, 0x4100, 0x81c1, 0x8081, 0x4040,
+};
+
+static uint16_t l2cap_fcs_calc(const uint8_t * data, uint16_t len){
+    uint16_t crc = 0;
+    while (len--){
+        crc = (crc >> 8) ^ l2cap_fcs_table[(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+static uint8_t l2cap_ertm_validate_local_config(l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size){
+    switch (ertm_config->mode){
+        case L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION:
+        case L2CAP_CHANNEL_MODE_STREAMING:
+            break;
+        default:
+            log_error("l2cap ertm: invalid mode %u", ertm_config->mode);
+            return ERROR_CODE_INVALID_HCI_COMMAND_PARAMETERS;
+    }
+    if (ertm_config->tx_window < 1 || ertm_config->tx_window > L2CAP_ERTM_MAX_WINDOW){
+        log_error("l2cap ertm: invalid tx window %u", ertm_config->tx_window);
+        return ERROR_CODE_INVALID_HCI_COMMAND_PARAMETERS;
+    }
+    if (ertm_config->num_tx_buffers < 1 || ertm_config->num_tx_buffers > L2CAP_ERTM_MAX_WINDOW){
+        log_error("l2cap ertm: invalid number of tx buffers %u", ertm_config->num_tx_buffers);
+        return ERROR_CODE_INVALID_HCI_COMMAND_PARAMETERS;
+    }
+    // align buffer for l2cap_ertm_tx_packet_state_t
+    uint32_t bytes_till_alignment = (sizeof(void *) - ((uintptr_t) buffer & (sizeof(void *) - 1))) & (sizeof(void *) - 1);
+    uint32_t reserved = bytes_till_alignment + ertm_config->num_tx_buffers * sizeof(l2cap_ertm_tx_packet_state_t) + ertm_config->local_mtu;
+    // each outgoing I-frame needs room for SDU length and at least one byte
+    if (size <= reserved + ertm_config->num_tx_buffers * 2){
+        log_error("l2cap ertm: buffer size %u too small", (int) size);
+        return BTSTACK_MEMORY_ALLOC_FAILED;
+    }
+    return 0;
+}
+
+static void l2cap_ertm_configure_channel(l2cap_channel_t * channel, l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size){
+
+    channel->mode           = ertm_config->mode;
+    channel->mode_requested = ertm_config->mode;
+    channel->ertm_mandatory = ertm_config->ertm_mandatory;
+
+    channel->local_fcs_option  = ertm_config->fcs_option;
+    channel->remote_fcs_option = 1;
+
+    channel->local_mtu                       = ertm_config->local_mtu;
+    channel->local_tx_window                 = ertm_config->tx_window;
+    channel->local_max_transmit              = ertm_config->max_transmit;
+    channel->local_retransmission_timeout_ms = ertm_config->retransmission_timeout_ms;
+    channel->local_monitor_timeout_ms        = ertm_config->monitor_timeout_ms;
+    if (channel->local_retransmission_timeout_ms == 0){
+        channel->local_retransmission_timeout_ms = L2CAP_ERTM_DEFAULT_RETRANSMISSION_TIMEOUT_MS;
+    }
+    if (channel->local_monitor_timeout_ms == 0){
+        channel->local_monitor_timeout_ms = L2CAP_ERTM_DEFAULT_MONITOR_TIMEOUT_MS;
+    }
+
+    // incoming I-frames are limited by HCI ACL buffer
+    channel->local_mps = l2cap_max_mtu() - L2CAP_ERTM_OVERHEAD;
+    if (channel->local_mps > channel->local_mtu + 2){
+        channel->local_mps = channel->local_mtu + 2;
+    }
+
+    // until provided by remote
+    channel->remote_mps = 0xffff;
+
+    // layout: tx packet state, rx sdu buffer, tx packets
+    uint32_t bytes_till_alignment = (sizeof(void *) - ((uintptr_t) buffer & (sizeof(void *) - 1))) & (sizeof(void *) - 1);
+    buffer += bytes_till_alignment;
+    size   -= bytes_till_alignment;
+
+    channel->num_tx_buffers   = ertm_config->num_tx_buffers;
+    channel->tx_packets_state = (l2cap_ertm_tx_packet_state_t *) buffer;
+    buffer += channel->num_tx_buffers * sizeof(l2cap_ertm_tx_packet_state_t);
+    size   -= channel->num_tx_buffers * sizeof(l2cap_ertm_tx_packet_state_t);
+
+    channel->receive_sdu_buffer = buffer;
+    buffer += channel->local_mtu;
+    size   -= channel->local_mtu;
+
+    channel->tx_packets_data = buffer;
+    channel->tx_packet_size  = size / channel->num_tx_buffers;
+
+    log_info("l2cap ertm: local cid 0x%02x, mode %u, tx buffers %u x %u bytes", channel->local_cid, channel->mode,
+        channel->num_tx_buffers, channel->tx_packet_size);
+}
+
+static void l2cap_ertm_fallback_to_basic_mode(l2cap_channel_t * channel){
+    log_info("l2cap ertm: local cid 0x%02x, use Basic Mode", channel->local_cid);
+    channel->mode = L2CAP_CHANNEL_MODE_BASIC;
+    if (channel->local_mtu > l2cap_max_mtu()){
+        channel->local_mtu = l2cap_max_mtu();
+    }
+}
+
+static void l2cap_ertm_channel_opened(l2cap_channel_t * channel){
+    if (channel->mode == L2CAP_CHANNEL_MODE_BASIC) return;
+
+    // FCS is omitted only if both sides don't request it
+    channel->fcs_enabled = channel->local_fcs_option || channel->remote_fcs_option;
+
+    // max PDU size
+    uint16_t tx_mps = l2cap_max_mtu() - L2CAP_ERTM_OVERHEAD;
+    if (tx_mps > channel->remote_mps){
+        tx_mps = channel->remote_mps;
+    }
+    if (tx_mps > channel->tx_packet_size){
+        tx_mps = channel->tx_packet_size;
+    }
+    channel->tx_mps = tx_mps;
+
+    if (channel->remote_retransmission_timeout_ms == 0){
+        channel->remote_retransmission_timeout_ms = L2CAP_ERTM_DEFAULT_RETRANSMISSION_TIMEOUT_MS;
+    }
+    if (channel->remote_monitor_timeout_ms == 0){
+        channel->remote_monitor_timeout_ms = L2CAP_ERTM_DEFAULT_MONITOR_TIMEOUT_MS;
+    }
+    if (channel->remote_tx_window == 0){
+        channel->remote_tx_window = 1;
+    }
+
+    channel->tx_read_index    = 0;
+    channel->tx_stored        = 0;
+    channel->tx_sent          = 0;
+    channel->expected_ack_seq = 0;
+    channel->expected_tx_seq  = 0;
+    channel->receive_sdu_len  = 0;
+    channel->receive_sdu_pos  = 0;
+
+    log_info("l2cap ertm: local cid 0x%02x open, mode %u, fcs %u, tx mps %u, remote tx window %u", channel->local_cid,
+        channel->mode, channel->fcs_enabled, channel->tx_mps, channel->remote_tx_window);
+}
+
+static uint16_t l2cap_ertm_setup_retransmission_and_flow_control_option(uint8_t * config_options, uint8_t mode, uint8_t tx_window,
+    uint8_t max_transmit, uint16_t retransmission_timeout_ms, uint16_t monitor_timeout_ms, uint16_t mps){
+    config_options[0] = L2CAP_CONF_OPTION_TYPE_RETRANSMISSION_AND_FLOW_CONTROL;
+    config_options[1] = 9;
+    config_options[2] = mode;
+    // tx window, max transmit and timeouts are not used in Streaming Mode
+    if (mode != L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION){
+        tx_window = 0;
+        max_transmit = 0;
+        retransmission_timeout_ms = 0;
+        monitor_timeout_ms = 0;
+    }
+    config_options[3] = tx_window;
+    config_options[4] = max_transmit;
+    little_endian_store_16(config_options, 5, retransmission_timeout_ms);
+    little_endian_store_16(config_options, 7, monitor_timeout_ms);
+    little_endian_store_16(config_options, 9, mps);
+    return 11;
+}
+
+// @returns size of Retransmission and Flow Control and FCS options for Configuration Request
+static uint16_t l2cap_ertm_setup_options_request(l2cap_channel_t * channel, uint8_t * config_options){
+    if (channel->mode == L2CAP_CHANNEL_MODE_BASIC) return 0;
+    // timeouts are provided by the remote in its Configuration Response
+    uint16_t pos = l2cap_ertm_setup_retransmission_and_flow_control_option(config_options, channel->mode, channel->local_tx_window,
+        channel->local_max_transmit, 0, 0, channel->local_mps);
+    // FCS is used by default
+    if (!channel->local_fcs_option){
+        config_options[pos++] = L2CAP_CONF_OPTION_TYPE_FRAME_CHECK_SEQUENCE;
+        config_options[pos++] = 1;
+        config_options[pos++] = 0;
+    }
+    return pos;
+}
+
+// @returns 1 if channel can be configured, 0 if extended features are not known yet or channel gets closed
+static int l2cap_ertm_select_mode(l2cap_channel_t * channel){
+    if (channel->mode == L2CAP_CHANNEL_MODE_BASIC) return 1;
+    hci_connection_t * connection = hci_connection_for_handle(channel->con_handle);
+    if (!connection) return 0;
+    switch (connection->l2cap_state.information_state){
+        case L2CAP_INFORMATION_STATE_IDLE:
+            connection->l2cap_state.information_state = L2CAP_INFORMATION_STATE_W2_SEND_EXTENDED_FEATURE_REQUEST;
+            l2cap_start_rtx(channel);
+            return 0;
+        case L2CAP_INFORMATION_STATE_DONE:
+            break;
+        default:
+            return 0;
+    }
+    uint16_t feature = channel->mode == L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION ?
+        L2CAP_EXTENDED_FEATURE_ENHANCED_RETRANSMISSION_MODE : L2CAP_EXTENDED_FEATURE_STREAMING_MODE;
+    if (connection->l2cap_state.extended_feature_mask & feature) return 1;
+    if (channel->ertm_mandatory){
+        log_info("l2cap ertm: local cid 0x%02x, mode %u not supported by remote", channel->local_cid, channel->mode);
+        l2cap_emit_channel_opened(channel, L2CAP_CONNECTION_RESPONSE_RESULT_ERTM_NOT_SUPPORTED);
+        channel->state = L2CAP_STATE_WILL_SEND_DISCONNECT_REQUEST;
+        return 0;
+    }
+    l2cap_ertm_fallback_to_basic_mode(channel);
+    return 1;
+}
+
+static void l2cap_ertm_handle_remote_mode(l2cap_channel_t * channel, uint8_t remote_mode){
+    if (remote_mode == channel->mode){
+        if (remote_mode != L2CAP_CHANNEL_MODE_BASIC){
+            channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_ERTM);
+        }
+        return;
+    }
+    // remote only uses Basic Mode
+    if (remote_mode == L2CAP_CHANNEL_MODE_BASIC && !channel->ertm_mandatory){
+        l2cap_ertm_fallback_to_basic_mode(channel);
+        // our configure request has to be repeated in Basic Mode if it was already sent
+        if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SENT_CONF_REQ){
+            channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_REQ);
+        }
+        return;
+    }
+    // request our mode
+    log_info("l2cap ertm: local cid 0x%02x, remote requested mode %u instead of %u", channel->local_cid, remote_mode, channel->mode);
+    channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_UNACCEPTABLE);
+}
+
+static void l2cap_ertm_handle_configure_response(l2cap_channel_t * channel, uint16_t result, uint8_t * command){
+    uint16_t end_pos = 4 + little_endian_read_16(command, L2CAP_SIGNALING_COMMAND_LENGTH_OFFSET);
+    uint16_t pos     = 10;
+    while (pos < end_pos){
+        uint8_t option_type = command[pos] & 0x7f;
+        uint8_t length      = command[pos+1];
+        pos += 2;
+        if (option_type == L2CAP_CONF_OPTION_TYPE_RETRANSMISSION_AND_FLOW_CONTROL && length == 9){
+            uint8_t mode = command[pos];
+            switch (result){
+                case L2CAP_CONF_RESULT_SUCCESS:
+                    // timeouts to use for our I-frames
+                    channel->remote_retransmission_timeout_ms = little_endian_read_16(command, pos + 3);
+                    channel->remote_monitor_timeout_ms        = little_endian_read_16(command, pos + 5);
+                    break;
+                case L2CAP_CONF_RESULT_UNACCEPTABLE_PARAMETERS:
+                    if (mode == channel->mode) break;
+                    if (mode == L2CAP_CHANNEL_MODE_BASIC && !channel->ertm_mandatory){
+                        l2cap_ertm_fallback_to_basic_mode(channel);
+                        break;
+                    }
+                    log_info("l2cap ertm: local cid 0x%02x, remote requires mode %u", channel->local_cid, mode);
+                    l2cap_emit_channel_opened(channel, L2CAP_CONNECTION_RESPONSE_RESULT_ERTM_NOT_SUPPORTED);
+                    channel->state = L2CAP_STATE_WILL_SEND_DISCONNECT_REQUEST;
+                    return;
+                default:
+                    break;
+            }
+        }
+        pos += length;
+    }
+}
+
+static int l2cap_ertm_num_segments(l2cap_channel_t * channel, uint16_t len){
+    if (len <= channel->tx_mps) return 1;
+    // start segment contains SDU length
+    len -= channel->tx_mps - 2;
+    return 1 + (len + channel->tx_mps - 1) / channel->tx_mps;
+}
+
+static int l2cap_ertm_can_store_packet_now(l2cap_channel_t * channel){
+    if (channel->state != L2CAP_STATE_OPEN) return 0;
+    int num_free = channel->num_tx_buffers - channel->tx_stored;
+    int num_required = l2cap_ertm_num_segments(channel, channel->remote_mtu);
+    if (num_required > channel->num_tx_buffers){
+        num_required = channel->num_tx_buffers;
+    }
+    return num_free >= num_required;
+}
+
+static int l2cap_ertm_send(l2cap_channel_t * channel, uint8_t * data, uint16_t len){
+    if (channel->state != L2CAP_STATE_OPEN){
+        log_error("l2cap_send cid 0x%02x, channel not open", channel->local_cid);
+        return ERROR_CODE_COMMAND_DISALLOWED;
+    }
+    int num_segments = l2cap_ertm_num_segments(channel, len);
+    if (num_segments > channel->num_tx_buffers - channel->tx_stored){
+        log_info("l2cap_send cid 0x%02x, cannot store %u segments", channel->local_cid, num_segments);
+        return BTSTACK_ACL_BUFFERS_FULL;
+    }
+    uint16_t pos = 0;
+    int i;
+    for (i = 0; i < num_segments; i++){
+        uint8_t index = (channel->tx_read_index + channel->tx_stored) % channel->num_tx_buffers;
+        l2cap_ertm_tx_packet_state_t * tx_state = &channel->tx_packets_state[index];
+        uint8_t * tx_packet = &channel->tx_packets_data[index * channel->tx_packet_size];
+        uint16_t header_len = 0;
+        uint16_t segment_len;
+        if (num_segments == 1){
+            tx_state->sar = L2CAP_SAR_UNSEGMENTED;
+            segment_len = len;
+        } else if (i == 0){
+            tx_state->sar = L2CAP_SAR_START;
+            little_endian_store_16(tx_packet, 0, len);
+            header_len  = 2;
+            segment_len = channel->tx_mps - 2;
+        } else {
+            segment_len = len - pos;
+            if (segment_len > channel->tx_mps){
+                segment_len = channel->tx_mps;
+                tx_state->sar = L2CAP_SAR_CONTINUATION;
+            } else {
+                tx_state->sar = L2CAP_SAR_END;
+            }
+        }
+        memcpy(&tx_packet[header_len], &data[pos], segment_len);
+        pos += segment_len;
+        tx_state->len = header_len + segment_len;
+        tx_state->num_transmissions = 0;
+        tx_state->retransmission_requested = 0;
+        channel->tx_stored++;
+    }
+    l2cap_run();
+    return 0;
+}
+
+static void l2cap_ertm_send_frame(l2cap_channel_t * channel, uint16_t control, uint8_t * data, uint16_t len){
+    hci_reserve_packet_buffer();
+    uint8_t * acl_buffer = hci_get_outgoing_packet_buffer();
+    uint8_t packet_boundary_flag = hci_non_flushable_packet_boundary_flag_supported() ? 0x00 : 0x02;
+    uint16_t l2cap_len = 2 + len;
+    if (channel->fcs_enabled){
+        l2cap_len += 2;
+    }
+    l2cap_setup_header(acl_buffer, channel->con_handle, packet_boundary_flag, channel->remote_cid, l2cap_len);
+    little_endian_store_16(acl_buffer, COMPLETE_L2CAP_HEADER, control);
+    if (len){
+        memcpy(&acl_buffer[COMPLETE_L2CAP_HEADER + 2], data, len);
+    }
+    if (channel->fcs_enabled){
+        // FCS covers basic L2CAP header, control field and information payload
+        uint16_t fcs = l2cap_fcs_calc(&acl_buffer[HCI_ACL_HEADER_SIZE], L2CAP_HEADER_SIZE + 2 + len);
+        little_endian_store_16(acl_buffer, COMPLETE_L2CAP_HEADER + 2 + len, fcs);
+    }
+    hci_send_acl_packet_buffer(HCI_ACL_HEADER_SIZE + L2CAP_HEADER_SIZE + l2cap_len);
+}
+
+static void l2cap_ertm_start_timer(l2cap_channel_t * channel, uint8_t timer_state){
+    btstack_run_loop_remove_timer(&channel->ertm_timer);
+    uint32_t timeout_ms = timer_state == L2CAP_ERTM_TIMER_MONITOR ? channel->remote_monitor_timeout_ms : channel->remote_retransmission_timeout_ms;
+    btstack_run_loop_set_timer_handler(&channel->ertm_timer, l2cap_ertm_timeout_handler);
+    btstack_run_loop_set_timer_context(&channel->ertm_timer, channel);
+    btstack_run_loop_set_timer(&channel->ertm_timer, timeout_ms);
+    btstack_run_loop_add_timer(&channel->ertm_timer);
+    channel->ertm_timer_state = timer_state;
+}
+
+static void l2cap_ertm_stop_timer(l2cap_channel_t * channel){
+    btstack_run_loop_remove_timer(&channel->ertm_timer);
+    channel->ertm_timer_state = L2CAP_ERTM_TIMER_IDLE;
+}
+
+static void l2cap_ertm_timeout_handler(btstack_timer_source_t * ts){
+    l2cap_channel_t * channel = (l2cap_channel_t *) btstack_run_loop_get_timer_context(ts);
+    if (channel->state != L2CAP_STATE_OPEN){
+        channel->ertm_timer_state = L2CAP_ERTM_TIMER_IDLE;
+        return;
+    }
+    if (channel->ertm_timer_state == L2CAP_ERTM_TIMER_RETRANSMISSION){
+        channel->ertm_retry_count = 0;
+    }
+    channel->ertm_timer_state = L2CAP_ERTM_TIMER_IDLE;
+    if (channel->local_max_transmit && channel->ertm_retry_count >= channel->local_max_transmit){
+        log_info("l2cap ertm: local cid 0x%02x, no response to poll, disconnect", channel->local_cid);
+        channel->state = L2CAP_STATE_WILL_SEND_DISCONNECT_REQUEST;
+    } else {
+        // poll remote and wait for final bit
+        log_info("l2cap ertm: local cid 0x%02x, %s timeout, poll remote", channel->local_cid, 
+            channel->ertm_retry_count ? "monitor" : "retransmission");
+        channel->ertm_retry_count++;
+        channel->send_supervisor_frame_poll = 1;
+        l2cap_ertm_start_timer(channel, L2CAP_ERTM_TIMER_MONITOR);
+    }
+    l2cap_run();
+}
+
+// @returns 1 if S-frame was sent
+static int l2cap_ertm_send_supervisor_frame(l2cap_channel_t * channel){
+    uint8_t function = L2CAP_ERTM_SUPERVISORY_FUNCTION_RR;
+    uint8_t poll  = 0;
+    uint8_t final = channel->send_supervisor_frame_final;
+    if (channel->send_supervisor_frame_reject){
+        function = L2CAP_ERTM_SUPERVISORY_FUNCTION_REJ;
+    } else if (channel->send_supervisor_frame_poll && !final){
+        poll = 1;
+        channel->send_supervisor_frame_poll = 0;
+    } else if (!final && !channel->send_supervisor_frame_receiver_ready){
+        return 0;
+    }
+    channel->send_supervisor_frame_reject = 0;
+    channel->send_supervisor_frame_final = 0;
+    // S-frame also acknowledges received I-frames
+    channel->send_supervisor_frame_receiver_ready = 0;
+    uint16_t control = 1 | (function << 2) | (poll << 4) | (final << 7) | (channel->expected_tx_seq << 8);
+    l2cap_ertm_send_frame(channel, control, NULL, 0);
+    return 1;
+}
+
+// @returns offset of next I-frame to send relative to oldest unacknowledged frame or -1
+static int l2cap_ertm_next_information_frame(l2cap_channel_t * channel){
+    if (channel->mode == L2CAP_CHANNEL_MODE_STREAMING){
+        return channel->tx_stored ? 0 : -1;
+    }
+    // wait for final bit
+    if (channel->ertm_timer_state == L2CAP_ERTM_TIMER_MONITOR) return -1;
+    // frames requested by SREJ first
+    int i;
+    for (i = 0; i < channel->tx_sent; i++){
+        uint8_t index = (channel->tx_read_index + i) % channel->num_tx_buffers;
+        if (channel->tx_packets_state[index].retransmission_requested) return i;
+    }
+    if (channel->tx_sent >= channel->tx_stored) return -1;
+    if (channel->remote_busy) return -1;
+    if (channel->tx_sent >= channel->remote_tx_window) return -1;
+    return channel->tx_sent;
+}
+
+// @returns 1 if I-frame was sent
+static int l2cap_ertm_send_information_frame(l2cap_channel_t * channel){
+    int offset = l2cap_ertm_next_information_frame(channel);
+    if (offset < 0) return 0;
+
+    uint8_t index = (channel->tx_read_index + offset) % channel->num_tx_buffers;
+    l2cap_ertm_tx_packet_state_t * tx_state = &channel->tx_packets_state[index];
+    uint8_t   tx_seq    = (channel->expected_ack_seq + offset) & L2CAP_ERTM_SEQ_MASK;
+    uint8_t * tx_packet = &channel->tx_packets_data[index * channel->tx_packet_size];
+
+    if (channel->mode == L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION){
+        if (channel->local_max_transmit && tx_state->num_transmissions >= channel->local_max_transmit){
+            log_info("l2cap ertm: local cid 0x%02x, max transmit reached for TxSeq %u, disconnect", channel->local_cid, tx_seq);
+            channel->state = L2CAP_STATE_WILL_SEND_DISCONNECT_REQUEST;
+            return 0;
+        }
+        tx_state->num_transmissions++;
+        tx_state->retransmission_requested = 0;
+        if (offset == channel->tx_sent){
+            channel->tx_sent++;
+        }
+        if (channel->ertm_timer_state == L2CAP_ERTM_TIMER_IDLE){
+            l2cap_ertm_start_timer(channel, L2CAP_ERTM_TIMER_RETRANSMISSION);
+        }
+        // acknowledgement is piggybacked
+        channel->send_supervisor_frame_receiver_ready = 0;
+    }
+
+    uint16_t control = (tx_seq << 1) | (channel->expected_tx_seq << 8) | (tx_state->sar << 14);
+
+    if (channel->mode == L2CAP_CHANNEL_MODE_STREAMING){
+        // frames are not acknowledged, buffer can be reused as soon as HCI has copied it
+        channel->tx_read_index = (channel->tx_read_index + 1) % channel->num_tx_buffers;
+        channel->tx_stored--;
+        channel->expected_ack_seq = (channel->expected_ack_seq + 1) & L2CAP_ERTM_SEQ_MASK;
+        l2cap_can_send_now_resume(channel);
+    }
+
+    l2cap_ertm_send_frame(channel, control, tx_packet, tx_state->len);
+    return 1;
+}
+
+static void l2cap_ertm_run(l2cap_channel_t * channel){
+    if (channel->mode == L2CAP_CHANNEL_MODE_BASIC) return;
+    while (channel->state == L2CAP_STATE_OPEN && hci_can_send_acl_packet_now(channel->con_handle)){
+        if (l2cap_ertm_send_supervisor_frame(channel)) continue;
+        if (l2cap_ertm_send_information_frame(channel)) continue;
+        break;
+    }
+}
+
+static void l2cap_ertm_process_req_seq(l2cap_channel_t * channel, uint8_t req_seq){
+    uint8_t num_acked = (req_seq - channel->expected_ack_seq) & L2CAP_ERTM_SEQ_MASK;
+    if (num_acked == 0) return;
+    if (num_acked > channel->tx_sent){
+        log_error("l2cap ertm: local cid 0x%02x, invalid ReqSeq %u", channel->local_cid, req_seq);
+        return;
+    }
+    channel->tx_read_index    = (channel->tx_read_index + num_acked) % channel->num_tx_buffers;
+    channel->tx_stored       -= num_acked;
+    channel->tx_sent         -= num_acked;
+    channel->expected_ack_seq = req_seq;
+    if (channel->ertm_timer_state == L2CAP_ERTM_TIMER_RETRANSMISSION){
+        if (channel->tx_sent){
+            l2cap_ertm_start_timer(channel, L2CAP_ERTM_TIMER_RETRANSMISSION);
+        } else {
+            l2cap_ertm_stop_timer(channel);
+        }
+    }
+    l2cap_can_send_now_resume(channel);
+    l2cap_notify_channel_can_send();
+}
+
+static void l2cap_ertm_process_final(l2cap_channel_t * channel){
+    if (channel->ertm_timer_state != L2CAP_ERTM_TIMER_MONITOR) return;
+    l2cap_ertm_stop_timer(channel);
+    channel->ertm_retry_count = 0;
+    // retransmit all unacknowledged I-frames
+    channel->tx_sent = 0;
+}
+
+static void l2cap_ertm_handle_in_sequence_sdu(l2cap_channel_t * channel, uint8_t sar, uint8_t * payload, uint16_t size){
+    switch (sar){
+        case L2CAP_SAR_UNSEGMENTED:
+            if (channel->receive_sdu_len){
+                log_info("l2cap ertm: local cid 0x%02x, unsegmented SDU during reassembly, drop partial SDU", channel->local_cid);
+                channel->receive_sdu_len = 0;
+            }
+            if (size > channel->local_mtu){
+                log_info("l2cap ertm: local cid 0x%02x, SDU len %u > MTU, drop", channel->local_cid, size);
+                break;
+            }
+            l2cap_dispatch_to_channel(channel, L2CAP_DATA_PACKET, payload, size);
+            break;
+        case L2CAP_SAR_START:
+            if (size < 2) break;
+            channel->receive_sdu_len = little_endian_read_16(payload, 0);
+            channel->receive_sdu_pos = size - 2;
+            if (channel->receive_sdu_len > channel->local_mtu || channel->receive_sdu_pos > channel->receive_sdu_len){
+                log_info("l2cap ertm: local cid 0x%02x, SDU len %u > MTU, drop", channel->local_cid, channel->receive_sdu_len);
+                channel->receive_sdu_len = 0;
+                break;
+            }
+            memcpy(channel->receive_sdu_buffer, &payload[2], channel->receive_sdu_pos);
+            break;
+        case L2CAP_SAR_CONTINUATION:
+        case L2CAP_SAR_END:
+            if (channel->receive_sdu_len == 0) break;
+            if (channel->receive_sdu_pos + size > channel->receive_sdu_len){
+                log_info("l2cap ertm: local cid 0x%02x, SDU longer than announced, drop", channel->local_cid);
+                channel->receive_sdu_len = 0;
+                break;
+            }
+            memcpy(&channel->receive_sdu_buffer[channel->receive_sdu_pos], payload, size);
+            channel->receive_sdu_pos += size;
+            if (sar == L2CAP_SAR_CONTINUATION) break;
+            if (channel->receive_sdu_pos == channel->receive_sdu_len){
+                l2cap_dispatch_to_channel(channel, L2CAP_DATA_PACKET, channel->receive_sdu_buffer, channel->receive_sdu_len);
+            } else {
+                log_info("l2cap ertm: local cid 0x%02x, SDU shorter than announced, drop", channel->local_cid);
+            }
+            channel->receive_sdu_len = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+static void l2cap_ertm_handle_packet(l2cap_channel_t * channel, uint8_t * packet, uint16_t size){
+    if (channel->state != L2CAP_STATE_OPEN) return;
+    if (size < COMPLETE_L2CAP_HEADER + 2) return;
+
+    uint8_t * payload = &packet[COMPLETE_L2CAP_HEADER];
+    uint16_t  len     = size - COMPLETE_L2CAP_HEADER;
+
+    if (channel->fcs_enabled){
+        if (len < 4) return;
+        len -= 2;
+        uint16_t fcs = l2cap_fcs_calc(&packet[HCI_ACL_HEADER_SIZE], L2CAP_HEADER_SIZE + len);
+        if (fcs != little_endian_read_16(payload, len)){
+            log_info("l2cap ertm: local cid 0x%02x, FCS error, drop frame", channel->local_cid);
+            return;
+        }
+    }
+
+    uint16_t control = little_endian_read_16(payload, 0);
+    uint8_t  req_seq = (control >> 8) & L2CAP_ERTM_SEQ_MASK;
+    uint8_t  final   = (control >> 7) & 1;
+    payload += 2;
+    len     -= 2;
+
+    if (control & 1){
+        // S-frame
+        if (channel->mode != L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION) return;
+        uint8_t function = (control >> 2) & 3;
+        uint8_t poll     = (control >> 4) & 1;
+        if (function != L2CAP_ERTM_SUPERVISORY_FUNCTION_SREJ){
+            l2cap_ertm_process_req_seq(channel, req_seq);
+        }
+        if (final){
+            l2cap_ertm_process_final(channel);
+        }
+        if (poll){
+            channel->send_supervisor_frame_final = 1;
+        }
+        switch (function){
+            case L2CAP_ERTM_SUPERVISORY_FUNCTION_RR:
+                channel->remote_busy = 0;
+                break;
+            case L2CAP_ERTM_SUPERVISORY_FUNCTION_RNR:
+                channel->remote_busy = 1;
+                break;
+            case L2CAP_ERTM_SUPERVISORY_FUNCTION_REJ:
+                channel->remote_busy = 0;
+                if (channel->ertm_timer_state == L2CAP_ERTM_TIMER_MONITOR) break;
+                // retransmit all unacknowledged I-frames
+                l2cap_ertm_stop_timer(channel);
+                channel->tx_sent = 0;
+                break;
+            case L2CAP_ERTM_SUPERVISORY_FUNCTION_SREJ: {
+                uint8_t offset = (req_seq - channel->expected_ack_seq) & L2CAP_ERTM_SEQ_MASK;
+                if (offset >= channel->tx_sent) break;
+                channel->tx_packets_state[(channel->tx_read_index + offset) % channel->num_tx_buffers].retransmission_requested = 1;
+                break;
+            }
+            default:
+                break;
+        }
+        return;
+    }
+
+    // I-frame
+    uint8_t tx_seq = (control >> 1) & L2CAP_ERTM_SEQ_MASK;
+    uint8_t sar    = control >> 14;
+
+    if (channel->mode == L2CAP_CHANNEL_MODE_STREAMING){
+        // missing frames are not retransmitted, drop partial SDU
+        if (tx_seq != channel->expected_tx_seq && channel->receive_sdu_len){
+            log_info("l2cap streaming: local cid 0x%02x, missing TxSeq %u, drop partial SDU", channel->local_cid, channel->expected_tx_seq);
+            channel->receive_sdu_len = 0;
+        }
+        channel->expected_tx_seq = (tx_seq + 1) & L2CAP_ERTM_SEQ_MASK;
+        l2cap_ertm_handle_in_sequence_sdu(channel, sar, payload, len);
+        return;
+    }
+
+    l2cap_ertm_process_req_seq(channel, req_seq);
+    if (final){
+        l2cap_ertm_process_final(channel);
+    }
+
+    uint8_t offset = (tx_seq - channel->expected_tx_seq) & L2CAP_ERTM_SEQ_MASK;
+    if (offset == 0){
+        channel->expected_tx_seq = (channel->expected_tx_seq + 1) & L2CAP_ERTM_SEQ_MASK;
+        channel->reject_actioned = 0;
+        channel->send_supervisor_frame_receiver_ready = 1;
+        l2cap_ertm_handle_in_sequence_sdu(channel, sar, payload, len);
+        return;
+    }
+    if (offset > L2CAP_ERTM_SEQ_MASK - channel->local_tx_window){
+        // duplicate, acknowledge again
+        channel->send_supervisor_frame_receiver_ready = 1;
+        return;
+    }
+    // frames missing, request retransmission from expected TxSeq
+    log_info("l2cap ertm: local cid 0x%02x, expected TxSeq %u, received %u", channel->local_cid, channel->expected_tx_seq, tx_seq);
+    if (channel->reject_actioned) return;
+    channel->reject_actioned = 1;
+    channel->send_supervisor_frame_reject = 1;
+}
+
+uint8_t l2cap_create_ertm_channel(btstack_packet_handler_t packet_handler, bd_addr_t address, uint16_t psm,
+    l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size, uint16_t * out_local_cid){
+
+    uint8_t status = l2cap_ertm_validate_local_config(ertm_config, buffer, size);
+    if (status) return status;
+
+    uint16_t local_cid;
+    status = l2cap_create_channel(packet_handler, address, psm, ertm_config->local_mtu, &local_cid);
+    if (status) return status;
+
+    l2cap_channel_t * channel = l2cap_get_channel_for_local_cid(local_cid);
+    l2cap_ertm_configure_channel(channel, ertm_config, buffer, size);
+
+    if (out_local_cid){
+        *out_local_cid = local_cid;
+    }
+    return 0;
+}
+
+uint8_t l2cap_accept_ertm_connection(uint16_t local_cid, l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size){
+    l2cap_channel_t * channel = l2cap_get_channel_for_local_cid(local_cid);
+    if (!channel) {
+        log_error("l2cap_accept_ertm_connection called but local_cid 0x%x not found", local_cid);
+        return L2CAP_LOCAL_CID_DOES_NOT_EXIST;
+    }
+
+    uint8_t status = l2cap_ertm_validate_local_config(ertm_config, buffer, size);
+    if (status) return status;
+
+    l2cap_ertm_configure_channel(channel, ertm_config, buffer, size);
+    l2cap_accept_connection(local_cid);
+    return 0;
+}
+#endif
 #endif
 
 
@@ -599,7 +1577,10 @@ static void l2cap_run(void){
                         break;
                     case 2: { // Extended Features Supported
                             // extended features request supported, features: fixed channels, unicast connectionless data reception
-                            uint32_t features = 0x280;
+                            uint32_t features = L2CAP_EXTENDED_FEATURE_FIXED_CHANNELS | L2CAP_EXTENDED_FEATURE_UNICAST_CONNECTIONLESS_DATA;
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                            features |= L2CAP_EXTENDED_FEATURE_ENHANCED_RETRANSMISSION_MODE | L2CAP_EXTENDED_FEATURE_STREAMING_MODE | L2CAP_EXTENDED_FEATURE_FCS_OPTION;
+#endif
                             l2cap_send_signaling_packet(handle, INFORMATION_RESPONSE, sig_id, infoType, 0, sizeof(features), &features);
                         }
                         break;
@@ -638,7 +1619,21 @@ static void l2cap_run(void){
     UNUSED(it);
 
 #ifdef ENABLE_CLASSIC
-    uint8_t  config_options[4];
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    // query extended features of remote L2CAP
+    hci_connections_get_iterator(&it);
+    while (btstack_linked_list_iterator_has_next(&it)){
+        hci_connection_t * connection = (hci_connection_t *) btstack_linked_list_iterator_next(&it);
+        if (connection->l2cap_state.information_state != L2CAP_INFORMATION_STATE_W2_SEND_EXTENDED_FEATURE_REQUEST) continue;
+        if (!hci_can_send_acl_packet_now(connection->con_handle)) continue;
+        connection->l2cap_state.information_state = L2CAP_INFORMATION_STATE_W4_EXTENDED_FEATURE_RESPONSE;
+        l2cap_send_signaling_packet(connection->con_handle, INFORMATION_REQUEST, l2cap_next_sig_id(), L2CAP_INFO_TYPE_EXTENDED_FEATURES);
+    }
+#endif
+
+    // MTU option + Retransmission and Flow Control option + FCS option
+    uint8_t  config_options[18];
+    uint16_t options_size;
     btstack_linked_list_iterator_init(&it, &l2cap_channels);
     while (btstack_linked_list_iterator_has_next(&it)){
 
@@ -669,6 +1664,7 @@ static void l2cap_run(void){
                 l2cap_send_signaling_packet(channel->con_handle, CONNECTION_RESPONSE, channel->remote_sig_id, channel->local_cid, channel->remote_cid, channel->reason, 0);
                 // discard channel - l2cap_finialize_channel_close without sending l2cap close event
                 l2cap_stop_rtx(channel);
+                l2cap_can_send_now_dequeue(channel);
                 btstack_linked_list_iterator_remove(&it);
                 btstack_memory_l2cap_channel_free(channel); 
                 break;
@@ -701,33 +1697,69 @@ static void l2cap_run(void){
                     }
                     if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_INVALID){
                         l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_RESPONSE, channel->remote_sig_id, channel->remote_cid, flags, L2CAP_CONF_RESULT_UNKNOWN_OPTIONS, 0, NULL);
-                    } else if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_MTU){
-                        config_options[0] = 1; // MTU
-                        config_options[1] = 2; // len param
-                        little_endian_store_16( (uint8_t*)&config_options, 2, channel->remote_mtu);
-                        l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_RESPONSE, channel->remote_sig_id, channel->remote_cid, flags, 0, 4, &config_options);
-                        channelStateVarClearFlag(channel,L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_MTU);
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                    } else if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_UNACCEPTABLE){
+                        // propose our mode, remote will send a new Configuration Request
+                        channelStateVarClearFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_UNACCEPTABLE);
+                        channelStateVarClearFlag(channel, L2CAP_CHANNEL_STATE_VAR_SENT_CONF_RSP);
+                        options_size = l2cap_ertm_setup_retransmission_and_flow_control_option(config_options, channel->mode, channel->local_tx_window,
+                            channel->local_max_transmit, channel->local_retransmission_timeout_ms, channel->local_monitor_timeout_ms, channel->local_mps);
+                        l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_RESPONSE, channel->remote_sig_id, channel->remote_cid, flags, L2CAP_CONF_RESULT_UNACCEPTABLE_PARAMETERS, options_size, &config_options);
+#endif
                     } else {
-                        l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_RESPONSE, channel->remote_sig_id, channel->remote_cid, flags, 0, 0, NULL);
+                        options_size = 0;
+                        if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_MTU){
+                            config_options[0] = L2CAP_CONF_OPTION_TYPE_MTU;
+                            config_options[1] = 2; // len param
+                            little_endian_store_16( (uint8_t*)&config_options, 2, channel->remote_mtu);
+                            options_size = 4;
+                            channelStateVarClearFlag(channel,L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_MTU);
+                        }
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                        if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_ERTM){
+                            // accept remote parameters, provide timeouts for our I-frames
+                            options_size += l2cap_ertm_setup_retransmission_and_flow_control_option(&config_options[options_size], channel->mode, channel->remote_tx_window,
+                                channel->remote_max_transmit, channel->local_retransmission_timeout_ms, channel->local_monitor_timeout_ms, channel->remote_mps);
+                            channelStateVarClearFlag(channel,L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_ERTM);
+                        }
+#endif
+                        l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_RESPONSE, channel->remote_sig_id, channel->remote_cid, flags, 0, options_size, &config_options);
                     }
                     channelStateVarClearFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_CONT);
                 }
                 else if (channel->state_var & L2CAP_CHANNEL_STATE_VAR_SEND_CONF_REQ){
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                    // wait for extended features of remote
+                    if (!l2cap_ertm_select_mode(channel)) break;
+#endif
                     channelStateVarClearFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_REQ);
                     channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SENT_CONF_REQ);
                     channel->local_sig_id = l2cap_next_sig_id();
-                    config_options[0] = 1; // MTU
+                    config_options[0] = L2CAP_CONF_OPTION_TYPE_MTU;
                     config_options[1] = 2; // len param
                     little_endian_store_16( (uint8_t*)&config_options, 2, channel->local_mtu);
-                    l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_REQUEST, channel->local_sig_id, channel->remote_cid, 0, 4, &config_options);
+                    options_size = 4;
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                    options_size += l2cap_ertm_setup_options_request(channel, &config_options[options_size]);
+#endif
+                    l2cap_send_signaling_packet(channel->con_handle, CONFIGURE_REQUEST, channel->local_sig_id, channel->remote_cid, 0, options_size, &config_options);
                     l2cap_start_rtx(channel);
                 }
                 if (l2cap_channel_ready_for_open(channel)){
                     channel->state = L2CAP_STATE_OPEN;
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                    l2cap_ertm_channel_opened(channel);
+#endif
                     l2cap_emit_channel_opened(channel, 0);  // success
                 }
                 break;
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+            case L2CAP_STATE_OPEN:
+                l2cap_ertm_run(channel);
+                break;
+#endif
+
             case L2CAP_STATE_WILL_SEND_DISCONNECT_RESPONSE:
                 if (!hci_can_send_acl_packet_now(channel->con_handle)) break;
                 channel->state = L2CAP_STATE_INVALID;
@@ -929,6 +1961,7 @@ static l2cap_channel_t * l2cap_create_channel_entry(btstack_packet_handler_t pac
     channel->local_mtu  = local_mtu;
     channel->remote_mtu = L2CAP_MINIMAL_MTU;
     channel->required_security_level = security_level;
+    channel->priority = L2CAP_CHANNEL_PRIORITY_NORMAL;
 
     // 
     channel->local_cid = l2cap_next_local_cid();
@@ -1016,6 +2049,7 @@ static void l2cap_handle_connection_failed_for_addr(bd_addr_t address, uint8_t s
                 l2cap_emit_channel_opened(channel, status);
                 // discard channel
                 l2cap_stop_rtx(channel);
+                l2cap_can_send_now_dequeue(channel);
                 btstack_linked_list_iterator_remove(&it);
                 btstack_memory_l2cap_channel_free(channel);
                 break;
@@ -1042,14 +2076,22 @@ static void l2cap_handle_connection_success_for_addr(bd_addr_t address, hci_con_
 static void l2cap_notify_channel_can_send(void){
 
 #ifdef ENABLE_CLASSIC
-    btstack_linked_list_iterator_t it;
-    btstack_linked_list_iterator_init(&it, &l2cap_channels);
-    while (btstack_linked_list_iterator_has_next(&it)){
-        l2cap_channel_t * channel = (l2cap_channel_t *) btstack_linked_list_iterator_next(&it);
-        if (!channel->waiting_for_can_send_now) continue;
-        if (!hci_can_send_acl_packet_now(channel->con_handle)) continue;
-        channel->waiting_for_can_send_now = 0;
-        l2cap_emit_can_send_now(channel->packet_handler, channel->local_cid);
+    // requests while serving a channel are handled by the outermost call
+    if (!l2cap_can_send_now_active){
+        l2cap_can_send_now_active = 1;
+        l2cap_can_send_now_unpark();
+        // no classic channel can send if controller has no buffer left, keep queues as they are
+        while (hci_can_send_acl_classic_packet_now()){
+            int priority = l2cap_can_send_now_next_priority();
+            if (priority < 0) break;
+            l2cap_channel_t * channel = l2cap_can_send_now_pop(priority);
+            if (!channel) continue;
+            channel->waiting_for_can_send_now = 0;
+            l2cap_can_send_now_virtual_time = l2cap_can_send_now_pass[priority];
+            l2cap_can_send_now_pass[priority] += l2cap_can_send_now_stride[priority];
+            l2cap_emit_can_send_now(channel->packet_handler, channel->local_cid);
+        }
+        l2cap_can_send_now_active = 0;
     }
 #endif
 
@@ -1139,6 +2181,10 @@ static void l2cap_hci_event_handler(uint8_t packet_type, uint16_t cid, uint8_t *
                 if (channel->con_handle != handle) continue;
                 l2cap_emit_channel_closed(channel);
                 l2cap_stop_rtx(channel);
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                l2cap_ertm_stop_timer(channel);
+#endif
+                l2cap_can_send_now_dequeue(channel);
                 btstack_linked_list_iterator_remove(&it);
                 btstack_memory_l2cap_channel_free(channel);
             }
@@ -1335,6 +2381,11 @@ static void l2cap_signaling_handle_configure_request(l2cap_channel_t *channel, u
         channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_CONT);
     }
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    // Basic Mode if Retransmission and Flow Control option is missing
+    uint8_t remote_mode = L2CAP_CHANNEL_MODE_BASIC;
+#endif
+
     // accept the other's configuration options
     uint16_t end_pos = 4 + little_endian_read_16(command, L2CAP_SIGNALING_COMMAND_LENGTH_OFFSET);
     uint16_t pos     = 8;
@@ -1354,6 +2405,19 @@ static void l2cap_signaling_handle_configure_request(l2cap_channel_t *channel, u
         if (option_type == 2 && length == 2){
             channel->flush_timeout = little_endian_read_16(command, pos);
         }
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+        // Retransmission and Flow Control { type(8):4, len(8):9, Mode(8), TxWindow(8), MaxTransmit(8), Retransmission Timeout(16), Monitor Timeout(16), MPS(16)}
+        if (option_type == L2CAP_CONF_OPTION_TYPE_RETRANSMISSION_AND_FLOW_CONTROL && length == 9){
+            remote_mode = command[pos];
+            channel->remote_tx_window    = command[pos+1];
+            channel->remote_max_transmit = command[pos+2];
+            channel->remote_mps          = little_endian_read_16(command, pos+7);
+        }
+        // FCS { type(8):5, len(8):1, FCS Type(8)}
+        if (option_type == L2CAP_CONF_OPTION_TYPE_FRAME_CHECK_SEQUENCE && length == 1){
+            channel->remote_fcs_option = command[pos];
+        }
+#endif
         // check for unknown options
         if (option_hint == 0 && (option_type == 0 || option_type >= 0x07)){
             log_info("l2cap cid %u, unknown options", channel->local_cid);
@@ -1361,6 +2425,12 @@ static void l2cap_signaling_handle_configure_request(l2cap_channel_t *channel, u
         }
         pos += length;
     }
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    if ((flags & 1) == 0){
+        l2cap_ertm_handle_remote_mode(channel, remote_mode);
+    }
+#endif
 }
 
 static int l2cap_channel_ready_for_open(l2cap_channel_t *channel){
@@ -1429,6 +2499,7 @@ static void l2cap_signaling_handler_channel(l2cap_channel_t *channel, uint8_t *c
                             }
                             
                             // discard channel
+                            l2cap_can_send_now_dequeue(channel);
                             btstack_linked_list_remove(&l2cap_channels, (btstack_linked_item_t *) channel);
                             btstack_memory_l2cap_channel_free(channel);
                             break;
@@ -1454,6 +2525,10 @@ static void l2cap_signaling_handler_channel(l2cap_channel_t *channel, uint8_t *c
                     break;
                 case CONFIGURE_RESPONSE:
                     l2cap_stop_rtx(channel);
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                    l2cap_ertm_handle_configure_response(channel, result, command);
+                    if (channel->state != L2CAP_STATE_CONFIG) break;
+#endif
                     switch (result){
                         case 0: // success
                             channelStateVarSetFlag(channel, L2CAP_CHANNEL_STATE_VAR_RCVD_CONF_RSP);
@@ -1473,6 +2548,9 @@ static void l2cap_signaling_handler_channel(l2cap_channel_t *channel, uint8_t *c
             if (l2cap_channel_ready_for_open(channel)){
                 // for open:
                 channel->state = L2CAP_STATE_OPEN;
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                l2cap_ertm_channel_opened(channel);
+#endif
                 l2cap_emit_channel_opened(channel, 0);
             }
             break;
@@ -1507,6 +2585,24 @@ static void l2cap_signaling_handler_dispatch( hci_con_handle_t handle, uint8_t *
     // get code, signalind identifier and command len
     uint8_t code   = command[L2CAP_SIGNALING_COMMAND_CODE_OFFSET];
     uint8_t sig_id = command[L2CAP_SIGNALING_COMMAND_SIGID_OFFSET];
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    // response to our extended features request
+    if (code == INFORMATION_RESPONSE){
+        hci_connection_t * connection = hci_connection_for_handle(handle);
+        if (!connection) return;
+        if (connection->l2cap_state.information_state != L2CAP_INFORMATION_STATE_W4_EXTENDED_FEATURE_RESPONSE) return;
+        uint16_t info_type = little_endian_read_16(command, L2CAP_SIGNALING_COMMAND_DATA_OFFSET);
+        uint16_t result    = little_endian_read_16(command, L2CAP_SIGNALING_COMMAND_DATA_OFFSET+2);
+        if (info_type != L2CAP_INFO_TYPE_EXTENDED_FEATURES) return;
+        if (result == 0){
+            connection->l2cap_state.extended_feature_mask = little_endian_read_16(command, L2CAP_SIGNALING_COMMAND_DATA_OFFSET+4);
+        }
+        connection->l2cap_state.information_state = L2CAP_INFORMATION_STATE_DONE;
+        log_info("l2cap extended features 0x%04x", connection->l2cap_state.extended_feature_mask);
+        return;
+    }
+#endif
     
     // not for a particular channel, and not CONNECTION_REQUEST, ECHO_[REQUEST|RESPONSE], INFORMATION_REQUEST 
     if (code < 1 || code == ECHO_RESPONSE || code > INFORMATION_REQUEST){
@@ -1913,6 +3009,12 @@ static void l2cap_acl_handler(uint8_t packet_type, uint16_t channel, uint8_t *pa
             // Find channel for this channel_id and connection handle
             l2cap_channel = l2cap_get_channel_for_local_cid(channel_id);
             if (l2cap_channel) {
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+                if (l2cap_channel->mode != L2CAP_CHANNEL_MODE_BASIC){
+                    l2cap_ertm_handle_packet(l2cap_channel, packet, size);
+                    break;
+                }
+#endif
                 l2cap_dispatch_to_channel(l2cap_channel, L2CAP_DATA_PACKET, &packet[COMPLETE_L2CAP_HEADER], size-COMPLETE_L2CAP_HEADER);
             }
 #endif
@@ -1972,6 +3074,10 @@ void l2cap_finialize_channel_close(l2cap_channel_t * channel){
     l2cap_emit_channel_closed(channel);
     // discard channel
     l2cap_stop_rtx(channel);
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    l2cap_ertm_stop_timer(channel);
+#endif
+    l2cap_can_send_now_dequeue(channel);
     btstack_linked_list_remove(&l2cap_channels, (btstack_linked_item_t *) channel);
     btstack_memory_l2cap_channel_free(channel);
 }
@@ -101,11 +101,54 @@ typedef enum {
     L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_INVALID = 1 << 8,   // in CONF RSP, send UNKNOWN OPTIONS
     L2CAP_CHANNEL_STATE_VAR_SEND_CMD_REJ_UNKNOWN  = 1 << 9,   // send CMD_REJ with reason unknown
     L2CAP_CHANNEL_STATE_VAR_SEND_CONN_RESP_PEND   = 1 << 10,  // send Connection Respond with pending
+    L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_ERTM    = 1 << 11,  // in CONF RSP, add Retransmission and Flow Control option
+    L2CAP_CHANNEL_STATE_VAR_SEND_CONF_RSP_UNACCEPTABLE = 1 << 12,  // in CONF RSP, send UNACCEPTABLE PARAMETERS with our mode
     L2CAP_CHANNEL_STATE_VAR_INCOMING              = 1 << 15,  // channel is incoming
 } L2CAP_CHANNEL_STATE_VAR;
 
-// info regarding an actual connection
+// priority for L2CAP_EVENT_CAN_SEND_NOW dispatch
+typedef enum {
+    L2CAP_CHANNEL_PRIORITY_LOW = 0,
+    L2CAP_CHANNEL_PRIORITY_NORMAL,
+    L2CAP_CHANNEL_PRIORITY_HIGH,
+    L2CAP_CHANNEL_PRIORITY_NUM_LEVELS
+} l2cap_channel_priority_t;
+
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+
+// configuration for Enhanced Retransmission and Streaming Mode channels
 typedef struct {
+    // L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION or L2CAP_CHANNEL_MODE_STREAMING
+    uint8_t  mode;
+    // if not set, Basic Mode is used if remote does not support the requested mode
+    uint8_t  ertm_mandatory;
+    // number of transmissions of a single I-frame before the channel is closed, 0 = infinite
+    uint8_t  max_transmit;
+    // timeouts used by remote side, announced in Configuration Response
+    uint16_t retransmission_timeout_ms;
+    uint16_t monitor_timeout_ms;
+    // max size of incoming SDUs
+    uint16_t local_mtu;
+    // number of I-frames that remote can send without acknowledgement, 1..63
+    uint8_t  tx_window;
+    // number of outgoing I-frames that can be stored for transmission and retransmission, 1..63
+    uint8_t  num_tx_buffers;
+    // use Frame Check Sequence, FCS is only omitted if both sides don't request it
+    uint8_t  fcs_option;
+} l2cap_ertm_config_t;
+
+// outgoing I-frame stored in ERTM/Streaming buffer
+typedef struct {
+    uint16_t len;
+    uint8_t  sar;
+    uint8_t  num_transmissions;
+    uint8_t  retransmission_requested;
+} l2cap_ertm_tx_packet_state_t;
+
+#endif
+
+// info regarding an actual connection
+typedef struct l2cap_channel {
     // linked list - assert: first field
     btstack_linked_item_t    item;
     
@@ -142,6 +185,12 @@ typedef struct {
     uint8_t   reason; // used in decline internal
     uint8_t   waiting_for_can_send_now;
 
+    // can send now queue, grouped by connection and priority, see l2cap_set_channel_priority
+    struct l2cap_channel * can_send_now_next;
+    struct l2cap_channel * can_send_now_next_group;
+    l2cap_channel_priority_t priority;
+    uint8_t   can_send_now_state;
+
     // LE Data Channels
 
     // incoming SDU
@@ -169,6 +218,60 @@ typedef struct {
     // automatic credits incoming
     uint16_t automatic_credits;
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+    // Enhanced Retransmission and Streaming Mode, incoming SDUs are reassembled in receive_sdu_buffer
+
+    // negotiated and requested mode
+    uint8_t  mode;
+    uint8_t  mode_requested;
+    uint8_t  ertm_mandatory;
+
+    // FCS option sent by each side, FCS is used if one side requests it
+    uint8_t  local_fcs_option;
+    uint8_t  remote_fcs_option;
+    uint8_t  fcs_enabled;
+
+    // local config, also announced to remote
+    uint8_t  local_tx_window;
+    uint8_t  local_max_transmit;
+    uint16_t local_retransmission_timeout_ms;
+    uint16_t local_monitor_timeout_ms;
+    uint16_t local_mps;
+
+    // config received from remote, remote_mps is shared with LE Data Channels
+    uint8_t  remote_tx_window;
+    uint8_t  remote_max_transmit;
+    uint16_t remote_retransmission_timeout_ms;
+    uint16_t remote_monitor_timeout_ms;
+
+    // retransmission or monitor timer
+    btstack_timer_source_t ertm_timer;
+    uint8_t  ertm_timer_state;
+    uint8_t  ertm_retry_count;
+
+    // outgoing I-frames: ring of num_tx_buffers, oldest unacknowledged frame at tx_read_index has TxSeq expected_ack_seq
+    l2cap_ertm_tx_packet_state_t * tx_packets_state;
+    uint8_t * tx_packets_data;
+    uint16_t  tx_packet_size;
+    uint16_t  tx_mps;
+    uint8_t   num_tx_buffers;
+    uint8_t   tx_read_index;
+    uint8_t   tx_stored;
+    uint8_t   tx_sent;
+    uint8_t   expected_ack_seq;
+    uint8_t   remote_busy;
+
+    // incoming I-frames
+    uint8_t   expected_tx_seq;
+    uint8_t   reject_actioned;
+
+    // pending S-frames
+    uint8_t   send_supervisor_frame_receiver_ready;
+    uint8_t   send_supervisor_frame_reject;
+    uint8_t   send_supervisor_frame_poll;
+    uint8_t   send_supervisor_frame_final;
+#endif
+
 } l2cap_channel_t;
 
 // info regarding potential connections
@@ -246,6 +349,34 @@ uint16_t l2cap_max_le_mtu(void);
  */
 uint8_t l2cap_create_channel(btstack_packet_handler_t packet_handler, bd_addr_t address, uint16_t psm, uint16_t mtu, uint16_t * out_local_cid);
 
+#ifdef ENABLE_L2CAP_ENHANCED_RETRANSMISSION_MODE
+/**
+ * @brief Creates L2CAP channel in Enhanced Retransmission or Streaming Mode to the PSM of a remote device with baseband address.
+ * @note  The provided buffer holds outgoing I-frames and the reassembly buffer for incoming SDUs,
+ *        it needs to be at least num_tx_buffers * (sizeof(l2cap_ertm_tx_packet_state_t) + PDU size) + local_mtu
+ * @param packet_handler
+ * @param address
+ * @param psm
+ * @param ertm_config
+ * @param buffer
+ * @param size
+ * @param out_local_cid
+ * @return status
+ */
+uint8_t l2cap_create_ertm_channel(btstack_packet_handler_t packet_handler, bd_addr_t address, uint16_t psm,
+    l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size, uint16_t * out_local_cid);
+
+/**
+ * @brief Accepts incoming L2CAP connection in Enhanced Retransmission or Streaming Mode, see l2cap_create_ertm_channel for buffer size
+ * @param local_cid
+ * @param ertm_config
+ * @param buffer
+ * @param size
+ * @return status
+ */
+uint8_t l2cap_accept_ertm_connection(uint16_t local_cid, l2cap_ertm_config_t * ertm_config, uint8_t * buffer, uint32_t size);
+#endif
+
 /** 
  * @brief Disconnects L2CAP channel with given identifier. 
  */
@@ -294,6 +425,17 @@ int  l2cap_can_send_packet_now(uint16_t local_cid);
  */
 void l2cap_request_can_send_now_event(uint16_t local_cid);
 
+/**
+ * @brief Set priority for L2CAP_EVENT_CAN_SEND_NOW dispatch, default L2CAP_CHANNEL_PRIORITY_NORMAL.
+ * @note  Whenever outgoing buffers become available, connections with waiting channels of the same priority are
+ *        served round robin, and channels of one connection in the order of their requests.
+ *        If channels of all priorities keep sending, LOW, NORMAL and HIGH get 1 : 4 : 16 of the packets,
+ *        so neither a bulk sender nor a higher priority can starve other channels.
+ * @param local_cid
+ * @param priority
+ */
+void l2cap_set_channel_priority(uint16_t local_cid, l2cap_channel_priority_t priority);
+
 /** 
  * @brief Reserve outgoing buffer
  */
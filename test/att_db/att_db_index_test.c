@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+// *****************************************************************************
+//
+// ATT DB lookups with ENABLE_ATT_DB_INDEX against linear search
+//
+// *****************************************************************************
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "ble/att_db.h"
+#include "ble/att_db_util.h"
+#include "bluetooth.h"
+#include "btstack_util.h"
+
+#include "att_db_linear.h"
+
+#define NUM_SERVICES 12
+#define NUM_CHARACTERISTICS_PER_SERVICE 6
+// 12 services with 16 attributes each, incl. Client Characteristic Configurations, probe beyond last handle
+#define MAX_HANDLE 200
+
+static const uint8_t bluetooth_base_uuid[] = { 0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+static const uint16_t uuids16[] = { 0x2800, 0x2801, 0x2803, 0x2902, 0x2a00, 0x2a01, 0x2a02, 0x2a03, 0x2a04, 0x2a05, 0x1234 };
+
+static att_connection_t connection_index;
+static att_connection_t connection_linear;
+static int num_requests;
+
+static void uuid128_for_uuid16(uint16_t uuid16, uint8_t * uuid128){
+    memcpy(uuid128, bluetooth_base_uuid, 16);
+    little_endian_store_16(uuid128, 12, uuid16);
+}
+
+// mixed UUID16 / UUID128 DB, UUID128 both based on Bluetooth Base UUID or not
+static void setup_db(void){
+    uint8_t data[4] = { 1, 2, 3, 4 };
+    uint8_t uuid128[16];
+    int s, c;
+    att_db_util_init();
+    for (s = 0; s < NUM_SERVICES; s++){
+        if (s % 3 == 2){
+            memset(uuid128, s, 16);
+            att_db_util_add_service_uuid128(uuid128);
+        } else {
+            att_db_util_add_service_uuid16(0x1800 + s % 4);
+        }
+        for (c = 0; c < NUM_CHARACTERISTICS_PER_SERVICE; c++){
+            switch ((s + c) % 4){
+                case 0:
+                    att_db_util_add_characteristic_uuid16(0x2a00 + c, ATT_PROPERTY_READ | ATT_PROPERTY_NOTIFY, data, 1 + c % 3);
+                    break;
+                case 1:
+                    memset(uuid128, 0x40 + c, 16);
+                    att_db_util_add_characteristic_uuid128(uuid128, ATT_PROPERTY_READ, data, 2);
+                    break;
+                case 2:
+                    uuid128_for_uuid16(0x2a00 + c, uuid128);
+                    att_db_util_add_characteristic_uuid128(uuid128, ATT_PROPERTY_READ | ATT_PROPERTY_INDICATE, data, 2);
+                    break;
+                default:
+                    att_db_util_add_characteristic_uuid16(0x2a00 + c, ATT_PROPERTY_WRITE, data, 4);
+                    break;
+            }
+        }
+    }
+}
+
+static void check_request(uint8_t * request, uint16_t request_len){
+    uint8_t response_index[64];
+    uint8_t response_linear[64];
+    uint16_t response_index_len  = att_handle_request(&connection_index, request, request_len, response_index);
+    uint16_t response_linear_len = linear_att_handle_request(&connection_linear, request, request_len, response_linear);
+    CHECK_EQUAL(response_linear_len, response_index_len);
+    MEMCMP_EQUAL(response_linear, response_index, response_index_len);
+    num_requests++;
+}
+
+static void check_range_requests(uint16_t start_handle, uint16_t end_handle){
+    uint8_t request[32];
+    int i;
+
+    request[0] = ATT_FIND_INFORMATION_REQUEST;
+    little_endian_store_16(request, 1, start_handle);
+    little_endian_store_16(request, 3, end_handle);
+    check_request(request, 5);
+
+    for (i = 0; i < (int) (sizeof(uuids16) / sizeof(uint16_t)); i++){
+        request[0] = ATT_READ_BY_TYPE_REQUEST;
+        little_endian_store_16(request, 5, uuids16[i]);
+        check_request(request, 7);
+        // same type as UUID128
+        uuid128_for_uuid16(uuids16[i], &request[5]);
+        check_request(request, 21);
+
+        request[0] = ATT_READ_BY_GROUP_TYPE_REQUEST;
+        little_endian_store_16(request, 5, uuids16[i]);
+        check_request(request, 7);
+
+        request[0] = ATT_FIND_BY_TYPE_VALUE_REQUEST;
+        little_endian_store_16(request, 5, GATT_PRIMARY_SERVICE_UUID);
+        little_endian_store_16(request, 7, 0x1800 + i % 4);
+        check_request(request, 9);
+
+        CHECK_EQUAL(linear_gatt_server_get_value_handle_for_characteristic_with_uuid16(start_handle, end_handle, uuids16[i]),
+                    gatt_server_get_value_handle_for_characteristic_with_uuid16(start_handle, end_handle, uuids16[i]));
+        CHECK_EQUAL(linear_gatt_server_get_client_configuration_handle_for_characteristic_with_uuid16(start_handle, end_handle, uuids16[i]),
+                    gatt_server_get_client_configuration_handle_for_characteristic_with_uuid16(start_handle, end_handle, uuids16[i]));
+    }
+
+    // UUID128 not based on Bluetooth Base UUID
+    for (i = 0; i < 4; i++){
+        request[0] = ATT_READ_BY_TYPE_REQUEST;
+        memset(&request[5], 0x40 + i, 16);
+        check_request(request, 21);
+    }
+}
+
+static void check_handle_requests(uint16_t handle){
+    uint8_t request[5];
+
+    request[0] = ATT_READ_REQUEST;
+    little_endian_store_16(request, 1, handle);
+    check_request(request, 3);
+
+    request[0] = ATT_READ_BLOB_REQUEST;
+    little_endian_store_16(request, 3, 1);
+    check_request(request, 5);
+
+    CHECK_EQUAL(linear_att_uuid_for_handle(handle), att_uuid_for_handle(handle));
+    CHECK_EQUAL(linear_gatt_server_get_client_configuration_handle_for_value_handle(handle),
+                gatt_server_get_client_configuration_handle_for_value_handle(handle));
+}
+
+TEST_GROUP(AttDbIndex){
+    void setup(void){
+        setup_db();
+        att_set_db(att_db_util_get_address());
+        linear_att_set_db(att_db_util_get_address());
+        memset(&connection_index, 0, sizeof(connection_index));
+        connection_index.mtu = ATT_DEFAULT_MTU;
+        connection_index.max_mtu = ATT_DEFAULT_MTU;
+        connection_linear = connection_index;
+        num_requests = 0;
+    }
+};
+
+TEST(AttDbIndex, HandleLookups){
+    int handle;
+    for (handle = 0; handle < MAX_HANDLE; handle++){
+        check_handle_requests(handle);
+    }
+    check_handle_requests(0xffff);
+}
+
+TEST(AttDbIndex, RangeLookups){
+    int start_handle;
+    int end_handle;
+    for (start_handle = 0; start_handle < MAX_HANDLE; start_handle++){
+        for (end_handle = start_handle; end_handle < MAX_HANDLE; end_handle += 7){
+            check_range_requests(start_handle, end_handle);
+        }
+        check_range_requests(start_handle, 0xffff);
+    }
+    CHECK(num_requests > 100000);
+}
+
+TEST(AttDbIndex, ServiceRange){
+    uint16_t uuid16;
+    for (uuid16 = 0x1800; uuid16 < 0x1805; uuid16++){
+        uint16_t start_index  = 0;
+        uint16_t end_index    = 0;
+        uint16_t start_linear = 0;
+        uint16_t end_linear   = 0;
+        int found_index  = gatt_server_get_get_handle_range_for_service_with_uuid16(uuid16, &start_index, &end_index);
+        int found_linear = linear_gatt_server_get_get_handle_range_for_service_with_uuid16(uuid16, &start_linear, &end_linear);
+        CHECK_EQUAL(found_linear, found_index);
+        CHECK_EQUAL(start_linear, start_index);
+        CHECK_EQUAL(end_linear, end_index);
+    }
+}
+
+// DB changed after att_set_db, e.g. another service added, index valid again after calling att_set_db
+TEST(AttDbIndex, DbChanged){
+    uint8_t data[2] = { 0, 0 };
+    att_db_util_add_service_uuid16(0x1805);
+    att_db_util_add_characteristic_uuid16(0x2a2b, ATT_PROPERTY_READ | ATT_PROPERTY_NOTIFY, data, 2);
+    att_set_db(att_db_util_get_address());
+    linear_att_set_db(att_db_util_get_address());
+    int handle;
+    for (handle = 0; handle < MAX_HANDLE + 4; handle++){
+        check_handle_requests(handle);
+    }
+    check_range_requests(1, 0xffff);
+    CHECK(gatt_server_get_value_handle_for_characteristic_with_uuid16(1, 0xffff, 0x2a2b) != 0);
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  att_db_linear.c
+ *
+ *  att_db.c without ENABLE_ATT_DB_INDEX and with public functions renamed to linear_*,
+ *  reference for lookups with index in att_db_index_test
+ */
+
+#include "btstack_config.h"
+
+#undef ENABLE_ATT_DB_INDEX
+
+#define att_set_db                                                             linear_att_set_db
+#define att_set_read_callback                                                  linear_att_set_read_callback
+#define att_set_write_callback                                                 linear_att_set_write_callback
+#define att_dump_attributes                                                    linear_att_dump_attributes
+#define att_handle_request                                                     linear_att_handle_request
+#define att_prepare_handle_value_notification                                  linear_att_prepare_handle_value_notification
+#define att_prepare_handle_value_indication                                    linear_att_prepare_handle_value_indication
+#define att_clear_transaction_queue                                            linear_att_clear_transaction_queue
+#define att_register_service_handler                                           linear_att_register_service_handler
+#define att_uuid_for_handle                                                    linear_att_uuid_for_handle
+#define gatt_server_get_get_handle_range_for_service_with_uuid16               linear_gatt_server_get_get_handle_range_for_service_with_uuid16
+#define gatt_server_get_value_handle_for_characteristic_with_uuid16            linear_gatt_server_get_value_handle_for_characteristic_with_uuid16
+#define gatt_server_get_client_configuration_handle_for_characteristic_with_uuid16 linear_gatt_server_get_client_configuration_handle_for_characteristic_with_uuid16
+#define gatt_server_get_client_configuration_handle_for_value_handle           linear_gatt_server_get_client_configuration_handle_for_value_handle
+#define gatt_server_get_client_configuration                                   linear_gatt_server_get_client_configuration
+
+#include "ble/att_db.c"
@@ -0,0 +1,283 @@
+/*
+ *  att_server_notification_queue_test.c
+ *
+ *  Notifications and Indications queued by att_server_notify_subscribers: fan-out to subscribed
+ *  connections, coalescing and drop of oldest, one outstanding Indication per connection,
+ *  Client Characteristic Configurations provided by the app, e.g. restored for a bonded device,
+ *  or written with Write Command, and can send now clients next to a blocked connection
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "ble/att_db.h"
+#include "ble/att_db_util.h"
+#include "ble/att_server.h"
+#include "bluetooth.h"
+#include "btstack_defines.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "mock.h"
+
+#define HANDLE_1 0x0040
+#define HANDLE_2 0x0041
+
+static uint16_t value_handle;
+static uint16_t client_configuration_handle;
+
+// Client Characteristic Configuration as stored by the app for each connection
+static hci_con_handle_t stored_con_handles[MOCK_MAX_CONNECTIONS];
+static uint16_t stored_client_configurations[MOCK_MAX_CONNECTIONS];
+static int num_stored;
+
+static int stored_index(hci_con_handle_t con_handle){
+    int i;
+    for (i = 0; i < num_stored; i++){
+        if (stored_con_handles[i] == con_handle) return i;
+    }
+    stored_con_handles[num_stored] = con_handle;
+    stored_client_configurations[num_stored] = 0;
+    return num_stored++;
+}
+
+static uint16_t att_read_callback(hci_con_handle_t con_handle, uint16_t attribute_handle, uint16_t offset, uint8_t * buffer, uint16_t buffer_size){
+    if (attribute_handle != client_configuration_handle) return 0;
+    if (buffer == NULL) return 2;
+    if (offset != 0 || buffer_size < 2) return 0;
+    little_endian_store_16(buffer, 0, stored_client_configurations[stored_index(con_handle)]);
+    return 2;
+}
+
+static int att_write_callback(hci_con_handle_t con_handle, uint16_t attribute_handle, uint16_t transaction_mode, uint16_t offset, uint8_t *buffer, uint16_t buffer_size){
+    UNUSED(transaction_mode);
+    if (attribute_handle != client_configuration_handle) return 0;
+    if (offset != 0 || buffer_size != 2) return ATT_ERROR_INVALID_ATTRIBUTE_VALUE_LENGTH;
+    stored_client_configurations[stored_index(con_handle)] = little_endian_read_16(buffer, 0);
+    return 0;
+}
+
+static void write_client_configuration(hci_con_handle_t con_handle, uint16_t client_configuration){
+    uint8_t write_request[5];
+    write_request[0] = ATT_WRITE_REQUEST;
+    little_endian_store_16(write_request, 1, client_configuration_handle);
+    little_endian_store_16(write_request, 3, client_configuration);
+    mock_receive_att_packet(con_handle, write_request, sizeof(write_request));
+    CHECK_EQUAL(con_handle, mock_can_send_now_requested());
+    mock_can_send_now();
+    int index = mock_num_packets_sent() - 1;
+    CHECK_EQUAL(ATT_WRITE_RESPONSE, mock_packet(index)[0]);
+}
+
+static void write_client_configuration_without_response(hci_con_handle_t con_handle, uint16_t client_configuration){
+    uint8_t write_command[5];
+    write_command[0] = ATT_WRITE_COMMAND;
+    little_endian_store_16(write_command, 1, client_configuration_handle);
+    little_endian_store_16(write_command, 3, client_configuration);
+    mock_receive_att_packet(con_handle, write_command, sizeof(write_command));
+}
+
+// Client Characteristic Configuration only accepts Write Requests by default
+static void client_configuration_allow_write_command(void){
+    uint8_t * entry = att_db_util_get_address();
+    while (little_endian_read_16(entry, 0)){
+        if (little_endian_read_16(entry, 4) == client_configuration_handle){
+            little_endian_store_16(entry, 2, little_endian_read_16(entry, 2) | ATT_PROPERTY_WRITE_WITHOUT_RESPONSE);
+            return;
+        }
+        entry += little_endian_read_16(entry, 0);
+    }
+}
+
+static int can_send_now_client_called;
+static void can_send_now_client(void * context){
+    UNUSED(context);
+    can_send_now_client_called++;
+}
+
+static void store_client_configuration(hci_con_handle_t con_handle, uint16_t client_configuration){
+    stored_client_configurations[stored_index(con_handle)] = client_configuration;
+}
+
+static int check_packet(int index, hci_con_handle_t con_handle, uint8_t opcode, uint8_t value){
+    if (index >= mock_num_packets_sent()) return 0;
+    if (mock_packet_con_handle(index) != con_handle) return 0;
+    if (mock_packet_size(index) != 4) return 0;
+    const uint8_t * packet = mock_packet(index);
+    if (packet[0] != opcode) return 0;
+    if (little_endian_read_16(packet, 1) != value_handle) return 0;
+    return packet[3] == value;
+}
+
+static int notify_subscribers(uint8_t value, int coalesce){
+    return att_server_notify_subscribers(value_handle, &value, 1, coalesce);
+}
+
+TEST_GROUP(ATTServerNotificationQueue){
+    void setup(void){
+        uint8_t value = 0;
+        att_db_util_init();
+        att_db_util_add_service_uuid16(0x180d);
+        value_handle = att_db_util_add_characteristic_uuid16(0x2a37, ATT_PROPERTY_READ | ATT_PROPERTY_NOTIFY | ATT_PROPERTY_INDICATE, &value, 1);
+        num_stored = 0;
+        mock_init();
+        att_server_init(att_db_util_get_address(), &att_read_callback, &att_write_callback);
+        client_configuration_handle = gatt_server_get_client_configuration_handle_for_value_handle(value_handle);
+        mock_connect(HANDLE_1);
+        mock_connect(HANDLE_2);
+    }
+};
+
+TEST(ATTServerNotificationQueue, FanOut){
+    CHECK(client_configuration_handle != 0);
+    write_client_configuration(HANDLE_1, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION);
+    write_client_configuration(HANDLE_2, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION);
+    int sent = mock_num_packets_sent();
+
+    CHECK_EQUAL(0, notify_subscribers(1, 0));
+    CHECK_EQUAL(sent + 2, mock_num_packets_sent());
+    CHECK_TRUE(check_packet(sent,     HANDLE_1, ATT_HANDLE_VALUE_NOTIFICATION, 1));
+    CHECK_TRUE(check_packet(sent + 1, HANDLE_2, ATT_HANDLE_VALUE_NOTIFICATION, 1));
+
+    // unsubscribe
+    write_client_configuration(HANDLE_2, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NONE);
+    sent = mock_num_packets_sent();
+    CHECK_EQUAL(0, notify_subscribers(2, 0));
+    CHECK_EQUAL(sent + 1, mock_num_packets_sent());
+    CHECK_TRUE(check_packet(sent, HANDLE_1, ATT_HANDLE_VALUE_NOTIFICATION, 2));
+
+    att_server_notification_stats_t stats;
+    CHECK_EQUAL(0, att_server_get_notification_stats(HANDLE_1, &stats));
+    CHECK_EQUAL(2, stats.sent);
+    CHECK_EQUAL(0, stats.dropped);
+    CHECK_EQUAL(0, stats.coalesced);
+}
+
+TEST(ATTServerNotificationQueue, CoalesceAndDrop){
+    write_client_configuration(HANDLE_1, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION);
+    int sent = mock_num_packets_sent();
+
+    mock_set_can_send_now(0);
+    CHECK_EQUAL(0, notify_subscribers(1, 1));
+    CHECK_EQUAL(0, notify_subscribers(2, 1));
+    CHECK_EQUAL(HANDLE_1, mock_can_send_now_requested());
+    mock_set_can_send_now(1);
+    mock_can_send_now();
+    CHECK_EQUAL(sent + 1, mock_num_packets_sent());
+    CHECK_TRUE(check_packet(sent, HANDLE_1, ATT_HANDLE_VALUE_NOTIFICATION, 2));
+
+    // queue full, oldest dropped
+    mock_set_can_send_now(0);
+    uint8_t value;
+    for (value = 1; value <= ATT_SERVER_NOTIFICATION_QUEUE_SIZE + 1; value++){
+        CHECK_EQUAL(0, notify_subscribers(value, 0));
+    }
+    mock_set_can_send_now(1);
+    mock_can_send_now();
+    CHECK_EQUAL(sent + 1 + ATT_SERVER_NOTIFICATION_QUEUE_SIZE, mock_num_packets_sent());
+    for (value = 0; value < ATT_SERVER_NOTIFICATION_QUEUE_SIZE; value++){
+        CHECK_TRUE(check_packet(sent + 1 + value, HANDLE_1, ATT_HANDLE_VALUE_NOTIFICATION, value + 2));
+    }
+
+    att_server_notification_stats_t stats;
+    CHECK_EQUAL(0, att_server_get_notification_stats(HANDLE_1, &stats));
+    CHECK_EQUAL(1 + ATT_SERVER_NOTIFICATION_QUEUE_SIZE, stats.sent);
+    CHECK_EQUAL(1, stats.dropped);
+    CHECK_EQUAL(1, stats.coalesced);
+}
+
+TEST(ATTServerNotificationQueue, IndicationWaitsForConfirmation){
+    write_client_configuration(HANDLE_1, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_INDICATION);
+    write_client_configuration(HANDLE_2, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION);
+    int sent = mock_num_packets_sent();
+
+    CHECK_EQUAL(0, notify_subscribers(1, 0));
+    CHECK_EQUAL(0, notify_subscribers(2, 0));
+    CHECK_EQUAL(sent + 3, mock_num_packets_sent());
+    CHECK_TRUE(check_packet(sent,     HANDLE_1, ATT_HANDLE_VALUE_INDICATION,   1));
+    CHECK_TRUE(check_packet(sent + 1, HANDLE_2, ATT_HANDLE_VALUE_NOTIFICATION, 1));
+    CHECK_TRUE(check_packet(sent + 2, HANDLE_2, ATT_HANDLE_VALUE_NOTIFICATION, 2));
+
+    // second indication waits, also for app
+    CHECK_EQUAL(0, mock_can_send_now_requested());
+    uint8_t value = 3;
+    CHECK_EQUAL(ATT_HANDLE_VALUE_INDICATION_IN_PORGRESS, att_server_indicate(HANDLE_1, value_handle, &value, 1));
+
+    uint8_t confirmation[] = { ATT_HANDLE_VALUE_CONFIRMATION };
+    mock_receive_att_packet(HANDLE_1, confirmation, sizeof(confirmation));
+    CHECK_EQUAL(HANDLE_1, mock_can_send_now_requested());
+    mock_can_send_now();
+    CHECK_EQUAL(sent + 4, mock_num_packets_sent());
+    CHECK_TRUE(check_packet(sent + 3, HANDLE_1, ATT_HANDLE_VALUE_INDICATION, 2));
+
+    mock_receive_att_packet(HANDLE_1, confirmation, sizeof(confirmation));
+    CHECK_EQUAL(0, mock_can_send_now_requested());
+}
+
+TEST(ATTServerNotificationQueue, StoredClientConfiguration){
+    // e.g. restored for bonded device, not written on this connection
+    store_client_configuration(HANDLE_2, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION);
+    int sent = mock_num_packets_sent();
+
+    CHECK_EQUAL(0, notify_subscribers(1, 0));
+    CHECK_EQUAL(sent + 1, mock_num_packets_sent());
+    CHECK_TRUE(check_packet(sent, HANDLE_2, ATT_HANDLE_VALUE_NOTIFICATION, 1));
+
+    // client disables it
+    write_client_configuration(HANDLE_2, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NONE);
+    sent = mock_num_packets_sent();
+    CHECK_EQUAL(0, notify_subscribers(2, 0));
+    CHECK_EQUAL(sent, mock_num_packets_sent());
+}
+
+TEST(ATTServerNotificationQueue, WriteCommand){
+    client_configuration_allow_write_command();
+    write_client_configuration_without_response(HANDLE_1, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION);
+    int sent = mock_num_packets_sent();
+
+    CHECK_EQUAL(0, notify_subscribers(1, 0));
+    CHECK_EQUAL(sent + 1, mock_num_packets_sent());
+    CHECK_TRUE(check_packet(sent, HANDLE_1, ATT_HANDLE_VALUE_NOTIFICATION, 1));
+
+    // client disables it
+    write_client_configuration_without_response(HANDLE_1, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NONE);
+    sent = mock_num_packets_sent();
+    CHECK_EQUAL(0, notify_subscribers(2, 0));
+    CHECK_EQUAL(sent, mock_num_packets_sent());
+}
+
+TEST(ATTServerNotificationQueue, BlockedConnectionDoesNotStarveClients){
+    write_client_configuration(HANDLE_1, GATT_CLIENT_CHARACTERISTICS_CONFIGURATION_NOTIFICATION);
+    int sent = mock_num_packets_sent();
+
+    // notification for HANDLE_1 and can send now client for HANDLE_2 wait
+    mock_set_can_send_now(0);
+    CHECK_EQUAL(0, notify_subscribers(1, 0));
+    btstack_context_callback_registration_t client;
+    client.callback = &can_send_now_client;
+    can_send_now_client_called = 0;
+    att_server_register_can_send_now_callback(&client, HANDLE_2);
+    CHECK_EQUAL(0, can_send_now_client_called);
+
+    // only HANDLE_2 can send again
+    mock_set_can_send_now(1);
+    mock_set_can_send_now_blocked(HANDLE_1);
+    mock_can_send_now();
+    CHECK_EQUAL(1, can_send_now_client_called);
+    CHECK_EQUAL(sent, mock_num_packets_sent());
+    CHECK_EQUAL(HANDLE_1, mock_can_send_now_requested());
+
+    // then HANDLE_1
+    mock_set_can_send_now_blocked(0);
+    mock_can_send_now();
+    CHECK_EQUAL(sent + 1, mock_num_packets_sent());
+    CHECK_TRUE(check_packet(sent, HANDLE_1, ATT_HANDLE_VALUE_NOTIFICATION, 1));
+}
+
+int main (int argc, const char * argv[]){
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
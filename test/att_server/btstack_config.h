@@ -0,0 +1,21 @@
+//
+// btstack_config.h for ATT Server tests
+//
+
+#ifndef __BTSTACK_CONFIG
+#define __BTSTACK_CONFIG
+
+// Port related features
+#define HAVE_MALLOC
+#define HAVE_POSIX_TIME
+
+// BTstack features that can be enabled
+#define ENABLE_BLE
+#define ENABLE_LOG_ERROR
+#define ENABLE_ATT_SERVER_NOTIFICATION_QUEUE
+
+// BTstack configuration. buffers, sizes, ...
+#define HCI_ACL_PAYLOAD_SIZE 52
+#define ATT_SERVER_NOTIFICATION_QUEUE_SIZE 4
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  mock.c
+ *
+ *  HCI connections, ATT Dispatch, L2CAP and SM replaced for ATT Server tests.
+ *  Packets sent by the ATT Server are recorded.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ble/att_dispatch.h"
+#include "ble/sm.h"
+#include "btstack_linked_list.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "l2cap.h"
+#include "mock.h"
+
+#define MOCK_MAX_PACKETS 16
+#define MOCK_MAX_PACKET_SIZE 32
+
+static hci_connection_t connections[MOCK_MAX_CONNECTIONS];
+static int num_connections;
+static btstack_linked_list_t connections_list;
+
+static btstack_packet_callback_registration_t * hci_event_callback;
+static btstack_packet_handler_t att_server_packet_handler;
+static int can_send_now;
+static hci_con_handle_t can_send_now_blocked;
+static hci_con_handle_t can_send_now_requested;
+
+static uint8_t outgoing_buffer[HCI_ACL_PAYLOAD_SIZE];
+static uint8_t packets[MOCK_MAX_PACKETS][MOCK_MAX_PACKET_SIZE];
+static uint16_t packet_sizes[MOCK_MAX_PACKETS];
+static hci_con_handle_t packet_con_handles[MOCK_MAX_PACKETS];
+static int num_packets;
+
+void mock_init(void){
+    memset(connections, 0, sizeof(connections));
+    num_connections = 0;
+    connections_list = NULL;
+    can_send_now = 1;
+    can_send_now_blocked = 0;
+    can_send_now_requested = 0;
+    num_packets = 0;
+}
+
+void mock_connect(hci_con_handle_t con_handle){
+    hci_connection_t * connection = &connections[num_connections++];
+    connection->con_handle = con_handle;
+    btstack_linked_list_add_tail(&connections_list, (btstack_linked_item_t *) connection);
+
+    uint8_t event[21];
+    memset(event, 0, sizeof(event));
+    event[0] = HCI_EVENT_LE_META;
+    event[1] = sizeof(event) - 2;
+    event[2] = HCI_SUBEVENT_LE_CONNECTION_COMPLETE;
+    little_endian_store_16(event, 4, con_handle);
+    (*hci_event_callback->callback)(HCI_EVENT_PACKET, 0, event, sizeof(event));
+}
+
+void mock_set_can_send_now(int value){
+    can_send_now = value;
+}
+
+void mock_set_can_send_now_blocked(hci_con_handle_t con_handle){
+    can_send_now_blocked = con_handle;
+}
+
+void mock_can_send_now(void){
+    if (!can_send_now_requested) return;
+    can_send_now_requested = 0;
+    uint8_t event[] = { L2CAP_EVENT_CAN_SEND_NOW, 0};
+    (*att_server_packet_handler)(HCI_EVENT_PACKET, 0, event, sizeof(event));
+}
+
+hci_con_handle_t mock_can_send_now_requested(void){
+    return can_send_now_requested;
+}
+
+void mock_receive_att_packet(hci_con_handle_t con_handle, uint8_t * packet, uint16_t size){
+    (*att_server_packet_handler)(ATT_DATA_PACKET, con_handle, packet, size);
+}
+
+int mock_num_packets_sent(void){
+    return num_packets;
+}
+
+hci_con_handle_t mock_packet_con_handle(int index){
+    return packet_con_handles[index];
+}
+
+const uint8_t * mock_packet(int index){
+    return packets[index];
+}
+
+uint16_t mock_packet_size(int index){
+    return packet_sizes[index];
+}
+
+// HCI
+void hci_add_event_handler(btstack_packet_callback_registration_t * callback_handler){
+    hci_event_callback = callback_handler;
+}
+
+hci_connection_t * hci_connection_for_handle(hci_con_handle_t con_handle){
+    int i;
+    for (i = 0; i < num_connections; i++){
+        if (connections[i].con_handle == con_handle) return &connections[i];
+    }
+    return NULL;
+}
+
+void hci_connections_get_iterator(btstack_linked_list_iterator_t *it){
+    btstack_linked_list_iterator_init(it, &connections_list);
+}
+
+// ATT Dispatch
+void att_dispatch_register_server(btstack_packet_handler_t packet_handler){
+    att_server_packet_handler = packet_handler;
+}
+
+int att_dispatch_server_can_send_now(hci_con_handle_t con_handle){
+    if (con_handle == can_send_now_blocked) return 0;
+    return can_send_now;
+}
+
+void att_dispatch_server_request_can_send_now_event(hci_con_handle_t con_handle){
+    can_send_now_requested = con_handle;
+}
+
+// L2CAP
+uint16_t l2cap_max_le_mtu(void){
+    return HCI_ACL_PAYLOAD_SIZE - L2CAP_HEADER_SIZE;
+}
+
+int l2cap_reserve_packet_buffer(void){
+    return 1;
+}
+
+void l2cap_release_packet_buffer(void){
+}
+
+uint8_t * l2cap_get_outgoing_buffer(void){
+    return outgoing_buffer;
+}
+
+int l2cap_send_prepared_connectionless(hci_con_handle_t con_handle, uint16_t cid, uint16_t len){
+    UNUSED(cid);
+    if (num_packets == MOCK_MAX_PACKETS) return BTSTACK_ACL_BUFFERS_FULL;
+    uint16_t size = btstack_min(len, MOCK_MAX_PACKET_SIZE);
+    memcpy(packets[num_packets], outgoing_buffer, size);
+    packet_sizes[num_packets] = len;
+    packet_con_handles[num_packets] = con_handle;
+    num_packets++;
+    return 0;
+}
+
+// SM
+void sm_add_event_handler(btstack_packet_callback_registration_t * callback_handler){
+    UNUSED(callback_handler);
+}
+
+int sm_authenticated(hci_con_handle_t con_handle){
+    UNUSED(con_handle);
+    return 0;
+}
+
+int sm_encryption_key_size(hci_con_handle_t con_handle){
+    UNUSED(con_handle);
+    return 0;
+}
+
+authorization_state_t sm_authorization_state(hci_con_handle_t con_handle){
+    UNUSED(con_handle);
+    return AUTHORIZATION_UNKNOWN;
+}
+
+void sm_request_pairing(hci_con_handle_t con_handle){
+    UNUSED(con_handle);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  mock.h
+ *
+ *  HCI connections, ATT Dispatch, L2CAP and SM replaced for ATT Server tests
+ */
+
+#ifndef __MOCK_H
+#define __MOCK_H
+
+#include <stdint.h>
+#include "bluetooth.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+#define MOCK_MAX_CONNECTIONS 4
+
+// remove all connections and sent packets
+void mock_init(void);
+
+// add LE connection and report LE Connection Complete
+void mock_connect(hci_con_handle_t con_handle);
+
+// if not set, ATT Dispatch reports that no packet can be sent
+void mock_set_can_send_now(int can_send_now);
+
+// ATT Dispatch reports that no packet can be sent on this connection, 0 for none
+void mock_set_can_send_now_blocked(hci_con_handle_t con_handle);
+
+// deliver L2CAP_EVENT_CAN_SEND_NOW to ATT Server if it was requested
+void mock_can_send_now(void);
+
+// con_handle of last can send now request, 0 if none pending
+hci_con_handle_t mock_can_send_now_requested(void);
+
+// ATT PDU received on con_handle
+void mock_receive_att_packet(hci_con_handle_t con_handle, uint8_t * packet, uint16_t size);
+
+// ATT PDUs sent by ATT Server since mock_init
+int             mock_num_packets_sent(void);
+hci_con_handle_t mock_packet_con_handle(int index);
+const uint8_t * mock_packet(int index);
+uint16_t        mock_packet_size(int index);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif // __MOCK_H
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+// *****************************************************************************
+//
+// AVDTP Sink jitter buffer test
+//
+// Streams an SBC encoded sine over a simulated link with jitter, reordering, 
+// packet loss and clock drift between source and sink into the jitter buffer 
+// and verifies that playback continues without underruns.
+//
+// *****************************************************************************
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+#include "btstack_sbc.h"
+#include "avdtp_sink_jitter_buffer.h"
+
+#define SAMPLE_RATE         44100
+#define NUM_CHANNELS        2
+#define FRAMES_PER_PACKET   7
+#define SAMPLES_PER_FRAME   128
+#define DURATION_MS         60000
+#define WARMUP_MS           5000
+#define MAX_JITTER_MS       30
+#define LOSS_PERIOD         50
+#define OUTPUT_PERIOD_MS    10
+#define NUM_PACKETS_IN_FLIGHT 16
+
+typedef struct {
+    uint32_t delivery_ms;
+    uint16_t len;
+    uint8_t  data[1024];
+} in_flight_packet_t;
+
+static in_flight_packet_t in_flight[NUM_PACKETS_IN_FLIGHT];
+static int num_in_flight;
+
+static avdtp_sink_jitter_buffer_t jitter_buffer;
+static btstack_sbc_encoder_state_t encoder_state;
+
+static uint32_t now_ms;
+static uint32_t random_state = 0x12345678;
+
+uint32_t btstack_run_loop_get_time_ms(void){
+    return now_ms;
+}
+
+static uint32_t next_random(void){
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 16;
+}
+
+static int send_packet(uint16_t sequence_number, uint32_t timestamp, double * phase){
+    uint8_t * packet = in_flight[num_in_flight].data;
+    packet[0] = 0x80;
+    packet[1] = 96;
+    big_endian_store_16(packet, 2, sequence_number);
+    big_endian_store_32(packet, 4, timestamp);
+    big_endian_store_32(packet, 8, 0x12345678);
+    packet[12] = FRAMES_PER_PACKET;
+    uint16_t pos = 13;
+    int i;
+    for (i=0;i<FRAMES_PER_PACKET;i++){
+        int16_t pcm[SAMPLES_PER_FRAME * NUM_CHANNELS];
+        int j;
+        for (j=0;j<SAMPLES_PER_FRAME;j++){
+            int16_t value = (int16_t) (10000 * sin(*phase));
+            *phase += 2 * M_PI * 1000 / SAMPLE_RATE;
+            pcm[j*2]   = value;
+            pcm[j*2+1] = value;
+        }
+        pos += btstack_sbc_encoder_process_data(&encoder_state, pcm, &packet[pos]);
+    }
+    // drop packet after encoding to simulate loss, loss of last packets cannot be detected
+    if ((sequence_number % LOSS_PERIOD) == LOSS_PERIOD - 1 && now_ms < DURATION_MS - 1000) return 1;
+    in_flight[num_in_flight].len = pos;
+    in_flight[num_in_flight].delivery_ms = now_ms + next_random() % MAX_JITTER_MS;
+    num_in_flight++;
+    return 0;
+}
+
+static void deliver_packets(void){
+    int i = 0;
+    while (i < num_in_flight){
+        if ((int32_t)(now_ms - in_flight[i].delivery_ms) < 0){
+            i++;
+            continue;
+        }
+        avdtp_sink_jitter_buffer_put_media_packet(&jitter_buffer, in_flight[i].data, in_flight[i].len);
+        num_in_flight--;
+        in_flight[i] = in_flight[num_in_flight];
+    }
+}
+
+static int run_test(int drift_ppm){
+    double   phase = 0;
+    uint16_t sequence_number = 0;
+    uint32_t timestamp = 0;
+    int      packets_dropped = 0;
+    double   output_frames_due = 0;
+    int      silent_frames = 0;
+    double   energy = 0;
+    int16_t  output[SAMPLE_RATE * NUM_CHANNELS / 50];
+    avdtp_sink_jitter_buffer_metrics_t metrics;
+    uint32_t underruns_after_warmup = 0;
+    int64_t  ppm_sum = 0;
+    int      ppm_count = 0;
+
+    num_in_flight = 0;
+    now_ms = 0;
+    btstack_sbc_encoder_init(&encoder_state, SBC_MODE_STANDARD, 16, 8, 0, SAMPLE_RATE, 53, SBC_CHANNEL_MODE_JOINT_STEREO);
+    avdtp_sink_jitter_buffer_init(&jitter_buffer, NUM_CHANNELS, SAMPLE_RATE);
+
+    for (now_ms = 0; now_ms < DURATION_MS; now_ms++){
+        // source sends packet when enough samples are due
+        while (timestamp + FRAMES_PER_PACKET * SAMPLES_PER_FRAME <= (uint64_t) now_ms * SAMPLE_RATE / 1000){
+            packets_dropped += send_packet(sequence_number++, timestamp, &phase);
+            timestamp += FRAMES_PER_PACKET * SAMPLES_PER_FRAME;
+        }
+        deliver_packets();
+
+        // sink plays audio with drifting clock
+        if (now_ms % OUTPUT_PERIOD_MS) continue;
+        output_frames_due += SAMPLE_RATE * (1.0 + drift_ppm / 1000000.0) * OUTPUT_PERIOD_MS / 1000;
+        int num_frames = (int) output_frames_due;
+        output_frames_due -= num_frames;
+        int frames_read = avdtp_sink_jitter_buffer_read_audio(&jitter_buffer, output, num_frames);
+        if (now_ms == WARMUP_MS){
+            avdtp_sink_jitter_buffer_get_metrics(&jitter_buffer, &metrics);
+            underruns_after_warmup = metrics.underruns;
+        }
+        if (now_ms < WARMUP_MS) continue;
+        silent_frames += num_frames - frames_read;
+        avdtp_sink_jitter_buffer_get_metrics(&jitter_buffer, &metrics);
+        ppm_sum += metrics.resampling_ppm;
+        ppm_count++;
+        int i;
+        for (i=0;i<frames_read*NUM_CHANNELS;i++){
+            energy += (double) output[i] * output[i];
+        }
+    }
+
+    avdtp_sink_jitter_buffer_get_metrics(&jitter_buffer, &metrics);
+    int ppm_avg = (int)(ppm_sum / ppm_count);
+    double rms = sqrt(energy / ((double)(DURATION_MS - WARMUP_MS) * SAMPLE_RATE / 1000 * NUM_CHANNELS));
+    printf("Drift %+5d ppm: received %u, reordered %u, lost %u/%u, late %u, concealed %u samples, underruns %u\n", 
+        drift_ppm, metrics.packets_received, metrics.packets_reordered, metrics.packets_lost, packets_dropped,
+        metrics.packets_late, metrics.samples_concealed, metrics.underruns);
+    printf("                 latency %u ms, target %u ms, jitter %u us, resampling %d ppm (avg), rms %.0f\n",
+        metrics.latency_ms, metrics.target_latency_ms, metrics.jitter_us, ppm_avg, rms);
+
+    int errors = 0;
+    if (metrics.underruns != underruns_after_warmup || silent_frames){
+        printf("FAIL: %u underruns, %u silent frames after warmup\n", metrics.underruns - underruns_after_warmup, silent_frames);
+        errors++;
+    }
+    if (metrics.packets_lost < (uint32_t) packets_dropped){
+        printf("FAIL: lost packets not detected\n");
+        errors++;
+    }
+    if (metrics.samples_concealed < (uint32_t) packets_dropped * FRAMES_PER_PACKET * SAMPLES_PER_FRAME * 9 / 10){
+        printf("FAIL: lost packets not concealed\n");
+        errors++;
+    }
+    if (abs(ppm_avg + drift_ppm) > 250){
+        printf("FAIL: resampling does not track clock drift\n");
+        errors++;
+    }
+    if (metrics.latency_ms > AVDTP_SINK_JITTER_BUFFER_MAX_LATENCY_MS + 50){
+        printf("FAIL: latency too high\n");
+        errors++;
+    }
+    if (rms < 5000){
+        printf("FAIL: output signal level %.0f too low\n", rms);
+        errors++;
+    }
+    return errors;
+}
+
+int main (void){
+    int errors = 0;
+    errors += run_test(0);
+    errors += run_test(500);
+    errors += run_test(-500);
+    printf("%s\n", errors ? "FAILED" : "OK");
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+// *****************************************************************************
+//
+// AVDTP Source benchmark
+//
+// Streams a WAV file through the AVDTP Source media path into a L2CAP loopback
+// and reports encode CPU time and media packet jitter.
+//
+// *****************************************************************************
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "btstack_config.h"
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "l2cap.h"
+#include "avdtp.h"
+#include "avdtp_source.h"
+#include "wav_util.h"
+
+#define MEDIA_CID 0x0041
+
+static uint16_t loopback_mtu = 895;
+static uint8_t  loopback_buffer[1024];
+static FILE *   sbc_file;
+
+static avdtp_stream_endpoint_t stream_endpoint;
+static btstack_timer_source_t  report_timer;
+
+static avdtp_source_sbc_configuration_t sbc_configuration = {
+    44100, SBC_CHANNEL_MODE_JOINT_STEREO, 16, 8, 0, 53
+};
+
+// loopback receiver state
+static int      num_packets;
+static int      num_frames;
+static int      sequence_errors;
+static uint16_t expected_sequence_number;
+static uint32_t first_timestamp;
+static uint64_t first_arrival_us;
+static uint64_t last_arrival_us;
+static uint32_t last_timestamp;
+static double   jitter_samples;
+static double   max_deviation_ms;
+
+// WAV file is read into memory before streaming to not measure file I/O
+static int16_t * pcm_data;
+static int       pcm_count;
+static int       pcm_offset;
+
+static clock_t  cpu_start;
+static uint64_t wall_start_us;
+
+static uint64_t time_us(void){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// L2CAP loopback
+int l2cap_can_send_packet_now(uint16_t local_cid){
+    UNUSED(local_cid);
+    return 1;
+}
+
+int l2cap_reserve_packet_buffer(void){
+    return 1;
+}
+
+void l2cap_release_packet_buffer(void){
+}
+
+uint8_t * l2cap_get_outgoing_buffer(void){
+    return loopback_buffer;
+}
+
+uint16_t l2cap_get_remote_mtu_for_local_cid(uint16_t local_cid){
+    UNUSED(local_cid);
+    return loopback_mtu;
+}
+
+int l2cap_send_prepared(uint16_t local_cid, uint16_t len){
+    UNUSED(local_cid);
+    uint64_t arrival_us = time_us();
+    uint16_t sequence_number = big_endian_read_16(loopback_buffer, 2);
+    uint32_t timestamp = big_endian_read_32(loopback_buffer, 4);
+    int frames = loopback_buffer[12] & 0x0f;
+
+    if ((loopback_buffer[0] >> 6) != 2){
+        printf("invalid RTP version in packet %u\n", num_packets);
+    }
+    if (num_packets == 0){
+        first_timestamp  = timestamp;
+        first_arrival_us = arrival_us;
+    } else {
+        if (sequence_number != expected_sequence_number) sequence_errors++;
+        // RFC 3550 interarrival jitter in samples
+        double transit_diff = (double)(arrival_us - last_arrival_us) * sbc_configuration.sampling_frequency / 1000000.0
+                            - (double)(uint32_t)(timestamp - last_timestamp);
+        if (transit_diff < 0) transit_diff = -transit_diff;
+        jitter_samples += (transit_diff - jitter_samples) / 16.0;
+        // deviation from ideal send time
+        double ideal_ms   = (double)(uint32_t)(timestamp - first_timestamp) * 1000.0 / sbc_configuration.sampling_frequency;
+        double actual_ms  = (double)(arrival_us - first_arrival_us) / 1000.0;
+        double deviation  = actual_ms > ideal_ms ? actual_ms - ideal_ms : ideal_ms - actual_ms;
+        if (deviation > max_deviation_ms) max_deviation_ms = deviation;
+    }
+    expected_sequence_number = sequence_number + 1;
+    last_timestamp  = timestamp;
+    last_arrival_us = arrival_us;
+    num_packets++;
+    num_frames += frames;
+
+    if (sbc_file){
+        fwrite(&loopback_buffer[13], 1, len - 13, sbc_file);
+    }
+    return 0;
+}
+
+static void report(btstack_timer_source_t * ts){
+    UNUSED(ts);
+    double cpu_ms  = (double)(clock() - cpu_start) * 1000.0 / CLOCKS_PER_SEC;
+    double wall_ms = (double)(time_us() - wall_start_us) / 1000.0;
+    avdtp_source_stream_stats_t stats;
+    avdtp_source_stream_get_stats(&stats);
+
+    printf("SBC frames encoded:  %u, dropped %u\n", stats.frames_encoded, stats.frames_dropped);
+    printf("Media packets:       %u, %d frames, %d sequence errors\n", stats.packets_sent, num_frames, sequence_errors);
+    printf("Encode CPU time:     %.1f ms for %.1f ms audio, %.2f us per frame, %.2f%% CPU\n",
+        cpu_ms, wall_ms, stats.frames_encoded ? cpu_ms * 1000.0 / stats.frames_encoded : 0.0, cpu_ms * 100.0 / wall_ms);
+    printf("Packet jitter:       %.3f ms (RFC 3550), max deviation from sample clock %.3f ms\n",
+        jitter_samples * 1000.0 / sbc_configuration.sampling_frequency, max_deviation_ms);
+
+    free(pcm_data);
+    if (sbc_file) fclose(sbc_file);
+    exit(0);
+}
+
+static void fill_audio(int16_t * pcm_buffer, int num_samples_per_channel, int num_channels, void * context){
+    UNUSED(context);
+    int num_samples = num_samples_per_channel * num_channels;
+    if (pcm_offset + num_samples <= pcm_count){
+        memcpy(pcm_buffer, &pcm_data[pcm_offset], num_samples * sizeof(int16_t));
+        pcm_offset += num_samples;
+        return;
+    }
+
+    // end of file, suspend stream and report
+    memset(pcm_buffer, 0, num_samples * sizeof(int16_t));
+    avdtp_source_stream_stop(&stream_endpoint);
+    stream_endpoint.state = AVDTP_STREAM_ENDPOINT_OPENED;
+    btstack_run_loop_set_timer_handler(&report_timer, &report);
+    btstack_run_loop_set_timer(&report_timer, 0);
+    btstack_run_loop_add_timer(&report_timer);
+}
+
+int main (int argc, const char * argv[]){
+    if (argc < 2){
+        printf("Usage: %s WAV_FILE [MTU] [SBC_FILE]\n", argv[0]);
+        printf("Streams 44100 Hz stereo WAV_FILE through AVDTP Source into a L2CAP loopback\n");
+        return -1;
+    }
+    if (argc > 2){
+        loopback_mtu = atoi(argv[2]);
+        if (loopback_mtu > sizeof(loopback_buffer)) loopback_mtu = sizeof(loopback_buffer);
+    }
+    if (argc > 3){
+        sbc_file = fopen(argv[3], "wb");
+    }
+    if (wav_reader_open(argv[1]) != 0){
+        printf("Can't open file %s\n", argv[1]);
+        return -1;
+    }
+    int pcm_size = 0;
+    while (1){
+        if (pcm_count + 256 > pcm_size){
+            pcm_size = pcm_size ? pcm_size * 2 : 65536;
+            pcm_data = realloc(pcm_data, pcm_size * sizeof(int16_t));
+        }
+        if (!wav_reader_read_int16(256, &pcm_data[pcm_count])) break;
+        pcm_count += 256;
+    }
+    wav_reader_close();
+
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+
+    memset(&stream_endpoint, 0, sizeof(stream_endpoint));
+    stream_endpoint.sep.seid = 1;
+    stream_endpoint.sep.type = AVDTP_SOURCE;
+    stream_endpoint.l2cap_media_cid = MEDIA_CID;
+    stream_endpoint.state = AVDTP_STREAM_ENDPOINT_STREAMING;
+
+    printf("Streaming %s, %.1f s, MTU %u\n", argv[1], (double) pcm_count / 2 / sbc_configuration.sampling_frequency, loopback_mtu);
+    cpu_start = clock();
+    wall_start_us = time_us();
+    avdtp_source_stream_start(&stream_endpoint, &sbc_configuration, &fill_audio, NULL);
+
+    btstack_run_loop_execute();
+    return 0;
+}
@@ -23,6 +23,7 @@
 #define ENABLE_LE_SIGNED_WRITE
 #define ENABLE_LE_PERIPHERAL
 #define ENABLE_LE_CENTRAL
+#define ENABLE_GATT_CLIENT_CACHE
 
 // BTstack configuration. buffers, sizes, ...
 #define HCI_ACL_PAYLOAD_SIZE 52
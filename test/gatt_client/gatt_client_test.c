@@ -20,6 +20,7 @@
 #include "hci.h"
 #include "hci_dump.h"
 #include "ble/gatt_client.h"
+#include "ble/gatt_client_cache_memory.h"
 #include "ble/att_db.h"
 #include "profile.h"
 #include "expected_results.h"
@@ -71,8 +72,15 @@ static gatt_client_service_t included_services[50];
 static gatt_client_characteristic_t characteristics[50];
 static gatt_client_characteristic_descriptor_t descriptors[50];
 
+static uint16_t completed_operations[10];
+static int      completed_operations_count;
+
 void mock_simulate_discover_primary_services_response(void);
 void mock_simulate_att_exchange_mtu_response(void);
+void mock_set_le_device_index(int index);
+void mock_simulate_disconnect(void);
+void mock_simulate_att_indication(uint16_t attribute_handle);
+extern int mock_att_requests_sent;
 
 void CHECK_EQUAL_ARRAY(const uint8_t * expected, uint8_t * actual, int size){
 	for (int i=0; i<size; i++){
@@ -211,6 +219,10 @@ static void handle_ble_client_event(uint8_t packet_type, uint16_t channel, uint8
         	verify_blob(little_endian_read_16(packet, 8), little_endian_read_16(packet, 6), &packet[10]);
         	result_counter++;
         	break;
+        case GATT_EVENT_OPERATION_COMPLETE:
+            CHECK_EQUAL(0, packet[6]);
+            completed_operations[completed_operations_count++] = little_endian_read_16(packet, 4);
+            break;
 	}
 }
 
@@ -698,6 +710,112 @@ TEST(GATTClient, TestWriteReliableLongCharacteristicValue){
 	CHECK_EQUAL(gatt_query_complete, 1);
 }
 
+TEST(GATTClient, TestQueuedOperations){
+	test = READ_CHARACTERISTIC_VALUE;
+	reset_query_state();
+	status = gatt_client_discover_primary_services_by_uuid16(handle_ble_client_event, gatt_client_handle, service_uuid16);
+	CHECK_EQUAL(status, 0);
+	CHECK_EQUAL(gatt_query_complete, 1);
+
+	reset_query_state();
+	status = gatt_client_discover_characteristics_for_service_by_uuid16(handle_ble_client_event, gatt_client_handle, &services[0], 0xF100);
+	CHECK_EQUAL(status, 0);
+	CHECK_EQUAL(gatt_query_complete, 1);
+
+	reset_query_state();
+	gatt_client_operation_t operations[3];
+	memset(operations, 0, sizeof(operations));
+	operations[0].type = GATT_CLIENT_OPERATION_READ_VALUE;
+	operations[0].start_handle = characteristics[0].value_handle;
+	operations[1].type = GATT_CLIENT_OPERATION_WRITE_WITHOUT_RESPONSE;
+	operations[1].start_handle = characteristics[0].value_handle;
+	operations[1].value_length = short_value_length;
+	operations[1].value = (uint8_t *) short_value;
+	operations[2] = operations[0];
+	completed_operations_count = 0;
+	for (int i=0;i<3;i++){
+		status = gatt_client_queue_operation(handle_ble_client_event, gatt_client_handle, &operations[i]);
+		CHECK_EQUAL(status, 0);
+	}
+	CHECK_EQUAL(3, completed_operations_count);
+	for (int i=0;i<3;i++){
+		CHECK_EQUAL(operations[i].operation_id, completed_operations[i]);
+	}
+	CHECK_EQUAL(result_counter, 6);
+	// query complete is replaced by operation complete
+	CHECK_EQUAL(gatt_query_complete, 0);
+}
+TEST(GATTClient, TestDiscoveryCache){
+	test = DISCOVER_PRIMARY_SERVICES;
+	mock_set_le_device_index(0);
+	gatt_client_set_cache(gatt_client_cache_memory_instance());
+
+	reset_query_state();
+	status = gatt_client_discover_primary_services(handle_ble_client_event, gatt_client_handle);
+	CHECK_EQUAL(status, 0);
+	CHECK_EQUAL(gatt_query_complete, 1);
+	verify_primary_services();
+
+	// same query is answered without ATT requests
+	reset_query_state();
+	mock_att_requests_sent = 0;
+	status = gatt_client_discover_primary_services(handle_ble_client_event, gatt_client_handle);
+	CHECK_EQUAL(status, 0);
+	CHECK_EQUAL(gatt_query_complete, 1);
+	CHECK_EQUAL(mock_att_requests_sent, 0);
+	verify_primary_services();
+
+	gatt_client_set_cache(NULL);
+	mock_set_le_device_index(-1);
+}
+
+TEST(GATTClient, TestDiscoveryCacheServiceChanged){
+	const uint16_t service_changed_handle = 0x0099;
+	const gatt_client_cache_t * cache = gatt_client_cache_memory_instance();
+	test = DISCOVER_PRIMARY_SERVICES;
+	mock_set_le_device_index(0);
+	gatt_client_set_cache(cache);
+
+	// handle discovered in an earlier connection
+	cache->put_service_changed_handle(0, service_changed_handle);
+	mock_simulate_disconnect();
+
+	for (int i=0;i<2;i++){
+		reset_query_state();
+		status = gatt_client_discover_primary_services(handle_ble_client_event, gatt_client_handle);
+		CHECK_EQUAL(status, 0);
+		CHECK_EQUAL(gatt_query_complete, 1);
+
+		// answered from cache
+		reset_query_state();
+		mock_att_requests_sent = 0;
+		status = gatt_client_discover_primary_services(handle_ble_client_event, gatt_client_handle);
+		CHECK_EQUAL(status, 0);
+		CHECK_EQUAL(mock_att_requests_sent, 0);
+
+		// other indications keep the cache, every Service Changed indication clears it
+		mock_simulate_att_indication(service_changed_handle + 1);
+		CHECK_EQUAL(service_changed_handle, cache->get_service_changed_handle(0));
+		reset_query_state();
+		mock_att_requests_sent = 0;
+		status = gatt_client_discover_primary_services(handle_ble_client_event, gatt_client_handle);
+		CHECK_EQUAL(mock_att_requests_sent, 0);
+
+		mock_simulate_att_indication(service_changed_handle);
+		CHECK_EQUAL(service_changed_handle, cache->get_service_changed_handle(0));
+		reset_query_state();
+		mock_att_requests_sent = 0;
+		status = gatt_client_discover_primary_services(handle_ble_client_event, gatt_client_handle);
+		CHECK_EQUAL(status, 0);
+		CHECK_EQUAL(gatt_query_complete, 1);
+		CHECK_TRUE(mock_att_requests_sent > 0);
+		verify_primary_services();
+		mock_simulate_disconnect();
+	}
+
+	gatt_client_set_cache(NULL);
+	mock_set_le_device_index(-1);
+}
 
 int main (int argc, const char * argv[]){
 	att_set_db(profile_data);
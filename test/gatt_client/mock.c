@@ -18,6 +18,12 @@ static btstack_linked_list_t     connections;
 static const uint16_t max_mtu = 23;
 static uint8_t  l2cap_stack_buffer[HCI_INCOMING_PRE_BUFFER_SIZE + 8 + max_mtu];	// pre buffer + HCI Header + L2CAP header
 uint16_t gatt_client_handle = 0x40;
+static int le_device_index = -1;
+int mock_att_requests_sent;
+
+void mock_set_le_device_index(int index){
+	le_device_index = index;
+}
 
 uint16_t get_gatt_client_handle(void){
 	return gatt_client_handle;
@@ -38,6 +44,16 @@ void mock_simulate_connected(void){
 	registered_hci_event_handler(HCI_EVENT_PACKET, 0, (uint8_t *)&packet, sizeof(packet));
 }
 
+void mock_simulate_disconnect(void){
+	uint8_t packet[] = {HCI_EVENT_DISCONNECTION_COMPLETE, 4, 0, (uint8_t) (gatt_client_handle & 0xff), (uint8_t) (gatt_client_handle >> 8), 0x13};
+	registered_hci_event_handler(HCI_EVENT_PACKET, 0, (uint8_t *)&packet, sizeof(packet));
+}
+
+void mock_simulate_att_indication(uint16_t attribute_handle){
+	uint8_t packet[] = {ATT_HANDLE_VALUE_INDICATION, (uint8_t) (attribute_handle & 0xff), (uint8_t) (attribute_handle >> 8), 0x01, 0x00, 0xff, 0xff};
+	att_packet_handler(ATT_DATA_PACKET, gatt_client_handle, (uint8_t *)&packet, sizeof(packet));
+}
+
 void mock_simulate_scan_response(void){
 	uint8_t packet[] = {0xE2, 0x13, 0xE2, 0x01, 0x34, 0xB1, 0xF7, 0xD1, 0x77, 0x9B, 0xCC, 0x09, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
 	registered_hci_event_handler(HCI_EVENT_PACKET, 0, (uint8_t *)&packet, sizeof(packet));
@@ -50,6 +66,9 @@ void gap_stop_scan(void){
 uint8_t gap_connect(bd_addr_t addr, bd_addr_type_t addr_type){
 	return 0;
 }
+void gap_local_bd_addr(bd_addr_t address_buffer){
+	memset(address_buffer, 0, 6);
+}
 void gap_set_scan_parameters(uint8_t scan_type, uint16_t scan_interval, uint16_t scan_window){
 }
 
@@ -110,6 +129,7 @@ void l2cap_request_can_send_fix_channel_now_event(uint16_t handle, uint16_t chan
 int l2cap_send_prepared_connectionless(uint16_t handle, uint16_t cid, uint16_t len){
 	att_connection_t att_connection;
 	att_init_connection(&att_connection);
+	mock_att_requests_sent++;
 	uint8_t response[max_mtu];
 	uint16_t response_len = att_handle_request(&att_connection, l2cap_get_outgoing_buffer(), len, &response[0]);
 	if (response_len){
@@ -125,7 +145,7 @@ void sm_cmac_signed_write_start(const sm_key_t key, uint8_t opcode, uint16_t att
 	//sm_notify_client(SM_EVENT_IDENTITY_RESOLVING_SUCCEEDED, sm_central_device_addr_type, sm_central_device_address, 0, sm_central_device_matched);      
 }
 int sm_le_device_index(uint16_t handle ){
-	return -1;
+	return le_device_index;
 }
 
 void btstack_run_loop_set_timer(btstack_timer_source_t *a, uint32_t timeout_in_ms){
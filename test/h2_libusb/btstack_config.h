@@ -0,0 +1,24 @@
+//
+// btstack_config.h for libusb H2 transport benchmark
+//
+
+#ifndef __BTSTACK_CONFIG
+#define __BTSTACK_CONFIG
+
+// Port related features
+#define HAVE_MALLOC
+#define HAVE_POSIX_TIME
+
+// BTstack features that can be enabled
+#define ENABLE_CLASSIC
+#define ENABLE_LOG_ERROR
+
+// BTstack configuration. buffers, sizes, ...
+#define HCI_ACL_PAYLOAD_SIZE 1021
+#define HCI_INCOMING_PRE_BUFFER_SIZE 4
+
+// emulated controller
+#define USB_VENDOR_ID  0x0a12
+#define USB_PRODUCT_ID 0x0001
+
+#endif
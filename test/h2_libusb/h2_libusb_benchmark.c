@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  h2_libusb_benchmark.c
+ *
+ *  Measures ACL throughput of the libusb H2 transport against an emulated USB Controller (libusb_stub.c)
+ *
+ *  usage: h2_libusb_benchmark [nr_packets] [pollfds|polling] [latency_us] [bytes_per_ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libusb.h>
+
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_transport.h"
+
+#define BENCHMARK_HANDLE 0x0001
+
+// defaults of hci_transport_h2_libusb.c, only used for reporting
+#ifndef HCI_TRANSPORT_USB_ACL_IN_BUFFER_COUNT
+#define HCI_TRANSPORT_USB_ACL_IN_BUFFER_COUNT 8
+#endif
+#ifndef HCI_TRANSPORT_USB_ACL_OUT_BUFFER_COUNT
+#define HCI_TRANSPORT_USB_ACL_OUT_BUFFER_COUNT 4
+#endif
+
+static int nr_packets = 2000;
+static int polling;
+static uint32_t latency_us   = 1000;
+static uint32_t bytes_per_ms = 1000;
+
+static const hci_transport_t * transport;
+static uint8_t  acl_packet[HCI_ACL_BUFFER_SIZE];
+static int      packets_sent;
+static int      packets_acked;
+static int      packets_received;
+static int      packets_invalid;
+static uint64_t start_ns;
+static btstack_timer_source_t start_timer;
+
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char * direction){
+    double duration_ms = (now_ns() - start_ns) / 1e6;
+    int bytes = nr_packets * HCI_ACL_PAYLOAD_SIZE;
+    printf("ACL %-3s, %-7s, %u in / %u out transfers: %u packets, %u bytes, %.0f ms, %.1f kB/s\n",
+        direction, polling ? "polling" : "pollfds", HCI_TRANSPORT_USB_ACL_IN_BUFFER_COUNT, HCI_TRANSPORT_USB_ACL_OUT_BUFFER_COUNT,
+        nr_packets, bytes, duration_ms, bytes / duration_ms);
+}
+
+static void send_packets(void){
+    while (packets_sent < nr_packets && transport->can_send_packet_now(HCI_ACL_DATA_PACKET)){
+        little_endian_store_16(acl_packet, 0, BENCHMARK_HANDLE);
+        little_endian_store_16(acl_packet, 2, HCI_ACL_PAYLOAD_SIZE);
+        memset(&acl_packet[4], packets_sent, HCI_ACL_PAYLOAD_SIZE);
+        packets_sent++;
+        transport->send_packet(HCI_ACL_DATA_PACKET, acl_packet, sizeof(acl_packet));
+    }
+}
+
+static int packet_valid(int packet_nr, const uint8_t * packet, uint16_t size){
+    if (size != HCI_ACL_BUFFER_SIZE) return 0;
+    if (little_endian_read_16(packet, 2) != HCI_ACL_PAYLOAD_SIZE) return 0;
+    int i;
+    for (i = 0; i < HCI_ACL_PAYLOAD_SIZE; i++){
+        if (packet[4 + i] != (uint8_t) (packet_nr + i)) return 0;
+    }
+    return 1;
+}
+
+static void packet_handler(uint8_t packet_type, uint8_t * packet, uint16_t size){
+    switch (packet_type){
+        case HCI_EVENT_PACKET:
+            if (packet[0] != HCI_EVENT_TRANSPORT_PACKET_SENT) break;
+            packets_acked++;
+            if (packets_acked < nr_packets){
+                send_packets();
+                break;
+            }
+            report("out");
+            // controller sends same amount of data
+            start_ns = now_ns();
+            libusb_stub_send_acl_packets(nr_packets, HCI_ACL_PAYLOAD_SIZE);
+            break;
+        case HCI_ACL_DATA_PACKET:
+            if (!packet_valid(packets_received, packet, size)){
+                packets_invalid++;
+            }
+            packets_received++;
+            if (packets_received < nr_packets) break;
+            report("in");
+            if (packets_invalid){
+                printf("%u invalid packets received\n", packets_invalid);
+                exit(1);
+            }
+            exit(0);
+            break;
+        default:
+            break;
+    }
+}
+
+static void start_benchmark(btstack_timer_source_t * ts){
+    start_ns = now_ns();
+    send_packets();
+}
+
+int main(int argc, const char * argv[]){
+    if (argc > 1) nr_packets = atoi(argv[1]);
+    if (argc > 2) polling = strcmp(argv[2], "polling") == 0;
+    if (argc > 3) latency_us = atoi(argv[3]);
+    if (argc > 4) bytes_per_ms = atoi(argv[4]);
+    if (nr_packets < 1 || bytes_per_ms < 1){
+        printf("usage: %s [nr_packets] [pollfds|polling] [latency_us] [bytes_per_ms]\n", argv[0]);
+        return 1;
+    }
+
+    libusb_stub_set_timing(latency_us, bytes_per_ms);
+    libusb_stub_set_pollfds_enabled(!polling);
+
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    transport = hci_transport_usb_instance();
+    transport->register_packet_handler(&packet_handler);
+    if (transport->open()){
+        printf("failed to open transport\n");
+        return 1;
+    }
+
+    btstack_run_loop_set_timer_handler(&start_timer, &start_benchmark);
+    btstack_run_loop_set_timer(&start_timer, 0);
+    btstack_run_loop_add_timer(&start_timer);
+    btstack_run_loop_execute();
+    return 0;
+}
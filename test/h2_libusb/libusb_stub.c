@@ -0,0 +1,439 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  libusb_stub.c
+ *
+ *  Emulated USB Bluetooth Controller for hci_transport_h2_libusb.c benchmark
+ *
+ *  Transfers on an endpoint complete in order after the configured latency and share the configured bandwidth.
+ *  Completions are signaled via a timerfd, unless polling is forced.
+ */
+
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libusb.h"
+
+#define STUB_MAX_PENDING 64
+#define STUB_ACL_IN_ENDPOINT 0x82
+
+struct libusb_device {
+    int dummy;
+};
+
+struct libusb_device_handle {
+    libusb_device * device;
+};
+
+typedef struct {
+    struct libusb_transfer * transfer;
+    uint64_t completion_us;     // 0 = no data yet
+    int      cancelled;
+} stub_pending_t;
+
+static libusb_device         stub_device;
+static libusb_device_handle  stub_handle = { &stub_device };
+
+static stub_pending_t stub_pending[STUB_MAX_PENDING];
+static int            stub_num_pending;
+
+static uint32_t stub_latency_us    = 1000;
+static uint32_t stub_bytes_per_ms  = 1000;
+static int      stub_pollfds_enabled = 1;
+static int      stub_timer_fd = -1;
+static struct libusb_pollfd stub_pollfd;
+
+// per direction: time bus is busy until
+static uint64_t stub_out_busy_us;
+static uint64_t stub_in_busy_us;
+
+// ACL IN data
+static int      stub_acl_in_remaining;
+static int      stub_acl_in_sent;
+static uint16_t stub_acl_in_payload_size;
+
+static uint64_t stub_now_us(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint64_t stub_transfer_time_us(int len){
+    return (uint64_t) len * 1000 / stub_bytes_per_ms;
+}
+
+static void stub_update_timer(void){
+    if (stub_timer_fd < 0) return;
+    // earliest completion, cancelled transfers complete right away
+    uint64_t next = 0;
+    int i;
+    for (i = 0; i < stub_num_pending; i++){
+        uint64_t t = stub_pending[i].cancelled ? 1 : stub_pending[i].completion_us;
+        if (t == 0) continue;
+        if (next == 0 || t < next) next = t;
+    }
+    // absolute monotonic time, zero disarms timer
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec  = next / 1000000;
+    its.it_value.tv_nsec = (next % 1000000) * 1000;
+    timerfd_settime(stub_timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// schedule ACL IN transfers waiting for data in order of submission
+static void stub_schedule_acl_in(void){
+    uint64_t now = stub_now_us();
+    int i;
+    for (i = 0; i < stub_num_pending && stub_acl_in_remaining; i++){
+        stub_pending_t * pending = &stub_pending[i];
+        if (pending->transfer->endpoint != STUB_ACL_IN_ENDPOINT) continue;
+        if (pending->completion_us || pending->cancelled) continue;
+        uint16_t len = 4 + stub_acl_in_payload_size;
+        uint64_t start = now + stub_latency_us;
+        if (start < stub_in_busy_us) start = stub_in_busy_us;
+        stub_in_busy_us = start + stub_transfer_time_us(len);
+        pending->completion_us = stub_in_busy_us;
+        stub_acl_in_remaining--;
+    }
+}
+
+static void stub_fill_acl_in(struct libusb_transfer * transfer){
+    uint8_t * buffer = transfer->buffer;
+    int packet_nr = stub_acl_in_sent++;
+    buffer[0] = 0x01;
+    buffer[1] = 0x20;
+    buffer[2] = stub_acl_in_payload_size & 0xff;
+    buffer[3] = stub_acl_in_payload_size >> 8;
+    int i;
+    for (i = 0; i < stub_acl_in_payload_size; i++){
+        buffer[4 + i] = (uint8_t) (packet_nr + i);
+    }
+    transfer->actual_length = 4 + stub_acl_in_payload_size;
+}
+
+void libusb_stub_set_timing(uint32_t latency_us, uint32_t bytes_per_ms){
+    stub_latency_us   = latency_us;
+    stub_bytes_per_ms = bytes_per_ms;
+}
+
+void libusb_stub_set_pollfds_enabled(int enabled){
+    stub_pollfds_enabled = enabled;
+}
+
+void libusb_stub_send_acl_packets(int num_packets, uint16_t payload_size){
+    stub_acl_in_remaining    = num_packets;
+    stub_acl_in_payload_size = payload_size;
+    stub_schedule_acl_in();
+    stub_update_timer();
+}
+
+int libusb_init(libusb_context **ctx){
+    (void) ctx;
+    stub_num_pending = 0;
+    stub_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    return stub_timer_fd < 0 ? LIBUSB_ERROR_IO : LIBUSB_SUCCESS;
+}
+
+void libusb_exit(libusb_context *ctx){
+    (void) ctx;
+    if (stub_timer_fd >= 0){
+        close(stub_timer_fd);
+        stub_timer_fd = -1;
+    }
+}
+
+void libusb_set_debug(libusb_context *ctx, int level){
+    (void) ctx;
+    (void) level;
+}
+
+const char * libusb_error_name(int errcode){
+    (void) errcode;
+    return "LIBUSB_STUB_ERROR";
+}
+
+ssize_t libusb_get_device_list(libusb_context *ctx, libusb_device ***list){
+    (void) ctx;
+    static libusb_device * devices[] = { &stub_device, NULL};
+    *list = devices;
+    return 1;
+}
+
+void libusb_free_device_list(libusb_device **list, int unref_devices){
+    (void) list;
+    (void) unref_devices;
+}
+
+int libusb_get_device_descriptor(libusb_device *dev, struct libusb_device_descriptor *desc){
+    (void) dev;
+    memset(desc, 0, sizeof(struct libusb_device_descriptor));
+    desc->bDeviceClass    = 0xe0;
+    desc->bDeviceSubClass = 0x01;
+    desc->bDeviceProtocol = 0x01;
+    return 0;
+}
+
+int libusb_get_active_config_descriptor(libusb_device *dev, struct libusb_config_descriptor **config){
+    (void) dev;
+    (void) config;
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+
+void libusb_free_config_descriptor(struct libusb_config_descriptor *config){
+    (void) config;
+}
+
+uint8_t libusb_get_bus_number(libusb_device *dev){
+    (void) dev;
+    return 1;
+}
+
+uint8_t libusb_get_device_address(libusb_device *dev){
+    (void) dev;
+    return 1;
+}
+
+int libusb_get_port_numbers(libusb_device *dev, uint8_t* port_numbers, int port_numbers_len){
+    (void) dev;
+    if (port_numbers_len < 1) return 0;
+    port_numbers[0] = 1;
+    return 1;
+}
+
+int libusb_open(libusb_device *dev, libusb_device_handle **handle){
+    (void) dev;
+    *handle = &stub_handle;
+    return 0;
+}
+
+libusb_device_handle * libusb_open_device_with_vid_pid(libusb_context *ctx, uint16_t vendor_id, uint16_t product_id){
+    (void) ctx;
+    (void) vendor_id;
+    (void) product_id;
+    return &stub_handle;
+}
+
+void libusb_close(libusb_device_handle *dev_handle){
+    (void) dev_handle;
+}
+
+libusb_device * libusb_get_device(libusb_device_handle *dev_handle){
+    return dev_handle->device;
+}
+
+int libusb_reset_device(libusb_device_handle *dev_handle){
+    (void) dev_handle;
+    return 0;
+}
+
+int libusb_kernel_driver_active(libusb_device_handle *dev_handle, int interface_number){
+    (void) dev_handle;
+    (void) interface_number;
+    return 0;
+}
+
+int libusb_detach_kernel_driver(libusb_device_handle *dev_handle, int interface_number){
+    (void) dev_handle;
+    (void) interface_number;
+    return 0;
+}
+
+int libusb_attach_kernel_driver(libusb_device_handle *dev_handle, int interface_number){
+    (void) dev_handle;
+    (void) interface_number;
+    return 0;
+}
+
+int libusb_set_configuration(libusb_device_handle *dev_handle, int configuration){
+    (void) dev_handle;
+    (void) configuration;
+    return 0;
+}
+
+int libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number){
+    (void) dev_handle;
+    (void) interface_number;
+    return 0;
+}
+
+int libusb_release_interface(libusb_device_handle *dev_handle, int interface_number){
+    (void) dev_handle;
+    (void) interface_number;
+    return 0;
+}
+
+int libusb_set_interface_alt_setting(libusb_device_handle *dev_handle, int interface_number, int alternate_setting){
+    (void) dev_handle;
+    (void) interface_number;
+    (void) alternate_setting;
+    return 0;
+}
+
+int libusb_clear_halt(libusb_device_handle *dev_handle, unsigned char endpoint){
+    (void) dev_handle;
+    (void) endpoint;
+    return 0;
+}
+
+struct libusb_transfer * libusb_alloc_transfer(int iso_packets){
+    return calloc(1, sizeof(struct libusb_transfer) + iso_packets * sizeof(struct libusb_iso_packet_descriptor));
+}
+
+void libusb_free_transfer(struct libusb_transfer *transfer){
+    if (!transfer) return;
+    if (transfer->flags & LIBUSB_TRANSFER_FREE_BUFFER){
+        free(transfer->buffer);
+    }
+    free(transfer);
+}
+
+int libusb_submit_transfer(struct libusb_transfer *transfer){
+    if (stub_num_pending >= STUB_MAX_PENDING) return LIBUSB_ERROR_BUSY;
+    stub_pending_t * pending = &stub_pending[stub_num_pending++];
+    pending->transfer      = transfer;
+    pending->cancelled     = 0;
+    pending->completion_us = 0;
+    transfer->status = LIBUSB_TRANSFER_COMPLETED;
+    transfer->actual_length = 0;
+
+    if (transfer->endpoint & 0x80){
+        // IN: ACL data if available, events and SCO are not emulated
+        if (transfer->endpoint == STUB_ACL_IN_ENDPOINT){
+            stub_schedule_acl_in();
+        }
+    } else {
+        // OUT: commands and ACL packets share bandwidth
+        uint64_t start = stub_now_us() + stub_latency_us;
+        if (start < stub_out_busy_us) start = stub_out_busy_us;
+        stub_out_busy_us = start + stub_transfer_time_us(transfer->length);
+        pending->completion_us = stub_out_busy_us;
+        transfer->actual_length = transfer->length;
+    }
+    stub_update_timer();
+    return LIBUSB_SUCCESS;
+}
+
+int libusb_cancel_transfer(struct libusb_transfer *transfer){
+    int i;
+    for (i = 0; i < stub_num_pending; i++){
+        if (stub_pending[i].transfer != transfer) continue;
+        stub_pending[i].cancelled = 1;
+        stub_update_timer();
+        return LIBUSB_SUCCESS;
+    }
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+
+int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv){
+    (void) ctx;
+    (void) tv;
+
+    // clear timer fd
+    uint64_t expirations;
+    if (stub_timer_fd >= 0){
+        ssize_t res = read(stub_timer_fd, &expirations, sizeof(expirations));
+        (void) res;
+    }
+
+    // complete due transfers in order of completion time
+    while (1){
+        uint64_t now = stub_now_us();
+        int next = -1;
+        int i;
+        for (i = 0; i < stub_num_pending; i++){
+            stub_pending_t * pending = &stub_pending[i];
+            if (pending->cancelled){
+                next = i;
+                break;
+            }
+            if (pending->completion_us == 0 || pending->completion_us > now) continue;
+            if (next < 0 || pending->completion_us < stub_pending[next].completion_us){
+                next = i;
+            }
+        }
+        if (next < 0) break;
+
+        struct libusb_transfer * transfer = stub_pending[next].transfer;
+        int cancelled = stub_pending[next].cancelled;
+        stub_num_pending--;
+        memmove(&stub_pending[next], &stub_pending[next+1], (stub_num_pending - next) * sizeof(stub_pending_t));
+
+        if (cancelled){
+            transfer->status = LIBUSB_TRANSFER_CANCELLED;
+        } else if (transfer->endpoint == STUB_ACL_IN_ENDPOINT){
+            stub_fill_acl_in(transfer);
+        }
+        transfer->callback(transfer);
+    }
+    stub_update_timer();
+    return 0;
+}
+
+int libusb_pollfds_handle_timeouts(libusb_context *ctx){
+    (void) ctx;
+    return 1;
+}
+
+int libusb_get_next_timeout(libusb_context *ctx, struct timeval *tv){
+    (void) ctx;
+    (void) tv;
+    return 0;
+}
+
+const struct libusb_pollfd ** libusb_get_pollfds(libusb_context *ctx){
+    (void) ctx;
+    if (!stub_pollfds_enabled) return NULL;
+    // caller frees list
+    const struct libusb_pollfd ** list = malloc(2 * sizeof(struct libusb_pollfd *));
+    stub_pollfd.fd     = stub_timer_fd;
+    stub_pollfd.events = POLLIN;
+    list[0] = &stub_pollfd;
+    list[1] = NULL;
+    return list;
+}
+
+void libusb_set_pollfd_notifiers(libusb_context *ctx, libusb_pollfd_added_cb added_cb, libusb_pollfd_removed_cb removed_cb, void *user_data){
+    (void) ctx;
+    (void) added_cb;
+    (void) removed_cb;
+    (void) user_data;
+}
@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  h5_benchmark.c
+ *
+ *  Measures H5 throughput between two H5 transport instances connected via a pseudo terminal
+ *
+ *  Optionally, the receiver delays each write to emulate the latency of e.g. an USB-to-serial adapter
+ *
+ *  usage: h5_benchmark [nr_packets] [bytewise|streaming] [latency_ms]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_uart_block.h"
+#include "hci.h"
+#include "hci_transport.h"
+
+#ifndef HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE
+#define HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE 1
+#endif
+#ifdef ENABLE_H5_DATA_INTEGRITY_CHECK
+#define BENCHMARK_CRC 1
+#else
+#define BENCHMARK_CRC 0
+#endif
+
+#define BENCHMARK_BAUDRATE 921600
+#define BENCHMARK_HANDLE   0x0001
+
+static int nr_packets = 2000;
+static int bytewise;
+static int latency_ms;
+
+static const hci_transport_t * transport;
+static uint8_t   acl_packet[HCI_ACL_HEADER_SIZE + HCI_ACL_PAYLOAD_SIZE];
+static int       link_active;
+static int       packets_sent;
+static int       packets_acked;
+static int       packets_received;
+static int       packets_invalid;
+static uint64_t  start_ns;
+static btstack_timer_source_t done_timer;
+
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fill_packet(int packet_nr){
+    little_endian_store_16(acl_packet, 0, BENCHMARK_HANDLE);
+    little_endian_store_16(acl_packet, 2, HCI_ACL_PAYLOAD_SIZE);
+    int i;
+    for (i = 0; i < HCI_ACL_PAYLOAD_SIZE; i++){
+        acl_packet[HCI_ACL_HEADER_SIZE + i] = (uint8_t) (packet_nr + i);
+    }
+}
+
+static int packet_valid(int packet_nr, const uint8_t * packet, uint16_t size){
+    if (size != sizeof(acl_packet)) return 0;
+    if (little_endian_read_16(packet, 2) != HCI_ACL_PAYLOAD_SIZE) return 0;
+    int i;
+    for (i = 0; i < HCI_ACL_PAYLOAD_SIZE; i++){
+        if (packet[HCI_ACL_HEADER_SIZE + i] != (uint8_t) (packet_nr + i)) return 0;
+    }
+    return 1;
+}
+
+// UART driver for master side of pseudo terminal
+static btstack_data_source_t pty_data_source;
+static const uint8_t * pty_write_data;
+static uint16_t        pty_write_len;
+static uint8_t *       pty_read_data;
+static uint16_t        pty_read_len;
+static int             pty_read_partial;
+static btstack_timer_source_t pty_write_timer;
+static void (*pty_block_sent)(void);
+static void (*pty_block_received)(void);
+static void (*pty_bytes_received)(uint16_t num_bytes);
+
+static void pty_process(btstack_data_source_t * ds, btstack_data_source_callback_type_t callback_type){
+    ssize_t res;
+    switch (callback_type){
+        case DATA_SOURCE_CALLBACK_READ:
+            if (pty_read_len == 0) return;
+            res = read(ds->fd, pty_read_data, pty_read_len);
+            if (res <= 0) return;
+            if (pty_read_partial){
+                pty_read_len = 0;
+                btstack_run_loop_disable_data_source_callbacks(ds, DATA_SOURCE_CALLBACK_READ);
+                (*pty_bytes_received)((uint16_t) res);
+                return;
+            }
+            pty_read_data += res;
+            pty_read_len  -= res;
+            if (pty_read_len) return;
+            btstack_run_loop_disable_data_source_callbacks(ds, DATA_SOURCE_CALLBACK_READ);
+            (*pty_block_received)();
+            break;
+        case DATA_SOURCE_CALLBACK_WRITE:
+            if (pty_write_len == 0) return;
+            res = write(ds->fd, pty_write_data, pty_write_len);
+            if (res <= 0) return;
+            pty_write_data += res;
+            pty_write_len  -= res;
+            if (pty_write_len) return;
+            btstack_run_loop_disable_data_source_callbacks(ds, DATA_SOURCE_CALLBACK_WRITE);
+            (*pty_block_sent)();
+            break;
+        default:
+            break;
+    }
+}
+
+static int pty_init(const btstack_uart_config_t * config){
+    return 0;
+}
+
+static int pty_open(void){
+    fcntl(pty_data_source.fd, F_SETFL, O_NONBLOCK);
+    btstack_run_loop_set_data_source_handler(&pty_data_source, &pty_process);
+    btstack_run_loop_add_data_source(&pty_data_source);
+    return 0;
+}
+
+static int pty_close(void){
+    btstack_run_loop_remove_data_source(&pty_data_source);
+    close(pty_data_source.fd);
+    return 0;
+}
+
+static void pty_set_block_received(void (*handler)(void)){
+    pty_block_received = handler;
+}
+
+static void pty_set_block_sent(void (*handler)(void)){
+    pty_block_sent = handler;
+}
+
+static void pty_set_bytes_received(void (*handler)(uint16_t num_bytes)){
+    pty_bytes_received = handler;
+}
+
+static int pty_set_baudrate(uint32_t baudrate){
+    return 0;
+}
+
+static int pty_set_parity(int parity){
+    return 0;
+}
+
+static void pty_receive(uint8_t * buffer, uint16_t len, int partial){
+    pty_read_data = buffer;
+    pty_read_len  = len;
+    pty_read_partial = partial;
+    btstack_run_loop_enable_data_source_callbacks(&pty_data_source, DATA_SOURCE_CALLBACK_READ);
+}
+
+static void pty_receive_block(uint8_t * buffer, uint16_t len){
+    pty_receive(buffer, len, 0);
+}
+
+static void pty_receive_bytes(uint8_t * buffer, uint16_t max_len){
+    pty_receive(buffer, max_len, 1);
+}
+
+static void pty_start_write(btstack_timer_source_t * ts){
+    btstack_run_loop_enable_data_source_callbacks(&pty_data_source, DATA_SOURCE_CALLBACK_WRITE);
+}
+
+static void pty_send_block(const uint8_t * data, uint16_t size){
+    pty_write_data = data;
+    pty_write_len  = size;
+    if (latency_ms){
+        btstack_run_loop_set_timer_handler(&pty_write_timer, &pty_start_write);
+        btstack_run_loop_set_timer(&pty_write_timer, latency_ms);
+        btstack_run_loop_add_timer(&pty_write_timer);
+    } else {
+        pty_start_write(NULL);
+    }
+}
+
+static const btstack_uart_block_t pty_uart_block = {
+    &pty_init,
+    &pty_open,
+    &pty_close,
+    &pty_set_block_received,
+    &pty_set_block_sent,
+    &pty_set_baudrate,
+    &pty_set_parity,
+    &pty_receive_block,
+    &pty_send_block,
+    NULL,
+    NULL,
+    &pty_set_bytes_received,
+    &pty_receive_bytes,
+};
+
+// sender: send packets as fast as the transport accepts them
+static void sender_report(void){
+    double duration_ms = (now_ns() - start_ns) / 1e6;
+    int bytes = nr_packets * HCI_ACL_PAYLOAD_SIZE;
+    printf("window %u, crc %u, %-9s, latency %2u ms: %u packets, %u bytes, %.0f ms, %.1f kB/s\n",
+        HCI_TRANSPORT_H5_SLIDING_WINDOW_SIZE, BENCHMARK_CRC, bytewise ? "bytewise" : "streaming", latency_ms,
+        nr_packets, bytes, duration_ms, bytes / duration_ms);
+}
+
+static void sender_packet_handler(uint8_t packet_type, uint8_t * packet, uint16_t size){
+    if (packet_type != HCI_EVENT_PACKET) return;
+    if (packet[0] != HCI_EVENT_TRANSPORT_PACKET_SENT) return;
+    if (!link_active){
+        // link established
+        link_active = 1;
+        start_ns = now_ns();
+    } else {
+        packets_acked++;
+        if (packets_acked == nr_packets){
+            sender_report();
+            btstack_run_loop_remove_data_source(&pty_data_source);
+            int status = 1;
+            wait(&status);
+            exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+        }
+    }
+    while (packets_sent < nr_packets && transport->can_send_packet_now(HCI_ACL_DATA_PACKET)){
+        fill_packet(packets_sent++);
+        transport->send_packet(HCI_ACL_DATA_PACKET, acl_packet, sizeof(acl_packet));
+    }
+}
+
+// receiver: validate packets and exit after last ack has been sent
+static void receiver_done(btstack_timer_source_t * ts){
+    if (packets_invalid){
+        printf("%u invalid packets received\n", packets_invalid);
+        exit(1);
+    }
+    exit(0);
+}
+
+static void receiver_packet_handler(uint8_t packet_type, uint8_t * packet, uint16_t size){
+    if (packet_type != HCI_ACL_DATA_PACKET) return;
+    if (!packet_valid(packets_received, packet, size)){
+        packets_invalid++;
+    }
+    packets_received++;
+    if (packets_received < nr_packets) return;
+    btstack_run_loop_set_timer_handler(&done_timer, &receiver_done);
+    btstack_run_loop_set_timer(&done_timer, 200);
+    btstack_run_loop_add_timer(&done_timer);
+}
+
+int main(int argc, const char * argv[]){
+    if (argc > 1) nr_packets = atoi(argv[1]);
+    if (argc > 2) bytewise = strcmp(argv[2], "bytewise") == 0;
+    if (argc > 3) latency_ms = atoi(argv[3]);
+    if (nr_packets < 1 || latency_ms < 0){
+        printf("usage: %s [nr_packets] [bytewise|streaming] [latency_ms]\n", argv[0]);
+        return 1;
+    }
+
+    // pseudo terminal in raw mode
+    int master_fd, slave_fd;
+    struct termios toptions;
+    memset(&toptions, 0, sizeof(toptions));
+    cfmakeraw(&toptions);
+    if (openpty(&master_fd, &slave_fd, NULL, &toptions, NULL) < 0){
+        printf("openpty failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    static hci_transport_config_uart_t config = {
+        HCI_TRANSPORT_CONFIG_UART,
+        BENCHMARK_BAUDRATE,
+        0,
+        0,
+        NULL,
+    };
+
+    static btstack_uart_block_t uart_driver;
+    void (*packet_handler)(uint8_t packet_type, uint8_t * packet, uint16_t size);
+    pid_t pid = fork();
+    if (pid < 0){
+        printf("fork failed: %s\n", strerror(errno));
+        return 1;
+    }
+    if (pid == 0){
+        // receiver on master side
+        close(slave_fd);
+        uart_driver = pty_uart_block;
+        pty_data_source.fd = master_fd;
+        packet_handler = &receiver_packet_handler;
+    } else {
+        // sender on slave side, keep slave_fd open until posix uart driver has opened the device
+        close(master_fd);
+        uart_driver = *btstack_uart_block_posix_instance();
+        config.device_name = ttyname(slave_fd);
+        packet_handler = &sender_packet_handler;
+    }
+
+    // emulate UART driver without streaming receive
+    if (bytewise){
+        uart_driver.set_bytes_received = NULL;
+        uart_driver.receive_bytes = NULL;
+    }
+
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    transport = hci_transport_h5_instance(&uart_driver);
+    transport->init(&config);
+    transport->register_packet_handler(packet_handler);
+    if (transport->open()){
+        printf("failed to open transport\n");
+        return 1;
+    }
+    btstack_run_loop_execute();
+    return 0;
+}
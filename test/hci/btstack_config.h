@@ -0,0 +1,23 @@
+//
+// btstack_config.h for HCI tests
+//
+
+#ifndef __BTSTACK_CONFIG
+#define __BTSTACK_CONFIG
+
+// Port related features
+#define HAVE_MALLOC
+#define HAVE_POSIX_TIME
+
+// BTstack features that can be enabled
+#define ENABLE_CLASSIC
+#define ENABLE_HCI_ACL_REASSEMBLY_POOL
+#define ENABLE_LOG_ERROR
+
+// BTstack configuration. buffers, sizes, ...
+#define HCI_ACL_PAYLOAD_SIZE 1021
+#define HCI_INCOMING_PRE_BUFFER_SIZE 4
+#define HCI_OUTGOING_PACKET_BUFFERS 4
+#define MAX_NR_HCI_ACL_REASSEMBLY_BUFFERS 1
+
+#endif
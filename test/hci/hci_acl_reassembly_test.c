@@ -0,0 +1,144 @@
+/*
+ *  hci_acl_reassembly_test.c
+ *
+ *  Reassembly of fragmented L2CAP packets with ENABLE_HCI_ACL_REASSEMBLY_POOL: the single pool buffer
+ *  has to be returned after completion, stale and oversized fragments, and disconnect
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "bluetooth.h"
+#include "btstack_memory.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "mock.h"
+
+#define HANDLE_1 0x0001
+
+#define ACL_FIRST_FRAGMENT        0x2000
+#define ACL_CONTINUATION_FRAGMENT 0x1000
+
+static bd_addr_t address_1 = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+
+static uint8_t  received_packet[HCI_ACL_BUFFER_SIZE];
+static uint16_t received_size;
+static int      received_packets;
+
+static void acl_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(packet_type);
+    UNUSED(channel);
+    memcpy(received_packet, packet, btstack_min(size, sizeof(received_packet)));
+    received_size = size;
+    received_packets++;
+}
+
+// L2CAP packet with l2cap_length bytes payload, pos is offset into L2CAP packet incl. basic header
+static void receive_fragment(uint16_t flags, uint16_t l2cap_length, uint16_t pos, uint16_t len){
+    uint8_t l2cap_packet[4 + 1100];
+    little_endian_store_16(l2cap_packet, 0, l2cap_length);
+    little_endian_store_16(l2cap_packet, 2, 0x0040);
+    int i;
+    for (i = 0; i < l2cap_length && i < 1100; i++){
+        l2cap_packet[4 + i] = (uint8_t) i;
+    }
+    uint8_t packet[4 + 1100];
+    little_endian_store_16(packet, 0, HANDLE_1 | flags);
+    little_endian_store_16(packet, 2, len);
+    memcpy(&packet[4], &l2cap_packet[pos], len);
+    mock_receive_acl_packet(packet, 4 + len);
+}
+
+// pool buffer can be taken, i.e. HCI returned it
+static int reassembly_buffer_available(void){
+    hci_acl_reassembly_buffer_t * buffer = btstack_memory_hci_acl_reassembly_buffer_get();
+    if (!buffer) return 0;
+    btstack_memory_hci_acl_reassembly_buffer_free(buffer);
+    return 1;
+}
+
+static int check_l2cap_packet(uint16_t l2cap_length){
+    if (received_size != 4 + 4 + l2cap_length) return 0;
+    if (little_endian_read_16(received_packet, 2) != 4 + l2cap_length) return 0;
+    if (little_endian_read_16(received_packet, 4) != l2cap_length) return 0;
+    int i;
+    for (i = 0; i < l2cap_length; i++){
+        if (received_packet[8 + i] != (uint8_t) i) return 0;
+    }
+    return 1;
+}
+
+TEST_GROUP(HCIACLReassembly){
+    void setup(void){
+        received_size = 0;
+        received_packets = 0;
+        mock_init();
+        hci_register_acl_packet_handler(&acl_packet_handler);
+        mock_connect(address_1, HANDLE_1);
+    }
+    void teardown(void){
+        hci_close();
+    }
+};
+
+TEST(HCIACLReassembly, Fragments){
+    receive_fragment(ACL_FIRST_FRAGMENT, 600, 0, 300);
+    CHECK_FALSE(reassembly_buffer_available());
+    receive_fragment(ACL_CONTINUATION_FRAGMENT, 600, 300, 200);
+    CHECK_EQUAL(0, received_packets);
+    receive_fragment(ACL_CONTINUATION_FRAGMENT, 600, 500, 104);
+    CHECK_EQUAL(1, received_packets);
+    CHECK_TRUE(check_l2cap_packet(600));
+    CHECK_TRUE(reassembly_buffer_available());
+}
+
+TEST(HCIACLReassembly, StaleFragmentsThenCompletePacket){
+    receive_fragment(ACL_FIRST_FRAGMENT, 600, 0, 300);
+    // new first fragment contains complete L2CAP packet
+    receive_fragment(ACL_FIRST_FRAGMENT, 100, 0, 104);
+    CHECK_EQUAL(1, received_packets);
+    CHECK_TRUE(check_l2cap_packet(100));
+    CHECK_TRUE(reassembly_buffer_available());
+    // continuation of stale packet is dropped
+    receive_fragment(ACL_CONTINUATION_FRAGMENT, 600, 300, 304);
+    CHECK_EQUAL(1, received_packets);
+    CHECK_TRUE(reassembly_buffer_available());
+}
+
+TEST(HCIACLReassembly, StaleFragmentsThenFragments){
+    receive_fragment(ACL_FIRST_FRAGMENT, 600, 0, 300);
+    receive_fragment(ACL_FIRST_FRAGMENT, 400, 0, 200);
+    receive_fragment(ACL_CONTINUATION_FRAGMENT, 400, 200, 204);
+    CHECK_EQUAL(1, received_packets);
+    CHECK_TRUE(check_l2cap_packet(400));
+    CHECK_TRUE(reassembly_buffer_available());
+}
+
+TEST(HCIACLReassembly, OversizedL2CAPPacket){
+    receive_fragment(ACL_FIRST_FRAGMENT, 600, 0, 300);
+    // L2CAP packet does not fit into reassembly buffer
+    receive_fragment(ACL_FIRST_FRAGMENT, HCI_ACL_BUFFER_SIZE, 0, 300);
+    CHECK_TRUE(reassembly_buffer_available());
+    receive_fragment(ACL_CONTINUATION_FRAGMENT, HCI_ACL_BUFFER_SIZE, 300, 300);
+    CHECK_EQUAL(0, received_packets);
+    CHECK_TRUE(reassembly_buffer_available());
+}
+
+TEST(HCIACLReassembly, DisconnectDuringReassembly){
+    receive_fragment(ACL_FIRST_FRAGMENT, 600, 0, 300);
+    CHECK_FALSE(reassembly_buffer_available());
+    mock_disconnect(HANDLE_1);
+    CHECK_TRUE(reassembly_buffer_available());
+    CHECK_EQUAL(0, received_packets);
+}
+
+int main (int argc, const char * argv[]){
+    btstack_memory_init();
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
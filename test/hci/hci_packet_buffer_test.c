@@ -0,0 +1,157 @@
+/*
+ *  hci_packet_buffer_test.c
+ *
+ *  Outgoing packet buffer ring with an asynchronous HCI transport: per-connection limit,
+ *  full ring, wrap-around, and copy of external command packets
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "bluetooth.h"
+#include "btstack_defines.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "mock.h"
+
+#define HANDLE_1 0x0001
+#define HANDLE_2 0x0002
+
+static bd_addr_t address_1 = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+static bd_addr_t address_2 = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x77 };
+
+// Read BD_ADDR
+static uint8_t read_bd_addr_command[] = { 0x09, 0x10, 0x00 };
+
+static int send_acl_packet(hci_con_handle_t con_handle, uint8_t value, uint16_t payload_len){
+    if (!hci_reserve_packet_buffer()) return -1;
+    uint8_t * packet = hci_get_outgoing_packet_buffer();
+    little_endian_store_16(packet, 0, con_handle | 0x2000);
+    little_endian_store_16(packet, 2, payload_len);
+    memset(&packet[4], value, payload_len);
+    return hci_send_acl_packet_buffer(4 + payload_len);
+}
+
+static int check_acl_packet(hci_con_handle_t con_handle, uint8_t value, uint16_t payload_len){
+    if (mock_last_packet_type() != HCI_ACL_DATA_PACKET) return 0;
+    if (mock_last_packet_size() != 4 + payload_len) return 0;
+    uint8_t * packet = mock_last_packet();
+    if ((little_endian_read_16(packet, 0) & 0x0fff) != con_handle) return 0;
+    int i;
+    for (i = 0; i < payload_len; i++){
+        if (packet[4 + i] != value) return 0;
+    }
+    return 1;
+}
+
+TEST_GROUP(HCIPacketBuffer){
+    void setup(void){
+        mock_init();
+        mock_connect(address_1, HANDLE_1);
+        mock_connect(address_2, HANDLE_2);
+    }
+    void teardown(void){
+        hci_close();
+    }
+};
+
+TEST(HCIPacketBuffer, PerConnectionLimit){
+    CHECK_EQUAL(HCI_OUTGOING_PACKET_BUFFERS - 1, HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION);
+    int i;
+    for (i = 0; i < HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION; i++){
+        CHECK_TRUE(hci_can_send_acl_packet_now(HANDLE_1));
+        CHECK_EQUAL(0, send_acl_packet(HANDLE_1, i, 100));
+    }
+    CHECK_EQUAL(HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION, mock_num_packets_in_transport());
+
+    // connection 1 used up its share, buffer still left for other connections and commands
+    CHECK_FALSE(hci_can_send_acl_packet_now(HANDLE_1));
+    CHECK_TRUE(hci_can_send_acl_packet_now(HANDLE_2));
+    CHECK_TRUE(hci_can_send_command_packet_now());
+    CHECK_EQUAL(BTSTACK_ACL_BUFFERS_FULL, send_acl_packet(HANDLE_1, 0xff, 100));
+    CHECK_EQUAL(HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION, mock_num_packets_in_transport());
+
+    // oldest packet done
+    mock_packet_sent();
+    CHECK_TRUE(check_acl_packet(HANDLE_1, 0, 100));
+    CHECK_TRUE(hci_can_send_acl_packet_now(HANDLE_1));
+}
+
+TEST(HCIPacketBuffer, FullRing){
+    int i;
+    for (i = 0; i < HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION; i++){
+        CHECK_EQUAL(0, send_acl_packet(HANDLE_1, i, 100));
+    }
+    CHECK_EQUAL(0, send_acl_packet(HANDLE_2, 0x80, 100));
+    CHECK_EQUAL(HCI_OUTGOING_PACKET_BUFFERS, mock_num_packets_in_transport());
+
+    // all buffers in transport
+    CHECK_FALSE(hci_can_send_acl_packet_now(HANDLE_1));
+    CHECK_FALSE(hci_can_send_acl_packet_now(HANDLE_2));
+    CHECK_FALSE(hci_can_send_acl_classic_packet_now());
+    CHECK_FALSE(hci_can_send_command_packet_now());
+    CHECK_FALSE(hci_reserve_packet_buffer());
+
+    // external command is not sent
+    CHECK_EQUAL(BTSTACK_ACL_BUFFERS_FULL, hci_send_cmd_packet(read_bd_addr_command, sizeof(read_bd_addr_command)));
+    CHECK_EQUAL(HCI_OUTGOING_PACKET_BUFFERS, mock_num_packets_in_transport());
+
+    // packets complete in order without being overwritten
+    for (i = 0; i < HCI_OUTGOING_PACKET_BUFFERS_PER_CONNECTION; i++){
+        mock_packet_sent();
+        CHECK_TRUE(check_acl_packet(HANDLE_1, i, 100));
+    }
+    mock_packet_sent();
+    CHECK_TRUE(check_acl_packet(HANDLE_2, 0x80, 100));
+    CHECK_EQUAL(0, mock_num_packets_modified());
+
+    CHECK_TRUE(hci_can_send_command_packet_now());
+    CHECK_TRUE(hci_can_send_acl_packet_now(HANDLE_1));
+    CHECK_TRUE(hci_can_send_acl_packet_now(HANDLE_2));
+}
+
+TEST(HCIPacketBuffer, WrapAround){
+    // keep ring busy over several rounds, alternating connections and sizes
+    int packets_sent = 0;
+    int packets_done = 0;
+    while (packets_done < 20){
+        while (packets_sent < 20){
+            hci_con_handle_t con_handle = (packets_sent & 1) ? HANDLE_2 : HANDLE_1;
+            if (!hci_can_send_acl_packet_now(con_handle)) break;
+            CHECK_EQUAL(0, send_acl_packet(con_handle, packets_sent, 50 + packets_sent * 40));
+            packets_sent++;
+        }
+        CHECK(mock_num_packets_in_transport() <= HCI_OUTGOING_PACKET_BUFFERS);
+        mock_packet_sent();
+        hci_con_handle_t con_handle = (packets_done & 1) ? HANDLE_2 : HANDLE_1;
+        CHECK_TRUE(check_acl_packet(con_handle, packets_done, 50 + packets_done * 40));
+        packets_done++;
+    }
+    CHECK_EQUAL(0, mock_num_packets_in_transport());
+    CHECK_EQUAL(0, mock_num_packets_modified());
+}
+
+TEST(HCIPacketBuffer, ExternalCommandCopied){
+    uint8_t command[sizeof(read_bd_addr_command)];
+    memcpy(command, read_bd_addr_command, sizeof(command));
+    CHECK_EQUAL(0, hci_send_cmd_packet(command, sizeof(command)));
+    CHECK_EQUAL(1, mock_num_packets_in_transport());
+
+    // caller may reuse its buffer right away
+    memset(command, 0, sizeof(command));
+    mock_packet_sent();
+    CHECK_EQUAL(HCI_COMMAND_DATA_PACKET, mock_last_packet_type());
+    CHECK(mock_last_packet_buffer() != command);
+    MEMCMP_EQUAL(read_bd_addr_command, mock_last_packet(), sizeof(read_bd_addr_command));
+    CHECK_EQUAL(0, mock_num_packets_modified());
+}
+
+int main (int argc, const char * argv[]){
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  mock.c
+ *
+ *  Emulated Controller behind an asynchronous HCI transport: packets stay in the transport
+ *  until completed by mock_packet_sent or mock_run. Commands are answered with Command Complete,
+ *  ACL packets with Number Of Completed Packets. The content of each packet is checked on completion.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "btstack_debug.h"
+#include "btstack_event.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_cmd.h"
+#include "hci_transport.h"
+#include "mock.h"
+
+#define MOCK_MAX_PACKETS_IN_TRANSPORT 16
+
+typedef struct {
+    uint8_t   packet_type;
+    uint8_t * packet;
+    uint16_t  size;
+    uint8_t   data[HCI_PACKET_BUFFER_SIZE];
+} mock_packet_t;
+
+static void (*transport_packet_handler)(uint8_t packet_type, uint8_t *packet, uint16_t size);
+
+static mock_packet_t transport_packets[MOCK_MAX_PACKETS_IN_TRANSPORT];
+static int transport_packets_read_index;
+static int transport_packets_queued;
+
+static mock_packet_t last_packet;
+static btstack_packet_callback_registration_t hci_event_callback_registration;
+static HCI_STATE hci_state;
+static int num_packets_sent;
+static int num_packets_modified;
+
+static int transport_open(void){
+    return 0;
+}
+
+static int transport_close(void){
+    return 0;
+}
+
+static void transport_register_packet_handler(void (*handler)(uint8_t packet_type, uint8_t *packet, uint16_t size)){
+    transport_packet_handler = handler;
+}
+
+static int transport_can_send_packet_now(uint8_t packet_type){
+    UNUSED(packet_type);
+    return transport_packets_queued < MOCK_MAX_PACKETS_IN_TRANSPORT;
+}
+
+static int transport_send_packet(uint8_t packet_type, uint8_t *packet, int size){
+    if (transport_packets_queued >= MOCK_MAX_PACKETS_IN_TRANSPORT || size > HCI_PACKET_BUFFER_SIZE){
+        log_error("mock: cannot queue packet");
+        return -1;
+    }
+    int index = (transport_packets_read_index + transport_packets_queued) % MOCK_MAX_PACKETS_IN_TRANSPORT;
+    mock_packet_t * entry = &transport_packets[index];
+    entry->packet_type = packet_type;
+    entry->packet = packet;
+    entry->size = size;
+    memcpy(entry->data, packet, size);
+    transport_packets_queued++;
+    return 0;
+}
+
+static const hci_transport_t transport = {
+    /* .name = */                    "Mock",
+    /* .init = */                    NULL,
+    /* .open = */                    &transport_open,
+    /* .close = */                   &transport_close,
+    /* .register_packet_handler = */ &transport_register_packet_handler,
+    /* .can_send_packet_now = */     &transport_can_send_packet_now,
+    /* .send_packet = */             &transport_send_packet,
+    /* .set_baudrate = */            NULL,
+    /* .reset_link = */              NULL,
+    /* .set_sco_config = */          NULL,
+};
+
+static void mock_command_complete(uint16_t opcode){
+    // Command Complete with status ok and zeroed return parameters, only Read Buffer Size is supported
+    uint8_t event[2 + 255];
+    memset(event, 0, sizeof(event));
+    event[0] = HCI_EVENT_COMMAND_COMPLETE;
+    event[1] = 255;
+    event[2] = 1;
+    little_endian_store_16(event, 3, opcode);
+    if (opcode == hci_read_local_supported_commands.opcode){
+        // Supported Commands octet 14, bit 7: Read Buffer Size
+        event[6 + 14] = 0x80;
+    }
+    if (opcode == hci_read_buffer_size.opcode){
+        little_endian_store_16(event, 6, HCI_ACL_PAYLOAD_SIZE);
+        little_endian_store_16(event, 9, MOCK_NUM_ACL_PACKETS);
+    }
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+static void mock_number_of_completed_packets(hci_con_handle_t con_handle){
+    uint8_t event[7];
+    event[0] = HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS;
+    event[1] = sizeof(event) - 2;
+    event[2] = 1;
+    little_endian_store_16(event, 3, con_handle);
+    little_endian_store_16(event, 5, 1);
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+void mock_packet_sent(void){
+    if (!transport_packets_queued) return;
+    last_packet = transport_packets[transport_packets_read_index];
+    transport_packets_read_index = (transport_packets_read_index + 1) % MOCK_MAX_PACKETS_IN_TRANSPORT;
+    transport_packets_queued--;
+    num_packets_sent++;
+    if (memcmp(last_packet.packet, last_packet.data, last_packet.size) != 0){
+        num_packets_modified++;
+    }
+
+    uint8_t event[] = { HCI_EVENT_TRANSPORT_PACKET_SENT, 0};
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+
+    switch (last_packet.packet_type){
+        case HCI_COMMAND_DATA_PACKET:
+            mock_command_complete(little_endian_read_16(last_packet.data, 0));
+            break;
+        case HCI_ACL_DATA_PACKET:
+            mock_number_of_completed_packets(little_endian_read_16(last_packet.data, 0) & 0x0fff);
+            break;
+        default:
+            break;
+    }
+}
+
+void mock_run(void){
+    while (transport_packets_queued){
+        mock_packet_sent();
+    }
+}
+
+int mock_num_packets_in_transport(void){
+    return transport_packets_queued;
+}
+
+int mock_num_packets_sent(void){
+    return num_packets_sent;
+}
+
+int mock_num_packets_modified(void){
+    return num_packets_modified;
+}
+
+uint8_t mock_last_packet_type(void){
+    return last_packet.packet_type;
+}
+
+uint8_t * mock_last_packet(void){
+    return last_packet.data;
+}
+
+uint16_t mock_last_packet_size(void){
+    return last_packet.size;
+}
+
+const uint8_t * mock_last_packet_buffer(void){
+    return last_packet.packet;
+}
+
+void mock_connect(bd_addr_t remote_addr, hci_con_handle_t con_handle){
+    uint8_t event[13];
+    // Connection Request for ACL link, accepted by HCI
+    memset(event, 0, sizeof(event));
+    event[0] = HCI_EVENT_CONNECTION_REQUEST;
+    event[1] = 10;
+    reverse_bd_addr(remote_addr, &event[2]);
+    event[11] = 1;
+    transport_packet_handler(HCI_EVENT_PACKET, event, 12);
+    mock_run();
+    // Connection Complete
+    memset(event, 0, sizeof(event));
+    event[0] = HCI_EVENT_CONNECTION_COMPLETE;
+    event[1] = 11;
+    little_endian_store_16(event, 3, con_handle);
+    reverse_bd_addr(remote_addr, &event[5]);
+    event[11] = 1;
+    transport_packet_handler(HCI_EVENT_PACKET, event, 13);
+    mock_run();
+}
+
+void mock_disconnect(hci_con_handle_t con_handle){
+    uint8_t event[6];
+    event[0] = HCI_EVENT_DISCONNECTION_COMPLETE;
+    event[1] = sizeof(event) - 2;
+    event[2] = 0;
+    little_endian_store_16(event, 3, con_handle);
+    event[5] = 0x13;
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+    mock_run();
+}
+
+void mock_receive_acl_packet(uint8_t * packet, uint16_t size){
+    transport_packet_handler(HCI_ACL_DATA_PACKET, packet, size);
+}
+
+static void hci_event_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(channel);
+    UNUSED(size);
+    if (packet_type != HCI_EVENT_PACKET) return;
+    if (hci_event_packet_get_type(packet) != BTSTACK_EVENT_STATE) return;
+    hci_state = (HCI_STATE) btstack_event_state_get_state(packet);
+}
+
+void mock_init(void){
+    transport_packets_read_index = 0;
+    transport_packets_queued = 0;
+    num_packets_sent = 0;
+    num_packets_modified = 0;
+    memset(&last_packet, 0, sizeof(last_packet));
+
+    hci_init(&transport, NULL);
+    hci_event_callback_registration.callback = &hci_event_handler;
+    hci_add_event_handler(&hci_event_callback_registration);
+    hci_power_control(HCI_POWER_ON);
+    mock_run();
+    if (hci_state != HCI_STATE_WORKING){
+        log_error("mock: HCI not working");
+    }
+}
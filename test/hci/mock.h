@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  mock.h
+ *
+ *  Emulated Controller behind an asynchronous HCI transport for HCI tests
+ */
+
+#ifndef __MOCK_H
+#define __MOCK_H
+
+#include <stdint.h>
+#include "bluetooth.h"
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+// number of ACL packets the emulated Controller can buffer
+#define MOCK_NUM_ACL_PACKETS 16
+
+// hci_init with emulated Controller, power on and run until HCI_STATE_WORKING, must be called after btstack_run_loop_init
+void mock_init(void);
+
+// complete all packets in transport, answer commands and report completed ACL packets
+void mock_run(void);
+
+// complete oldest packet in transport
+void mock_packet_sent(void);
+
+int mock_num_packets_in_transport(void);
+
+// packets completed by the emulated Controller since mock_init, including commands
+int mock_num_packets_sent(void);
+
+// packets changed by the stack while in transport
+int mock_num_packets_modified(void);
+
+// last packet completed by the emulated Controller
+uint8_t   mock_last_packet_type(void);
+uint8_t * mock_last_packet(void);
+uint16_t  mock_last_packet_size(void);
+// buffer passed to send_packet for last packet
+const uint8_t * mock_last_packet_buffer(void);
+
+// incoming ACL connection from remote_addr gets accepted and completes with con_handle
+void mock_connect(bd_addr_t remote_addr, hci_con_handle_t con_handle);
+
+void mock_disconnect(hci_con_handle_t con_handle);
+
+void mock_receive_acl_packet(uint8_t * packet, uint16_t size);
+
+#if defined __cplusplus
+}
+#endif
+
+#endif // __MOCK_H
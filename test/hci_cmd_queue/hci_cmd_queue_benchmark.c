@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  hci_cmd_queue_benchmark.c
+ *
+ *  Measures how fast queued HCI Command requests complete against an emulated Controller
+ *  that answers each command after a fixed latency and accepts up to num_cmd_packets commands
+ *
+ *  With fault 'nop', the Controller answers every tenth command with a Command Complete for opcode 0x0000,
+ *  with fault 'lost', it does not answer every tenth command at all. All other requests still have to complete.
+ *
+ *  usage: hci_cmd_queue_benchmark [nr_requests] [num_cmd_packets] [latency_ms] [nop|lost]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btstack_event.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_cmd.h"
+#include "hci_transport.h"
+
+#define MAX_CONTROLLER_COMMANDS 16
+#define CONTROLLER_FAULT_INTERVAL 10
+
+typedef enum {
+    CONTROLLER_FAULT_NONE,
+    CONTROLLER_FAULT_NOP,
+    CONTROLLER_FAULT_LOST,
+} controller_fault_t;
+
+static int nr_requests = 200;
+static int controller_num_cmd_packets = 4;
+static int latency_ms = 2;
+static controller_fault_t controller_fault = CONTROLLER_FAULT_NONE;
+
+// emulated Controller
+static void (*transport_packet_handler)(uint8_t packet_type, uint8_t *packet, uint16_t size);
+static btstack_timer_source_t controller_timer;
+static uint16_t controller_opcodes[MAX_CONTROLLER_COMMANDS];
+static uint32_t controller_due_ms[MAX_CONTROLLER_COMMANDS];
+static int      controller_num_commands;
+static int      controller_max_commands;
+static int      controller_overruns;
+static int      controller_faults_enabled;
+static int      controller_commands;
+
+// benchmark
+static hci_command_request_t * requests;
+static btstack_packet_callback_registration_t hci_event_callback_registration;
+static int      requests_sent;
+static int      requests_completed;
+static int      requests_invalid;
+static int      requests_expected;
+static int      request_last_completed;
+static uint32_t start_ms;
+
+static void controller_timer_start(void){
+    if (controller_num_commands == 0) return;
+    uint32_t now = btstack_run_loop_get_time_ms();
+    uint32_t timeout = controller_due_ms[0] > now ? controller_due_ms[0] - now : 0;
+    btstack_run_loop_remove_timer(&controller_timer);
+    btstack_run_loop_set_timer(&controller_timer, timeout);
+    btstack_run_loop_add_timer(&controller_timer);
+}
+
+static void controller_timer_handler(btstack_timer_source_t * ts){
+    UNUSED(ts);
+    uint32_t now = btstack_run_loop_get_time_ms();
+    while (controller_num_commands && controller_due_ms[0] <= now){
+        uint16_t opcode = controller_opcodes[0];
+        controller_num_commands--;
+        memmove(&controller_opcodes[0], &controller_opcodes[1], controller_num_commands * sizeof(uint16_t));
+        memmove(&controller_due_ms[0], &controller_due_ms[1], controller_num_commands * sizeof(uint32_t));
+        // Command Complete with status ok and zeroed return parameters
+        uint8_t event[2 + 255];
+        memset(event, 0, sizeof(event));
+        event[0] = HCI_EVENT_COMMAND_COMPLETE;
+        event[1] = 255;
+        event[2] = controller_num_cmd_packets - controller_num_commands;
+        little_endian_store_16(event, 3, opcode);
+        transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+    }
+    controller_timer_start();
+}
+
+static int controller_open(void){
+    return 0;
+}
+
+static int controller_close(void){
+    return 0;
+}
+
+static void controller_register_packet_handler(void (*handler)(uint8_t packet_type, uint8_t *packet, uint16_t size)){
+    transport_packet_handler = handler;
+}
+
+static int controller_send_packet(uint8_t packet_type, uint8_t *packet, int size){
+    UNUSED(size);
+    if (packet_type != HCI_COMMAND_DATA_PACKET) return 0;
+    if (controller_num_commands >= controller_num_cmd_packets){
+        controller_overruns++;
+        return 0;
+    }
+    uint16_t opcode = little_endian_read_16(packet, 0);
+    if (controller_faults_enabled && (++controller_commands % CONTROLLER_FAULT_INTERVAL) == (CONTROLLER_FAULT_INTERVAL / 2)){
+        switch (controller_fault){
+            case CONTROLLER_FAULT_NOP:
+                opcode = 0;
+                break;
+            case CONTROLLER_FAULT_LOST:
+                return 0;
+            default:
+                break;
+        }
+    }
+    controller_opcodes[controller_num_commands] = opcode;
+    controller_due_ms[controller_num_commands]  = btstack_run_loop_get_time_ms() + latency_ms;
+    controller_num_commands++;
+    controller_max_commands = btstack_max(controller_max_commands, controller_num_commands);
+    if (controller_num_commands == 1){
+        controller_timer_start();
+    }
+    return 0;
+}
+
+static const hci_transport_t controller_transport = {
+    /* .name = */                    "Controller",
+    /* .init = */                    NULL,
+    /* .open = */                    &controller_open,
+    /* .close = */                   &controller_close,
+    /* .register_packet_handler = */ &controller_register_packet_handler,
+    /* .can_send_packet_now = */     NULL,
+    /* .send_packet = */             &controller_send_packet,
+    /* .set_baudrate = */            NULL,
+    /* .reset_link = */              NULL,
+    /* .set_sco_config = */          NULL,
+};
+
+static void send_command(void * context){
+    UNUSED(context);
+    requests_sent++;
+    hci_send_cmd(&hci_read_bd_addr);
+}
+
+static void command_complete(void * context, uint8_t * event, uint16_t size){
+    UNUSED(size);
+    hci_command_request_t * request = (hci_command_request_t *) context;
+    // requests complete in order, requests hit by a Controller fault don't complete
+    int index = request - requests;
+    if (index <= request_last_completed || !HCI_EVENT_IS_COMMAND_COMPLETE(event, hci_read_bd_addr)){
+        requests_invalid++;
+    }
+    request_last_completed = index;
+    requests_completed++;
+    if (requests_completed < requests_expected) return;
+
+    uint32_t duration_ms = btstack_run_loop_get_time_ms() - start_ms;
+    printf("%u requests, max %u outstanding, Controller accepts %u, latency %u ms: %u ms, %u commands in Controller at most\n",
+        nr_requests, HCI_MAX_OUTSTANDING_COMMANDS, controller_num_cmd_packets, latency_ms, duration_ms, controller_max_commands);
+    if (requests_invalid || controller_overruns || requests_sent != nr_requests){
+        printf("%u invalid completions, %u Controller overruns, %u requests sent\n", requests_invalid, controller_overruns, requests_sent);
+        exit(1);
+    }
+    exit(0);
+}
+
+static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(channel);
+    UNUSED(size);
+    if (packet_type != HCI_EVENT_PACKET) return;
+    if (hci_event_packet_get_type(packet) != BTSTACK_EVENT_STATE) return;
+    if (btstack_event_state_get_state(packet) != HCI_STATE_WORKING) return;
+
+    // initialization done, queue all requests at once
+    controller_max_commands = 0;
+    controller_faults_enabled = 1;
+    requests_expected = nr_requests;
+    request_last_completed = -1;
+    if (controller_fault != CONTROLLER_FAULT_NONE){
+        requests_expected -= (nr_requests + CONTROLLER_FAULT_INTERVAL / 2) / CONTROLLER_FAULT_INTERVAL;
+    }
+    start_ms = btstack_run_loop_get_time_ms();
+    int i;
+    for (i = 0; i < nr_requests; i++){
+        requests[i].send_command     = &send_command;
+        requests[i].command_complete = &command_complete;
+        requests[i].context          = &requests[i];
+        hci_request_command(&requests[i]);
+    }
+}
+
+int main(int argc, const char * argv[]){
+    if (argc > 1) nr_requests = atoi(argv[1]);
+    if (argc > 2) controller_num_cmd_packets = atoi(argv[2]);
+    if (argc > 3) latency_ms = atoi(argv[3]);
+    if (argc > 4 && strcmp(argv[4], "nop") == 0)  controller_fault = CONTROLLER_FAULT_NOP;
+    if (argc > 4 && strcmp(argv[4], "lost") == 0) controller_fault = CONTROLLER_FAULT_LOST;
+    if (nr_requests < 1 || controller_num_cmd_packets < 1 || controller_num_cmd_packets > MAX_CONTROLLER_COMMANDS){
+        printf("usage: %s [nr_requests] [num_cmd_packets] [latency_ms] [nop|lost]\n", argv[0]);
+        return 1;
+    }
+    requests = calloc(nr_requests, sizeof(hci_command_request_t));
+
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    btstack_run_loop_set_timer_handler(&controller_timer, &controller_timer_handler);
+
+    hci_init(&controller_transport, NULL);
+    hci_event_callback_registration.callback = &packet_handler;
+    hci_add_event_handler(&hci_event_callback_registration);
+    hci_power_control(HCI_POWER_ON);
+
+    btstack_run_loop_execute();
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  hci_connection_lookup_benchmark.c
+ *
+ *  Measures connection lookup by con handle and by address, as well as incoming ACL packet dispatch,
+ *  with 1, 16, and 64 LE connections. A linear scan over all connections is shown for comparison.
+ *
+ *  usage: hci_connection_lookup_benchmark [nr_iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "btstack_event.h"
+#include "btstack_linked_list.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_transport.h"
+
+#define MAX_CONNECTIONS 64
+#define FIRST_HANDLE    0x0040
+
+static int nr_iterations = 1000000;
+
+static void (*transport_packet_handler)(uint8_t packet_type, uint8_t *packet, uint16_t size);
+static int nr_connections;
+static int acl_packets_received;
+static volatile uintptr_t sink;
+
+static void transport_register_packet_handler(void (*handler)(uint8_t packet_type, uint8_t *packet, uint16_t size)){
+    transport_packet_handler = handler;
+}
+
+static int transport_send_packet(uint8_t packet_type, uint8_t *packet, int size){
+    UNUSED(packet_type);
+    UNUSED(packet);
+    UNUSED(size);
+    return 0;
+}
+
+static const hci_transport_t transport = {
+    /* .name = */                    "Dummy",
+    /* .init = */                    NULL,
+    /* .open = */                    NULL,
+    /* .close = */                   NULL,
+    /* .register_packet_handler = */ &transport_register_packet_handler,
+    /* .can_send_packet_now = */     NULL,
+    /* .send_packet = */             &transport_send_packet,
+    /* .set_baudrate = */            NULL,
+    /* .reset_link = */              NULL,
+    /* .set_sco_config = */          NULL,
+};
+
+static void acl_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(packet_type);
+    UNUSED(channel);
+    UNUSED(packet);
+    UNUSED(size);
+    acl_packets_received++;
+}
+
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static hci_con_handle_t handle_for_index(int index){
+    return FIRST_HANDLE + index;
+}
+
+static void address_for_index(int index, bd_addr_t addr){
+    int i;
+    for (i = 0; i < 6; i++){
+        addr[i] = (uint8_t) (index * 37 + i * 101);
+    }
+}
+
+static void connection_complete(int index){
+    bd_addr_t addr;
+    address_for_index(index, addr);
+    uint8_t event[21];
+    memset(event, 0, sizeof(event));
+    event[0] = HCI_EVENT_LE_META;
+    event[1] = sizeof(event) - 2;
+    event[2] = HCI_SUBEVENT_LE_CONNECTION_COMPLETE;
+    event[3] = 0;
+    little_endian_store_16(event, 4, handle_for_index(index));
+    event[6] = HCI_ROLE_SLAVE;
+    event[7] = BD_ADDR_TYPE_LE_RANDOM;
+    reverse_bd_addr(addr, &event[8]);
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+static void disconnection_complete(int index){
+    uint8_t event[6];
+    event[0] = HCI_EVENT_DISCONNECTION_COMPLETE;
+    event[1] = sizeof(event) - 2;
+    event[2] = 0;
+    little_endian_store_16(event, 3, handle_for_index(index));
+    event[5] = 0x13;
+    transport_packet_handler(HCI_EVENT_PACKET, event, sizeof(event));
+}
+
+static hci_connection_t * linear_connection_for_handle(hci_con_handle_t con_handle){
+    btstack_linked_list_iterator_t it;
+    hci_connections_get_iterator(&it);
+    while (btstack_linked_list_iterator_has_next(&it)){
+        hci_connection_t * item = (hci_connection_t *) btstack_linked_list_iterator_next(&it);
+        if (item->con_handle == con_handle) return item;
+    }
+    return NULL;
+}
+
+static double benchmark_handle_lookup(int linear){
+    uint64_t start = now_ns();
+    int i;
+    for (i = 0; i < nr_iterations; i++){
+        hci_con_handle_t con_handle = handle_for_index(i % nr_connections);
+        hci_connection_t * conn = linear ? linear_connection_for_handle(con_handle) : hci_connection_for_handle(con_handle);
+        sink += (uintptr_t) conn;
+    }
+    return (double) (now_ns() - start) / nr_iterations;
+}
+
+static double benchmark_address_lookup(void){
+    bd_addr_t addresses[MAX_CONNECTIONS];
+    int i;
+    for (i = 0; i < nr_connections; i++){
+        address_for_index(i, addresses[i]);
+    }
+    uint64_t start = now_ns();
+    for (i = 0; i < nr_iterations; i++){
+        hci_connection_t * conn = hci_connection_for_bd_addr_and_type(addresses[i % nr_connections], BD_ADDR_TYPE_LE_RANDOM);
+        sink += (uintptr_t) conn;
+    }
+    return (double) (now_ns() - start) / nr_iterations;
+}
+
+static double benchmark_acl_dispatch(void){
+    // complete L2CAP packet with 23 bytes payload
+    uint8_t packet[4 + 4 + 23];
+    memset(packet, 0, sizeof(packet));
+    little_endian_store_16(packet, 2, sizeof(packet) - 4);
+    little_endian_store_16(packet, 4, sizeof(packet) - 8);
+    little_endian_store_16(packet, 6, 0x0004);
+    acl_packets_received = 0;
+    uint64_t start = now_ns();
+    int i;
+    for (i = 0; i < nr_iterations; i++){
+        // first automatically flushable packet
+        little_endian_store_16(packet, 0, handle_for_index(i % nr_connections) | 0x2000);
+        transport_packet_handler(HCI_ACL_DATA_PACKET, packet, sizeof(packet));
+    }
+    return (double) (now_ns() - start) / nr_iterations;
+}
+
+static int verify_lookups(void){
+    int i;
+    for (i = 0; i < MAX_CONNECTIONS; i++){
+        bd_addr_t addr;
+        address_for_index(i, addr);
+        hci_connection_t * conn = hci_connection_for_handle(handle_for_index(i));
+        hci_connection_t * conn_by_address = hci_connection_for_bd_addr_and_type(addr, BD_ADDR_TYPE_LE_RANDOM);
+        if (conn != conn_by_address) return 0;
+        if ((i < nr_connections) != (conn != NULL)) return 0;
+        if (conn && conn != linear_connection_for_handle(handle_for_index(i))) return 0;
+    }
+    return 1;
+}
+
+int main(int argc, const char * argv[]){
+    if (argc > 1) nr_iterations = atoi(argv[1]);
+    if (nr_iterations < 1){
+        printf("usage: %s [nr_iterations]\n", argv[0]);
+        return 1;
+    }
+
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    hci_init(&transport, NULL);
+    hci_register_acl_packet_handler(&acl_packet_handler);
+
+    static const int steps[] = { 1, 16, 64 };
+    unsigned int step;
+    for (step = 0; step < sizeof(steps) / sizeof(int); step++){
+        while (nr_connections < steps[step]){
+            connection_complete(nr_connections++);
+        }
+        if (!verify_lookups()){
+            printf("lookup failed with %u connections\n", nr_connections);
+            return 1;
+        }
+        double linear_ns  = benchmark_handle_lookup(1);
+        double handle_ns  = benchmark_handle_lookup(0);
+        double address_ns = benchmark_address_lookup();
+        double acl_ns     = benchmark_acl_dispatch();
+        if (acl_packets_received != nr_iterations){
+            printf("%u of %u ACL packets received\n", acl_packets_received, nr_iterations);
+            return 1;
+        }
+        printf("%2u connections: handle linear %5.1f ns, handle %5.1f ns, address %5.1f ns, ACL packet %5.1f ns\n",
+            nr_connections, linear_ns, handle_ns, address_ns, acl_ns);
+    }
+
+    // connections are removed from lookup on disconnect
+    while (nr_connections > 0){
+        disconnection_complete(--nr_connections);
+        if (!verify_lookups()){
+            printf("lookup failed after disconnect, %u connections\n", nr_connections);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ *  hci_transport_h4_test.c
+ *
+ *  H4 transport with emulated UART: random HCI stream received in exact blocks and in
+ *  streaming mode with random chunk sizes, resync after invalid packet type
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_uart_block.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "hci_transport.h"
+
+#define STREAM_SIZE 200000
+#define MAX_CHUNK_SIZE 700
+
+// emulated UART
+static btstack_uart_block_t uart;
+static void (*block_received)(void);
+static void (*bytes_received)(uint16_t num_bytes);
+static uint8_t * receive_buffer;
+static uint16_t  receive_len;
+static int       num_reads;
+
+// HCI stream sent by emulated Controller
+static uint8_t stream[STREAM_SIZE];
+static int     stream_len;
+static int     stream_pos;
+
+// received packets are compared against stream
+static int expected_pos;
+static int num_packets;
+static int num_mismatches;
+
+static int uart_init(const btstack_uart_config_t * uart_config){
+    UNUSED(uart_config);
+    return 0;
+}
+
+static int uart_open(void){
+    return 0;
+}
+
+static int uart_close(void){
+    return 0;
+}
+
+static void uart_set_block_received(void (*block_handler)(void)){
+    block_received = block_handler;
+}
+
+static void uart_set_block_sent(void (*block_handler)(void)){
+    UNUSED(block_handler);
+}
+
+static int uart_set_baudrate(uint32_t baudrate){
+    UNUSED(baudrate);
+    return 0;
+}
+
+static void uart_receive_block(uint8_t * buffer, uint16_t len){
+    receive_buffer = buffer;
+    receive_len = len;
+}
+
+static void uart_send_block(const uint8_t * buffer, uint16_t length){
+    UNUSED(buffer);
+    UNUSED(length);
+}
+
+static void uart_set_bytes_received(void (*bytes_handler)(uint16_t num_bytes)){
+    bytes_received = bytes_handler;
+}
+
+static void uart_receive_bytes(uint8_t * buffer, uint16_t max_len){
+    receive_buffer = buffer;
+    receive_len = max_len;
+}
+
+static void setup_uart(int streaming){
+    memset(&uart, 0, sizeof(uart));
+    uart.init               = &uart_init;
+    uart.open               = &uart_open;
+    uart.close              = &uart_close;
+    uart.set_block_received = &uart_set_block_received;
+    uart.set_block_sent     = &uart_set_block_sent;
+    uart.set_baudrate       = &uart_set_baudrate;
+    uart.receive_block      = &uart_receive_block;
+    uart.send_block         = &uart_send_block;
+    if (streaming){
+        uart.set_bytes_received = &uart_set_bytes_received;
+        uart.receive_bytes      = &uart_receive_bytes;
+    }
+}
+
+// deliver stream to transport, block mode gets exactly the requested block, streaming mode random chunks
+static void run_uart(int streaming){
+    while (stream_pos < stream_len){
+        int len = receive_len;
+        if (streaming){
+            len = btstack_min(len, 1 + rand() % MAX_CHUNK_SIZE);
+            len = btstack_min(len, stream_len - stream_pos);
+        }
+        memcpy(receive_buffer, &stream[stream_pos], len);
+        stream_pos += len;
+        num_reads++;
+        if (streaming){
+            (*bytes_received)(len);
+        } else {
+            (*block_received)();
+        }
+    }
+}
+
+static void packet_handler(uint8_t packet_type, uint8_t * packet, uint16_t size){
+    if (expected_pos + 1 + size > stream_len
+    || stream[expected_pos] != packet_type
+    || memcmp(&stream[expected_pos + 1], packet, size) != 0){
+        num_mismatches++;
+    }
+    expected_pos += 1 + size;
+    num_packets++;
+    // stack may use incoming pre-buffer
+    memset(packet - HCI_INCOMING_PRE_BUFFER_SIZE, 0x55, HCI_INCOMING_PRE_BUFFER_SIZE);
+}
+
+static void add_random_packets(int len){
+    while (stream_len < len){
+        uint8_t * packet = &stream[stream_len];
+        int header_size;
+        int payload_len;
+        switch (rand() % 3){
+            case 0:
+                header_size = 1 + HCI_EVENT_HEADER_SIZE;
+                payload_len = rand() % 256;
+                packet[0] = HCI_EVENT_PACKET;
+                packet[1] = rand();
+                packet[2] = payload_len;
+                break;
+            case 1:
+                header_size = 1 + HCI_ACL_HEADER_SIZE;
+                payload_len = rand() % (HCI_ACL_PAYLOAD_SIZE + 1);
+                packet[0] = HCI_ACL_DATA_PACKET;
+                little_endian_store_16(packet, 1, 0x0001);
+                little_endian_store_16(packet, 3, payload_len);
+                break;
+            default:
+                header_size = 1 + HCI_SCO_HEADER_SIZE;
+                payload_len = rand() % 200;
+                packet[0] = HCI_SCO_DATA_PACKET;
+                little_endian_store_16(packet, 1, 0x0001);
+                packet[3] = payload_len;
+                break;
+        }
+        int i;
+        for (i = 0; i < payload_len; i++){
+            packet[header_size + i] = rand();
+        }
+        stream_len += header_size + payload_len;
+    }
+}
+
+static void open_transport(int streaming){
+    setup_uart(streaming);
+    const hci_transport_t * transport = hci_transport_h4_instance(&uart);
+    hci_transport_config_uart_t config = { HCI_TRANSPORT_CONFIG_UART, 115200, 0, 0, NULL };
+    transport->init(&config);
+    transport->register_packet_handler(&packet_handler);
+    transport->open();
+}
+
+TEST_GROUP(H4Transport){
+    void setup(void){
+        srand(1);
+        stream_len = 0;
+        stream_pos = 0;
+        expected_pos = 0;
+        num_packets = 0;
+        num_mismatches = 0;
+        num_reads = 0;
+        add_random_packets(STREAM_SIZE - 2000);
+    }
+};
+
+TEST(H4Transport, BlockMode){
+    open_transport(0);
+    run_uart(0);
+    CHECK_EQUAL(0, num_mismatches);
+    CHECK_EQUAL(stream_len, expected_pos);
+}
+
+TEST(H4Transport, StreamingMode){
+    open_transport(1);
+    run_uart(1);
+    CHECK_EQUAL(0, num_mismatches);
+    CHECK_EQUAL(stream_len, expected_pos);
+    // block mode needs three reads per packet
+    CHECK(num_reads < num_packets);
+}
+
+TEST(H4Transport, StreamingResync){
+    // invalid packet type in front of stream is dropped
+    memmove(&stream[2], stream, stream_len);
+    stream[0] = 0x00;
+    stream[1] = 0xff;
+    stream_len += 2;
+    expected_pos = 2;
+    open_transport(1);
+    run_uart(1);
+    CHECK_EQUAL(0, num_mismatches);
+    CHECK_EQUAL(stream_len, expected_pos);
+}
+
+int main (int argc, const char * argv[]){
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  l2cap_can_send_now_benchmark.c
+ *
+ *  Emulates a controller with a shared ACL buffer pool and a per-connection limit. Bulk channels on
+ *  several connections request L2CAP_EVENT_CAN_SEND_NOW after every packet, while a high priority
+ *  media channel and a low priority SDP channel send periodically. Reports dispatch time per
+ *  completed packet, the packets per bulk channel, and the longest wait for media and SDP in completed packets.
+ *  The dispatch time grows with the number of bulk channels, as l2cap_run() checks all channels.
+ *
+ *  usage: l2cap_can_send_now_benchmark [nr_packets]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "btstack_event.h"
+#include "btstack_memory.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "hci.h"
+#include "l2cap.h"
+
+#define NUM_CONNECTIONS              8
+#define MAX_BULK_CHANNELS            256
+#define CONTROLLER_ACL_PACKETS       10
+#define CONTROLLER_ACL_PER_CONNECTION 2
+#define PERIODIC_INTERVAL            8
+#define PSM_TEST                     0x1001
+
+typedef struct {
+    uint16_t cid;
+    uint32_t requested;
+    uint32_t max_wait;
+    uint32_t packets;
+    int      waiting;
+} periodic_channel_t;
+
+static int nr_packets = 100000;
+
+static btstack_packet_callback_registration_t * event_callback_registration;
+
+static hci_connection_t connections[NUM_CONNECTIONS];
+static btstack_linked_list_t connection_list;
+
+// emulated controller: packets in flight are completed in order
+static int     acl_in_flight[NUM_CONNECTIONS];
+static uint8_t acl_fifo[CONTROLLER_ACL_PACKETS];
+static int     acl_fifo_read_index;
+static int     acl_fifo_count;
+static uint8_t outgoing_packet_buffer[HCI_ACL_BUFFER_SIZE];
+static int     outgoing_packet_reserved;
+
+static int      nr_bulk_channels;
+static uint16_t bulk_cids[MAX_BULK_CHANNELS];
+static uint32_t bulk_packets[MAX_BULK_CHANNELS];
+
+static periodic_channel_t media;
+static periodic_channel_t sdp;
+static uint32_t packets_completed;
+
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void address_for_index(int index, bd_addr_t addr){
+    int i;
+    for (i = 0; i < 6; i++){
+        addr[i] = (uint8_t) (index * 37 + i * 101);
+    }
+}
+
+static hci_con_handle_t handle_for_index(int index){
+    return 0x0001 + index;
+}
+
+static int controller_can_send(hci_con_handle_t con_handle){
+    if (acl_fifo_count >= CONTROLLER_ACL_PACKETS) return 0;
+    return acl_in_flight[con_handle - handle_for_index(0)] < CONTROLLER_ACL_PER_CONNECTION;
+}
+
+static void controller_send(hci_con_handle_t con_handle){
+    if (!controller_can_send(con_handle)){
+        printf("packet sent without buffer for handle 0x%04x\n", con_handle);
+        exit(EXIT_FAILURE);
+    }
+    int index = con_handle - handle_for_index(0);
+    acl_fifo[(acl_fifo_read_index + acl_fifo_count) % CONTROLLER_ACL_PACKETS] = index;
+    acl_fifo_count++;
+    acl_in_flight[index]++;
+}
+
+static void controller_complete_packet(void){
+    if (!acl_fifo_count) return;
+    int index = acl_fifo[acl_fifo_read_index];
+    acl_fifo_read_index = (acl_fifo_read_index + 1) % CONTROLLER_ACL_PACKETS;
+    acl_fifo_count--;
+    acl_in_flight[index]--;
+    packets_completed++;
+    uint8_t event[] = { HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS, 5, 1, 0, 0, 1, 0};
+    little_endian_store_16(event, 3, handle_for_index(index));
+    (*event_callback_registration->callback)(HCI_EVENT_PACKET, 0, event, sizeof(event));
+}
+
+static void periodic_request(periodic_channel_t * periodic){
+    periodic->waiting = 1;
+    periodic->requested = packets_completed;
+    l2cap_request_can_send_now_event(periodic->cid);
+}
+
+static void periodic_can_send_now(periodic_channel_t * periodic){
+    uint32_t wait = packets_completed - periodic->requested;
+    if (wait > periodic->max_wait){
+        periodic->max_wait = wait;
+    }
+    periodic->waiting = 0;
+    periodic->packets++;
+}
+
+static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t * packet, uint16_t size){
+    UNUSED(size);
+    if (packet_type != HCI_EVENT_PACKET) return;
+    if (hci_event_packet_get_type(packet) != L2CAP_EVENT_CAN_SEND_NOW) return;
+    uint16_t cid = l2cap_event_can_send_now_get_local_cid(packet);
+    hci_con_handle_t con_handle = 0;
+    if (cid == media.cid){
+        periodic_can_send_now(&media);
+        con_handle = handle_for_index(0);
+    } else if (cid == sdp.cid){
+        periodic_can_send_now(&sdp);
+        con_handle = handle_for_index(1);
+    } else {
+        // bulk channels are created in order with consecutive cids
+        int index = cid - bulk_cids[0];
+        bulk_packets[index]++;
+        con_handle = handle_for_index(index % NUM_CONNECTIONS);
+    }
+    controller_send(con_handle);
+    if (cid == media.cid || cid == sdp.cid) return;
+    l2cap_request_can_send_now_event(cid);
+}
+
+static uint16_t create_channel(int connection_index){
+    bd_addr_t addr;
+    address_for_index(connection_index, addr);
+    uint16_t cid = 0;
+    uint8_t status = l2cap_create_channel(&packet_handler, addr, PSM_TEST, 100, &cid);
+    if (status){
+        printf("create channel failed, status 0x%02x\n", status);
+        exit(EXIT_FAILURE);
+    }
+    return cid;
+}
+
+static int run_benchmark(void){
+    memset(&media, 0, sizeof(media));
+    memset(&sdp, 0, sizeof(sdp));
+    media.cid = create_channel(0);
+    sdp.cid   = create_channel(1);
+    l2cap_set_channel_priority(media.cid, L2CAP_CHANNEL_PRIORITY_HIGH);
+    l2cap_set_channel_priority(sdp.cid,   L2CAP_CHANNEL_PRIORITY_LOW);
+
+    int i;
+    for (i = 0; i < nr_bulk_channels; i++){
+        bulk_cids[i] = create_channel(i % NUM_CONNECTIONS);
+        bulk_packets[i] = 0;
+        if (bulk_cids[i] != bulk_cids[0] + i){
+            printf("unexpected cid 0x%04x\n", bulk_cids[i]);
+            return 0;
+        }
+    }
+    for (i = 0; i < nr_bulk_channels; i++){
+        l2cap_request_can_send_now_event(bulk_cids[i]);
+    }
+
+    packets_completed = 0;
+    uint64_t start = now_ns();
+    while (packets_completed < (uint32_t) nr_packets){
+        if (!media.waiting && (packets_completed % PERIODIC_INTERVAL) == 0){
+            periodic_request(&media);
+        }
+        if (!sdp.waiting && (packets_completed % PERIODIC_INTERVAL) == PERIODIC_INTERVAL / 2){
+            periodic_request(&sdp);
+        }
+        // re-queue all waiting bulk channels once
+        if (packets_completed == (uint32_t) nr_packets / 2){
+            for (i = 0; i < nr_bulk_channels; i++){
+                l2cap_set_channel_priority(bulk_cids[i], L2CAP_CHANNEL_PRIORITY_NORMAL);
+            }
+        }
+        controller_complete_packet();
+    }
+    double ns = (double) (now_ns() - start) / nr_packets;
+
+    uint32_t min_packets = 0xffffffff;
+    uint32_t max_packets = 0;
+    for (i = 0; i < nr_bulk_channels; i++){
+        if (bulk_packets[i] < min_packets) min_packets = bulk_packets[i];
+        if (bulk_packets[i] > max_packets) max_packets = bulk_packets[i];
+    }
+    printf("%3u bulk channels: %6.1f ns per completed packet, bulk packets per channel %5u..%5u, media %5u packets, max wait %2u, sdp %5u packets, max wait %2u\n",
+        nr_bulk_channels, ns, min_packets, max_packets, media.packets, media.max_wait, sdp.packets, sdp.max_wait);
+    return min_packets > 0 && sdp.packets > 0 && media.packets > 0;
+}
+
+static void reset(void){
+    memset(acl_in_flight, 0, sizeof(acl_in_flight));
+    acl_fifo_read_index = 0;
+    acl_fifo_count = 0;
+    btstack_memory_init();
+    l2cap_init();
+}
+
+int main(int argc, const char * argv[]){
+    if (argc > 1) nr_packets = atoi(argv[1]);
+    if (nr_packets < 1){
+        printf("usage: %s [nr_packets]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+
+    int i;
+    for (i = 0; i < NUM_CONNECTIONS; i++){
+        connections[i].con_handle = handle_for_index(i);
+        connections[i].address_type = BD_ADDR_TYPE_CLASSIC;
+        address_for_index(i, connections[i].address);
+        btstack_linked_list_add_tail(&connection_list, (btstack_linked_item_t *) &connections[i]);
+    }
+
+    static const int steps[] = { 8, 64, 256 };
+    unsigned int step;
+    for (step = 0; step < sizeof(steps) / sizeof(int); step++){
+        reset();
+        nr_bulk_channels = steps[step];
+        if (!run_benchmark()){
+            printf("FAILED: channel starved\n");
+            return EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
+
+// HCI
+
+void hci_add_event_handler(btstack_packet_callback_registration_t * callback_handler){
+    event_callback_registration = callback_handler;
+}
+
+void hci_register_acl_packet_handler(btstack_packet_handler_t handler){
+}
+
+hci_connection_t * hci_connection_for_handle(hci_con_handle_t con_handle){
+    int index = con_handle - handle_for_index(0);
+    if (index < 0 || index >= NUM_CONNECTIONS) return NULL;
+    return &connections[index];
+}
+
+hci_connection_t * hci_connection_for_bd_addr_and_type(bd_addr_t addr, bd_addr_type_t addr_type){
+    int i;
+    for (i = 0; i < NUM_CONNECTIONS; i++){
+        if (connections[i].address_type != addr_type) continue;
+        if (bd_addr_cmp(addr, connections[i].address)) continue;
+        return &connections[i];
+    }
+    return NULL;
+}
+
+void hci_connections_get_iterator(btstack_linked_list_iterator_t * it){
+    btstack_linked_list_iterator_init(it, &connection_list);
+}
+
+int hci_authentication_active_for_handle(hci_con_handle_t handle){
+    return 0;
+}
+
+void hci_disconnect_security_block(hci_con_handle_t con_handle){
+}
+
+int hci_can_send_command_packet_now(void){
+    return 1;
+}
+
+int hci_send_cmd(const hci_cmd_t * cmd, ...){
+    return 0;
+}
+
+int hci_can_send_acl_classic_packet_now(void){
+    if (outgoing_packet_reserved) return 0;
+    return acl_fifo_count < CONTROLLER_ACL_PACKETS;
+}
+
+int hci_can_send_acl_le_packet_now(void){
+    return 0;
+}
+
+int hci_can_send_prepared_acl_packet_now(hci_con_handle_t con_handle){
+    return controller_can_send(con_handle);
+}
+
+int hci_can_send_acl_packet_now(hci_con_handle_t con_handle){
+    if (outgoing_packet_reserved) return 0;
+    return controller_can_send(con_handle);
+}
+
+int hci_reserve_packet_buffer(void){
+    outgoing_packet_reserved = 1;
+    return 1;
+}
+
+void hci_release_packet_buffer(void){
+    outgoing_packet_reserved = 0;
+}
+
+int hci_is_packet_buffer_reserved(void){
+    return outgoing_packet_reserved;
+}
+
+uint8_t * hci_get_outgoing_packet_buffer(void){
+    return outgoing_packet_buffer;
+}
+
+int hci_send_acl_packet_buffer(int size){
+    UNUSED(size);
+    outgoing_packet_reserved = 0;
+    controller_send(little_endian_read_16(outgoing_packet_buffer, 0) & 0x0fff);
+    return 0;
+}
+
+uint16_t hci_max_acl_data_packet_length(void){
+    return HCI_ACL_PAYLOAD_SIZE;
+}
+
+int hci_non_flushable_packet_boundary_flag_supported(void){
+    return 1;
+}
+
+uint16_t hci_usable_acl_packet_types(void){
+    return 0;
+}
+
+// GAP
+
+void gap_connectable_control(uint8_t enable){
+}
+
+void gap_drop_link_key_for_bd_addr(bd_addr_t addr){
+}
+
+gap_connection_type_t gap_get_connection_type(hci_con_handle_t connection_handle){
+    return GAP_CONNECTION_ACL;
+}
+
+int gap_ssp_supported_on_both_sides(hci_con_handle_t handle){
+    return 0;
+}
+
+void gap_request_security_level(hci_con_handle_t con_handle, gap_security_level_t level){
+}
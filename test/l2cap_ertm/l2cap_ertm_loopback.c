@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  l2cap_ertm_loopback.c
+ *
+ *  Connects an L2CAP channel in Enhanced Retransmission or Streaming Mode to a local service
+ *  over an HCI loopback, transfers SDUs larger than the ACL payload and reports the throughput
+ *
+ *  usage: l2cap_ertm_loopback [ertm|streaming] [drop_interval] [nr_sdus] [sdu_size]
+ *  drop_interval n drops 1 in n data channel frames at random. The test fails if not all SDUs are received in ERTM
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btstack_event.h"
+#include "btstack_memory.h"
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_posix.h"
+#include "hci_dump.h"
+#include "l2cap.h"
+#include "mock.h"
+
+#define PSM_TEST 0x1001
+#define MAX_SDU_SIZE 4000
+
+// test is considered failed if no progress is made
+#define WATCHDOG_TIMEOUT_MS 2000
+
+static bd_addr_t remote_addr = { 0x00, 0x1b, 0xdc, 0x07, 0x32, 0xef };
+
+static l2cap_ertm_config_t ertm_config = {
+    L2CAP_CHANNEL_MODE_ENHANCED_RETRANSMISSION,
+    1,      // ertm mandatory
+    10,     // max transmit
+    100,    // retransmission timeout ms
+    500,    // monitor timeout ms
+    MAX_SDU_SIZE,   // local mtu
+    16,     // tx window
+    32,     // num tx buffers
+    1,      // fcs option
+};
+
+static uint8_t ertm_buffer_outgoing[32 * (1024 + 8) + MAX_SDU_SIZE + 8];
+static uint8_t ertm_buffer_incoming[32 * (1024 + 8) + MAX_SDU_SIZE + 8];
+
+static uint8_t  sdu[MAX_SDU_SIZE];
+static uint16_t sdu_size = 3000;
+static int      nr_sdus  = 2000;
+
+static uint16_t outgoing_cid;
+static uint16_t incoming_cid;
+static int      sdus_sent;
+static int      sdus_received;
+static int      sdus_lost;
+static uint32_t start_ms;
+
+static btstack_timer_source_t watchdog;
+
+static void fill_sdu(int index){
+    int i;
+    for (i = 0; i < sdu_size; i++){
+        sdu[i] = (uint8_t) (index + i);
+    }
+}
+
+static void test_done(void);
+
+static void watchdog_handler(btstack_timer_source_t * ts){
+    // in Streaming Mode, last SDUs might have been lost
+    if (ertm_config.mode == L2CAP_CHANNEL_MODE_STREAMING && sdus_sent == nr_sdus && sdus_received > 0){
+        sdus_lost = nr_sdus - sdus_received;
+        test_done();
+    }
+    printf("FAILED: timeout, %u of %u SDUs received\n", sdus_received, nr_sdus);
+    exit(EXIT_FAILURE);
+}
+
+static void watchdog_restart(void){
+    btstack_run_loop_remove_timer(&watchdog);
+    btstack_run_loop_set_timer(&watchdog, WATCHDOG_TIMEOUT_MS);
+    btstack_run_loop_add_timer(&watchdog);
+}
+
+static void test_done(void){
+    uint32_t duration_ms = btstack_run_loop_get_time_ms() - start_ms;
+    if (sdus_received + sdus_lost < nr_sdus){
+        // stopped by watchdog
+        duration_ms -= WATCHDOG_TIMEOUT_MS;
+    }
+    if (duration_ms == 0){
+        duration_ms = 1;
+    }
+    uint32_t bytes = sdus_received * sdu_size;
+    printf("%s: %u SDUs of %u bytes in %u ms, %u SDUs lost, %u frames dropped, %u kB/s\n",
+        ertm_config.mode == L2CAP_CHANNEL_MODE_STREAMING ? "Streaming" : "ERTM",
+        sdus_received, sdu_size, duration_ms, sdus_lost, mock_num_dropped(), bytes / duration_ms);
+    exit(EXIT_SUCCESS);
+}
+
+static void send_sdus(void){
+    while (sdus_sent < nr_sdus){
+        if (!l2cap_can_send_packet_now(outgoing_cid)){
+            l2cap_request_can_send_now_event(outgoing_cid);
+            return;
+        }
+        fill_sdu(sdus_sent);
+        int status = l2cap_send(outgoing_cid, sdu, sdu_size);
+        if (status){
+            printf("FAILED: l2cap_send status 0x%02x\n", status);
+            exit(EXIT_FAILURE);
+        }
+        sdus_sent++;
+    }
+}
+
+static void handle_sdu(uint8_t * packet, uint16_t size){
+    if (size != sdu_size){
+        printf("FAILED: SDU %u, size %u instead of %u\n", sdus_received, size, sdu_size);
+        exit(EXIT_FAILURE);
+    }
+    // in Streaming Mode, lost SDUs are skipped
+    int index = sdus_received + sdus_lost;
+    for (; index < nr_sdus; index++){
+        fill_sdu(index);
+        if (memcmp(sdu, packet, size) == 0) break;
+        if (ertm_config.mode != L2CAP_CHANNEL_MODE_STREAMING){
+            printf("FAILED: SDU %u, data mismatch\n", sdus_received);
+            exit(EXIT_FAILURE);
+        }
+        sdus_lost++;
+    }
+    if (index == nr_sdus){
+        printf("FAILED: SDU %u, data mismatch\n", sdus_received);
+        exit(EXIT_FAILURE);
+    }
+    sdus_received++;
+    watchdog_restart();
+    if (sdus_received + sdus_lost == nr_sdus){
+        test_done();
+    }
+}
+
+static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t * packet, uint16_t size){
+    uint8_t status;
+    switch (packet_type){
+        case L2CAP_DATA_PACKET:
+            if (channel != incoming_cid) break;
+            handle_sdu(packet, size);
+            break;
+        case HCI_EVENT_PACKET:
+            switch (hci_event_packet_get_type(packet)){
+                case L2CAP_EVENT_INCOMING_CONNECTION:
+                    incoming_cid = l2cap_event_incoming_connection_get_local_cid(packet);
+                    status = l2cap_accept_ertm_connection(incoming_cid, &ertm_config, ertm_buffer_incoming, sizeof(ertm_buffer_incoming));
+                    if (status){
+                        printf("FAILED: accept status 0x%02x\n", status);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+                case L2CAP_EVENT_CHANNEL_OPENED:
+                    status = l2cap_event_channel_opened_get_status(packet);
+                    if (status){
+                        printf("FAILED: channel opened status 0x%02x\n", status);
+                        exit(EXIT_FAILURE);
+                    }
+                    if (l2cap_event_channel_opened_get_local_cid(packet) != outgoing_cid) break;
+                    start_ms = btstack_run_loop_get_time_ms();
+                    send_sdus();
+                    break;
+                case L2CAP_EVENT_CAN_SEND_NOW:
+                    if (l2cap_event_can_send_now_get_local_cid(packet) != outgoing_cid) break;
+                    send_sdus();
+                    break;
+                case L2CAP_EVENT_CHANNEL_CLOSED:
+                    printf("FAILED: channel closed, %u of %u SDUs received\n", sdus_received, nr_sdus);
+                    exit(EXIT_FAILURE);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+int main(int argc, const char * argv[]){
+    int drop_interval = 0;
+    if (argc > 1 && strcmp(argv[1], "streaming") == 0){
+        ertm_config.mode = L2CAP_CHANNEL_MODE_STREAMING;
+    }
+    if (argc > 2){
+        drop_interval = atoi(argv[2]);
+    }
+    if (argc > 3){
+        nr_sdus = atoi(argv[3]);
+    }
+    if (argc > 4){
+        sdu_size = atoi(argv[4]);
+        if (sdu_size < 1 || sdu_size > MAX_SDU_SIZE){
+            printf("sdu_size must be 1..%u\n", MAX_SDU_SIZE);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // only report errors
+    hci_dump_enable_log_level(LOG_LEVEL_INFO, 0);
+
+    btstack_memory_init();
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    mock_init(remote_addr);
+    mock_set_drop_interval(drop_interval);
+
+    l2cap_init();
+    l2cap_register_service(&packet_handler, PSM_TEST, MAX_SDU_SIZE, LEVEL_0);
+    uint8_t status = l2cap_create_ertm_channel(&packet_handler, remote_addr, PSM_TEST, &ertm_config,
+        ertm_buffer_outgoing, sizeof(ertm_buffer_outgoing), &outgoing_cid);
+    if (status){
+        printf("FAILED: create channel status 0x%02x\n", status);
+        return EXIT_FAILURE;
+    }
+
+    btstack_run_loop_set_timer_handler(&watchdog, watchdog_handler);
+    watchdog_restart();
+
+    btstack_run_loop_execute();
+    return 0;
+}
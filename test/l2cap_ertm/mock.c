@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  mock.c
+ *
+ *  HCI loopback for L2CAP tests: outgoing ACL packets are queued and delivered back to L2CAP
+ *  on the same connection, so that an outgoing channel connects to a local service.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "hci.h"
+#include "hci_dump.h"
+#include "l2cap.h"
+#include "mock.h"
+
+// number of ACL packets the "controller" can buffer
+#define MOCK_NUM_ACL_PACKETS 8
+
+static btstack_packet_handler_t acl_packet_handler;
+static btstack_packet_callback_registration_t * event_callback_registration;
+
+static hci_connection_t     connection;
+static btstack_linked_list_t connections;
+
+static uint8_t  outgoing_packet_buffer[HCI_ACL_BUFFER_SIZE];
+static int      outgoing_packet_reserved;
+
+static uint8_t  acl_packets[MOCK_NUM_ACL_PACKETS][HCI_ACL_BUFFER_SIZE];
+static uint16_t acl_packets_size[MOCK_NUM_ACL_PACKETS];
+static int      acl_packets_read_index;
+static int      acl_packets_queued;
+
+static int      security_level_requested;
+
+static int      drop_interval;
+static uint32_t drop_random;
+static uint32_t num_dropped;
+
+static btstack_timer_source_t loopback_timer;
+
+static void mock_emit_event(uint8_t * event, uint16_t size){
+    if (!event_callback_registration) return;
+    (*event_callback_registration->callback)(HCI_EVENT_PACKET, 0, event, size);
+}
+
+static void mock_deliver_packet(void){
+    uint8_t  packet[HCI_INCOMING_PRE_BUFFER_SIZE + HCI_ACL_BUFFER_SIZE];
+    uint16_t size = acl_packets_size[acl_packets_read_index];
+    memcpy(&packet[HCI_INCOMING_PRE_BUFFER_SIZE], acl_packets[acl_packets_read_index], size);
+    acl_packets_read_index = (acl_packets_read_index + 1) % MOCK_NUM_ACL_PACKETS;
+    acl_packets_queued--;
+
+    uint16_t cid = little_endian_read_16(packet, HCI_INCOMING_PRE_BUFFER_SIZE + 6);
+    int drop = 0;
+    if (cid >= 0x40 && drop_interval){
+        // fixed LCG instead of a regular pattern that could hit the same retransmitted frame every time
+        drop_random = drop_random * 1103515245 + 12345;
+        drop = ((drop_random >> 16) % drop_interval) == 0;
+    }
+
+    if (drop){
+        num_dropped++;
+    } else {
+        (*acl_packet_handler)(HCI_ACL_DATA_PACKET, 0, &packet[HCI_INCOMING_PRE_BUFFER_SIZE], size);
+    }
+
+    // report buffer as free
+    uint8_t event[] = { HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS, 5, 1, 0, 0, 1, 0};
+    little_endian_store_16(event, 3, connection.con_handle);
+    mock_emit_event(event, sizeof(event));
+}
+
+static void mock_loopback_handler(btstack_timer_source_t * ts){
+    if (security_level_requested){
+        security_level_requested = 0;
+        uint8_t event[] = { GAP_EVENT_SECURITY_LEVEL, 3, 0, 0, LEVEL_0};
+        little_endian_store_16(event, 2, connection.con_handle);
+        mock_emit_event(event, sizeof(event));
+    }
+    int num_packets = acl_packets_queued;
+    while (num_packets--){
+        mock_deliver_packet();
+    }
+    // poll again, packets are delivered from run loop to avoid recursion
+    btstack_run_loop_set_timer(ts, acl_packets_queued ? 0 : 1);
+    btstack_run_loop_add_timer(ts);
+}
+
+void mock_init(bd_addr_t remote_addr){
+    memset(&connection, 0, sizeof(connection));
+    connection.con_handle = 0x0001;
+    connection.address_type = BD_ADDR_TYPE_CLASSIC;
+    connection.bonding_flags = BONDING_RECEIVED_REMOTE_FEATURES;
+    bd_addr_copy(connection.address, remote_addr);
+    connections = NULL;
+    btstack_linked_list_add(&connections, (btstack_linked_item_t *) &connection);
+
+    btstack_run_loop_set_timer_handler(&loopback_timer, mock_loopback_handler);
+    btstack_run_loop_set_timer(&loopback_timer, 0);
+    btstack_run_loop_add_timer(&loopback_timer);
+}
+
+void mock_set_drop_interval(int interval){
+    drop_interval = interval;
+    drop_random = 1;
+}
+
+uint32_t mock_num_dropped(void){
+    return num_dropped;
+}
+
+// HCI
+
+void hci_add_event_handler(btstack_packet_callback_registration_t * callback_handler){
+    event_callback_registration = callback_handler;
+}
+
+void hci_register_acl_packet_handler(btstack_packet_handler_t handler){
+    acl_packet_handler = handler;
+}
+
+hci_connection_t * hci_connection_for_handle(hci_con_handle_t con_handle){
+    if (con_handle != connection.con_handle) return NULL;
+    return &connection;
+}
+
+hci_connection_t * hci_connection_for_bd_addr_and_type(bd_addr_t addr, bd_addr_type_t addr_type){
+    if (addr_type != BD_ADDR_TYPE_CLASSIC) return NULL;
+    if (bd_addr_cmp(addr, connection.address)) return NULL;
+    return &connection;
+}
+
+void hci_connections_get_iterator(btstack_linked_list_iterator_t * it){
+    btstack_linked_list_iterator_init(it, &connections);
+}
+
+int hci_authentication_active_for_handle(hci_con_handle_t handle){
+    return 0;
+}
+
+void hci_disconnect_security_block(hci_con_handle_t con_handle){
+}
+
+int hci_can_send_command_packet_now(void){
+    return 1;
+}
+
+int hci_send_cmd(const hci_cmd_t * cmd, ...){
+    return 0;
+}
+
+int hci_can_send_acl_classic_packet_now(void){
+    if (outgoing_packet_reserved) return 0;
+    return acl_packets_queued < MOCK_NUM_ACL_PACKETS;
+}
+
+int hci_can_send_acl_le_packet_now(void){
+    return 0;
+}
+
+int hci_can_send_prepared_acl_packet_now(hci_con_handle_t con_handle){
+    return acl_packets_queued < MOCK_NUM_ACL_PACKETS;
+}
+
+int hci_can_send_acl_packet_now(hci_con_handle_t con_handle){
+    if (outgoing_packet_reserved) return 0;
+    return hci_can_send_prepared_acl_packet_now(con_handle);
+}
+
+int hci_reserve_packet_buffer(void){
+    if (outgoing_packet_reserved){
+        log_error("hci_reserve_packet_buffer called but buffer already reserved");
+        return 0;
+    }
+    outgoing_packet_reserved = 1;
+    return 1;
+}
+
+void hci_release_packet_buffer(void){
+    outgoing_packet_reserved = 0;
+}
+
+int hci_is_packet_buffer_reserved(void){
+    return outgoing_packet_reserved;
+}
+
+uint8_t * hci_get_outgoing_packet_buffer(void){
+    return outgoing_packet_buffer;
+}
+
+int hci_send_acl_packet_buffer(int size){
+    outgoing_packet_reserved = 0;
+    if (acl_packets_queued >= MOCK_NUM_ACL_PACKETS){
+        log_error("hci_send_acl_packet_buffer called but no controller buffer available");
+        return BTSTACK_ACL_BUFFERS_FULL;
+    }
+    int index = (acl_packets_read_index + acl_packets_queued) % MOCK_NUM_ACL_PACKETS;
+    memcpy(acl_packets[index], outgoing_packet_buffer, size);
+    acl_packets_size[index] = size;
+    acl_packets_queued++;
+    return 0;
+}
+
+uint16_t hci_max_acl_data_packet_length(void){
+    return HCI_ACL_PAYLOAD_SIZE;
+}
+
+int hci_non_flushable_packet_boundary_flag_supported(void){
+    return 1;
+}
+
+uint16_t hci_usable_acl_packet_types(void){
+    return 0;
+}
+
+// GAP
+
+void gap_connectable_control(uint8_t enable){
+}
+
+void gap_drop_link_key_for_bd_addr(bd_addr_t addr){
+}
+
+gap_connection_type_t gap_get_connection_type(hci_con_handle_t connection_handle){
+    return GAP_CONNECTION_ACL;
+}
+
+int gap_ssp_supported_on_both_sides(hci_con_handle_t handle){
+    return 0;
+}
+
+void gap_request_security_level(hci_con_handle_t con_handle, gap_security_level_t level){
+    security_level_requested = 1;
+}
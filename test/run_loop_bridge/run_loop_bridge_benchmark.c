@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2016 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+/*
+ *  run_loop_bridge_benchmark.c
+ *
+ *  Measures latency and throughput of callbacks posted from several threads into the BTstack thread
+ *
+ *  usage: run_loop_bridge_benchmark [nr_threads] [posts_per_thread]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "btstack_run_loop.h"
+#include "btstack_run_loop_bridge.h"
+#include "btstack_run_loop_bridge_posix.h"
+#include "btstack_run_loop_posix.h"
+
+#define MAX_THREADS 64
+
+typedef struct {
+    btstack_run_loop_bridge_item_t item;
+    uint64_t posted_ns;
+} benchmark_item_t;
+
+static int nr_threads = 4;
+static int posts_per_thread = 100000;
+
+static benchmark_item_t * items;
+static pthread_t threads[MAX_THREADS];
+
+static int      received;
+static uint64_t latency_sum_ns;
+static uint64_t latency_max_ns;
+static uint64_t start_ns;
+static uint64_t post_duration_ns[MAX_THREADS];
+
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(void){
+    uint64_t total_ns = now_ns() - start_ns;
+    uint64_t post_ns = 0;
+    int i;
+    for (i = 0; i < nr_threads; i++){
+        post_ns += post_duration_ns[i];
+    }
+    printf("%u threads x %u posts\n", nr_threads, posts_per_thread);
+    printf("- throughput:   %.0f callbacks/s\n", (double) received * 1e9 / total_ns);
+    printf("- post cost:    %.1f ns average\n", (double) post_ns / received);
+    printf("- latency:      %.1f us average, %.1f us max\n", (double) latency_sum_ns / received / 1000.0, (double) latency_max_ns / 1000.0);
+}
+
+static void benchmark_callback(void * context){
+    benchmark_item_t * item = (benchmark_item_t *) context;
+    uint64_t latency = now_ns() - item->posted_ns;
+    latency_sum_ns += latency;
+    if (latency > latency_max_ns){
+        latency_max_ns = latency;
+    }
+    received++;
+    if (received < nr_threads * posts_per_thread) return;
+    report();
+    exit(0);
+}
+
+static void * producer_thread(void * arg){
+    int thread_nr = (int)(intptr_t) arg;
+    benchmark_item_t * thread_items = &items[thread_nr * posts_per_thread];
+    uint64_t post_ns = 0;
+    int i;
+    for (i = 0; i < posts_per_thread; i++){
+        uint64_t before = now_ns();
+        thread_items[i].posted_ns = before;
+        btstack_run_loop_bridge_post_callback(&thread_items[i].item, &benchmark_callback, &thread_items[i]);
+        post_ns += now_ns() - before;
+    }
+    post_duration_ns[thread_nr] = post_ns;
+    return NULL;
+}
+
+static void start_threads(btstack_timer_source_t * ts){
+    int i;
+    start_ns = now_ns();
+    for (i = 0; i < nr_threads; i++){
+        pthread_create(&threads[i], NULL, &producer_thread, (void *)(intptr_t) i);
+    }
+}
+
+int main(int argc, const char * argv[]){
+    static btstack_timer_source_t start_timer;
+
+    if (argc > 1) nr_threads = atoi(argv[1]);
+    if (argc > 2) posts_per_thread = atoi(argv[2]);
+    if (nr_threads < 1 || nr_threads > MAX_THREADS || posts_per_thread < 1){
+        printf("usage: %s [nr_threads 1-%u] [posts_per_thread]\n", argv[0], MAX_THREADS);
+        return 1;
+    }
+    items = calloc(nr_threads * posts_per_thread, sizeof(benchmark_item_t));
+
+    btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+    btstack_run_loop_bridge_posix_init();
+
+    // start producers from within run loop
+    btstack_run_loop_set_timer_handler(&start_timer, &start_threads);
+    btstack_run_loop_set_timer(&start_timer, 0);
+    btstack_run_loop_add_timer(&start_timer);
+
+    btstack_run_loop_execute();
+    return 0;
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+ 
+// *****************************************************************************
+//
+// SBC encoder multi-stream benchmark
+//
+// Encodes several A2DP SBC and HFP mSBC streams concurrently with independent
+// encoder instances, first interleaved on a single thread and then with one
+// thread per stream. Each stream's output is compared against a reference
+// encoding of the same stream run in isolation.
+//
+// *****************************************************************************
+
+#include "btstack_config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "btstack.h"
+
+#include "hfp_msbc.h"
+#include "btstack_sbc.h"
+
+#define NUM_A2DP_STREAMS_DEFAULT    2
+#define NUM_MSBC_STREAMS_DEFAULT    6
+#define MAX_STREAMS                 32
+#define AUDIO_DURATION_SECONDS      10
+#define SBC_FRAME_BUFFER_SIZE       512
+
+typedef enum {
+    STREAM_TYPE_A2DP,
+    STREAM_TYPE_MSBC
+} stream_type_t;
+
+typedef struct {
+    stream_type_t type;
+    int           index;
+    int           num_channels;
+    int           sample_rate;
+
+    // encoder instances
+    btstack_sbc_encoder_state_t sbc_encoder_state;
+    hfp_msbc_state_t            msbc_state;
+
+    // input
+    int16_t * pcm;
+    int       pcm_frames;
+    int       pcm_position;
+
+    // output
+    uint8_t   sbc_frame[SBC_FRAME_BUFFER_SIZE];
+    uint32_t  checksum;
+    uint32_t  reference_checksum;
+    int       num_sbc_frames;
+    int       num_sbc_bytes;
+} stream_t;
+
+static stream_t streams[MAX_STREAMS];
+static int num_streams;
+
+static double time_now(void){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+// FNV-1a
+static uint32_t checksum_update(uint32_t checksum, const uint8_t * data, int len){
+    int i;
+    for (i=0;i<len;i++){
+        checksum ^= data[i];
+        checksum *= 16777619u;
+    }
+    return checksum;
+}
+
+// tone mix with per-stream frequencies and a little noise, so that streams differ
+static void stream_generate_pcm(stream_t * stream){
+    stream->pcm_frames = stream->sample_rate * AUDIO_DURATION_SECONDS;
+    stream->pcm = malloc(stream->pcm_frames * stream->num_channels * sizeof(int16_t));
+    uint32_t noise = 0x12345678 + stream->index;
+    int i, c;
+    for (i=0;i<stream->pcm_frames;i++){
+        for (c=0;c<stream->num_channels;c++){
+            double f = 220.0 * (stream->index + 1) + 110.0 * c;
+            noise = noise * 1664525u + 1013904223u;
+            double sample = 12000.0 * sin(2 * M_PI * f * i / stream->sample_rate) + (int16_t)(noise >> 16) / 16.0;
+            stream->pcm[i * stream->num_channels + c] = (int16_t) sample;
+        }
+    }
+}
+
+static void stream_init(stream_t * stream){
+    stream->pcm_position   = 0;
+    stream->checksum       = 2166136261u;
+    stream->num_sbc_frames = 0;
+    stream->num_sbc_bytes  = 0;
+    switch (stream->type){
+        case STREAM_TYPE_A2DP:
+            // A2DP high quality: 44.1 kHz joint stereo, 16 blocks, 8 subbands, loudness, bitpool 53
+            btstack_sbc_encoder_init(&stream->sbc_encoder_state, SBC_MODE_STANDARD, 16, 8, 0, 44100, 53, SBC_CHANNEL_MODE_JOINT_STEREO);
+            break;
+        case STREAM_TYPE_MSBC:
+            hfp_msbc_init(&stream->msbc_state);
+            break;
+    }
+}
+
+// encode a single SBC/mSBC frame, returns 0 if input is exhausted
+static int stream_encode_frame(stream_t * stream){
+    int num_frames;
+    switch (stream->type){
+        case STREAM_TYPE_A2DP:
+            num_frames = btstack_sbc_encoder_num_audio_samples(&stream->sbc_encoder_state) / stream->num_channels;
+            if (stream->pcm_position + num_frames > stream->pcm_frames) return 0;
+            uint16_t len = btstack_sbc_encoder_process_data(&stream->sbc_encoder_state,
+                &stream->pcm[stream->pcm_position * stream->num_channels], stream->sbc_frame);
+            stream->pcm_position += num_frames;
+            stream->checksum = checksum_update(stream->checksum, stream->sbc_frame, len);
+            stream->num_sbc_bytes += len;
+            break;
+        case STREAM_TYPE_MSBC:
+            num_frames = hfp_msbc_num_audio_samples_per_frame(&stream->msbc_state);
+            if (stream->pcm_position + num_frames > stream->pcm_frames) return 0;
+            hfp_msbc_encode_audio_frame(&stream->msbc_state, &stream->pcm[stream->pcm_position]);
+            stream->pcm_position += num_frames;
+            while (hfp_msbc_num_bytes_in_stream(&stream->msbc_state)){
+                int bytes = hfp_msbc_num_bytes_in_stream(&stream->msbc_state);
+                if (bytes > (int) sizeof(stream->sbc_frame)){
+                    bytes = sizeof(stream->sbc_frame);
+                }
+                hfp_msbc_read_from_stream(&stream->msbc_state, stream->sbc_frame, bytes);
+                stream->checksum = checksum_update(stream->checksum, stream->sbc_frame, bytes);
+                stream->num_sbc_bytes += bytes;
+            }
+            break;
+    }
+    stream->num_sbc_frames++;
+    return 1;
+}
+
+static void stream_encode_all(stream_t * stream){
+    stream_init(stream);
+    while (stream_encode_frame(stream));
+}
+
+static void * stream_thread(void * context){
+    stream_encode_all((stream_t *) context);
+    return NULL;
+}
+
+static int verify_streams(const char * name){
+    int errors = 0;
+    int i;
+    for (i=0;i<num_streams;i++){
+        if (streams[i].checksum == streams[i].reference_checksum) continue;
+        printf("%s: stream %u output differs from isolated encoding (0x%08x != 0x%08x)\n", name,
+            i, streams[i].checksum, streams[i].reference_checksum);
+        errors++;
+    }
+    return errors;
+}
+
+static void report(const char * name, double duration){
+    int total_frames = 0;
+    int i;
+    for (i=0;i<num_streams;i++){
+        total_frames += streams[i].num_sbc_frames;
+    }
+    double audio_seconds = num_streams * (double) AUDIO_DURATION_SECONDS;
+    printf("%-12s %8.3f s, %9.0f frames/s, %6.2f us/frame, %7.1f x realtime (all streams)\n", name, duration,
+        total_frames / duration, duration * 1000000.0 / total_frames, audio_seconds / duration);
+}
+
+int main (int argc, const char * argv[]){
+    int num_a2dp_streams = NUM_A2DP_STREAMS_DEFAULT;
+    int num_msbc_streams = NUM_MSBC_STREAMS_DEFAULT;
+    if (argc > 1){
+        num_a2dp_streams = atoi(argv[1]);
+    }
+    if (argc > 2){
+        num_msbc_streams = atoi(argv[2]);
+    }
+    if (num_a2dp_streams < 0 || num_msbc_streams < 0 || num_a2dp_streams + num_msbc_streams == 0 ||
+        num_a2dp_streams + num_msbc_streams > MAX_STREAMS){
+        printf("Usage: %s [NUM_A2DP_STREAMS] [NUM_MSBC_STREAMS], at most %u streams in total\n", argv[0], MAX_STREAMS);
+        return -1;
+    }
+
+    int i;
+    num_streams = num_a2dp_streams + num_msbc_streams;
+    for (i=0;i<num_streams;i++){
+        stream_t * stream = &streams[i];
+        stream->index = i;
+        if (i < num_a2dp_streams){
+            stream->type         = STREAM_TYPE_A2DP;
+            stream->num_channels = 2;
+            stream->sample_rate  = 44100;
+        } else {
+            stream->type         = STREAM_TYPE_MSBC;
+            stream->num_channels = 1;
+            stream->sample_rate  = 16000;
+        }
+        stream_generate_pcm(stream);
+    }
+    printf("SBC encoder benchmark: %u A2DP SBC and %u HFP mSBC streams, %u s audio each\n",
+        num_a2dp_streams, num_msbc_streams, AUDIO_DURATION_SECONDS);
+
+    // reference: each stream on its own
+    double start = time_now();
+    for (i=0;i<num_streams;i++){
+        stream_encode_all(&streams[i]);
+        streams[i].reference_checksum = streams[i].checksum;
+    }
+    report("sequential", time_now() - start);
+
+    // interleaved: one frame per stream in turn, single thread
+    for (i=0;i<num_streams;i++){
+        stream_init(&streams[i]);
+    }
+    start = time_now();
+    int active = num_streams;
+    while (active){
+        active = 0;
+        for (i=0;i<num_streams;i++){
+            active += stream_encode_frame(&streams[i]);
+        }
+    }
+    report("interleaved", time_now() - start);
+    int errors = verify_streams("interleaved");
+
+    // threaded: one encoder thread per stream
+    pthread_t threads[MAX_STREAMS];
+    start = time_now();
+    for (i=0;i<num_streams;i++){
+        pthread_create(&threads[i], NULL, &stream_thread, &streams[i]);
+    }
+    for (i=0;i<num_streams;i++){
+        pthread_join(threads[i], NULL);
+    }
+    report("threaded", time_now() - start);
+    errors += verify_streams("threaded");
+
+    for (i=0;i<num_streams;i++){
+        stream_t * stream = &streams[i];
+        printf("stream %2u: %s, %6u frames, %7u bytes, checksum 0x%08x\n", i,
+            stream->type == STREAM_TYPE_A2DP ? "A2DP SBC" : "HFP mSBC",
+            stream->num_sbc_frames, stream->num_sbc_bytes, stream->checksum);
+        free(stream->pcm);
+    }
+
+    if (errors){
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+ 
+// *****************************************************************************
+//
+// SBC SIMD filterbank test vectors
+//
+// Encodes a set of generated test signals with all combinations of subbands,
+// blocks, channel modes and allocation methods, plus mSBC, and decodes the
+// result again. The checksums of the SBC frames and of the decoded PCM are
+// compared against reference values from the scalar implementation, for every
+// SIMD implementation supported by the current CPU.
+//
+// *****************************************************************************
+
+#include "btstack_config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "btstack.h"
+
+#include "btstack_sbc.h"
+#include "oi_codec_sbc.h"
+
+#define TEST_DURATION_MS        300
+#define MAX_PCM_FRAMES          (48000 * TEST_DURATION_MS / 1000)
+#define DECODER_DATA_SIZE       (SBC_MAX_CHANNELS*SBC_MAX_BLOCKS*SBC_MAX_BANDS * 4 + SBC_CODEC_MIN_FILTER_BUFFERS*SBC_MAX_BANDS*SBC_MAX_CHANNELS * 2)
+#define NUM_STANDARD_CONFIGS    64
+#define NUM_CONFIGS             (NUM_STANDARD_CONFIGS + 1)
+
+typedef struct {
+    btstack_sbc_mode_t mode;
+    int subbands;
+    int blocks;
+    btstack_sbc_channel_mode_t channel_mode;
+    int allocation_method;
+    int sample_rate;
+    int bitpool;
+} test_config_t;
+
+typedef struct {
+    uint32_t sbc_checksum;
+    uint32_t pcm_checksum;
+} test_vector_t;
+
+// reference checksums of the scalar implementation
+static const test_vector_t test_vectors[NUM_CONFIGS] = {
+#include "sbc_simd_test_vectors.h"
+};
+
+static const char * simd_names[] = { "none", "sse2", "avx2", "neon" };
+
+static int16_t  pcm_in[MAX_PCM_FRAMES * 2];
+static int16_t  pcm_out[SBC_MAX_CHANNELS * SBC_MAX_BANDS * SBC_MAX_BLOCKS];
+static uint8_t  sbc_frame[512];
+static OI_UINT32 decoder_data[(DECODER_DATA_SIZE+3)/4];
+static OI_CODEC_SBC_DECODER_CONTEXT decoder_context;
+static btstack_sbc_encoder_state_t encoder_state;
+
+// FNV-1a
+static uint32_t checksum_update(uint32_t checksum, const uint8_t * data, int len){
+    int i;
+    for (i=0;i<len;i++){
+        checksum ^= data[i];
+        checksum *= 16777619u;
+    }
+    return checksum;
+}
+
+static void config_for_index(int index, test_config_t * config){
+    static const int sample_rates[] = { 16000, 32000, 44100, 48000 };
+    static const int bitpools[] = { 2, 18, 35, 53 };
+    if (index == NUM_STANDARD_CONFIGS){
+        config->mode              = SBC_MODE_mSBC;
+        config->subbands          = 8;
+        config->blocks            = 15;
+        config->channel_mode      = SBC_CHANNEL_MODE_MONO;
+        config->allocation_method = 0;
+        config->sample_rate       = 16000;
+        config->bitpool           = 26;
+        return;
+    }
+    config->mode              = SBC_MODE_STANDARD;
+    config->subbands          = (index & 1) ? 8 : 4;
+    config->allocation_method = (index >> 1) & 1;
+    config->channel_mode      = (btstack_sbc_channel_mode_t) ((index >> 2) & 3);
+    config->blocks            = 4 * (((index >> 4) & 3) + 1);
+    config->sample_rate       = sample_rates[index & 3];
+    config->bitpool           = bitpools[(index >> 3) & 3];
+}
+
+// chirp, full scale noise, clipping square wave, alternating impulses and low level noise;
+// the second channel is inverted or scaled in some segments to exercise joint stereo
+static int generate_pcm(const test_config_t * config){
+    int num_channels = config->channel_mode == SBC_CHANNEL_MODE_MONO ? 1 : 2;
+    int num_frames = config->sample_rate * TEST_DURATION_MS / 1000;
+    int segment = num_frames / 5;
+    uint32_t noise = 0x5eed + config->subbands * 1000 + config->blocks * 10 + config->channel_mode;
+    double phase = 0;
+    int i, c;
+    for (i=0;i<num_frames;i++){
+        int16_t left;
+        int16_t right;
+        noise = noise * 1664525u + 1013904223u;
+        switch (i / segment){
+            case 0:
+                phase += 2 * M_PI * (20.0 + (config->sample_rate / 2) * i / segment) / config->sample_rate;
+                left  = (int16_t) (32000.0 * sin(phase));
+                right = (int16_t) (24000.0 * cos(phase * 0.5));
+                break;
+            case 1:
+                left  = (int16_t) (noise >> 16);
+                right = (int16_t) (noise >> 8);
+                break;
+            case 2:
+                left  = ((i / 37) & 1) ? 32767 : -32768;
+                right = -left - 1;
+                break;
+            case 3:
+                left  = (i % 13) == 0 ? ((i & 1) ? 32767 : -32768) : 0;
+                right = (i % 7)  == 0 ? -32768 : left;
+                break;
+            default:
+                left  = (int16_t) ((int32_t)(noise >> 16) >> 12);
+                right = left;
+                break;
+        }
+        for (c=0;c<num_channels;c++){
+            pcm_in[i * num_channels + c] = c ? right : left;
+        }
+    }
+    return num_frames;
+}
+
+static void run_config(const test_config_t * config, test_vector_t * result){
+    int num_frames = generate_pcm(config);
+    int num_channels = config->channel_mode == SBC_CHANNEL_MODE_MONO ? 1 : 2;
+
+    btstack_sbc_encoder_init(&encoder_state, config->mode, config->blocks, config->subbands,
+        config->allocation_method, config->sample_rate, config->bitpool, config->channel_mode);
+    // decoder reset does not clear the synthesis history, start each configuration from a clean state
+    memset(decoder_data, 0, sizeof(decoder_data));
+    memset(&decoder_context, 0, sizeof(decoder_context));
+    if (config->mode == SBC_MODE_mSBC){
+        OI_CODEC_mSBC_DecoderReset(&decoder_context, decoder_data, sizeof(decoder_data));
+    } else {
+        OI_CODEC_SBC_DecoderReset(&decoder_context, decoder_data, sizeof(decoder_data), 2, 2, FALSE);
+    }
+
+    result->sbc_checksum = 2166136261u;
+    result->pcm_checksum = 2166136261u;
+    int samples_per_frame = btstack_sbc_encoder_num_audio_samples(&encoder_state) / num_channels;
+    int pos;
+    for (pos = 0; pos + samples_per_frame <= num_frames; pos += samples_per_frame){
+        uint16_t len = btstack_sbc_encoder_process_data(&encoder_state, &pcm_in[pos * num_channels], sbc_frame);
+        result->sbc_checksum = checksum_update(result->sbc_checksum, sbc_frame, len);
+
+        const OI_BYTE * frame_data = sbc_frame;
+        OI_UINT32 frame_bytes = len;
+        OI_UINT32 pcm_bytes = sizeof(pcm_out);
+        OI_STATUS status = OI_CODEC_SBC_DecodeFrame(&decoder_context, &frame_data, &frame_bytes, pcm_out, &pcm_bytes);
+        if (status != OI_STATUS_SUCCESS){
+            printf("decode error %d\n", status);
+            result->pcm_checksum = 0;
+            return;
+        }
+        result->pcm_checksum = checksum_update(result->pcm_checksum, (const uint8_t *) pcm_out, pcm_bytes);
+    }
+}
+
+static int run_all(btstack_sbc_simd_t simd, int generate){
+    int errors = 0;
+    int i;
+    for (i=0;i<NUM_CONFIGS;i++){
+        test_config_t config;
+        test_vector_t result;
+        config_for_index(i, &config);
+        run_config(&config, &result);
+        if (generate){
+            printf("    { 0x%08x, 0x%08x },\n", result.sbc_checksum, result.pcm_checksum);
+            continue;
+        }
+        if (result.sbc_checksum == test_vectors[i].sbc_checksum && result.pcm_checksum == test_vectors[i].pcm_checksum) continue;
+        printf("%s: config %2u (%s, %u subbands, %2u blocks, channel mode %u, allocation %u, %u hz, bitpool %u) %s%s mismatch\n",
+            simd_names[simd], i, config.mode == SBC_MODE_mSBC ? "mSBC" : "SBC", config.subbands, config.blocks, config.channel_mode,
+            config.allocation_method, config.sample_rate, config.bitpool,
+            result.sbc_checksum == test_vectors[i].sbc_checksum ? "" : "encoder ",
+            result.pcm_checksum == test_vectors[i].pcm_checksum ? "" : "decoder ");
+        errors++;
+    }
+    return errors;
+}
+
+int main (int argc, const char * argv[]){
+    if (argc > 1 && strcmp(argv[1], "--generate") == 0){
+        btstack_sbc_set_simd(SBC_SIMD_NONE);
+        run_all(SBC_SIMD_NONE, 1);
+        return 0;
+    }
+
+    int errors = 0;
+    int simd;
+    for (simd = SBC_SIMD_NONE; simd <= SBC_SIMD_NEON; simd++){
+        if (btstack_sbc_set_simd((btstack_sbc_simd_t) simd) != 0){
+            printf("%-4s: not supported\n", simd_names[simd]);
+            continue;
+        }
+        int simd_errors = run_all((btstack_sbc_simd_t) simd, 0);
+        printf("%-4s: %s\n", simd_names[simd], simd_errors ? "FAILED" : "OK");
+        errors += simd_errors;
+    }
+    return errors ? 1 : 0;
+}
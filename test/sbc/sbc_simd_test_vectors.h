@@ -0,0 +1,67 @@
+// SBC stream and decoded PCM checksums for the configurations in sbc_simd_test.c
+// generated with the portable C code: ./sbc_simd_test --generate
+    { 0x09d16380, 0x384e2e4d },
+    { 0xfb2670b3, 0xada58e0d },
+    { 0x46b2b48d, 0xc0b7a8b9 },
+    { 0xf09b6930, 0xe3b67611 },
+    { 0xeed759bc, 0x1e840e2d },
+    { 0x74dfe1a7, 0x4ff73e4c },
+    { 0x5036919e, 0x7ea588be },
+    { 0x2abdeeb3, 0xf348722e },
+    { 0x1b065e6a, 0x5343882d },
+    { 0x5b76022f, 0xa30b9d85 },
+    { 0xb1d0bdb7, 0xa38106d3 },
+    { 0x3c9e5e2a, 0x4a7b40bc },
+    { 0x277cc064, 0xc995ab49 },
+    { 0x02e0923a, 0x990996b7 },
+    { 0xd75afeae, 0x8dd91b40 },
+    { 0x367c3767, 0xc2afe462 },
+    { 0x46c5b240, 0x649ecda5 },
+    { 0xda928b48, 0xf78a3325 },
+    { 0xac81bb92, 0x2d32baa1 },
+    { 0xf28fa06d, 0x6613e1bd },
+    { 0xa603c53f, 0x90b1eea0 },
+    { 0x2e692283, 0x5fa65f10 },
+    { 0x37df5924, 0xcd095ee1 },
+    { 0x7bc2d374, 0x5d947646 },
+    { 0x5516f122, 0x5877dd89 },
+    { 0xca8e007d, 0xb6d295f7 },
+    { 0x7c098eb9, 0x2c9127cb },
+    { 0x1091d57a, 0x5993ce42 },
+    { 0x6cc4d446, 0x2bd14a35 },
+    { 0xc35fc43c, 0x879a40c9 },
+    { 0x76a336e4, 0xf19ff367 },
+    { 0x1b32de4c, 0x79dd4c0f },
+    { 0xb2e7d063, 0x833c0801 },
+    { 0x234e72b6, 0x4d336449 },
+    { 0x66e1c0ae, 0xa8cea5a5 },
+    { 0x2a0436a1, 0xcb52830d },
+    { 0x657bef30, 0x3acfd6e0 },
+    { 0x7e3d75e2, 0x591ccea9 },
+    { 0x036e5f6c, 0x4fe9ee24 },
+    { 0x1c32bff9, 0x5edb70a0 },
+    { 0x03175e82, 0x63b35d7b },
+    { 0x2a5c8724, 0xb9f1744f },
+    { 0x32ff3d46, 0x40682a28 },
+    { 0x7ad35b4a, 0xe50be518 },
+    { 0xc121a971, 0xf9351e62 },
+    { 0x43accfb2, 0x1993b8e8 },
+    { 0xc06265cc, 0xd542dfbd },
+    { 0x4410c874, 0xc0e6f54d },
+    { 0x8dee5f12, 0x920dd1c1 },
+    { 0xb429d25d, 0xbf7aecfd },
+    { 0xa1748586, 0xe25e07c1 },
+    { 0xa3cbd6cf, 0x8c021e79 },
+    { 0xdad353a1, 0x1c21706e },
+    { 0x64bed82a, 0x24a5c3d0 },
+    { 0x951c15cd, 0x746fc89f },
+    { 0xfa537b3b, 0xa0ccb448 },
+    { 0xb818e6f2, 0xe04bdd6c },
+    { 0xc168441c, 0x04db7233 },
+    { 0x2180285b, 0xc86ae196 },
+    { 0x632fc2f3, 0x22424742 },
+    { 0x18d874cd, 0x3cb0b017 },
+    { 0x2258439b, 0x90285a7a },
+    { 0xe523913b, 0x44c3fcbd },
+    { 0x44d64958, 0x4ed4e87f },
+    { 0x79213eda, 0x09ac4f26 },
@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2017 BlueKitchen GmbH
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 4. Any redistribution, use, or modification is done solely for
+ *    personal benefit and not for any commercial purpose or for
+ *    monetary gain.
+ *
+ * THIS SOFTWARE IS PROVIDED BY BLUEKITCHEN GMBH AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MATTHIAS
+ * RINGWALD OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Please inquire about commercial licensing options at
+ * contact@bluekitchen-gmbh.com
+ *
+ */
+
+// *****************************************************************************
+//
+// Security Manager with software AES-128 engine: AES-128 and AES-CMAC test vectors,
+// ah() test vector and resolved address cache hit, miss, eviction and stale entries
+//
+// *****************************************************************************
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_config.h"
+#include "btstack_event.h"
+#include "btstack_memory.h"
+#include "btstack_run_loop_posix.h"
+#include "btstack_util.h"
+#include "ble/le_device_db.h"
+#include "ble/sm.h"
+#include "hci.h"
+#include "rijndael.h"
+
+// see Makefile
+#ifndef SM_RESOLVED_ADDRESS_CACHE_SIZE
+#error "SM_RESOLVED_ADDRESS_CACHE_SIZE not set"
+#endif
+
+void mock_init(void);
+void mock_simulate_hci_state_working(void);
+
+static btstack_packet_callback_registration_t sm_event_callback_registration;
+
+static int num_aes128_calls;
+static int resolved_index;
+
+static uint8_t cmac_hash[16];
+static int     cmac_hash_received;
+static uint8_t cmac_message[64];
+
+static void app_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size){
+    UNUSED(channel);
+    UNUSED(size);
+    if (packet_type != HCI_EVENT_PACKET) return;
+    switch (hci_event_packet_get_type(packet)){
+        case SM_EVENT_IDENTITY_RESOLVING_SUCCEEDED:
+            // index is stored in a single byte
+            resolved_index = packet[18];
+            break;
+        case SM_EVENT_IDENTITY_RESOLVING_FAILED:
+            resolved_index = -1;
+            break;
+        default:
+            break;
+    }
+}
+
+static void aes128_encrypt(const sm_key_t key, const sm_key_t plaintext, sm_key_t ciphertext){
+    uint32_t rk[RKLENGTH(KEYBITS)];
+    int nrounds = rijndaelSetupEncrypt(rk, &key[0], KEYBITS);
+    rijndaelEncrypt(rk, nrounds, plaintext, ciphertext);
+}
+
+static void counting_aes128_engine(const sm_key_t key, const sm_key_t plaintext, sm_key_t ciphertext){
+    num_aes128_calls++;
+    aes128_encrypt(key, plaintext, ciphertext);
+}
+
+static int parse_hex(uint8_t * buffer, const char * hex_string){
+    int len = 0;
+    while (*hex_string){
+        if (*hex_string == ' '){
+            hex_string++;
+            continue;
+        }
+        int high_nibble = nibble_for_char(*hex_string++);
+        int low_nibble = nibble_for_char(*hex_string++);
+        *buffer++ = (high_nibble << 4) | low_nibble;
+        len++;
+    }
+    return len;
+}
+
+static void cmac_done(uint8_t * hash){
+    memcpy(cmac_hash, hash, 16);
+    cmac_hash_received = 1;
+}
+
+static uint8_t cmac_get_byte(uint16_t offset){
+    return cmac_message[offset];
+}
+
+static void check_cmac(const char * key_string, const char * message_string, const char * cmac_string){
+    sm_key_t key;
+    sm_key_t cmac;
+    parse_hex(key, key_string);
+    parse_hex(cmac, cmac_string);
+    int len = parse_hex(cmac_message, message_string);
+    cmac_hash_received = 0;
+    sm_cmac_general_start(key, len, &cmac_get_byte, &cmac_done);
+    // software engine calculates CMAC without HCI roundtrip
+    CHECK_TRUE(cmac_hash_received);
+    MEMCMP_EQUAL(cmac, cmac_hash, 16);
+}
+
+// resolvable private address: prand with 0b01 in msb || ah(irk, prand)
+static void create_resolvable_private_address(const sm_key_t irk, uint32_t prand, bd_addr_t address){
+    sm_key_t r_prime;
+    sm_key_t ah;
+    memset(r_prime, 0, 16);
+    big_endian_store_24(r_prime, 13, (prand & 0x3fffff) | 0x400000);
+    aes128_encrypt(irk, r_prime, ah);
+    memcpy(&address[0], &r_prime[13], 3);
+    memcpy(&address[3], &ah[13], 3);
+}
+
+static void create_irk(int device, sm_key_t irk){
+    int i;
+    for (i = 0; i < 16; i++){
+        irk[i] = (device << 4) | i;
+    }
+}
+
+// returns le device db index or -1, number of ah() calculations in num_aes128_calls
+static int resolve(bd_addr_t address){
+    num_aes128_calls = 0;
+    resolved_index = -2;
+    sm_address_resolution_lookup(BD_ADDR_TYPE_LE_RANDOM, address);
+    CHECK(resolved_index != -2);
+    return resolved_index;
+}
+
+TEST_GROUP(SecurityManagerSoftwareAES){
+    void setup(void){
+        static int first = 1;
+        if (first){
+            first = 0;
+            btstack_memory_init();
+            btstack_run_loop_init(btstack_run_loop_posix_get_instance());
+        }
+        sm_init();
+        sm_event_callback_registration.callback = &app_packet_handler;
+        sm_add_event_handler(&sm_event_callback_registration);
+        mock_init();
+        mock_simulate_hci_state_working();
+        le_device_db_init();
+        sm_set_aes128_engine(&counting_aes128_engine);
+    }
+};
+
+// FIPS-197, Appendix C.1
+TEST(SecurityManagerSoftwareAES, AES128){
+    sm_key_t key;
+    sm_key_t plaintext;
+    sm_key_t expected;
+    sm_key_t ciphertext;
+    parse_hex(key,       "00010203 04050607 08090a0b 0c0d0e0f");
+    parse_hex(plaintext, "00112233 44556677 8899aabb ccddeeff");
+    parse_hex(expected,  "69c4e0d8 6a7b0430 d8cdb780 70b4c55a");
+    aes128_encrypt(key, plaintext, ciphertext);
+    MEMCMP_EQUAL(expected, ciphertext, 16);
+}
+
+// Core V4.2, Vol 3, Part H, Appendix D.1 (RFC 4493)
+TEST(SecurityManagerSoftwareAES, CMAC){
+    const char * key = "2b7e1516 28aed2a6 abf71588 09cf4f3c";
+    check_cmac(key, "", "bb1d6929 e9593728 7fa37d12 9b756746");
+    check_cmac(key, "6bc1bee2 2e409f96 e93d7e11 7393172a", "070a16b4 6b4d4144 f79bdd9d d04a287c");
+    check_cmac(key, "6bc1bee2 2e409f96 e93d7e11 7393172a ae2d8a57 1e03ac9c 9eb76fac 45af8e51 30c81c46 a35ce411",
+               "dfa66747 de9ae630 30ca3261 1497c827");
+    check_cmac(key, "6bc1bee2 2e409f96 e93d7e11 7393172a ae2d8a57 1e03ac9c 9eb76fac 45af8e51 30c81c46 a35ce411 "
+                    "e5fbc119 1a0a52ef f69f2445 df4f9b17 ad2b417b e66c3710",
+               "51f0bebf 7e3b9d92 fc497417 79363cfe");
+}
+
+// Core V4.2, Vol 3, Part H, Appendix D.7: ah(IRK, prand = 0x708194) = 0x0dfbaa
+TEST(SecurityManagerSoftwareAES, ResolvePrivateAddress){
+    sm_key_t irk;
+    bd_addr_t public_address = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+    bd_addr_t address = { 0x70, 0x81, 0x94, 0x0d, 0xfb, 0xaa };
+    parse_hex(irk, "ec0234a3 57c8ad05 341010a6 0a397d9b");
+    sm_key_t other_irk;
+    create_irk(1, other_irk);
+    le_device_db_add(BD_ADDR_TYPE_LE_PUBLIC, public_address, other_irk);
+    int index = le_device_db_add(BD_ADDR_TYPE_LE_PUBLIC, public_address, irk);
+    CHECK_EQUAL(index, resolve(address));
+    CHECK_EQUAL(2, num_aes128_calls);
+
+    // wrong hash
+    address[5] ^= 1;
+    CHECK_EQUAL(-1, resolve(address));
+}
+
+TEST(SecurityManagerSoftwareAES, ResolvedAddressCache){
+    bd_addr_t public_address = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+    bd_addr_t addresses[MAX_NR_LE_DEVICE_DB_ENTRIES];
+    int device;
+    for (device = 0; device < MAX_NR_LE_DEVICE_DB_ENTRIES; device++){
+        sm_key_t irk;
+        create_irk(device, irk);
+        CHECK_EQUAL(device, le_device_db_add(BD_ADDR_TYPE_LE_PUBLIC, public_address, irk));
+        create_resolvable_private_address(irk, 0x123456 + device, addresses[device]);
+    }
+    int last = MAX_NR_LE_DEVICE_DB_ENTRIES - 1;
+
+    // miss: check all devices up to match
+    CHECK_EQUAL(last, resolve(addresses[last]));
+    CHECK_EQUAL(last + 1, num_aes128_calls);
+
+    // hit: verified by single ah()
+    CHECK_EQUAL(last, resolve(addresses[last]));
+    CHECK_EQUAL(1, num_aes128_calls);
+
+    // eviction: least recently used entry is dropped
+    for (device = last - 1; device >= last - SM_RESOLVED_ADDRESS_CACHE_SIZE; device--){
+        CHECK_EQUAL(device, resolve(addresses[device]));
+        CHECK_EQUAL(device + 1, num_aes128_calls);
+    }
+    CHECK_EQUAL(last, resolve(addresses[last]));
+    CHECK_EQUAL(last + 1, num_aes128_calls);
+    // most recently used entry is still cached
+    device = last - SM_RESOLVED_ADDRESS_CACHE_SIZE;
+    CHECK_EQUAL(device, resolve(addresses[device]));
+    CHECK_EQUAL(1, num_aes128_calls);
+
+    // stale: device replaced by another one with same index, cached entry fails, full lookup finds nothing
+    CHECK_EQUAL(last, resolve(addresses[last]));
+    le_device_db_remove(last);
+    sm_key_t irk;
+    create_irk(0x0f, irk);
+    CHECK_EQUAL(last, le_device_db_add(BD_ADDR_TYPE_LE_PUBLIC, public_address, irk));
+    CHECK_EQUAL(-1, resolve(addresses[last]));
+    CHECK_EQUAL(1 + MAX_NR_LE_DEVICE_DB_ENTRIES, num_aes128_calls);
+}
+
+int main (int argc, const char * argv[]){
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -0,0 +1,23 @@
+//
+// btstack_config.h for daemon socket connection tests
+//
+
+#ifndef __BTSTACK_CONFIG
+#define __BTSTACK_CONFIG
+
+// Port related features
+#define HAVE_MALLOC
+#define HAVE_POSIX_TIME
+
+// BTstack features that can be enabled
+#define ENABLE_CLASSIC
+#define ENABLE_LOG_ERROR
+
+// BTstack configuration. buffers, sizes, ...
+#define HCI_ACL_PAYLOAD_SIZE 1021
+
+// Daemon configuration
+#define ENABLE_DAEMON_SHARED_MEMORY
+#define BTSTACK_UNIX "/tmp/BTstack_socket_connection_test"
+
+#endif
@@ -0,0 +1,455 @@
+/*
+ *  socket_connection_test.c
+ *
+ *  BTdaemon socket connection with daemon and clients in one process: slow client gets disconnected
+ *  instead of losing packets, client and daemon flooding each other do not deadlock, over socket and
+ *  shared memory. Daemon rejects shared memory that can shrink and disconnects on corrupt stream.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "CppUTest/TestHarness.h"
+#include "CppUTest/CommandLineTestRunner.h"
+
+#include "btstack_config.h"
+#include "btstack_defines.h"
+#include "btstack_linked_list.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+#include "btstack_client.h"
+#include "socket_connection.h"
+
+#define TEST_PACKET 0x07
+#define MAX_DAEMON_CONNECTIONS 2
+#define NUM_ECHO_PACKETS 20000
+#define MAX_STEPS 1000000
+
+// shared memory request and layout as used by socket_connection.c with default ring size
+#define SHARED_MEMORY_REQUEST       0xff00
+#define SHARED_MEMORY_RESPONSE      0xff01
+#define SHARED_MEMORY_RING_SIZE     65536
+#define SHARED_MEMORY_REGION_SIZE   (2 * 128 + 2 * SHARED_MEMORY_RING_SIZE)
+#define SHARED_MEMORY_TAIL_OFFSET   64
+#define SHARED_MEMORY_DATA_OFFSET   256
+
+// run loop that lets the test process single iterations
+static btstack_linked_list_t data_sources;
+static int data_sources_modified;
+
+static void test_run_loop_init(void){
+    data_sources = NULL;
+}
+
+static void test_run_loop_add_data_source(btstack_data_source_t * ds){
+    data_sources_modified = 1;
+    btstack_linked_list_add(&data_sources, (btstack_linked_item_t *) ds);
+}
+
+static int test_run_loop_remove_data_source(btstack_data_source_t * ds){
+    data_sources_modified = 1;
+    return btstack_linked_list_remove(&data_sources, (btstack_linked_item_t *) ds);
+}
+
+static void test_run_loop_enable_data_source_callbacks(btstack_data_source_t * ds, uint16_t callbacks){
+    ds->flags |= callbacks;
+}
+
+static void test_run_loop_disable_data_source_callbacks(btstack_data_source_t * ds, uint16_t callbacks){
+    ds->flags &= ~callbacks;
+}
+
+static uint32_t test_run_loop_get_time_ms(void){
+    return 0;
+}
+
+static const btstack_run_loop_t test_run_loop = {
+    &test_run_loop_init,
+    &test_run_loop_add_data_source,
+    &test_run_loop_remove_data_source,
+    &test_run_loop_enable_data_source_callbacks,
+    &test_run_loop_disable_data_source_callbacks,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    &test_run_loop_get_time_ms,
+};
+
+static void run_loop_step(void){
+    fd_set descriptors_read;
+    fd_set descriptors_write;
+    FD_ZERO(&descriptors_read);
+    FD_ZERO(&descriptors_write);
+    int highest_fd = -1;
+    btstack_linked_list_iterator_t it;
+    btstack_linked_list_iterator_init(&it, &data_sources);
+    while (btstack_linked_list_iterator_has_next(&it)){
+        btstack_data_source_t * ds = (btstack_data_source_t *) btstack_linked_list_iterator_next(&it);
+        if (ds->flags & DATA_SOURCE_CALLBACK_READ)  FD_SET(ds->fd, &descriptors_read);
+        if (ds->flags & DATA_SOURCE_CALLBACK_WRITE) FD_SET(ds->fd, &descriptors_write);
+        if (ds->fd > highest_fd) highest_fd = ds->fd;
+    }
+    struct timeval tv = { 0, 0 };
+    select(highest_fd + 1, &descriptors_read, &descriptors_write, NULL, &tv);
+    data_sources_modified = 0;
+    btstack_linked_list_iterator_init(&it, &data_sources);
+    while (btstack_linked_list_iterator_has_next(&it) && !data_sources_modified){
+        btstack_data_source_t * ds = (btstack_data_source_t *) btstack_linked_list_iterator_next(&it);
+        if (FD_ISSET(ds->fd, &descriptors_read)){
+            ds->process(ds, DATA_SOURCE_CALLBACK_READ);
+        }
+        if (data_sources_modified) break;
+        if (FD_ISSET(ds->fd, &descriptors_write)){
+            ds->process(ds, DATA_SOURCE_CALLBACK_WRITE);
+        }
+    }
+}
+
+// client connection using socket_connection, always reads
+static connection_t * client_conn;
+static uint32_t client_rx;
+static int client_errors;
+
+// daemon side connections in order of accept
+static connection_t * daemon_conns[MAX_DAEMON_CONNECTIONS];
+static int daemon_congested[MAX_DAEMON_CONNECTIONS];
+static int daemon_closed[MAX_DAEMON_CONNECTIONS];
+static int num_daemon_conns;
+static int num_daemon_closed;
+
+// daemon echoes packets, refuses every 100th packet once to park connection
+static int daemon_echo;
+static uint32_t daemon_rx;
+static uint32_t daemon_refused;
+static int daemon_errors;
+static int num_parked;
+
+static uint8_t payload[600];
+
+static int daemon_index(connection_t * connection){
+    int i;
+    for (i = 0; i < num_daemon_conns; i++){
+        if (daemon_conns[i] == connection) return i;
+    }
+    return -1;
+}
+
+static int packet_handler(connection_t * connection, uint16_t packet_type, uint16_t channel, uint8_t * data, uint16_t length){
+    if (packet_type == DAEMON_EVENT_PACKET){
+        switch (data[0]){
+            case DAEMON_EVENT_CONNECTION_OPENED:
+                if (num_daemon_conns < MAX_DAEMON_CONNECTIONS){
+                    daemon_conns[num_daemon_conns++] = connection;
+                }
+                break;
+            case DAEMON_EVENT_CONNECTION_CLOSED:
+                if (connection == client_conn){
+                    client_conn = NULL;
+                    break;
+                }
+                if (daemon_index(connection) >= 0){
+                    daemon_closed[daemon_index(connection)] = 1;
+                    num_daemon_closed++;
+                }
+                break;
+            default:
+                break;
+        }
+        return 0;
+    }
+    if (packet_type != TEST_PACKET) return 0;
+    uint32_t seq = little_endian_read_32(data, 0);
+    if (connection == client_conn){
+        if (seq != client_rx || data[length - 1] != (uint8_t) seq) client_errors++;
+        client_rx++;
+        return 0;
+    }
+    if (!daemon_echo) return 0;
+    if ((seq % 100) == 99 && daemon_refused != seq + 1){
+        daemon_refused = seq + 1;
+        num_parked++;
+        return 1;
+    }
+    if (seq != daemon_rx) daemon_errors++;
+    daemon_rx++;
+    socket_connection_send_packet(connection, packet_type, channel, data, length);
+    return 0;
+}
+
+static void flow_control_handler(connection_t * connection, int congested){
+    int index = daemon_index(connection);
+    if (index >= 0 && congested){
+        daemon_congested[index] = 1;
+    }
+}
+
+static int connect_raw_client(void){
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un server;
+    memset(&server, 0, sizeof(server));
+    server.sun_family = AF_UNIX;
+    strcpy(server.sun_path, BTSTACK_UNIX);
+    if (connect(fd, (struct sockaddr *) &server, sizeof(server)) < 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void shrink_socket_buffers(btstack_data_source_t * ds){
+    int size = 4096;
+    setsockopt(ds->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(ds->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+// sends shared memory request with memfd and doorbells, returns status of response
+static int request_shared_memory(int fd, int memfd, int doorbell_daemon_fd, int doorbell_client_fd){
+    uint8_t packet[6 + 4];
+    little_endian_store_16(packet, 0, SHARED_MEMORY_REQUEST);
+    little_endian_store_16(packet, 2, 0);
+    little_endian_store_16(packet, 4, 4);
+    little_endian_store_32(packet, 6, SHARED_MEMORY_RING_SIZE);
+    int fds[3] = { memfd, doorbell_daemon_fd, doorbell_client_fd };
+    union {
+        struct cmsghdr header;
+        uint8_t data[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct iovec iov;
+    iov.iov_base = packet;
+    iov.iov_len  = sizeof(packet);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data;
+    msg.msg_controllen = sizeof(control.data);
+    struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, 0) != (int) sizeof(packet)) return -1;
+
+    uint8_t response[6 + 1];
+    int steps;
+    for (steps = 0; steps < 1000; steps++){
+        run_loop_step();
+        if (recv(fd, response, sizeof(response), MSG_DONTWAIT | MSG_PEEK) == (int) sizeof(response)) break;
+    }
+    if (recv(fd, response, sizeof(response), MSG_DONTWAIT) != (int) sizeof(response)) return -1;
+    if (little_endian_read_16(response, 0) != SHARED_MEMORY_RESPONSE) return -1;
+    return response[6];
+}
+
+static int create_memfd(uint32_t size, int seals){
+    int memfd = memfd_create("socket_connection_test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) return -1;
+    if (ftruncate(memfd, size) < 0 || (seals && fcntl(memfd, F_ADD_SEALS, seals) < 0)){
+        close(memfd);
+        return -1;
+    }
+    return memfd;
+}
+
+static void wait_for_daemon_connections(int num_connections){
+    int steps;
+    for (steps = 0; steps < 1000 && num_daemon_conns < num_connections; steps++){
+        run_loop_step();
+    }
+    CHECK_EQUAL(num_connections, num_daemon_conns);
+}
+
+static void client_send(uint32_t seq){
+    uint16_t len = 5 + (seq % 500);
+    little_endian_store_32(payload, 0, seq);
+    payload[len - 1] = (uint8_t) seq;
+    socket_connection_send_packet(client_conn, TEST_PACKET, 0x40, payload, len);
+}
+
+TEST_GROUP(SocketConnection){
+    btstack_data_source_t * listening_ds;
+    int raw_fd;
+    int memfd;
+    int doorbell_daemon_fd;
+    int doorbell_client_fd;
+
+    void setup(void){
+        raw_fd = -1;
+        memfd = -1;
+        doorbell_daemon_fd = -1;
+        doorbell_client_fd = -1;
+        client_conn = NULL;
+        client_rx = 0;
+        client_errors = 0;
+        memset(daemon_conns, 0, sizeof(daemon_conns));
+        memset(daemon_congested, 0, sizeof(daemon_congested));
+        memset(daemon_closed, 0, sizeof(daemon_closed));
+        num_daemon_conns = 0;
+        num_daemon_closed = 0;
+        daemon_echo = 0;
+        daemon_rx = 0;
+        daemon_refused = 0;
+        daemon_errors = 0;
+        num_parked = 0;
+        socket_connection_register_packet_callback(&packet_handler);
+        socket_connection_register_flow_control_callback(&flow_control_handler);
+        CHECK_EQUAL(0, socket_connection_create_unix((char *) BTSTACK_UNIX));
+        listening_ds = (btstack_data_source_t *) data_sources;
+    }
+
+    void teardown(void){
+        if (client_conn){
+            socket_connection_close_unix(client_conn);
+            client_conn = NULL;
+        }
+        int fds[4] = { raw_fd, memfd, doorbell_daemon_fd, doorbell_client_fd };
+        int i;
+        for (i = 0; i < 4; i++){
+            if (fds[i] >= 0) close(fds[i]);
+        }
+        int steps;
+        for (steps = 0; steps < 1000 && num_daemon_closed < num_daemon_conns; steps++){
+            run_loop_step();
+        }
+        CHECK_EQUAL(num_daemon_conns, num_daemon_closed);
+        // listening socket is not closed by socket_connection, connections stuck after a failure are leaked
+        data_sources = NULL;
+        close(listening_ds->fd);
+        free(listening_ds);
+        unlink(BTSTACK_UNIX);
+    }
+};
+
+TEST(SocketConnection, SlowClientGetsDisconnected){
+    // slow client never reads
+    raw_fd = connect_raw_client();
+    CHECK(raw_fd >= 0);
+    wait_for_daemon_connections(1);
+    client_conn = socket_connection_open_unix();
+    CHECK(client_conn != NULL);
+    wait_for_daemon_connections(2);
+
+    // fan out events, client using socket_connection keeps up
+    uint32_t seq;
+    for (seq = 0; seq < 20000 && !daemon_closed[0]; seq++){
+        uint16_t len = 200;
+        little_endian_store_32(payload, 0, seq);
+        payload[len - 1] = (uint8_t) seq;
+        socket_connection_send_packet_all(TEST_PACKET, 0, payload, len);
+        int i;
+        for (i = 0; i < 4; i++){
+            run_loop_step();
+        }
+    }
+    CHECK_EQUAL(1, daemon_congested[0]);
+    CHECK_EQUAL(1, daemon_closed[0]);
+    CHECK_EQUAL(0, daemon_closed[1]);
+
+    int steps;
+    for (steps = 0; steps < 1000 && client_rx < seq; steps++){
+        run_loop_step();
+    }
+    CHECK_EQUAL(seq, client_rx);
+    CHECK_EQUAL(0, client_errors);
+}
+
+static void flood_with_echo(void){
+    // small socket buffers let both queues reach the high watermark, connection starts with its data source
+    shrink_socket_buffers((btstack_data_source_t *) client_conn);
+    shrink_socket_buffers((btstack_data_source_t *) daemon_conns[0]);
+
+    // client sends while not congested, daemon echoes and gets parked on refused packets
+    uint32_t client_tx = 0;
+    int steps;
+    for (steps = 0; steps < MAX_STEPS && client_conn && client_rx < NUM_ECHO_PACKETS; steps++){
+        while (client_tx < NUM_ECHO_PACKETS && !socket_connection_is_congested(client_conn)){
+            client_send(client_tx++);
+        }
+        run_loop_step();
+        socket_connection_retry_parked();
+    }
+    CHECK_EQUAL(NUM_ECHO_PACKETS, client_rx);
+    CHECK_EQUAL(NUM_ECHO_PACKETS, daemon_rx);
+    CHECK_EQUAL(0, client_errors);
+    CHECK_EQUAL(0, daemon_errors);
+    CHECK_EQUAL(NUM_ECHO_PACKETS / 100, num_parked);
+    CHECK_EQUAL(0, num_daemon_closed);
+}
+
+TEST(SocketConnection, FloodWithEcho){
+    daemon_echo = 1;
+    client_conn = socket_connection_open_unix();
+    CHECK(client_conn != NULL);
+    wait_for_daemon_connections(1);
+    flood_with_echo();
+}
+
+TEST(SocketConnection, FloodWithEchoSharedMemory){
+    daemon_echo = 1;
+    client_conn = socket_connection_open_unix();
+    CHECK(client_conn != NULL);
+    CHECK_EQUAL(0, socket_connection_enable_shared_memory(client_conn));
+    wait_for_daemon_connections(1);
+    flood_with_echo();
+}
+
+TEST(SocketConnection, UnsealedMemoryRejected){
+    raw_fd = connect_raw_client();
+    wait_for_daemon_connections(1);
+    memfd = create_memfd(SHARED_MEMORY_REGION_SIZE, 0);
+    doorbell_daemon_fd = eventfd(0, EFD_NONBLOCK);
+    doorbell_client_fd = eventfd(0, EFD_NONBLOCK);
+    CHECK_EQUAL(1, request_shared_memory(raw_fd, memfd, doorbell_daemon_fd, doorbell_client_fd));
+}
+
+TEST(SocketConnection, ShortMemoryRejected){
+    raw_fd = connect_raw_client();
+    wait_for_daemon_connections(1);
+    memfd = create_memfd(4096, F_SEAL_SHRINK | F_SEAL_GROW);
+    doorbell_daemon_fd = eventfd(0, EFD_NONBLOCK);
+    doorbell_client_fd = eventfd(0, EFD_NONBLOCK);
+    CHECK_EQUAL(1, request_shared_memory(raw_fd, memfd, doorbell_daemon_fd, doorbell_client_fd));
+}
+
+TEST(SocketConnection, OversizePacketInSharedMemoryDisconnects){
+    raw_fd = connect_raw_client();
+    wait_for_daemon_connections(1);
+    memfd = create_memfd(SHARED_MEMORY_REGION_SIZE, F_SEAL_SHRINK | F_SEAL_GROW);
+    doorbell_daemon_fd = eventfd(0, EFD_NONBLOCK);
+    doorbell_client_fd = eventfd(0, EFD_NONBLOCK);
+    CHECK_EQUAL(0, request_shared_memory(raw_fd, memfd, doorbell_daemon_fd, doorbell_client_fd));
+
+    // header announcing more than fits into the connection buffer, then ring doorbell of daemon
+    uint8_t * region = (uint8_t *) mmap(NULL, SHARED_MEMORY_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    CHECK(region != MAP_FAILED);
+    little_endian_store_16(region, SHARED_MEMORY_DATA_OFFSET + 0, TEST_PACKET);
+    little_endian_store_16(region, SHARED_MEMORY_DATA_OFFSET + 2, 0);
+    little_endian_store_16(region, SHARED_MEMORY_DATA_OFFSET + 4, 0xffff);
+    __sync_synchronize();
+    little_endian_store_32(region, SHARED_MEMORY_TAIL_OFFSET, 6);
+    uint64_t value = 1;
+    CHECK_EQUAL((int) sizeof(value), write(doorbell_daemon_fd, &value, sizeof(value)));
+
+    int steps;
+    for (steps = 0; steps < 1000 && !daemon_closed[0]; steps++){
+        run_loop_step();
+    }
+    CHECK_EQUAL(1, daemon_closed[0]);
+    munmap(region, SHARED_MEMORY_REGION_SIZE);
+}
+
+int main (int argc, const char * argv[]){
+    btstack_run_loop_init(&test_run_loop);
+    socket_connection_init();
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
@@ -172,7 +172,7 @@ def replacePlaceholder(template, struct_name):
     return snippet
     
 list_of_structs = [
-    ["hci_connection"],
+    ["hci_connection", "hci_acl_reassembly_buffer"],
     ["l2cap_service", "l2cap_channel"],
     ["rfcomm_multiplexer", "rfcomm_service", "rfcomm_channel"],
     ["btstack_link_key_db_memory_entry"],